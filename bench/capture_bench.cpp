@@ -0,0 +1,195 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+// Replay benchmark for the capture engines. Packets from a pcap file are injected into the interface
+// as fast as possible while isa-top captures them, once through libpcap and once through the TPACKET_V3 ring.
+// With -f every engine runs again with the filter, the CPU time of the capture thread shows what
+// kernel-side filtering saves at the drop ratio of that filter.
+// Requires root. Usage: capture_bench -i <interface> -r <file.pcap> [-n <loops>] [-f <filter>]
+
+#include "../src/packet.hpp"
+#include "../src/connectionsTable.hpp"
+
+#include <pcap.h>
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Captured frame kept in memory so file reading is not part of the measurement
+struct ReplayPacket
+{
+    std::vector<unsigned char> m_data;
+};
+
+// Load every packet of the capture file
+static bool loadPackets(const std::string &path, std::vector<ReplayPacket> &packets)
+{
+    char errorBuffer[PCAP_ERRBUF_SIZE];
+    pcap_t *file = pcap_open_offline(path.c_str(), errorBuffer);
+    if (file == nullptr)
+    {
+        std::cerr << "Couldn't open " << path << ": " << errorBuffer << std::endl;
+        return false;
+    }
+    struct pcap_pkthdr *header;
+    const unsigned char *data;
+    while (pcap_next_ex(file, &header, &data) == 1)
+    {
+        packets.push_back({std::vector<unsigned char>(data, data + header->caplen)});
+    }
+    pcap_close(file);
+    return !packets.empty();
+}
+
+// Result of one run, unfiltered runs are the baseline for filtered ones
+struct RunResult
+{
+    uint64_t m_delivered = 0;
+    double m_cpuSeconds = 0;
+};
+
+// CPU time consumed by the calling thread
+static double threadCpuSeconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Run one capture engine while the packets are replayed and print its results
+static RunResult runBackend(const std::string &name, CaptureBackend backend, const std::string &interfaceName,
+                            const std::vector<ReplayPacket> &packets, unsigned int loops, const std::string &filter)
+{
+    RunResult result;
+    ConnectionsTable table;
+    PacketCapture capture(interfaceName, table);
+    capture.m_config.m_backend = backend;
+    capture.m_config.m_filter = filter;
+
+    double cpuSeconds = 0;
+    std::thread captureThread([&capture, &cpuSeconds]()
+                              { capture.startCapture(); cpuSeconds = threadCpuSeconds(); });
+    // Give the engine time to open the interface
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    uint64_t receivedBefore = 0, droppedBefore = 0;
+    capture.getStats(receivedBefore, droppedBefore);
+
+    char errorBuffer[PCAP_ERRBUF_SIZE];
+    pcap_t *injector = pcap_open_live(interfaceName.c_str(), 65535, 0, 1, errorBuffer);
+    if (injector == nullptr)
+    {
+        std::cerr << "Couldn't open " << interfaceName << " for injection: " << errorBuffer << std::endl;
+        capture.stopCapture();
+        captureThread.join();
+        return result;
+    }
+
+    uint64_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int loop = 0; loop < loops; loop++)
+    {
+        for (const ReplayPacket &packet : packets)
+        {
+            if (pcap_sendpacket(injector, packet.m_data.data(), packet.m_data.size()) == 0)
+            {
+                sent++;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    pcap_close(injector);
+
+    // Let the engine drain what is still queued
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t received = 0, dropped = 0;
+    capture.getStats(received, dropped);
+    received -= receivedBefore;
+    dropped -= droppedBefore;
+
+    capture.stopCapture();
+    captureThread.join();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double delivered = received > dropped ? static_cast<double>(received - dropped) : 0;
+    std::printf("%-14s sent %10lu  received %10lu  dropped %10lu  drop %6.2f%%  %12.0f pkt/s  %10lu table locks  %7.3f s CPU\n",
+                name.c_str(), sent, received, dropped,
+                received ? 100.0 * dropped / received : 0.0,
+                seconds > 0 ? delivered / seconds : 0.0,
+                table.m_lockAcquisitions.load(), cpuSeconds);
+
+    result.m_delivered = static_cast<uint64_t>(delivered);
+    result.m_cpuSeconds = cpuSeconds;
+    return result;
+}
+
+// Compare filtered run with the unfiltered baseline
+static void printFilterSavings(const std::string &name, const RunResult &baseline, const RunResult &filtered)
+{
+    if (baseline.m_delivered == 0 || baseline.m_cpuSeconds <= 0)
+    {
+        return;
+    }
+    double dropRatio = 1.0 - static_cast<double>(filtered.m_delivered) / baseline.m_delivered;
+    double cpuSaved = 1.0 - filtered.m_cpuSeconds / baseline.m_cpuSeconds;
+    std::printf("%-14s filter dropped %6.2f%% of packets in the kernel, capture CPU saved %6.2f%%\n",
+                name.c_str(), 100.0 * dropRatio, 100.0 * cpuSaved);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string interfaceName;
+    std::string path;
+    unsigned int loops = 10;
+    std::string filter;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc)
+            interfaceName = argv[++i];
+        else if (arg == "-r" && i + 1 < argc)
+            path = argv[++i];
+        else if (arg == "-n" && i + 1 < argc)
+            loops = std::stoul(argv[++i]);
+        else if (arg == "-f" && i + 1 < argc)
+            filter = argv[++i];
+        else
+        {
+            std::cerr << "Usage: capture_bench -i <interface> -r <file.pcap> [-n <loops>] [-f <filter>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (interfaceName.empty() || path.empty())
+    {
+        std::cerr << "Usage: capture_bench -i <interface> -r <file.pcap> [-n <loops>] [-f <filter>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ReplayPacket> packets;
+    if (!loadPackets(path, packets))
+    {
+        return EXIT_FAILURE;
+    }
+    std::printf("Replaying %zu packets x %u on %s\n", packets.size(), loops, interfaceName.c_str());
+
+    RunResult pcapResult = runBackend("pcap", CaptureBackend::PCAP, interfaceName, packets, loops, "");
+    RunResult ringResult = runBackend("ring", CaptureBackend::RING, interfaceName, packets, loops, "");
+
+    if (!filter.empty())
+    {
+        std::printf("Filter: %s\n", filter.c_str());
+        RunResult pcapFiltered = runBackend("pcap+filter", CaptureBackend::PCAP, interfaceName, packets, loops, filter);
+        RunResult ringFiltered = runBackend("ring+filter", CaptureBackend::RING, interfaceName, packets, loops, filter);
+        printFilterSavings("pcap", pcapResult, pcapFiltered);
+        printFilterSavings("ring", ringResult, ringFiltered);
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+// Microbenchmark of the flow key hash. The string based hash is the previous ConnectionIDHash
+// (two inet_ntop calls and an ostringstream per lookup), kept here only as the baseline.
+// Usage: hash_bench [--benchmark_filter=<regex>]
+
+#include "../src/connectionID.hpp"
+#include "../src/connectionsTable.hpp"
+
+#include <benchmark/benchmark.h>
+#include <arpa/inet.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Flows of one client talking to many servers, both IPv4 and IPv6
+static std::vector<ConnectionID> makeFlows(size_t count)
+{
+    std::vector<ConnectionID> flows;
+    flows.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % 4 == 3)
+        {
+            sockaddr_in6 src{};
+            sockaddr_in6 dest{};
+            src.sin6_family = AF_INET6;
+            dest.sin6_family = AF_INET6;
+            inet_pton(AF_INET6, "2001:db8::1", &src.sin6_addr);
+            inet_pton(AF_INET6, "2001:db8:1::", &dest.sin6_addr);
+            dest.sin6_addr.s6_addr[14] = static_cast<uint8_t>(i >> 8);
+            dest.sin6_addr.s6_addr[15] = static_cast<uint8_t>(i);
+            src.sin6_port = htons(static_cast<uint16_t>(30000 + i));
+            dest.sin6_port = htons(443);
+            flows.emplace_back(src, dest, Protocol::TCP);
+        }
+        else
+        {
+            in_addr src{};
+            in_addr dest{};
+            src.s_addr = htonl(0x0a000001);
+            dest.s_addr = htonl(static_cast<uint32_t>(0xc0a80000 + i));
+            flows.push_back(ConnectionID::storeIPv4InIPv6(src, static_cast<uint16_t>(30000 + i), dest, 53, Protocol::UDP));
+        }
+    }
+    return flows;
+}
+
+// Previous ConnectionIDHash
+struct StringConnectionIDHash
+{
+    std::size_t operator()(const ConnectionID &connection) const
+    {
+        std::string srcStr = ConnectionID::endpointToString(connection.getSrcEndPoint());
+        std::string destStr = ConnectionID::endpointToString(connection.getDestEndPoint());
+        std::ostringstream oss;
+        oss << srcStr << "-" << destStr << "-" << static_cast<int>(connection.getProtocol());
+        return std::hash<std::string>{}(oss.str());
+    }
+};
+
+// Hash throughput over a working set of flows
+template <typename Hash>
+static void BM_Hash(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(4096);
+    Hash hash;
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(hash(flows[i]));
+        i = (i + 1) & (flows.size() - 1);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_Hash, StringConnectionIDHash);
+BENCHMARK_TEMPLATE(BM_Hash, ConnectionIDHash);
+
+// Per-packet table update of existing flows, one hash per lookup
+static void BM_UpdateConnection(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)));
+    ConnectionsTable table;
+    for (const ConnectionID &flow : flows)
+    {
+        table.updateConnection(flow, true, 64);
+    }
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        table.updateConnection(flows[i], (i & 1) != 0, 1500);
+        i = i + 1 == flows.size() ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateConnection)->Arg(1024)->Arg(65536);
+
+BENCHMARK_MAIN();
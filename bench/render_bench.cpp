@@ -0,0 +1,125 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+// Screen output benchmark. The display writes to a file instead of the terminal (TERM=xterm-256color, 50x200),
+// a table of flows changes between ticks and every tick runs Display::update. Reports the bytes written to
+// the terminal by the first tick (full screen) and per tick after it, with the given number of flows changed
+// every tick and with none.
+// Usage: render_bench [-n <flows>] [-c <changed flows per tick>] [-t <ticks>]
+
+#include "../src/display.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Bytes written to the output file so far
+static off_t written(int fd)
+{
+    fflush(stdout);
+    struct stat status;
+    fstat(fd, &status);
+    return status.st_size;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t flowCount = 2000;
+    size_t changed = 100;
+    int ticks = 100;
+    int option;
+    while ((option = getopt(argc, argv, "n:c:t:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            flowCount = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'c':
+            changed = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            ticks = std::atoi(optarg);
+            break;
+        default:
+            std::fprintf(stderr, "Usage: render_bench [-n <flows>] [-c <changed flows per tick>] [-t <ticks>]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    std::vector<ConnectionID> flows;
+    for (size_t i = 0; i < flowCount; i++)
+    {
+        in_addr src{};
+        in_addr dest{};
+        src.s_addr = htonl(0x0a000001);
+        dest.s_addr = htonl(static_cast<uint32_t>(0xc0a80000 + i));
+        flows.push_back(ConnectionID::storeIPv4InIPv6(src, static_cast<uint16_t>(1024 + i % 60000), dest, 443, Protocol::TCP));
+    }
+    auto time = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    table.setSimulatedTime(time);
+    std::mt19937 random(1);
+    for (size_t i = 0; i < flowCount; i++)
+    {
+        table.updateConnection(flows[i], true, 64 + random() % 1400);
+    }
+
+    // The terminal is a file, its size is what the display wrote
+    char path[] = "/tmp/render_bench.XXXXXX";
+    int output = mkstemp(path);
+    int terminal = dup(STDOUT_FILENO);
+    dup2(output, STDOUT_FILENO);
+    setenv("TERM", "xterm-256color", 1);
+    setenv("LINES", "50", 1);
+    setenv("COLUMNS", "200", 1);
+    // The display ends ncurses when it is destroyed, before the terminal is given back
+    off_t firstTick = 0;
+    double busyTick = 0;
+    double idleTick = 0;
+    {
+        Display display(table, BY_RATE, 1000);
+        display.init();
+
+        off_t before = written(output);
+        display.update();
+        firstTick = written(output) - before;
+        for (int phase = 0; phase < 2; phase++)
+        {
+            before = written(output);
+            for (int tick = 0; tick < ticks; tick++)
+            {
+                time += std::chrono::seconds(1);
+                table.setSimulatedTime(time);
+                for (size_t i = 0; phase == 0 && i < changed; i++)
+                {
+                    table.updateConnection(flows[random() % flowCount], random() % 2, 64 + random() % 1400);
+                }
+                display.update();
+            }
+            (phase == 0 ? busyTick : idleTick) = static_cast<double>(written(output) - before) / ticks;
+            // Idle ticks start once the rates of the last busy tick dropped to zero
+            time += std::chrono::seconds(1);
+            table.setSimulatedTime(time);
+            display.update();
+        }
+    }
+    fflush(stdout);
+    dup2(terminal, STDOUT_FILENO);
+    unlink(path);
+
+    std::printf("flows: %zu, changed per tick: %zu, ticks: %d\n", flowCount, changed, ticks);
+    std::printf("first tick:          %lld bytes\n", static_cast<long long>(firstTick));
+    std::printf("tick with changes:   %.0f bytes\n", busyTick);
+    std::printf("tick without change: %.0f bytes\n", idleTick);
+    return 0;
+}
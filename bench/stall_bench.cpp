@@ -0,0 +1,115 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+// Capture stall benchmark. A capture thread applies batches of updates to existing flows as fast as
+// it can while the main thread does the display work every tick (calculateSpeed, then reading the
+// top of the published snapshot). Reports how long the capture thread waited for the table lock and the
+// latency distribution of applyBatch.
+// Usage: stall_bench [-n <flows>] [-t <seconds>] [-i <tick ms>]
+
+#include "../src/connectionsTable.hpp"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    size_t flowCount = 200000;
+    int seconds = 5;
+    int tickMs = 100;
+    int option;
+    while ((option = getopt(argc, argv, "n:t:i:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            flowCount = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            seconds = std::atoi(optarg);
+            break;
+        case 'i':
+            tickMs = std::atoi(optarg);
+            break;
+        default:
+            std::fprintf(stderr, "Usage: stall_bench [-n <flows>] [-t <seconds>] [-i <tick ms>]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Populate the table
+    ConnectionsTable table;
+    std::vector<ConnectionID> flows;
+    flows.reserve(flowCount);
+    for (size_t i = 0; i < flowCount; i++)
+    {
+        in_addr src{};
+        in_addr dest{};
+        src.s_addr = htonl(0x0a000001);
+        dest.s_addr = htonl(static_cast<uint32_t>(0xc0a80000 + i));
+        flows.push_back(ConnectionID::storeIPv4InIPv6(src, static_cast<uint16_t>(1024 + i % 60000), dest, 443, Protocol::TCP));
+        table.updateConnection(flows.back(), true, 64);
+    }
+
+    // Capture thread: batches of 64 updates, latency of every applyBatch is recorded
+    std::atomic<bool> running{true};
+    std::vector<double> latencies;
+    std::thread capture([&]()
+                        {
+        std::mt19937 random(1);
+        std::vector<FlowDelta> batch(64);
+        latencies.reserve(1 << 22);
+        while (running)
+        {
+            for (FlowDelta &delta : batch)
+            {
+                delta.m_ID = flows[random() % flows.size()];
+                delta.m_bytesReceived = 1500;
+                delta.m_packetsReceived = 1;
+            }
+            auto start = std::chrono::steady_clock::now();
+            table.applyBatch(batch);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        } });
+
+    // Display ticks
+    int ticks = seconds * 1000 / tickMs;
+    double tickWork = 0;
+    for (int i = 0; i < ticks; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(tickMs));
+        auto start = std::chrono::steady_clock::now();
+        table.calculateSpeed();
+        std::vector<Connection> connections = table.getSnapshot()->m_top[SortBy::BY_BYTES];
+        table.getTopConnections(10, connections);
+        tickWork += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    running = false;
+    capture.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    // Batches that took over 1 ms were blocked by the display
+    double blockedMs = 0;
+    for (double latency : latencies)
+    {
+        blockedMs += latency > 1000 ? latency / 1000 : 0;
+    }
+    double stallMs = table.m_captureStallNs.load() / 1e6;
+    std::printf("flows %zu  ticks %d  display work %.2f ms/tick\n", flowCount, ticks, tickWork / ticks);
+    std::printf("batches %zu  capture stall %.2f ms total, %.2f ms/s\n", latencies.size(), stallMs, stallMs / seconds);
+    std::printf("time in batches over 1 ms: %.2f ms/s\n", blockedMs / seconds);
+    std::printf("applyBatch latency us: p50 %.2f  p99 %.2f  p99.99 %.2f  max %.2f\n",
+                latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+                latencies[latencies.size() * 9999 / 10000], latencies.back());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,619 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+// Microbenchmarks of the connections table. bytes_per_flow is the heap memory (malloc accounting,
+// allocator overhead included) the table holds per tracked flow.
+// Usage: table_bench [--benchmark_filter=<regex>]
+
+#include "../src/connectionsTable.hpp"
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Bytes currently allocated from the heap
+static int64_t heapBytes()
+{
+    return static_cast<int64_t>(mallinfo2().uordblks);
+}
+
+// Distinct flows, IPv4 or IPv6 depending on ipv6
+static std::vector<ConnectionID> makeFlows(size_t count, bool ipv6)
+{
+    std::vector<ConnectionID> flows;
+    flows.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ipv6)
+        {
+            sockaddr_in6 src{};
+            sockaddr_in6 dest{};
+            src.sin6_family = AF_INET6;
+            dest.sin6_family = AF_INET6;
+            inet_pton(AF_INET6, "2001:db8::1", &src.sin6_addr);
+            inet_pton(AF_INET6, "2001:db8:1::", &dest.sin6_addr);
+            dest.sin6_addr.s6_addr[13] = static_cast<uint8_t>(i >> 16);
+            dest.sin6_addr.s6_addr[14] = static_cast<uint8_t>(i >> 8);
+            dest.sin6_addr.s6_addr[15] = static_cast<uint8_t>(i);
+            src.sin6_port = htons(static_cast<uint16_t>(1024 + i % 60000));
+            dest.sin6_port = htons(443);
+            flows.emplace_back(src, dest, Protocol::TCP);
+        }
+        else
+        {
+            in_addr src{};
+            in_addr dest{};
+            src.s_addr = htonl(0x0a000001);
+            dest.s_addr = htonl(static_cast<uint32_t>(0xc0a80000 + i));
+            flows.push_back(ConnectionID::storeIPv4InIPv6(src, static_cast<uint16_t>(1024 + i % 60000), dest, 443, Protocol::TCP));
+        }
+    }
+    return flows;
+}
+
+// Inserts state.range(0) new flows into an empty table, reports heap bytes per flow
+static void BM_InsertFlows(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<ConnectionID> flows = makeFlows(count, state.range(1) != 0);
+    int64_t bytesPerFlow = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto table = std::make_unique<ConnectionsTable>();
+        int64_t heapBefore = heapBytes();
+        state.ResumeTiming();
+        for (const ConnectionID &flow : flows)
+        {
+            table->updateConnection(flow, true, 64);
+        }
+        state.PauseTiming();
+        bytesPerFlow = (heapBytes() - heapBefore) / static_cast<int64_t>(count);
+        table.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.counters["bytes_per_flow"] = static_cast<double>(bytesPerFlow);
+    state.counters["key_bytes"] = state.range(1) != 0 ? sizeof(FlowKey<AF_INET6>) : sizeof(FlowKey<AF_INET>);
+}
+BENCHMARK(BM_InsertFlows)->ArgNames({"flows", "ipv6"})->Args({100000, 0})->Args({100000, 1})->Unit(benchmark::kMillisecond);
+
+// New flows into a full table (SYN flood, port scan): every insert evicts a flow, records are recycled
+static void BM_FlowChurn(benchmark::State &state)
+{
+    const size_t limit = static_cast<size_t>(state.range(0));
+    std::vector<ConnectionID> flows = makeFlows(limit * 4, false);
+    ConnectionsTable table;
+    ExpiryConfig config;
+    config.m_maxFlows = limit;
+    table.setExpiryConfig(config);
+    for (size_t i = 0; i < limit; i++)
+    {
+        table.updateConnection(flows[i], true, 64);
+    }
+    size_t i = limit;
+    for (auto _ : state)
+    {
+        table.updateConnection(flows[i], true, 64);
+        i = i + 1 == flows.size() ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlowChurn)->ArgName("limit")->Arg(100000);
+
+// Lookup of existing flows spread over a table larger than the caches
+static void BM_UpdateExistingFlows(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), state.range(1) != 0);
+    ConnectionsTable table;
+    for (const ConnectionID &flow : flows)
+    {
+        table.updateConnection(flow, true, 64);
+    }
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        table.updateConnection(flows[i], false, 1500);
+        // Stride through the flows so consecutive lookups touch different cache lines
+        i += 7919;
+        if (i >= flows.size())
+        {
+            i -= flows.size();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateExistingFlows)->ArgNames({"flows", "ipv6"})->Args({1000000, 0})->Args({1000000, 1});
+
+// Lookup of present keys in a flat FlowMap and in a node based std::unordered_map
+template <typename Map>
+static void BM_Find(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    Map map;
+    for (const ConnectionID &flow : flows)
+    {
+        map.insert({flow.toIPv4Key(), Connection()});
+    }
+    std::vector<FlowKey<AF_INET>> keys;
+    for (const ConnectionID &flow : flows)
+    {
+        keys.push_back(flow.toIPv4Key());
+    }
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(map.find(keys[i])->second.m_bytesSent);
+        i += 7919;
+        if (i >= keys.size())
+        {
+            i -= keys.size();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+// One display tick over state.range(0) flows of which state.range(1) changed: calculateSpeed and reading
+// the top 10 by bytes
+static void BM_DisplayTick(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (const ConnectionID &flow : flows)
+    {
+        table.updateConnection(flow, true, 64);
+    }
+    table.calculateSpeed();
+    const size_t changed = static_cast<size_t>(state.range(1));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t j = 0; j < changed; j++)
+        {
+            table.updateConnection(flows[i], false, 1500);
+            i += 7919;
+            if (i >= flows.size())
+            {
+                i -= flows.size();
+            }
+        }
+        state.ResumeTiming();
+        table.calculateSpeed();
+        std::vector<Connection> top = table.getSnapshot()->m_top[SortBy::BY_BYTES];
+        table.getTopConnections(10, top);
+        benchmark::DoNotOptimize(top.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DisplayTick)->ArgNames({"flows", "changed"})->Args({500000, 1000})->Args({500000, 50000})->Args({1000000, 100000})->Args({1000000, 1000000})->Unit(benchmark::kMillisecond);
+
+// One key press scrolling to a random rank of state.range(0) flows spread over state.range(1) shards (0 = one
+// table): the 44 flows of a 50 line screen read from the rankings
+static void BM_ScrollKeyPress(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    std::vector<ConnectionsTable *> tables{&table};
+    for (int64_t shard = 1; shard < state.range(1); shard++)
+    {
+        tables.push_back(&table.addShard());
+    }
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        tables[i % tables.size()]->updateConnection(flows[i], true, 64 + i % 1400);
+    }
+    table.calculateSpeed();
+    std::vector<Connection> window;
+    size_t first = 0;
+    for (auto _ : state)
+    {
+        first = (first + 104729) % flows.size();
+        table.getRange(SortBy::BY_BYTES, first, 44, window);
+        benchmark::DoNotOptimize(window.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ScrollKeyPress)->ArgNames({"flows", "shards"})->Args({1000000, 0})->Args({1000000, 4});
+
+// First scrolled frame after a tick in which state.range(1) of state.range(0) flows changed: the ranking
+// repairs its sorted order. The tick itself is not timed
+static void BM_ScrollAfterTick(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], true, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    std::vector<Connection> window;
+    table.getRange(SortBy::BY_BYTES, flows.size() / 2, 44, window);
+    const size_t changed = static_cast<size_t>(state.range(1));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t j = 0; j < changed; j++)
+        {
+            table.updateConnection(flows[i], false, 1500);
+            i += 7919;
+            if (i >= flows.size())
+            {
+                i -= flows.size();
+            }
+        }
+        table.calculateSpeed();
+        state.ResumeTiming();
+        table.getRange(SortBy::BY_BYTES, flows.size() / 2, 44, window);
+        benchmark::DoNotOptimize(window.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ScrollAfterTick)->ArgNames({"flows", "changed"})->Args({1000000, 1000})->Args({1000000, 100000})->Unit(benchmark::kMillisecond);
+
+// What a scroll costs with a sorted copy of the whole table instead, for comparison
+static void BM_SortedCopy(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], true, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    std::vector<Connection> sorted;
+    for (auto _ : state)
+    {
+        table.getSortedConnections(SortBy::BY_BYTES, sorted);
+        benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SortedCopy)->ArgName("flows")->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Key press switching the sort key after a tick in which state.range(1) of state.range(0) flows changed: the
+// first page by bytes, packets, Rx rate and Tx rate in turn. Only the ranking shown keeps its order, so every
+// switch sorts the new key from scratch. The tick itself is not timed
+static void BM_SortKeySwitch(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], i % 2, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    // The display keeps the orders from its first frame on, while the table is small
+    const SortBy sortKeys[] = {SortBy::BY_BYTES, SortBy::BY_PACKETS, SortBy::BY_RX_RATE, SortBy::BY_TX_RATE};
+    std::vector<Connection> window;
+    for (SortBy sortBy : sortKeys)
+    {
+        table.getRange(sortBy, 0, 44, window);
+    }
+    const size_t changed = static_cast<size_t>(state.range(1));
+    size_t i = 0;
+    size_t key = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t j = 0; j < changed; j++)
+        {
+            table.updateConnection(flows[i], j % 2, 1500);
+            i += 7919;
+            if (i >= flows.size())
+            {
+                i -= flows.size();
+            }
+        }
+        table.calculateSpeed();
+        state.ResumeTiming();
+        table.getRange(sortKeys[key++ % 4], 0, 44, window);
+        benchmark::DoNotOptimize(window.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SortKeySwitch)->ArgNames({"flows", "changed"})->Args({1000000, 1000})->Args({1000000, 100000})->Unit(benchmark::kMillisecond);
+
+// First page of the flows matching a filter just typed at the display, of state.range(0) flows. filter = 0: a
+// source port, 1: a /20 network, 2: text, which formats the endpoints of every flow. A new filter scans all
+// flows once, the page alternates between two filters so every iteration scans
+static void BM_FilteredPage(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], true, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    const char *filters[][2] = {{"1100", "1101"}, {"192.168.16.0/20", "192.168.32.0/20"}, {"168.3.", "168.4."}};
+    FlowFilter filter[2];
+    std::string error;
+    filter[0].parse(filters[state.range(1)][0], error);
+    filter[1].parse(filters[state.range(1)][1], error);
+    std::vector<Connection> window;
+    size_t matching = 0;
+    size_t next = 0;
+    for (auto _ : state)
+    {
+        matching = table.getRange(SortBy::BY_BYTES, 0, 44, window, &filter[next++ % 2]);
+        benchmark::DoNotOptimize(window.data());
+    }
+    state.counters["matching"] = static_cast<double>(matching);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FilteredPage)->ArgNames({"flows", "filter"})->Args({1000000, 0})->Args({1000000, 1})->Args({1000000, 2})->Unit(benchmark::kMillisecond);
+
+// First page of a text filter after a tick in which state.range(1) of state.range(0) flows changed: the match
+// set is updated from the changed flows only. The tick itself is not timed, and the page costs so little that
+// the iterations are fixed
+static void BM_FilteredAfterTick(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], true, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    FlowFilter filter;
+    std::string error;
+    filter.parse("168.3.", error);
+    std::vector<Connection> window;
+    table.getRange(SortBy::BY_BYTES, 0, 44, window, &filter);
+    const size_t changed = static_cast<size_t>(state.range(1));
+    size_t i = 0;
+    size_t matching = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t j = 0; j < changed; j++)
+        {
+            table.updateConnection(flows[i], false, 1500);
+            i = (i + 7919) % flows.size();
+        }
+        table.calculateSpeed();
+        state.ResumeTiming();
+        matching = table.getRange(SortBy::BY_BYTES, 0, 44, window, &filter);
+        benchmark::DoNotOptimize(window.data());
+    }
+    state.counters["matching"] = static_cast<double>(matching);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilteredAfterTick)->ArgNames({"flows", "changed"})->Args({1000000, 1000})->Args({1000000, 100000})->Iterations(50)->Unit(benchmark::kMillisecond);
+
+// One write of the CSV log, which formats every flow of the table each tick, of state.range(0) IPv4 or IPv6
+// flows with the history summary of the default --history budget. items_per_second is rows formatted and
+// written per second
+static void BM_LogTable(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), state.range(1) != 0);
+    ConnectionsTable table;
+    table.setHistoryBudget(512);
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        table.updateConnection(flows[i], i % 2, 64 + i * 7919 % 1400);
+    }
+    table.calculateSpeed();
+    table.setLogFilePath("/tmp/table_bench_log.csv");
+    for (auto _ : state)
+    {
+        table.logConnectionsTable(SortBy::BY_BYTES);
+    }
+    std::remove("/tmp/table_bench_log.csv");
+    std::remove("/tmp/table_bench_log.rollup.csv");
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LogTable)->ArgNames({"flows", "ipv6"})->Args({100000, 0})->Args({100000, 1})->Unit(benchmark::kMillisecond);
+
+// Write of the history log ('h') of state.range(0) flows after a minute of traffic with the default --history
+// budget. items_per_second is samples decoded and written per second
+static void BM_LogHistory(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(static_cast<size_t>(state.range(0)), false);
+    ConnectionsTable table;
+    table.setHistoryBudget(512);
+    table.setSimulatedClock(true);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+    for (int second = 0; second < 60; second++)
+    {
+        table.setSimulatedTime(start + std::chrono::seconds(second));
+        for (size_t i = 0; i < flows.size(); i++)
+        {
+            table.updateConnection(flows[i], i % 2, 64 + (i + second) * 7919 % 1400);
+        }
+        table.calculateSpeed();
+    }
+    table.setLogFilePath("/tmp/table_bench_log.csv");
+    for (auto _ : state)
+    {
+        table.logHistory();
+    }
+    std::remove("/tmp/table_bench_log.history.csv");
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 60);
+}
+BENCHMARK(BM_LogHistory)->ArgName("flows")->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Rate sweep over the counter columns of state.range(0) flows, all of them changed
+static void BM_RateSweep(benchmark::State &state)
+{
+    FlowColumns columns;
+    columns.resize(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t row = 0; row < columns.size(); row++)
+        {
+            columns.m_bytesSent[row] += 1500;
+            columns.m_packetsReceived[row] += 1;
+        }
+        state.ResumeTiming();
+        columns.computeRates(0, columns.size(), 1);
+        benchmark::DoNotOptimize(columns.m_txSpeedBytes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RateSweep)->ArgName("flows")->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Recording an hour of per-second samples for 1000 flows with the default budget of 512 B per flow.
+// seconds_kept is how much of the hour a flow keeps. varying = 0: the same bytes every second, 1: bytes
+// that change every second (a packet size times a varying packet count)
+static void BM_HistoryRecord(benchmark::State &state)
+{
+    const uint32_t flows = 1000;
+    const int64_t seconds = 3600;
+    bool varying = state.range(0) != 0;
+    size_t samplesKept = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        FlowHistory history;
+        history.setBudget(512);
+        history.resize(flows);
+        state.ResumeTiming();
+        for (int64_t second = 0; second < seconds; second++)
+        {
+            for (uint32_t row = 0; row < flows; row++)
+            {
+                uint64_t packets = varying ? 1 + (second * 31 + row) % 17 : 10;
+                history.record(row, second, packets * 1448);
+            }
+        }
+        state.PauseTiming();
+        std::vector<HistorySample> samples;
+        history.read(0, samples);
+        samplesKept = samples.size();
+        state.ResumeTiming();
+    }
+    state.counters["seconds_kept"] = static_cast<double>(samplesKept);
+    state.SetItemsProcessed(state.iterations() * flows * seconds);
+}
+BENCHMARK(BM_HistoryRecord)->ArgName("varying")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// A day of rollups for 1000 flow updates a second spread over state.range(0) remote hosts, with the default
+// 256 host slots. More hosts than slots take slots over all the time. rollup_bytes is the memory of the
+// rollups at the end of the day
+static void BM_RollupDay(benchmark::State &state)
+{
+    std::vector<ConnectionID> flows = makeFlows(1000, false);
+    const uint32_t hosts = static_cast<uint32_t>(state.range(0));
+    const int64_t seconds = 86400;
+    size_t memory = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Rollups rollups;
+        state.ResumeTiming();
+        uint32_t host = 0;
+        for (int64_t second = 0; second < seconds; second++)
+        {
+            RollupTraffic tick;
+            for (ConnectionID &flow : flows)
+            {
+                // The remote end moves through the hosts
+                uint32_t address = htonl(0xc0a80000 + host);
+                std::memcpy(&flow.m_destAddress[12], &address, sizeof(address));
+                host = host + 1 == hosts ? 0 : host + 1;
+                RollupTraffic traffic{1448, 0, 1};
+                tick.add(traffic);
+                rollups.addHosts(second, flow, traffic);
+            }
+            rollups.addInterface(second, tick);
+        }
+        memory = rollups.memoryUsage();
+    }
+    state.counters["rollup_bytes"] = static_cast<double>(memory);
+    state.SetItemsProcessed(state.iterations() * flows.size() * seconds);
+}
+BENCHMARK(BM_RollupDay)->ArgName("hosts")->Arg(100)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// state.range(0) distinct flows of one packet each (a flood of spoofed sources) and ten large flows of one
+// packet in every 1000, applied in batches of 64 and published by one display tick. sketch = 0: exact table,
+// 1: heavy hitter sketch with the default size. memory_bytes is the heap held by the table after the tick,
+// large_found how many of the ten large flows are the top ten, max_error the largest error of the top ten
+static void BM_DistinctFlows(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<ConnectionID> flows = makeFlows(count + 10, false);
+    int64_t memory = 0;
+    int largeFound = 0;
+    uint64_t maxError = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        int64_t heapBefore = heapBytes();
+        auto table = std::make_unique<ConnectionsTable>();
+        SketchConfig config;
+        config.m_always = state.range(1) != 0;
+        table->setSketchConfig(config);
+        std::vector<FlowDelta> batch;
+        state.ResumeTiming();
+        for (size_t i = 0; i < count; i++)
+        {
+            FlowDelta delta;
+            delta.m_ID = flows[10 + i];
+            delta.m_bytesSent = 64;
+            delta.m_packetsSent = 1;
+            batch.push_back(delta);
+            if (i % 1000 == 0)
+            {
+                for (size_t large = 0; large < 10; large++)
+                {
+                    FlowDelta largeDelta;
+                    largeDelta.m_ID = flows[large];
+                    largeDelta.m_bytesReceived = 1500;
+                    largeDelta.m_packetsReceived = 1;
+                    batch.push_back(largeDelta);
+                }
+            }
+            if (batch.size() >= 64)
+            {
+                table->applyBatch(batch);
+                batch.clear();
+            }
+        }
+        table->applyBatch(batch);
+        table->calculateSpeed();
+        state.PauseTiming();
+        memory = heapBytes() - heapBefore;
+        std::shared_ptr<const TableSnapshot> snapshot = table->getSnapshot();
+        largeFound = 0;
+        maxError = 0;
+        if (snapshot->m_sketch)
+        {
+            for (const HeavyHitter &hitter : snapshot->m_heavyHitters)
+            {
+                largeFound += std::find(flows.begin(), flows.begin() + 10, hitter.m_connection.m_ID) != flows.begin() + 10;
+                maxError = std::max(maxError, hitter.m_error);
+            }
+        }
+        else
+        {
+            for (const Connection &connection : snapshot->m_top[BY_BYTES])
+            {
+                largeFound += std::find(flows.begin(), flows.begin() + 10, connection.m_ID) != flows.begin() + 10;
+            }
+        }
+        table.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.counters["memory_bytes"] = static_cast<double>(memory);
+    state.counters["large_found"] = largeFound;
+    state.counters["max_error"] = static_cast<double>(maxError);
+}
+BENCHMARK(BM_DistinctFlows)->ArgNames({"flows", "sketch"})->Args({10000000, 0})->Args({10000000, 1})->Iterations(1)->Unit(benchmark::kMillisecond);
+
+using FlatIPv4Map = FlowMap<FlowKey<AF_INET>, Connection, FlowKeyHash<AF_INET>>;
+using NodeIPv4Map = std::unordered_map<FlowKey<AF_INET>, Connection, FlowKeyHash<AF_INET>>;
+BENCHMARK_TEMPLATE(BM_Find, NodeIPv4Map)->ArgName("flows")->Arg(10000)->Arg(500000);
+BENCHMARK_TEMPLATE(BM_Find, FlatIPv4Map)->ArgName("flows")->Arg(10000)->Arg(500000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,48 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <string>
+
+// Capture engine used to read packets from the interface
+enum class CaptureBackend
+{
+    // libpcap live capture (default)
+    PCAP,
+    // Native AF_PACKET TPACKET_V3 memory-mapped block ring
+    RING
+};
+
+// Capture settings filled by CommandLineInterface and consumed by PacketCapture
+struct CaptureConfig
+{
+    CaptureBackend m_backend = CaptureBackend::PCAP;
+    // Total size of the TPACKET_V3 ring in MiB (one block per MiB)
+    unsigned int m_ringSizeMB = 64;
+    // Time after which the kernel retires a partially filled block (ms)
+    unsigned int m_blockTimeoutMs = 10;
+    // Number of capture workers, more than one joins them into a PACKET_FANOUT group
+    unsigned int m_workers = 1;
+    // PACKET_FANOUT group id shared by the workers, -1 if not used
+    int m_fanoutGroup = -1;
+    // libpcap kernel buffer size in MiB, 0 keeps the libpcap default
+    unsigned int m_bufferSizeMB = 0;
+    // Deliver packets immediately instead of waiting for the buffer timeout
+    bool m_immediateMode = false;
+    // libpcap packet buffer timeout (ms)
+    unsigned int m_timeoutMs = 1000;
+    // Source of the packet timestamps by its libpcap name (host, host_lowprec, host_hiprec, adapter,
+    // adapter_unsynced), empty keeps the libpcap default. Timestamps are requested with nanosecond precision
+    std::string m_tstampType;
+    // Maximum number of packets drained before the connections table is updated (one lock per batch)
+    unsigned int m_batchSize = 64;
+    // pcap filter expression, compiled to BPF and run by the kernel (empty = capture everything)
+    std::string m_filter;
+    // Capture file to replay instead of a live interface (-r)
+    std::string m_readFile;
+    // Replay with the original gaps between packets instead of as fast as possible
+    bool m_replayPaced = false;
+};
@@ -9,6 +9,7 @@
 CommandLineInterface::CommandLineInterface(int argc, char *argv[])
 {
     m_argc = argc;
+    m_sortBy = SortBy::BY_BYTES;
     for (int i = 0; i < argc; i++)
     {
         m_argv.push_back(argv[i]);
@@ -21,7 +22,7 @@ void CommandLineInterface::validateRetrieveArgs()
     bool interfaceSpecified = false;
 
     // Check for valid number of arguments
-    if (m_argc < 2 || m_argc > 6)
+    if (m_argc < 2)
     {
         std::cerr << USAGE_MESSAGE << std::endl;
         exit(EXIT_FAILURE);
@@ -43,16 +44,166 @@ void CommandLineInterface::validateRetrieveArgs()
                 m_sortBy = SortBy::BY_BYTES;
             else if (sortArg == "p")
                 m_sortBy = SortBy::BY_PACKETS;
+            else if (sortArg == "r")
+                m_sortBy = SortBy::BY_RATE;
+            else if (sortArg == "r10")
+                m_sortBy = SortBy::BY_RATE_10S;
+            else if (sortArg == "r40")
+                m_sortBy = SortBy::BY_RATE_40S;
+            else if (sortArg == "e")
+                m_sortBy = SortBy::BY_RATE_EWMA;
+            else if (sortArg == "rx")
+                m_sortBy = SortBy::BY_RX_RATE;
+            else if (sortArg == "tx")
+                m_sortBy = SortBy::BY_TX_RATE;
             else
             {
                 std::cerr << USAGE_MESSAGE << std::endl;
                 exit(EXIT_FAILURE);
             }
         }
+        else if (arg == "-f" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_filter = m_argv[++i];
+        }
         else if (arg == "-l" || arg == "--log")
         {
             m_logFilePath = "log.csv";
         }
+        else if (arg == "--ring")
+        {
+            m_captureConfig.m_backend = CaptureBackend::RING;
+        }
+        else if (arg == "--ring-size" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_ringSizeMB = parseNumber(m_argv[++i]);
+            if (m_captureConfig.m_ringSizeMB == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--block-timeout" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_blockTimeoutMs = parseNumber(m_argv[++i]);
+        }
+        else if (arg == "--workers" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_workers = parseNumber(m_argv[++i]);
+            if (m_captureConfig.m_workers == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            // Fanout groups exist only for AF_PACKET sockets
+            if (m_captureConfig.m_workers > 1)
+            {
+                m_captureConfig.m_backend = CaptureBackend::RING;
+            }
+        }
+        else if (arg == "--batch" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_batchSize = parseNumber(m_argv[++i]);
+            if (m_captureConfig.m_batchSize == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--buffer" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_bufferSizeMB = parseNumber(m_argv[++i]);
+        }
+        else if (arg == "--immediate")
+        {
+            m_captureConfig.m_immediateMode = true;
+        }
+        else if (arg == "--timeout" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_timeoutMs = parseNumber(m_argv[++i]);
+            // libpcap would wait for packets without a limit
+            if (m_captureConfig.m_timeoutMs == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--tstamp-type" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_tstampType = m_argv[++i];
+        }
+        else if ((arg == "--tcp-timeout" || arg == "--udp-timeout" || arg == "--icmp-timeout") && i + 1 < m_argc)
+        {
+            unsigned int timeout = parseNumber(m_argv[++i]);
+            if (timeout == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if (arg == "--tcp-timeout")
+                m_expiryConfig.m_tcpTimeout = timeout;
+            else if (arg == "--udp-timeout")
+                m_expiryConfig.m_udpTimeout = timeout;
+            else
+                m_expiryConfig.m_icmpTimeout = timeout;
+        }
+        else if (arg == "--max-flows" && i + 1 < m_argc)
+        {
+            m_expiryConfig.m_maxFlows = parseNumber(m_argv[++i]);
+        }
+        else if (arg == "--ewma" && i + 1 < m_argc)
+        {
+            m_ewmaWindow = parseNumber(m_argv[++i]);
+            if (m_ewmaWindow == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--history" && i + 1 < m_argc)
+        {
+            m_historyBudget = parseNumber(m_argv[++i]);
+            if (m_historyBudget != 0 && m_historyBudget < FlowHistory::MIN_BUDGET)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--rollup-hosts" && i + 1 < m_argc)
+        {
+            m_rollupHosts = parseNumber(m_argv[++i]);
+        }
+        else if (arg == "--sketch")
+        {
+            m_sketchConfig.m_always = true;
+        }
+        else if (arg == "--sketch-above" && i + 1 < m_argc)
+        {
+            m_sketchConfig.m_threshold = parseNumber(m_argv[++i]);
+            if (m_sketchConfig.m_threshold == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if ((arg == "--refresh" || arg == "--stats-interval") && i + 1 < m_argc)
+        {
+            unsigned int interval = parseNumber(m_argv[++i]);
+            if (interval == 0)
+            {
+                std::cerr << USAGE_MESSAGE << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            (arg == "--refresh" ? m_refreshMs : m_statsMs) = interval;
+        }
+        else if (arg == "-r" && i + 1 < m_argc)
+        {
+            m_captureConfig.m_readFile = m_argv[++i];
+        }
+        else if (arg == "--paced")
+        {
+            m_captureConfig.m_replayPaced = true;
+        }
         else if (arg == "-h")
         {
             std::cout << USAGE_MESSAGE << std::endl;
@@ -64,10 +215,33 @@ void CommandLineInterface::validateRetrieveArgs()
             exit(EXIT_FAILURE);
         }
     }
-    // Ensure the interface was specified
-    if (!interfaceSpecified)
+    // Ensure the interface or a capture file was specified
+    if (!interfaceSpecified && m_captureConfig.m_readFile.empty())
+    {
+        std::cerr << USAGE_MESSAGE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // A file is replayed by one thread into the table, every worker would replay all of it again
+    if (!m_captureConfig.m_readFile.empty() && m_captureConfig.m_workers > 1)
+    {
+        std::cerr << USAGE_MESSAGE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // The EWMA speed is computed only with its window
+    if (m_sortBy == SortBy::BY_RATE_EWMA && m_ewmaWindow == 0)
+    {
+        std::cerr << USAGE_MESSAGE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Convert numeric option value, reject anything that is not a plain decimal number
+unsigned int CommandLineInterface::parseNumber(const std::string &text)
+{
+    if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos)
     {
         std::cerr << USAGE_MESSAGE << std::endl;
         exit(EXIT_FAILURE);
     }
-}
\ No newline at end of file
+    return static_cast<unsigned int>(std::stoul(text));
+}
@@ -4,14 +4,39 @@
  */
 
 #include "connectionsTable.hpp"
+#include "captureConfig.hpp"
 
 #define USAGE_MESSAGE "\
-Usage: isa-top -i <interface> [-s <b|p>] [-l <logfile>]\n\n \
+Usage: isa-top -i <interface> | -r <file> [--paced] [-s <b|p|r|r10|r40|e|rx|tx>] [-f <filter>] [-l <logfile>] [--ring [--ring-size <MiB>] [--block-timeout <ms>]] [--workers <n>] [--batch <n>] [--buffer <MiB>] [--ewma <s>] [--history <bytes>] [--rollup-hosts <n>] [--sketch | --sketch-above <n>] [--refresh <ms>] [--stats-interval <ms>] [--immediate | --timeout <ms>] [--tstamp-type <type>] [--tcp-timeout <s>] [--udp-timeout <s>] [--icmp-timeout <s>] [--max-flows <n>]\n\n \
 Options:\n \
--h            Display this help message and exit\n \
--i <arg>      The network interface for app to listen on\n \
--s <arg>      Sort the output by bytes or packets, <arg> is b or p accordingly\n \
--l, --log     Turn on the logging\n"
+-h                    Display this help message and exit\n \
+-i <arg>              The network interface for app to listen on\n \
+-r <arg>              Replay packets from a pcap/pcapng file instead of listening (-i then only names the local host)\n \
+--paced               Replay with the original timing of the packets instead of as fast as possible\n \
+-s <arg>              Sort the output by bytes, packets, current rate, rate averaged over 10 s or 40 s, EWMA rate,\n \
+                      received or sent rate, <arg> is b, p, r, r10, r40, e, rx or tx accordingly (e needs --ewma)\n \
+--ewma <arg>          Show the rate averaged by an EWMA with a time constant of <arg> seconds (default off)\n \
+--history <arg>       Bytes of compressed per-second history kept per flow, at least 64, 0 = off (default 512)\n \
+--rollup-hosts <arg>  Hosts with 1 s, 1 min and 1 h rollups, 0 = only the interface (default 256)\n \
+--sketch              Count flows in a fixed-memory heavy hitter sketch and show the largest with their error\n \
+--sketch-above <arg>  Switch to the sketch when the table holds <arg> flows (default off)\n \
+--refresh <arg>       Time in ms between screen refreshes (default 1000)\n \
+--stats-interval <arg> Time in ms between computations of the speeds and log writes (default 1000)\n \
+-f <arg>              pcap filter expression, packets that don't match are dropped in the kernel\n \
+-l, --log             Turn on the logging\n \
+--ring                Capture through the AF_PACKET TPACKET_V3 ring instead of libpcap\n \
+--ring-size <arg>     Size of the ring in MiB (default 64)\n \
+--block-timeout <arg> Time in ms after which a partially filled ring block is delivered (default 10)\n \
+--workers <arg>       Number of capture threads sharing the traffic via PACKET_FANOUT, implies --ring, not with -r (default 1)\n \
+--batch <arg>         Maximum number of packets applied to the connections table under one lock (default 64)\n \
+--buffer <arg>        libpcap kernel buffer size in MiB (default: libpcap default)\n \
+--immediate           libpcap delivers every packet as soon as it arrives\n \
+--timeout <arg>       libpcap packet buffer timeout in ms, at least 1 (default 1000)\n \
+--tstamp-type <arg>   Source of libpcap packet timestamps: host, host_lowprec, host_hiprec, adapter or adapter_unsynced\n \
+--tcp-timeout <arg>   Seconds without traffic after which a TCP flow is removed (default 300)\n \
+--udp-timeout <arg>   Seconds without traffic after which a UDP flow is removed (default 60)\n \
+--icmp-timeout <arg>  Seconds without traffic after which an ICMP flow is removed (default 30)\n \
+--max-flows <arg>     Maximum number of tracked flows, the flow nearest to its timeout is evicted (default unlimited)\n"
 
 // Class to handle command line arguments
 class CommandLineInterface
@@ -24,8 +49,25 @@ public:
     void validateRetrieveArgs();
     CommandLineInterface(int argc, char *argv[]);
     std::string m_logFilePath;
+    // Capture engine settings
+    CaptureConfig m_captureConfig;
+    // Idle timeouts and flow limit of the connections table
+    ExpiryConfig m_expiryConfig;
+    // Time constant of the EWMA rate in seconds, 0 = off
+    unsigned int m_ewmaWindow = 0;
+    // Bytes of history per flow, 0 = off
+    unsigned int m_historyBudget = 512;
+    // Host slots of the rollups, 0 = only the interface
+    unsigned int m_rollupHosts = 256;
+    // Heavy hitter sketch instead of exact flows, always or above a number of flows
+    SketchConfig m_sketchConfig;
+    // Milliseconds between screen refreshes and between statistics ticks
+    unsigned int m_refreshMs = 1000;
+    unsigned int m_statsMs = 1000;
 
 private:
     int m_argc;
     std::vector<std::string> m_argv;
+    // Parse a decimal number, print usage and exit if it is not one
+    unsigned int parseNumber(const std::string &text);
 };
@@ -19,6 +19,7 @@
 #include <arpa/inet.h>
 #include <mutex>
 #include "connectionID.hpp"
+#include "flowHistory.hpp"
 
 enum IPFamily
 {
@@ -35,6 +36,9 @@ public:
     ConnectionID m_ID;
     // IP family (IPv4 or IPv6)
     IPFamily m_ipFamily;
+    // Source and destination address as text, formatted once when the flow got its row in the table
+    AddressText m_srcText;
+    AddressText m_destText;
 
     unsigned long int m_bytesSent;
     unsigned long int m_bytesReceived;
@@ -49,6 +53,19 @@ public:
     double m_rxSpeedPackets;
     double m_txSpeedPackets;
 
+    // Speeds averaged over 10 s, 40 s and the user's EWMA window (Bytes, both directions)
+    double m_speed10s;
+    double m_speed40s;
+    double m_speedEwma;
+
+    // Traffic of the last hour as a sparkline, filled for the rows of the published snapshot
+    SparklineText m_sparkline;
+    // Summary of the per-second history, filled for the log: first second with traffic, number of seconds with
+    // traffic and bytes of the busiest one (0 seconds = no history)
+    int64_t m_historyStart = 0;
+    uint32_t m_activeSeconds = 0;
+    uint64_t m_peakSecondBytes = 0;
+
     std::chrono::system_clock::time_point m_first_seen;
     std::chrono::system_clock::time_point m_last_seen;
     // Constructors
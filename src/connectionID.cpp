@@ -4,24 +4,27 @@
  */
 
 #include "connectionID.hpp"
+#include <algorithm>
+#include <charconv>
 #include <cstring>
 #include <arpa/inet.h>
-#include <sstream>
 
-// Default constructor, initialize endpoints
+// Default constructor, empty key
 ConnectionID::ConnectionID()
 {
+    std::memset(static_cast<FlowKey<AF_INET6> *>(this), 0, sizeof(FlowKey<AF_INET6>));
     m_protocol = Protocol::TCP;
-    std::memset(&m_srcEndPoint, 0, sizeof(m_srcEndPoint));
-    std::memset(&m_destEndPoint, 0, sizeof(m_destEndPoint));
 }
 
-// Constructor, set source, destination endpoints and protocol
+// Constructor, set source, destination endpoints and protocol. Only the fields that identify the flow are kept
 ConnectionID::ConnectionID(const sockaddr_in6 &src, const sockaddr_in6 &dest, Protocol protocol)
 {
-    m_srcEndPoint = src;
-    m_destEndPoint = dest;
+    std::memcpy(m_srcAddress, &src.sin6_addr, sizeof(m_srcAddress));
+    std::memcpy(m_destAddress, &dest.sin6_addr, sizeof(m_destAddress));
+    m_srcPort = src.sin6_port;
+    m_destPort = dest.sin6_port;
     m_protocol = protocol;
+    m_family = static_cast<uint8_t>(src.sin6_family);
 }
 
 // Stores IPv4 address in IPv6 structure
@@ -37,9 +40,7 @@ ConnectionID ConnectionID::storeIPv4InIPv6(const in_addr &src, uint16_t srcPort,
 // Eq operator to compare 2 ConnectionID objects
 bool ConnectionID::operator==(const ConnectionID &right) const
 {
-    return compareEndpoints(m_srcEndPoint, right.m_srcEndPoint) &&
-           compareEndpoints(m_destEndPoint, right.m_destEndPoint) &&
-           m_protocol == right.m_protocol;
+    return FlowKey<AF_INET6>::operator==(right);
 }
 
 // Maps IPv4 address and port to IPv6 structure
@@ -61,16 +62,26 @@ bool ConnectionID::compareEndpoints(const sockaddr_in6 &ep1, const sockaddr_in6
            ep1.sin6_port == ep2.sin6_port;
 }
 
+// Builds sockaddr_in6 from an address and port of the key
+static sockaddr_in6 makeEndPoint(const uint8_t *address, uint16_t port, uint8_t family)
+{
+    sockaddr_in6 endPoint{};
+    endPoint.sin6_family = family;
+    endPoint.sin6_port = port;
+    std::memcpy(&endPoint.sin6_addr, address, sizeof(endPoint.sin6_addr));
+    return endPoint;
+}
+
 // Getter for source endpoint
 sockaddr_in6 ConnectionID::getSrcEndPoint() const
 {
-    return m_srcEndPoint;
+    return makeEndPoint(m_srcAddress, m_srcPort, m_family);
 }
 
 // Getter for destination endpoint
 sockaddr_in6 ConnectionID::getDestEndPoint() const
 {
-    return m_destEndPoint;
+    return makeEndPoint(m_destAddress, m_destPort, m_family);
 }
 
 // Getter for protocol
@@ -82,47 +93,77 @@ Protocol ConnectionID::getProtocol() const
 // Getter for source port
 uint16_t ConnectionID::getSrcPort() const
 {
-    return ntohs(m_srcEndPoint.sin6_port);
+    return ntohs(m_srcPort);
 }
 
 // Getter for destination port
 uint16_t ConnectionID::getDestPort() const
 {
-    return ntohs(m_destEndPoint.sin6_port);
+    return ntohs(m_destPort);
 }
 
-// Hash function for ConnectionID
-std::size_t ConnectionIDHash::operator()(const ConnectionID &connection) const
+// Both endpoints are IPv4-mapped IPv6 addresses (::ffff:a.b.c.d)
+bool ConnectionID::isIPv4() const
 {
-    std::string srcStr = ConnectionID::endpointToString(connection.getSrcEndPoint());
-    std::string destStr = ConnectionID::endpointToString(connection.getDestEndPoint());
-
-    std::ostringstream oss;
-    oss << srcStr << "-" << destStr << "-" << static_cast<int>(connection.getProtocol());
-    std::string key = oss.str();
+    static const uint8_t prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+    return std::memcmp(m_srcAddress, prefix, sizeof(prefix)) == 0 &&
+           std::memcmp(m_destAddress, prefix, sizeof(prefix)) == 0;
+}
 
-    return std::hash<std::string>{}(key);
+// Drops the IPv4-mapped prefix of both addresses
+FlowKey<AF_INET> ConnectionID::toIPv4Key() const
+{
+    FlowKey<AF_INET> key;
+    std::memcpy(key.m_srcAddress, &m_srcAddress[12], sizeof(key.m_srcAddress));
+    std::memcpy(key.m_destAddress, &m_destAddress[12], sizeof(key.m_destAddress));
+    key.m_srcPort = m_srcPort;
+    key.m_destPort = m_destPort;
+    key.m_protocol = m_protocol;
+    key.m_family = AF_INET;
+    return key;
 }
 
-// Method to convert sockaddr_in6 to string
+// Converts an endpoint to "address:port"
 std::string ConnectionID::endpointToString(const sockaddr_in6 &endpoint)
 {
-    char ipStr[INET6_ADDRSTRLEN];
+    AddressText address;
+    formatAddress(endpoint.sin6_addr.s6_addr, address);
+    char buffer[ENDPOINT_LENGTH];
+    return std::string(buffer, writeEndpoint(address, ntohs(endpoint.sin6_port), buffer));
+}
 
-    if (IN6_IS_ADDR_V4MAPPED(&endpoint.sin6_addr))
-    {
-        struct in_addr ipv4Addr;
-        std::memcpy(&ipv4Addr, &endpoint.sin6_addr.s6_addr[12], sizeof(ipv4Addr));
-        inet_ntop(AF_INET, &ipv4Addr, ipStr, sizeof(ipStr));
-    }
-    else
+// IPv4-mapped addresses are written digit by digit with to_chars, other addresses by inet_ntop into a stack
+// buffer. Neither allocates
+void ConnectionID::formatAddress(const uint8_t (&address)[16], AddressText &text)
+{
+    static const uint8_t ipv4Prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (std::memcmp(address, ipv4Prefix, sizeof(ipv4Prefix)) == 0)
     {
-        inet_ntop(AF_INET6, &endpoint.sin6_addr, ipStr, sizeof(ipStr));
+        char *end = text.m_text;
+        for (int i = 12; i < 16; i++)
+        {
+            if (i > 12)
+            {
+                *end++ = '.';
+            }
+            end = std::to_chars(end, text.m_text + AddressText::CAPACITY, address[i]).ptr;
+        }
+        text.m_length = static_cast<uint8_t>(end - text.m_text);
+        return;
     }
+    char buffer[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, address, buffer, sizeof(buffer));
+    size_t length = std::min(std::strlen(buffer), AddressText::CAPACITY);
+    std::memcpy(text.m_text, buffer, length);
+    text.m_length = static_cast<uint8_t>(length);
+}
 
-    uint16_t port = ntohs(endpoint.sin6_port);
-
-    std::ostringstream oss;
-    oss << ipStr << ":" << port;
-    return oss.str();
+// Address, colon and the port written by to_chars, not terminated. Returns the length
+size_t ConnectionID::writeEndpoint(const AddressText &address, uint16_t port, char (&buffer)[ENDPOINT_LENGTH])
+{
+    std::memcpy(buffer, address.m_text, address.m_length);
+    char *end = buffer + address.m_length;
+    *end++ = ':';
+    end = std::to_chars(end, buffer + ENDPOINT_LENGTH, port).ptr;
+    return static_cast<size_t>(end - buffer);
 }
\ No newline at end of file
@@ -4,11 +4,16 @@
  */
 
 #pragma once
+#include "flowHash.hpp"
 #include <netinet/in.h>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
-// Enum for different protocols
-enum class Protocol
+// Enum for different protocols, stored in one byte of the flow key
+enum class Protocol : uint8_t
 {
     TCP,
     UDP,
@@ -16,8 +21,71 @@ enum class Protocol
     ICMPv6
 };
 
-// Class connectionID is a way to represent Connection and make it unique
-class ConnectionID
+// Compact flow key: addresses and ports in network byte order, protocol and address family.
+// The IPv4 variant (Family = AF_INET) keeps only 4 byte addresses. Keys have no padding and are
+// trivially copyable, so they are compared with memcmp and hashed as raw bytes
+template <int Family>
+struct FlowKey
+{
+    static constexpr size_t ADDRESS_LENGTH = Family == AF_INET ? 4 : 16;
+
+    uint8_t m_srcAddress[ADDRESS_LENGTH];
+    uint8_t m_destAddress[ADDRESS_LENGTH];
+    uint16_t m_srcPort;
+    uint16_t m_destPort;
+    Protocol m_protocol;
+    // sin6_family of the endpoints the key was built from (0 for an empty key), AF_INET for IPv4 keys
+    uint8_t m_family;
+
+    bool operator==(const FlowKey &right) const
+    {
+        return std::memcmp(this, &right, sizeof(FlowKey)) == 0;
+    }
+};
+
+static_assert(sizeof(FlowKey<AF_INET6>) == 16 + 16 + 2 + 2 + 1 + 1, "IPv6 flow key must not be padded");
+static_assert(sizeof(FlowKey<AF_INET>) == 4 + 4 + 2 + 2 + 1 + 1, "IPv4 flow key must not be padded");
+static_assert(std::is_trivially_copyable_v<FlowKey<AF_INET6>> && std::is_trivially_copyable_v<FlowKey<AF_INET>>);
+
+// Hash of a flow key, the layout is known at compile time
+template <int Family>
+struct FlowKeyHash
+{
+    std::size_t operator()(const FlowKey<Family> &key) const
+    {
+        if constexpr (Family == AF_INET)
+        {
+            return FlowHash::hashIPv4(key.m_srcAddress, key.m_destAddress, key.m_srcPort, key.m_destPort,
+                                      static_cast<uint8_t>(key.m_protocol));
+        }
+        else
+        {
+            return FlowHash::hash(key.m_srcAddress, key.m_destAddress, key.m_srcPort, key.m_destPort,
+                                  static_cast<uint8_t>(key.m_protocol));
+        }
+    }
+};
+
+// Address of a flow endpoint as output shows it: dotted IPv4 for IPv4-mapped addresses, the inet_ntop form
+// otherwise, which is at most 8 groups of 4 hex digits. Fixed size and trivially copyable, so a flow carries
+// its formatted addresses without allocating
+struct AddressText
+{
+    static constexpr size_t CAPACITY = 39;
+
+    char m_text[CAPACITY];
+    // 0 = not formatted
+    uint8_t m_length = 0;
+
+    std::string_view view() const
+    {
+        return std::string_view(m_text, m_length);
+    }
+};
+
+// Class connectionID is a way to represent Connection and make it unique.
+// It is the IPv6 flow key, IPv4 flows are stored as IPv4-mapped addresses
+class ConnectionID : public FlowKey<AF_INET6>
 {
 public:
     ConnectionID();
@@ -34,19 +102,27 @@ public:
     Protocol getProtocol() const;
     uint16_t getSrcPort() const;
     uint16_t getDestPort() const;
+    // Both addresses are IPv4-mapped
+    bool isIPv4() const;
+    // 12 byte address and port part of an IPv4 flow (valid only if isIPv4())
+    FlowKey<AF_INET> toIPv4Key() const;
     static sockaddr_in6 mapIPv4ToIPv6(const in_addr &ipv4Addr, uint16_t port);
     static bool compareEndpoints(const sockaddr_in6 &ep1, const sockaddr_in6 &ep2);
     static std::string endpointToString(const sockaddr_in6 &endpoint);
-
-    sockaddr_in6 m_srcEndPoint;
-    sockaddr_in6 m_destEndPoint;
-    Protocol m_protocol;
-    uint16_t m_srcPort;
-    uint16_t m_destPort;
+    // Allocation-free formatting into fixed buffers, the endpoint is "address:port" with port in host byte order
+    static constexpr size_t ENDPOINT_LENGTH = AddressText::CAPACITY + 6;
+    static void formatAddress(const uint8_t (&address)[16], AddressText &text);
+    static size_t writeEndpoint(const AddressText &address, uint16_t port, char (&buffer)[ENDPOINT_LENGTH]);
 };
 
-// Hash struct for ConnectionID to use in hash table later
+static_assert(sizeof(ConnectionID) == sizeof(FlowKey<AF_INET6>) && std::is_trivially_copyable_v<ConnectionID>);
+
+// Hash struct for ConnectionID to use in hash table later, works on the raw addresses and ports
+// without building strings
 struct ConnectionIDHash
 {
-    std::size_t operator()(const ConnectionID &connection) const;
+    std::size_t operator()(const ConnectionID &connection) const
+    {
+        return FlowKeyHash<AF_INET6>{}(connection);
+    }
 };
@@ -7,186 +7,1420 @@
 #include "connectionID.hpp"
 #include "display.hpp"
 
-// Erase connection from the table
+#include <charconv>
+#include <string_view>
+
+// Columns of the log and of the history log
+static const char LOG_HEADER[] = "timestamp,protocol,src_ip,src_port,dst_ip,dst_port,bytes_sent,bytes_received,packets_sent,packets_received,"
+                                 "history_start,active_seconds,peak_second_bytes\n";
+static const char HISTORY_LOG_HEADER[] = "protocol,src_ip,src_port,dst_ip,dst_port,second,bytes\n";
+
+// Whole seconds of a time point, the resolution of the expiry timers
+static int64_t toSeconds(std::chrono::system_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+// Erase connection from the table. Changes the flow maps, so it must not run while capture updates the table
 void ConnectionsTable::removeConnection(Connection connection)
 {
-    // Lock the table and erase
+    // Lock the table and erase, the published state of the flow goes too
+    std::lock_guard<std::mutex> publishLock(m_publishMutex);
     std::lock_guard<std::mutex> lock(m_tableMutex);
-    m_connectionsTable.erase(connection.m_ID);
+    uint32_t record = UINT32_MAX;
+    if (connection.m_ID.isIPv4())
+    {
+        auto found = m_ipv4Flows.m_current.find(connection.m_ID.toIPv4Key());
+        if (found != m_ipv4Flows.m_current.end())
+        {
+            record = found->second;
+            eraseFlow(m_ipv4Flows, found);
+        }
+    }
+    else
+    {
+        auto found = m_ipv6Flows.m_current.find(connection.m_ID);
+        if (found != m_ipv6Flows.m_current.end())
+        {
+            record = found->second;
+            eraseFlow(m_ipv6Flows, found);
+        }
+    }
+    if (record != UINT32_MAX)
+    {
+        removeRow(record);
+    }
 }
 
-// Get pointer to a connection, return nullptr if it doesn't exist
+// Get pointer to a copy of the connection with its current counters (valid until the next call), return
+// nullptr if it doesn't exist. Speeds are those of the last calculateSpeed
 Connection *ConnectionsTable::getConnection(Connection connection)
 {
-    // Lock the table
+    // Lock the table (publish lock first, same order as calculateSpeed)
+    std::lock_guard<std::mutex> publishLock(m_publishMutex);
     std::lock_guard<std::mutex> lock(m_tableMutex);
-    // Find connection
-    auto foundConnection = m_connectionsTable.find(connection.m_ID);
-    if (foundConnection != m_connectionsTable.end())
+    // Find connection in the table of its address family
+    uint32_t record = UINT32_MAX;
+    if (connection.m_ID.isIPv4())
     {
-        return &(foundConnection->second);
+        auto foundConnection = m_ipv4Flows.m_current.find(connection.m_ID.toIPv4Key());
+        if (foundConnection != m_ipv4Flows.m_current.end())
+        {
+            record = foundConnection->second;
+        }
+    }
+    else
+    {
+        auto foundConnection = m_ipv6Flows.m_current.find(connection.m_ID);
+        if (foundConnection != m_ipv6Flows.m_current.end())
+        {
+            record = foundConnection->second;
+        }
     }
     // Not found
-    return nullptr;
+    if (record == UINT32_MAX)
+    {
+        return nullptr;
+    }
+    m_records[record].read(m_found);
+    // Speeds are kept in the published row, the live table only has counters. The row may still hold an
+    // earlier flow whose record was reused
+    if (record < m_rowTick.size() && m_rowTick[record] != 0 && m_columns.m_ID[record] == connection.m_ID)
+    {
+        m_found.m_rxSpeedBytes = m_columns.m_rxSpeedBytes[record];
+        m_found.m_txSpeedBytes = m_columns.m_txSpeedBytes[record];
+        m_found.m_rxSpeedPackets = m_columns.m_rxSpeedPackets[record];
+        m_found.m_txSpeedPackets = m_columns.m_txSpeedPackets[record];
+    }
+    return &m_found;
+}
+
+// Updates connection depending on what it does (sends or receives). The packet timestamp saves a clock read
+void ConnectionsTable::updateConnection(const ConnectionID &id, bool isSending, uint64_t byteCount, std::chrono::system_clock::time_point timestamp)
+{
+    uint64_t bytesSent = isSending ? byteCount : 0;
+    uint64_t packetsSent = isSending ? 1 : 0;
+    uint64_t bytesReceived = isSending ? 0 : byteCount;
+    uint64_t packetsReceived = isSending ? 0 : 1;
+    auto currentTime = timestamp.time_since_epoch().count() != 0 ? timestamp : now();
+
+    // Sketch mode, every flow goes to the sketch
+    if (m_sketchActive)
+    {
+        std::unique_lock<std::mutex> lock = lockForIngest();
+        addToSketch(id, bytesSent, packetsSent, bytesReceived, packetsReceived);
+        expireIfDue(currentTime);
+        return;
+    }
+    // Existing flow, no lock
+    IngestScope ingest(*this);
+    bool updated = updateExisting(id, currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+    if (updated && currentTime.time_since_epoch().count() < m_expiryDue.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    // New flow, or idle flows are due to expire
+    std::unique_lock<std::mutex> lock = lockForIngest();
+    if (!updated)
+    {
+        addTraffic(id, currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+    }
+    expireIfDue(currentTime);
+}
+
+// Updates all connections of the batch. Existing flows are updated without the lock, the table is locked
+// at most once, to add the new flows. Flows are stamped with their packet timestamps, the clock is read only
+// for entries without one. Expiry runs at the time of the latest packet
+void ConnectionsTable::applyBatch(const std::vector<FlowDelta> &batch)
+{
+    std::chrono::system_clock::time_point currentTime;
+    std::chrono::system_clock::time_point batchTime;
+    // Sketch mode, the whole batch goes to the sketch under a single lock acquisition
+    if (m_sketchActive)
+    {
+        std::unique_lock<std::mutex> lock = lockForIngest();
+        for (const FlowDelta &delta : batch)
+        {
+            addToSketch(delta.m_ID, delta.m_bytesSent, delta.m_packetsSent, delta.m_bytesReceived, delta.m_packetsReceived);
+            currentTime = std::max(currentTime, delta.m_lastSeen);
+        }
+        expireIfDue(currentTime.time_since_epoch().count() != 0 ? currentTime : now());
+        return;
+    }
+    IngestScope ingest(*this);
+    m_newFlows.clear();
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        const FlowDelta &delta = batch[i];
+        std::chrono::system_clock::time_point flowTime = delta.m_lastSeen;
+        if (flowTime.time_since_epoch().count() == 0)
+        {
+            if (batchTime.time_since_epoch().count() == 0)
+            {
+                batchTime = now();
+            }
+            flowTime = batchTime;
+        }
+        currentTime = std::max(currentTime, flowTime);
+        if (!updateExisting(delta.m_ID, flowTime, delta.m_bytesSent, delta.m_packetsSent, delta.m_bytesReceived, delta.m_packetsReceived))
+        {
+            m_newFlows.push_back(i);
+        }
+    }
+    if (m_newFlows.empty() && currentTime.time_since_epoch().count() < m_expiryDue.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Lock the table
+    std::unique_lock<std::mutex> lock = lockForIngest();
+    for (size_t i : m_newFlows)
+    {
+        const FlowDelta &delta = batch[i];
+        std::chrono::system_clock::time_point flowTime = delta.m_lastSeen.time_since_epoch().count() != 0 ? delta.m_lastSeen : batchTime;
+        addTraffic(delta.m_ID, flowTime, delta.m_bytesSent, delta.m_packetsSent, delta.m_bytesReceived, delta.m_packetsReceived);
+    }
+    expireIfDue(currentTime);
+}
+
+// Expiry while capture is idle
+void ConnectionsTable::maintain()
+{
+    auto currentTime = now();
+    if (currentTime.time_since_epoch().count() < m_expiryDue.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock = lockForIngest();
+    expireIfDue(currentTime);
+}
+
+// Expiry from the statistics tick, for capture threads blocked in a read without timeout. A table whose capture
+// thread is updating flows without the lock is skipped, that thread expires its flows itself
+void ConnectionsTable::expireIdle()
+{
+    auto currentTime = now();
+    if (currentTime.time_since_epoch().count() >= m_expiryDue.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        m_idleExpiry.store(true);
+        if (!m_ingesting.load())
+        {
+            expireIfDue(currentTime);
+        }
+        m_idleExpiry.store(false);
+    }
+    for (auto &shard : m_shards)
+    {
+        shard->expireIdle();
+    }
+}
+
+// Capture marks its lock-free updates, then waits out an expireIdle that saw the mark unset. Both flags are
+// sequentially consistent, so either expireIdle sees m_ingesting or this sees m_idleExpiry
+ConnectionsTable::IngestScope::IngestScope(ConnectionsTable &table) : m_table(table)
+{
+    m_table.m_ingesting.store(true);
+    if (m_table.m_idleExpiry.load())
+    {
+        std::lock_guard<std::mutex> wait(m_table.m_tableMutex);
+    }
+}
+
+ConnectionsTable::IngestScope::~IngestScope()
+{
+    m_table.m_ingesting.store(false, std::memory_order_release);
+}
+
+// Locks the table for updates from capture. If the display holds the lock, the capture thread
+// stalls (and the kernel may drop packets), the waiting time is counted
+std::unique_lock<std::mutex> ConnectionsTable::lockForIngest()
+{
+    std::unique_lock<std::mutex> lock(m_tableMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        auto waitStart = std::chrono::steady_clock::now();
+        lock.lock();
+        auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - waitStart);
+        m_captureStallNs.fetch_add(waited.count(), std::memory_order_relaxed);
+    }
+    m_lockAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    return lock;
+}
+
+// Adds traffic to an existing flow without the lock, returns false if the flow doesn't exist. Besides capture
+// only expireIdle changes the flow maps, and never while the IngestScope of the caller is open, so these
+// lookups don't race with anything
+bool ConnectionsTable::updateExisting(const ConnectionID &id, std::chrono::system_clock::time_point currentTime,
+                                      uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    if (id.isIPv4())
+    {
+        return updateExisting(m_ipv4Flows, id.toIPv4Key(), currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+    }
+    return updateExisting(m_ipv6Flows, static_cast<const FlowKey<AF_INET6> &>(id), currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+}
+
+template <int Family>
+bool ConnectionsTable::updateExisting(FlowTables<Family> &tables, const FlowKey<Family> &key, std::chrono::system_clock::time_point currentTime,
+                                      uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    auto found = tables.m_current.find(key);
+    if (found == tables.m_current.end())
+    {
+        return false;
+    }
+    FlowRecord &record = m_records[found->second];
+    record.add(bytesSent, packetsSent, bytesReceived, packetsReceived, currentTime);
+    // First change since calculateSpeed cleared the flag. The exchange pairs with the one in copyChanged,
+    // so the counters added before it are seen there
+    if (!record.m_changed.exchange(true, std::memory_order_acq_rel))
+    {
+        m_changedRecords.push(found->second);
+    }
+    return true;
+}
+
+// Runs the expiry timers when a new second starts. Caller holds m_tableMutex
+void ConnectionsTable::expireIfDue(std::chrono::system_clock::time_point currentTime)
+{
+    if (currentTime.time_since_epoch().count() < m_expiryDue.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    int64_t seconds = toSeconds(currentTime);
+    m_expiryDue.store(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(seconds + 1)).count(),
+                      std::memory_order_relaxed);
+    expireFlows(seconds);
+}
+
+// Adds traffic to the table of the flow's address family
+void ConnectionsTable::addTraffic(const ConnectionID &id, std::chrono::system_clock::time_point currentTime,
+                                  uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    if (id.isIPv4())
+    {
+        addTraffic(m_ipv4Flows, id.toIPv4Key(), id, currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+    }
+    else
+    {
+        addTraffic(m_ipv6Flows, static_cast<const FlowKey<AF_INET6> &>(id), id, currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived);
+    }
+}
+
+// Adds traffic to an existing connection or creates a new one
+template <int Family>
+void ConnectionsTable::addTraffic(FlowTables<Family> &tables, const FlowKey<Family> &key, const ConnectionID &id,
+                                  std::chrono::system_clock::time_point currentTime,
+                                  uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    // Existing connection (listed twice in a batch)
+    if (updateExisting(tables, key, currentTime, bytesSent, packetsSent, bytesReceived, packetsReceived))
+    {
+        return;
+    }
+
+    // Otherwise its new connection. At the sketch threshold this and all later traffic goes to the sketch
+    if (m_sketch.m_threshold != 0 && m_ipv4Flows.m_current.size() + m_ipv6Flows.m_current.size() >= m_sketch.m_threshold)
+    {
+        m_sketchActive = true;
+        addToSketch(id, bytesSent, packetsSent, bytesReceived, packetsReceived);
+        return;
+    }
+    // Table is full, make room first
+    if (m_expiry.m_maxFlows != 0 && m_ipv4Flows.m_current.size() + m_ipv6Flows.m_current.size() >= m_expiry.m_maxFlows)
+    {
+        evictFlow();
+    }
+
+    // Take a record from the pool, it may hold a released flow
+    uint32_t record = m_records.allocate();
+    FlowRecord &newConnection = m_records[record];
+    newConnection.m_ID = id;
+    newConnection.m_ipFamily = Family == AF_INET ? IPFamily::IPv4 : IPFamily::IPv6;
+    newConnection.m_firstSeen = currentTime;
+    newConnection.m_lastSeen.store(currentTime.time_since_epoch().count(), std::memory_order_relaxed);
+    newConnection.m_bytesSent.store(bytesSent, std::memory_order_relaxed);
+    newConnection.m_packetsSent.store(packetsSent, std::memory_order_relaxed);
+    newConnection.m_bytesReceived.store(bytesReceived, std::memory_order_relaxed);
+    newConnection.m_packetsReceived.store(packetsReceived, std::memory_order_relaxed);
+    newConnection.m_changed.store(true, std::memory_order_relaxed);
+
+    tables.m_current.insert({key, record});
+    m_changedRecords.push(record);
+    int64_t seconds = toSeconds(currentTime);
+    tables.m_timers.schedule({key, currentTime.time_since_epoch().count()}, seconds + idleTimeout(key.m_protocol), seconds);
+}
+
+// The sketch is allocated when the first traffic arrives, so a table that never switches doesn't hold it
+void ConnectionsTable::addToSketch(const ConnectionID &id, uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    if (!m_heavyHitters.configured())
+    {
+        m_heavyHitters.configure(m_sketch.m_width, m_sketch.m_depth, m_sketch.m_candidates);
+    }
+    m_heavyHitters.add(id, bytesSent, packetsSent, bytesReceived, packetsReceived);
+}
+
+// Adds traffic of the capture thread. It is the only writer, so a relaxed load and store is an exact
+// increment without the cost of a locked read-modify-write
+void FlowRecord::add(uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived,
+                     std::chrono::system_clock::time_point currentTime)
+{
+    m_bytesSent.store(m_bytesSent.load(std::memory_order_relaxed) + bytesSent, std::memory_order_relaxed);
+    m_packetsSent.store(m_packetsSent.load(std::memory_order_relaxed) + packetsSent, std::memory_order_relaxed);
+    m_bytesReceived.store(m_bytesReceived.load(std::memory_order_relaxed) + bytesReceived, std::memory_order_relaxed);
+    m_packetsReceived.store(m_packetsReceived.load(std::memory_order_relaxed) + packetsReceived, std::memory_order_relaxed);
+    m_lastSeen.store(currentTime.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+// Copies the identity and the current counters of the flow into connection
+void FlowRecord::read(Connection &connection) const
+{
+    connection.m_ID = m_ID;
+    connection.m_ipFamily = m_ipFamily;
+    connection.m_bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+    connection.m_bytesReceived = m_bytesReceived.load(std::memory_order_relaxed);
+    connection.m_packetsSent = m_packetsSent.load(std::memory_order_relaxed);
+    connection.m_packetsReceived = m_packetsReceived.load(std::memory_order_relaxed);
+    connection.m_rxSpeedBytes = connection.m_txSpeedBytes = 0;
+    connection.m_rxSpeedPackets = connection.m_txSpeedPackets = 0;
+    connection.m_first_seen = m_firstSeen;
+    connection.m_last_seen = std::chrono::system_clock::time_point(std::chrono::system_clock::duration(m_lastSeen.load(std::memory_order_relaxed)));
+}
+
+// Idle timeout of a flow by its protocol
+int64_t ConnectionsTable::idleTimeout(Protocol protocol) const
+{
+    if (protocol == Protocol::TCP)
+    {
+        return m_expiry.m_tcpTimeout;
+    }
+    if (protocol == Protocol::UDP)
+    {
+        return m_expiry.m_udpTimeout;
+    }
+    return m_expiry.m_icmpTimeout;
+}
+
+// Removes the flow of an expiry timer if it has been idle for its timeout at time, otherwise returns the
+// time it becomes idle so the wheel reschedules the timer
+template <int Family>
+int64_t ConnectionsTable::expireFlow(FlowTables<Family> &tables, const FlowTimer<Family> &timer, int64_t time)
+{
+    auto found = tables.m_current.find(timer.m_key);
+    // The flow was removed, or this timer belongs to an earlier flow with the same key
+    if (found == tables.m_current.end() || m_records[found->second].m_firstSeen.time_since_epoch().count() != timer.m_firstSeen)
+    {
+        return TimerWheel<FlowTimer<Family>>::DROP;
+    }
+    int64_t lastSeen = m_records[found->second].m_lastSeen.load(std::memory_order_relaxed);
+    int64_t deadline = toSeconds(std::chrono::system_clock::time_point(std::chrono::system_clock::duration(lastSeen))) + idleTimeout(timer.m_key.m_protocol);
+    if (deadline > time)
+    {
+        return deadline;
+    }
+    m_removedRecords.push_back(found->second);
+    eraseFlow(tables, found);
+    return TimerWheel<FlowTimer<Family>>::EXPIRE;
+}
+
+// Frees the record of a flow and removes it from the live table
+template <int Family>
+void ConnectionsTable::eraseFlow(FlowTables<Family> &tables, typename decltype(FlowTables<Family>::m_current)::iterator flow)
+{
+    // A stale id of the record in m_changedRecords is skipped by its cleared flag
+    m_records[flow->second].m_changed.store(false, std::memory_order_relaxed);
+    m_records.release(flow->second);
+    tables.m_current.erase(flow);
+}
+
+// Evicts the flow nearest to its idle timeout, from the family with more flows
+void ConnectionsTable::evictFlow()
+{
+    auto evictIPv4 = [this]()
+    {
+        return m_ipv4Flows.m_timers.evictOne([this](const FlowTimer<AF_INET> &timer, int64_t time)
+                                             { return expireFlow(m_ipv4Flows, timer, time); });
+    };
+    auto evictIPv6 = [this]()
+    {
+        return m_ipv6Flows.m_timers.evictOne([this](const FlowTimer<AF_INET6> &timer, int64_t time)
+                                             { return expireFlow(m_ipv6Flows, timer, time); });
+    };
+    bool evicted;
+    if (m_ipv4Flows.m_current.size() >= m_ipv6Flows.m_current.size())
+    {
+        evicted = evictIPv4() || evictIPv6();
+    }
+    else
+    {
+        evicted = evictIPv6() || evictIPv4();
+    }
+    if (evicted)
+    {
+        m_evictedFlows.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Expires flows whose idle timeout passed, only the timers due since the previous call are visited
+void ConnectionsTable::expireFlows(int64_t now)
+{
+    size_t expired = m_ipv4Flows.m_timers.advance(now, [this](const FlowTimer<AF_INET> &timer, int64_t time)
+                                                  { return expireFlow(m_ipv4Flows, timer, time); });
+    expired += m_ipv6Flows.m_timers.advance(now, [this](const FlowTimer<AF_INET6> &timer, int64_t time)
+                                            { return expireFlow(m_ipv6Flows, timer, time); });
+    m_expiredFlows.fetch_add(expired, std::memory_order_relaxed);
+}
+
+// Sets timeouts and the flow limit. Shards share the limit equally
+void ConnectionsTable::setExpiryConfig(const ExpiryConfig &config)
+{
+    m_expiry = config;
+    for (auto &shard : m_shards)
+    {
+        ExpiryConfig shardConfig = config;
+        if (config.m_maxFlows != 0)
+        {
+            shardConfig.m_maxFlows = (config.m_maxFlows + m_shards.size() - 1) / m_shards.size();
+        }
+        shard->setExpiryConfig(shardConfig);
+    }
+}
+
+// Sketch settings of this table and of its shards
+void ConnectionsTable::setSketchConfig(const SketchConfig &config)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        m_sketch = config;
+        m_sketchActive = m_sketchActive || config.m_always;
+    }
+    for (auto &shard : m_shards)
+    {
+        SketchConfig shardConfig = config;
+        if (config.m_threshold != 0)
+        {
+            shardConfig.m_threshold = (config.m_threshold + m_shards.size() - 1) / m_shards.size();
+        }
+        shard->setSketchConfig(shardConfig);
+    }
+}
+
+// Expired flows of this table and all its shards
+uint64_t ConnectionsTable::countExpiredFlows()
+{
+    uint64_t count = m_expiredFlows.load(std::memory_order_relaxed);
+    for (auto &shard : m_shards)
+    {
+        count += shard->countExpiredFlows();
+    }
+    return count;
+}
+
+// Record pool statistics of this table and all its shards
+SlabStats ConnectionsTable::slabStats()
+{
+    SlabStats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        stats = m_records.stats();
+    }
+    for (auto &shard : m_shards)
+    {
+        SlabStats shardStats = shard->slabStats();
+        stats.m_liveSlabs += shardStats.m_liveSlabs;
+        stats.m_releasedSlabs += shardStats.m_releasedSlabs;
+        stats.m_records += shardStats.m_records;
+        stats.m_capacity += shardStats.m_capacity;
+    }
+    return stats;
+}
+
+// Evicted flows of this table and all its shards
+uint64_t ConnectionsTable::countEvictedFlows()
+{
+    uint64_t count = m_evictedFlows.load(std::memory_order_relaxed);
+    for (auto &shard : m_shards)
+    {
+        count += shard->countEvictedFlows();
+    }
+    return count;
+}
+
+// Lock acquisitions of this table and all its shards
+uint64_t ConnectionsTable::countLockAcquisitions()
+{
+    uint64_t count = m_lockAcquisitions.load(std::memory_order_relaxed);
+    for (auto &shard : m_shards)
+    {
+        count += shard->m_lockAcquisitions.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+// Capture stall of this table and all its shards (ns)
+uint64_t ConnectionsTable::countCaptureStall()
+{
+    uint64_t stall = m_captureStallNs.load(std::memory_order_relaxed);
+    for (auto &shard : m_shards)
+    {
+        stall += shard->m_captureStallNs.load(std::memory_order_relaxed);
+    }
+    return stall;
+}
+
+// Calculates speed of transfer for the connections that changed since the previous call, against their
+// published state from that call. Connections are re-ranked as they change, so the published top of every
+// sort key costs O(changed flows * log n + m_snapshotSize) instead of sorting the whole table. The live table
+// is locked only while the changed counters are copied
+void ConnectionsTable::calculateSpeed()
+{
+    // Worker shards are independent tables
+    for (auto &shard : m_shards)
+    {
+        shard->calculateSpeed();
+    }
+
+    // Rate of lock acquisitions and of capture stall since the previous call
+    uint64_t lockAcquisitions = countLockAcquisitions();
+    uint64_t captureStall = countCaptureStall();
+    auto lockRateTime = now();
+    double lockRateSeconds = std::chrono::duration<double>(lockRateTime - m_lockRateTime).count();
+    if (m_lockRateTime.time_since_epoch().count() != 0 && lockRateSeconds > 0)
+    {
+        m_lockRate = (lockAcquisitions - m_lockAcquisitionsBefore) / lockRateSeconds;
+        m_captureStallRate = (captureStall - m_captureStallBefore) / 1e6 / lockRateSeconds;
+    }
+    m_lockAcquisitionsBefore = lockAcquisitions;
+    m_captureStallBefore = captureStall;
+    m_lockRateTime = lockRateTime;
+
+    std::lock_guard<std::mutex> publishLock(m_publishMutex);
+    auto currentTime = now();
+    // Exact time since the previous call on a monotonic clock, so rates are not rounded to whole seconds
+    std::chrono::nanoseconds tickTime = monotonicNow();
+    double timeDeltaSeconds = 0;
+    if (m_tick > 0)
+    {
+        timeDeltaSeconds = std::chrono::duration<double>(tickTime - m_previousTick).count();
+    }
+    m_tick++;
+    // Averaging windows move to this tick. After a rescale the scores of all rows changed
+    bool rescaled = m_columns.advance(tickTime);
+
+    // Drop the rows of removed flows, then copy the changed counters. This is the only work done under the
+    // table lock. The flow maps have two writers, both under the table lock: capture, which adds flows and
+    // expires idle ones, and expireIdle from the statistics tick while capture is idle. Capture updates
+    // existing flows without the lock inside an IngestScope, which expireIdle never overlaps (m_ingesting and
+    // m_idleExpiry). Flows either of them removed are listed in m_removedRecords. A removed record may already
+    // hold a new flow, which then starts in a fresh row
+    m_changedRows.clear();
+    m_changedTraffic.clear();
+    auto snapshot = std::make_shared<TableSnapshot>();
+    RollupTraffic tickTraffic;
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        m_removedRows.swap(m_removedRecords);
+        for (uint32_t row : m_removedRows)
+        {
+            removeRow(row);
+        }
+        m_removedRecords.clear();
+        copyChanged();
+        // Largest flows of the sketch and the traffic it counted since the previous call
+        snapshot->m_sketch = m_sketchActive;
+        if (m_heavyHitters.configured())
+        {
+            m_heavyHitters.top(m_snapshotSize, timeDeltaSeconds, snapshot->m_heavyHitters);
+            snapshot->m_sketchConfidence = m_heavyHitters.confidence();
+            snapshot->m_sketchMemory = m_heavyHitters.memoryUsage();
+            RollupTraffic totals;
+            m_heavyHitters.totals(totals.m_bytesSent, totals.m_bytesReceived, totals.m_packets);
+            tickTraffic = {totals.m_bytesSent - m_sketchTotals.m_bytesSent, totals.m_bytesReceived - m_sketchTotals.m_bytesReceived,
+                           totals.m_packets - m_sketchTotals.m_packets};
+            m_sketchTotals = totals;
+        }
+    }
+    // History and rollups of the changed rows, outside of the table lock
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(currentTime.time_since_epoch()).count();
+    for (size_t i = 0; i < m_changedRows.size(); i++)
+    {
+        m_flowHistory.record(m_changedRows[i], second, m_changedTraffic[i].bytes());
+    }
+    for (const RollupTraffic &traffic : m_changedTraffic)
+    {
+        tickTraffic.add(traffic);
+    }
+    {
+        std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+        m_rollups->addInterface(second, tickTraffic);
+        if (m_rollups->hostLimit() != 0)
+        {
+            for (size_t i = 0; i < m_changedRows.size(); i++)
+            {
+                m_rollups->addHosts(second, m_columns.m_ID[m_changedRows[i]], m_changedTraffic[i]);
+            }
+        }
+    }
+
+    // Sparse changes are ranked one by one, when most flows changed a sweep of the columns is cheaper
+    bool dense = rescaled || m_changedRows.size() + m_movingRows.size() > m_activeRows / DENSE_SHARE;
+    if (dense)
+    {
+        rankAll(timeDeltaSeconds);
+    }
+    else
+    {
+        rankChanged(timeDeltaSeconds);
+    }
+    rankMatches(dense);
+    std::swap(m_movingRows, m_changedRows);
+    m_previousTick = tickTime;
+
+    // Publish the top of this table merged with the tops of the shards
+    snapshot->m_time = currentTime;
+    snapshot->m_flowCount = m_activeRows;
+    snapshot->m_lockRate = m_lockRate;
+    snapshot->m_captureStallRate = m_captureStallRate;
+    std::vector<uint32_t> topRows;
+    for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
+    {
+        std::vector<Connection> &top = snapshot->m_top[sortKey];
+        m_ranking[sortKey].top(m_snapshotSize, topRows);
+        top.resize(topRows.size());
+        for (size_t i = 0; i < topRows.size(); i++)
+        {
+            readRow(topRows[i], second, top[i]);
+        }
+    }
+    for (auto &shard : m_shards)
+    {
+        std::shared_ptr<const TableSnapshot> shardSnapshot = shard->getSnapshot();
+        if (!shardSnapshot)
+        {
+            continue;
+        }
+        snapshot->m_flowCount += shardSnapshot->m_flowCount;
+        snapshot->m_sketch = snapshot->m_sketch || shardSnapshot->m_sketch;
+        snapshot->m_heavyHitters.insert(snapshot->m_heavyHitters.end(), shardSnapshot->m_heavyHitters.begin(),
+                                        shardSnapshot->m_heavyHitters.end());
+        snapshot->m_sketchConfidence = std::max(snapshot->m_sketchConfidence, shardSnapshot->m_sketchConfidence);
+        snapshot->m_sketchMemory += shardSnapshot->m_sketchMemory;
+        for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
+        {
+            std::vector<Connection> &top = snapshot->m_top[sortKey];
+            top.insert(top.end(), shardSnapshot->m_top[sortKey].begin(), shardSnapshot->m_top[sortKey].end());
+        }
+    }
+    // Tops of the shards are already sorted, merging them needs only their few rows
+    if (!m_shards.empty())
+    {
+        for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
+        {
+            std::vector<Connection> &top = snapshot->m_top[sortKey];
+            sortConnections(static_cast<SortBy>(sortKey), top);
+            if (top.size() > m_snapshotSize)
+            {
+                top.resize(m_snapshotSize);
+            }
+        }
+        std::vector<HeavyHitter> &hitters = snapshot->m_heavyHitters;
+        std::sort(hitters.begin(), hitters.end(), [](const HeavyHitter &first, const HeavyHitter &second)
+                  { return first.m_estimate > second.m_estimate; });
+        if (hitters.size() > m_snapshotSize)
+        {
+            hitters.resize(m_snapshotSize);
+        }
+    }
+    m_snapshot.store(std::move(snapshot));
+}
+
+// Counters, speeds and sparkline of a row
+void ConnectionsTable::readRow(uint32_t row, int64_t second, Connection &connection)
+{
+    m_columns.read(row, connection);
+    if (m_flowHistory.budget() != 0)
+    {
+        m_flowHistory.read(row, m_samples);
+        FlowHistory::sparkline(m_samples, second, SPARKLINE_WIDTH, SPARKLINE_SECONDS, connection.m_sparkline);
+    }
+}
+
+// With shards the flows are ordered by score, then by shard (this table first), then by row. The window starts
+// in every table after as many of its flows as rank before first overall, found by a binary search over the
+// ranks of the table. The rank of a flow overall is its rank in its table plus the flows of the other tables
+// ranked before it, each a binary search as well, O(tables^2 * log^2 n) in total. The windows are then merged.
+// A filter ranks the flows it matches in a ranking of every table, which is read the same way
+size_t ConnectionsTable::getRange(SortBy sortBy, size_t first, size_t count, std::vector<Connection> &connections,
+                                  const FlowFilter *filter)
+{
+    std::vector<ConnectionsTable *> tables{this};
+    for (auto &shard : m_shards)
+    {
+        tables.push_back(shard.get());
+    }
+    if (filter != nullptr && filter->empty())
+    {
+        filter = nullptr;
+    }
+    // The scan of new match sets takes the publish lock of one table a chunk at a time, so ticks go on
+    if (filter != nullptr)
+    {
+        for (ConnectionsTable *table : tables)
+        {
+            table->scanMatches(*filter, sortBy);
+        }
+    }
+    std::vector<std::unique_lock<std::mutex>> publishLocks;
+    std::vector<RankHeap *> rankings;
+    size_t ranked = 0;
+    for (ConnectionsTable *table : tables)
+    {
+        publishLocks.emplace_back(table->m_publishMutex);
+        // Only the ranking shown keeps its order, the others stop listing their changes until they are shown
+        for (size_t key = 0; key < SORT_KEYS; key++)
+        {
+            if (key == static_cast<size_t>(sortBy))
+            {
+                table->m_ranking[key].keepOrder();
+            }
+            else
+            {
+                table->m_ranking[key].dropOrder();
+            }
+        }
+        // Without a filter the match set is no longer updated
+        if (filter == nullptr && table->m_matchKey >= 0)
+        {
+            table->m_matchKey = -1;
+            table->m_matches.clear();
+            std::fill(table->m_matchState.begin(), table->m_matchState.end(), MATCH_UNCHECKED);
+        }
+        rankings.push_back(filter != nullptr ? &table->m_matches : &table->m_ranking[sortBy]);
+        ranked += rankings.back()->size();
+    }
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now().time_since_epoch()).count();
+    connections.clear();
+
+    std::vector<uint32_t> rows;
+    if (tables.size() == 1)
+    {
+        rankings[0]->range(first, count, rows);
+        connections.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            readRow(rows[i], second, connections[i]);
+        }
+        return ranked;
+    }
+
+    // Flows of the other tables ranked before the flow at rank in table
+    auto rankOverall = [&rankings](size_t table, size_t rank)
+    {
+        RankHeap &ranking = *rankings[table];
+        double score = ranking.score(ranking.at(rank));
+        size_t before = rank;
+        for (size_t other = 0; other < rankings.size(); other++)
+        {
+            if (other != table)
+            {
+                before += rankings[other]->countBetter(score, other < table ? UINT32_MAX : 0);
+            }
+        }
+        return before;
+    };
+    std::vector<size_t> next(tables.size());
+    for (size_t table = 0; table < tables.size(); table++)
+    {
+        size_t low = 0;
+        size_t high = std::min(rankings[table]->size(), first);
+        while (low < high)
+        {
+            size_t middle = (low + high) / 2;
+            if (rankOverall(table, middle) < first)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        next[table] = low;
+    }
+
+    // Merge of the windows, the best next flow of all tables each time
+    while (connections.size() < count)
+    {
+        size_t best = tables.size();
+        double bestScore = 0;
+        for (size_t table = 0; table < tables.size(); table++)
+        {
+            RankHeap &ranking = *rankings[table];
+            if (next[table] >= ranking.size())
+            {
+                continue;
+            }
+            double score = ranking.score(ranking.at(next[table]));
+            if (best == tables.size() || score > bestScore)
+            {
+                best = table;
+                bestScore = score;
+            }
+        }
+        if (best == tables.size())
+        {
+            break;
+        }
+        RankHeap &ranking = *rankings[best];
+        connections.emplace_back();
+        tables[best]->readRow(ranking.at(next[best]++), second, connections.back());
+    }
+    return ranked;
+}
+
+// Copy changed connections into their rows and reset their changed flag
+void ConnectionsTable::copyChanged()
+{
+    m_changedRecords.drain([this](uint32_t row)
+                           {
+        // Removed in the meantime (slab released or flag cleared), or listed twice because the record was
+        // reused. Clearing the flag pairs with the exchange in updateExisting, the counters read below
+        // include everything added before it
+        if (!m_records.isAllocated(row) || !m_records[row].m_changed.exchange(false, std::memory_order_acq_rel))
+        {
+            return;
+        }
+        // Rows grow a slab at a time
+        if (row >= m_columns.size())
+        {
+            size_t rows = (static_cast<size_t>(row >> SlabPool<FlowRecord>::SLAB_SHIFT) + 1) << SlabPool<FlowRecord>::SLAB_SHIFT;
+            m_columns.resize(rows);
+            m_rowTick.resize(rows, 0);
+            m_matchState.resize(rows, MATCH_UNCHECKED);
+            if (m_flowHistory.budget() != 0)
+            {
+                m_flowHistory.resize(rows);
+            }
+        }
+        const FlowRecord &record = m_records[row];
+        RollupTraffic gained{m_columns.m_bytesSent[row], m_columns.m_bytesReceived[row],
+                             m_columns.m_packetsSent[row] + m_columns.m_packetsReceived[row]};
+        m_columns.m_bytesSent[row] = record.m_bytesSent.load(std::memory_order_relaxed);
+        m_columns.m_bytesReceived[row] = record.m_bytesReceived.load(std::memory_order_relaxed);
+        m_columns.m_packetsSent[row] = record.m_packetsSent.load(std::memory_order_relaxed);
+        m_columns.m_packetsReceived[row] = record.m_packetsReceived.load(std::memory_order_relaxed);
+        m_columns.m_lastSeen[row] = std::chrono::system_clock::time_point(std::chrono::system_clock::duration(record.m_lastSeen.load(std::memory_order_relaxed)));
+        // New flow, its first speed is zero
+        if (m_rowTick[row] == 0)
+        {
+            m_columns.setID(row, record.m_ID);
+            m_columns.m_ipFamily[row] = record.m_ipFamily;
+            m_columns.m_firstSeen[row] = record.m_firstSeen;
+            m_columns.startRow(row);
+            m_activeRows++;
+        }
+        m_rowTick[row] = m_tick;
+        m_changedRows.push_back(row);
+        // Rows of new flows start from zero, so they gain all their traffic
+        gained.m_bytesSent = m_columns.m_bytesSent[row] - gained.m_bytesSent;
+        gained.m_bytesReceived = m_columns.m_bytesReceived[row] - gained.m_bytesReceived;
+        gained.m_packets = m_columns.m_packetsSent[row] + m_columns.m_packetsReceived[row] - gained.m_packets;
+        m_changedTraffic.push_back(gained); });
 }
 
-// Updates connection depending on what it does (sends or receives)
-void ConnectionsTable::updateConnection(const ConnectionID &id, bool isSending, uint64_t byteCount)
+// Speed of every changed row against the previous tick, rows that moved in the previous call but not in this
+// one get zero speed by the same computation
+void ConnectionsTable::rankChanged(double timeDeltaSeconds)
 {
-    // Lock the table
-    std::lock_guard<std::mutex> lock(m_tableMutex);
-    // Find connection
-    auto currentConnection = m_connectionsTable.find(id);
-
-    if (currentConnection != m_connectionsTable.end())
+    for (uint32_t row : m_changedRows)
     {
-        Connection &connection = currentConnection->second;
-        connection.m_last_seen = std::chrono::system_clock::now();
-        // Sending -> increment bytes and packets sent
-        if (isSending)
-        {
-            connection.m_bytesSent += byteCount;
-            connection.m_packetsSent += 1;
-        }
-        // Receiving -> increment bytes and packets received
-        else
+        m_columns.computeRates(row, row + 1, timeDeltaSeconds);
+        for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
         {
-            connection.m_bytesReceived += byteCount;
-            connection.m_packetsReceived += 1;
+            if (sortKeyEnabled(sortKey))
+            {
+                m_ranking[sortKey].update(row, rowScore(static_cast<SortBy>(sortKey), row));
+            }
         }
     }
-    // Otherwise its new connection. Create new Connection object
-    else
+    for (uint32_t row : m_movingRows)
     {
-        // Initialization
-        Connection newConnection;
-        newConnection.m_ID = id;
-
-        if (id.getSrcEndPoint().sin6_family == AF_INET6)
+        if (m_rowTick[row] != 0 && m_rowTick[row] != m_tick)
         {
-            newConnection.m_ipFamily = IPFamily::IPv6;
+            m_columns.computeRates(row, row + 1, timeDeltaSeconds);
+            m_ranking[BY_RATE].update(row, 0);
+            m_ranking[BY_RX_RATE].update(row, 0);
+            m_ranking[BY_TX_RATE].update(row, 0);
         }
-        else
+    }
+}
+
+// Speeds of all rows in one linear sweep over the columns. Rows without a change get zero speed and free rows
+// are zero, so the sweep needs no list of rows. The rankings are rebuilt from the rows with a flow
+void ConnectionsTable::rankAll(double timeDeltaSeconds)
+{
+    m_columns.computeRates(0, m_columns.size(), timeDeltaSeconds);
+    m_rankedRows.clear();
+    for (uint32_t row = 0; row < m_rowTick.size(); row++)
+    {
+        if (m_rowTick[row] != 0)
         {
-            newConnection.m_ipFamily = IPFamily::IPv4;
+            m_rankedRows.push_back(row);
         }
-
-        auto now = std::chrono::system_clock::now();
-        newConnection.m_first_seen = now;
-        newConnection.m_last_seen = now;
-
-        if (isSending)
+    }
+    m_rowScores.resize(m_columns.size());
+    for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
+    {
+        if (!sortKeyEnabled(sortKey))
         {
-            newConnection.m_bytesSent = byteCount;
-            newConnection.m_packetsSent = 1;
-            newConnection.m_bytesReceived = 0;
-            newConnection.m_packetsReceived = 0;
+            continue;
         }
-        else
+        for (uint32_t row : m_rankedRows)
         {
-            newConnection.m_bytesSent = 0;
-            newConnection.m_packetsSent = 0;
-            newConnection.m_bytesReceived = byteCount;
-            newConnection.m_packetsReceived = 1;
+            m_rowScores[row] = rowScore(static_cast<SortBy>(sortKey), row);
         }
+        m_ranking[sortKey].build(m_rankedRows, m_rowScores);
+    }
+}
 
-        m_connectionsTable.insert({id, newConnection});
+// Value a row is ranked by, same order as rankScore. Averaged speeds rank by their decayed bytes, which
+// differ from the speeds by a factor common to all rows
+double ConnectionsTable::rowScore(SortBy sortBy, uint32_t row) const
+{
+    if (sortBy == SortBy::BY_PACKETS)
+    {
+        return static_cast<double>(m_columns.m_packetsReceived[row] + m_columns.m_packetsSent[row]);
+    }
+    if (sortBy == SortBy::BY_RATE)
+    {
+        return m_columns.m_rxSpeedBytes[row] + m_columns.m_txSpeedBytes[row];
+    }
+    if (sortBy == SortBy::BY_RX_RATE)
+    {
+        return m_columns.m_rxSpeedBytes[row];
+    }
+    if (sortBy == SortBy::BY_TX_RATE)
+    {
+        return m_columns.m_txSpeedBytes[row];
+    }
+    if (sortBy == SortBy::BY_RATE_10S)
+    {
+        return m_columns.m_decayedBytes[WINDOW_10S][row];
+    }
+    if (sortBy == SortBy::BY_RATE_40S)
+    {
+        return m_columns.m_decayedBytes[WINDOW_40S][row];
+    }
+    if (sortBy == SortBy::BY_RATE_EWMA)
+    {
+        return m_columns.m_decayedBytes[WINDOW_EWMA][row];
     }
+    return static_cast<double>(m_columns.m_bytesReceived[row] + m_columns.m_bytesSent[row]);
 }
 
-// Calculates speed of transfer for all connections that are currently in the connection table
-// To achieve this, ConnectionTableBefore is used. It represents ConnectionsTableState 1 second ago
-void ConnectionsTable::calculateSpeed()
+// Only the EWMA window can be switched off
+bool ConnectionsTable::sortKeyEnabled(int sortKey) const
 {
-    // Lock the table
-    std::lock_guard<std::mutex> lock(m_tableMutex);
-    auto now = std::chrono::system_clock::now();
+    return sortKey != SortBy::BY_RATE_EWMA || m_columns.m_windowSeconds[WINDOW_EWMA] > 0;
+}
 
-    for (auto &pair : m_connectionsTable)
+// EWMA window of this table and of its shards
+void ConnectionsTable::setEwmaWindow(double seconds)
+{
+    std::lock_guard<std::mutex> publishLock(m_publishMutex);
+    m_columns.m_windowSeconds[WINDOW_EWMA] = seconds;
+    for (auto &shard : m_shards)
     {
-        const ConnectionID &connectionID = pair.first;
-        Connection &current = pair.second;
+        shard->setEwmaWindow(seconds);
+    }
+}
 
-        // Find the previous state
-        auto before = m_connectionsTableBefore.find(connectionID);
-        if (before != m_connectionsTableBefore.end())
-        {
-            Connection &connectionBefore = before->second;
+// Time constant of the EWMA speed, 0 = off
+double ConnectionsTable::ewmaWindow() const
+{
+    return m_columns.m_windowSeconds[WINDOW_EWMA];
+}
 
-            double timeDeltaSeconds = std::chrono::duration_cast<std::chrono::seconds>(now - connectionBefore.m_last_seen).count();
-            // Connection is active
-            if (timeDeltaSeconds > 0)
-            {
-                // Speed calculation
-                current.m_rxSpeedBytes = (current.m_bytesReceived - connectionBefore.m_bytesReceived) / timeDeltaSeconds;
-                current.m_txSpeedBytes = (current.m_bytesSent - connectionBefore.m_bytesSent) / timeDeltaSeconds;
+// History budget of this table and of its shards
+void ConnectionsTable::setHistoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> publishLock(m_publishMutex);
+    m_flowHistory.setBudget(bytes);
+    m_flowHistory.resize(bytes != 0 ? m_columns.size() : 0);
+    for (auto &shard : m_shards)
+    {
+        shard->setHistoryBudget(bytes);
+    }
+}
 
-                current.m_rxSpeedPackets = (current.m_packetsReceived - connectionBefore.m_packetsReceived) / timeDeltaSeconds;
-                current.m_txSpeedPackets = (current.m_packetsSent - connectionBefore.m_packetsSent) / timeDeltaSeconds;
-            }
-            // Connection is inactive, set speeds to 0
-            else
-            {
-                current.m_rxSpeedBytes = 0;
-                current.m_txSpeedBytes = 0;
-                current.m_rxSpeedPackets = 0;
-                current.m_txSpeedPackets = 0;
-            }
+// Bytes of history per flow, 0 = off
+size_t ConnectionsTable::historyBudget() const
+{
+    return m_flowHistory.budget();
+}
+
+// Compressed history of this table and all its shards
+size_t ConnectionsTable::historyMemory()
+{
+    size_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> publishLock(m_publishMutex);
+        bytes = m_flowHistory.memoryUsage();
+    }
+    for (auto &shard : m_shards)
+    {
+        bytes += shard->historyMemory();
+    }
+    return bytes;
+}
+
+// Host slots of the rollups, shared by this table and its shards
+void ConnectionsTable::setRollupHosts(size_t hosts)
+{
+    std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+    m_rollups->setHostLimit(hosts);
+}
+
+// Number of host slots, 0 = only the interface
+size_t ConnectionsTable::rollupHosts()
+{
+    std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+    return m_rollups->hostLimit();
+}
+
+// Interface and busiest hosts over the spans ending now
+void ConnectionsTable::rollupSummary(size_t hosts, std::vector<RollupSummary> &rows)
+{
+    int64_t second = toSeconds(now());
+    std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+    m_rollups->summary(second, hosts, rows);
+}
+
+// Memory of the rollups, flat once every host slot is used
+size_t ConnectionsTable::rollupMemory()
+{
+    std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+    return m_rollups->memoryUsage();
+}
+
+// Drop the row of a removed flow and its ranks
+void ConnectionsTable::removeRow(uint32_t row)
+{
+    if (row >= m_rowTick.size() || m_rowTick[row] == 0)
+    {
+        return;
+    }
+    for (int sortKey = 0; sortKey < SORT_KEYS; sortKey++)
+    {
+        m_ranking[sortKey].erase(row);
+    }
+    m_matches.erase(row);
+    m_matchState[row] = MATCH_UNCHECKED;
+    m_columns.clear(row);
+    m_flowHistory.clear(row);
+    m_rowTick[row] = 0;
+    m_activeRows--;
+}
+
+// A new filter is checked on every row again, a new key only ranks the rows known to match by it. The lock is
+// let go between chunks, rows published meanwhile are checked by calculateSpeed
+void ConnectionsTable::scanMatches(const FlowFilter &filter, SortBy sortBy)
+{
+    {
+        std::lock_guard<std::mutex> publishLock(m_publishMutex);
+        if (m_matchKey == sortBy && m_matchFilter.text() == filter.text())
+        {
+            return;
         }
-        // No previous data at all, set speeds to 0
-        else
+        if (m_matchKey < 0 || m_matchFilter.text() != filter.text())
+        {
+            m_matchFilter = filter;
+            std::fill(m_matchState.begin(), m_matchState.end(), MATCH_UNCHECKED);
+        }
+        m_matchKey = sortBy;
+        m_matches.clear();
+        m_matchScanned = 0;
+    }
+    bool done = false;
+    while (!done)
+    {
+        std::lock_guard<std::mutex> publishLock(m_publishMutex);
+        size_t end = std::min(m_matchScanned + MATCH_SCAN_ROWS, m_rowTick.size());
+        for (size_t row = m_matchScanned; row < end; row++)
         {
-            current.m_rxSpeedBytes = 0;
-            current.m_txSpeedBytes = 0;
-            current.m_rxSpeedPackets = 0;
-            current.m_txSpeedPackets = 0;
+            if (m_rowTick[row] != 0)
+            {
+                refreshMatch(static_cast<uint32_t>(row));
+            }
         }
+        m_matchScanned = end;
+        done = end == m_rowTick.size();
+    }
+}
 
-        // Update connectionsTableBefore and last seen
-        current.m_last_seen = now;
-        m_connectionsTableBefore[connectionID] = current;
+// After a rebuild every score may have changed, the matching rows are rebuilt the same way. Rows the scan has
+// not reached yet are ranked when it does
+void ConnectionsTable::rankMatches(bool rebuilt)
+{
+    if (m_matchKey < 0)
+    {
+        return;
+    }
+    for (uint32_t row : m_changedRows)
+    {
+        refreshMatch(row);
     }
-    // Clean up connectionsTableBefore
-    for (auto current = m_connectionsTableBefore.begin(); current != m_connectionsTableBefore.end();)
+    if (!rebuilt)
     {
-        if (m_connectionsTable.find(current->first) == m_connectionsTable.end())
+        for (uint32_t row : m_movingRows)
         {
-            current = m_connectionsTableBefore.erase(current);
+            if (m_rowTick[row] != 0)
+            {
+                refreshMatch(row);
+            }
         }
-        else
+        return;
+    }
+    const RankHeap &ranking = m_ranking[m_matchKey];
+    m_rankedRows.clear();
+    for (uint32_t row = 0; row < m_matchState.size(); row++)
+    {
+        if (m_matchState[row] == MATCH_YES && ranking.contains(row))
         {
-            current++;
+            m_rankedRows.push_back(row);
+            m_rowScores[row] = ranking.score(row);
         }
     }
+    m_matches.build(m_rankedRows, m_rowScores);
+}
+
+// Keys and endpoints of a row never change, a row is checked once per filter
+void ConnectionsTable::refreshMatch(uint32_t row)
+{
+    if (m_matchState[row] == MATCH_UNCHECKED)
+    {
+        m_matchState[row] = m_matchFilter.matches(m_columns.m_ID[row], m_columns.m_srcText[row], m_columns.m_destText[row])
+                                ? MATCH_YES
+                                : MATCH_NO;
+    }
+    const RankHeap &ranking = m_ranking[m_matchKey];
+    if (m_matchState[row] == MATCH_YES && ranking.contains(row))
+    {
+        m_matches.update(row, ranking.score(row));
+    }
+    else
+    {
+        m_matches.erase(row);
+    }
+}
+
+// Last published snapshot
+std::shared_ptr<const TableSnapshot> ConnectionsTable::getSnapshot() const
+{
+    return m_snapshot.load();
 }
 
 // Sorts connections either by bytes or by packets and returns sorted connections represented as list (vector)
 void ConnectionsTable::getSortedConnections(SortBy sortBy, std::vector<Connection> &outputVector)
 {
-    // Lock the table
-    std::lock_guard<std::mutex> lock(m_tableMutex);
-
-    std::vector<std::pair<ConnectionID, Connection>> connections(m_connectionsTable.begin(), m_connectionsTable.end());
+    // Merge this table with worker shards. Fanout keeps every flow on one worker, so shards never overlap
+    outputVector.clear();
+    collectConnections(outputVector);
+    for (auto &shard : m_shards)
+    {
+        shard->collectConnections(outputVector);
+    }
+    sortConnections(sortBy, outputVector);
+}
 
+// Sorts connections by bytes, packets or current speed
+void ConnectionsTable::sortConnections(SortBy sortBy, std::vector<Connection> &outputVector)
+{
     // Use std::sort to get connections sorted by bytes
     if (sortBy == SortBy::BY_BYTES)
     {
-        std::sort(connections.begin(), connections.end(), [](const std::pair<ConnectionID, Connection> &first, const std::pair<ConnectionID, Connection> &second)
-                  { return (first.second.m_bytesReceived + first.second.m_bytesSent) > (second.second.m_bytesReceived + second.second.m_bytesSent); });
+        std::sort(outputVector.begin(), outputVector.end(), [](const Connection &first, const Connection &second)
+                  { return (first.m_bytesReceived + first.m_bytesSent) > (second.m_bytesReceived + second.m_bytesSent); });
     }
     // Use std::sort to get connections sorted by packets
     else if (sortBy == SortBy::BY_PACKETS)
     {
-        std::sort(connections.begin(), connections.end(), [](const std::pair<ConnectionID, Connection> &first, const std::pair<ConnectionID, Connection> &second)
-                  { return (first.second.m_packetsReceived + first.second.m_packetsSent) > (second.second.m_packetsReceived + second.second.m_packetsSent); });
+        std::sort(outputVector.begin(), outputVector.end(), [](const Connection &first, const Connection &second)
+                  { return (first.m_packetsReceived + first.m_packetsSent) > (second.m_packetsReceived + second.m_packetsSent); });
+    }
+    // Use std::sort to get connections sorted by current speed
+    else if (sortBy == SortBy::BY_RATE)
+    {
+        std::sort(outputVector.begin(), outputVector.end(), [](const Connection &first, const Connection &second)
+                  { return (first.m_rxSpeedBytes + first.m_txSpeedBytes) > (second.m_rxSpeedBytes + second.m_txSpeedBytes); });
+    }
+    // Use std::sort to get connections sorted by a speed of one direction or an averaged speed
+    else
+    {
+        std::sort(outputVector.begin(), outputVector.end(), [sortBy](const Connection &first, const Connection &second)
+                  { return rankScore(sortBy, first) > rankScore(sortBy, second); });
     }
+}
 
-    // Fill up output vector
-    outputVector.clear();
-    for (const auto &current : connections)
+// Value connections are ranked by, same order as sortConnections
+double ConnectionsTable::rankScore(SortBy sortBy, const Connection &connection)
+{
+    if (sortBy == SortBy::BY_PACKETS)
+    {
+        return static_cast<double>(connection.m_packetsReceived + connection.m_packetsSent);
+    }
+    if (sortBy == SortBy::BY_RATE)
+    {
+        return connection.m_rxSpeedBytes + connection.m_txSpeedBytes;
+    }
+    if (sortBy == SortBy::BY_RX_RATE)
+    {
+        return connection.m_rxSpeedBytes;
+    }
+    if (sortBy == SortBy::BY_TX_RATE)
+    {
+        return connection.m_txSpeedBytes;
+    }
+    if (sortBy == SortBy::BY_RATE_10S)
+    {
+        return connection.m_speed10s;
+    }
+    if (sortBy == SortBy::BY_RATE_40S)
+    {
+        return connection.m_speed40s;
+    }
+    if (sortBy == SortBy::BY_RATE_EWMA)
+    {
+        return connection.m_speedEwma;
+    }
+    return static_cast<double>(connection.m_bytesReceived + connection.m_bytesSent);
+}
+
+// Copies connections of this table into outputVector
+void ConnectionsTable::collectConnections(std::vector<Connection> &outputVector)
+{
+    // Lock the table
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+
+    outputVector.reserve(outputVector.size() + m_ipv4Flows.m_current.size() + m_ipv6Flows.m_current.size());
+    for (const auto &current : m_ipv4Flows.m_current)
+    {
+        outputVector.emplace_back();
+        m_records[current.second].read(outputVector.back());
+    }
+    for (const auto &current : m_ipv6Flows.m_current)
+    {
+        outputVector.emplace_back();
+        m_records[current.second].read(outputVector.back());
+    }
+}
+
+// Copies the published state of all flows of this table and its shards into outputVector
+void ConnectionsTable::collectPublished(std::vector<Connection> &outputVector, bool withHistory)
+{
+    {
+        std::lock_guard<std::mutex> publishLock(m_publishMutex);
+        outputVector.reserve(outputVector.size() + m_activeRows);
+        for (uint32_t row = 0; row < m_rowTick.size(); row++)
+        {
+            // Free rows have no tick
+            if (m_rowTick[row] != 0)
+            {
+                outputVector.emplace_back();
+                m_columns.read(row, outputVector.back());
+                if (withHistory)
+                {
+                    HistorySummary summary = m_flowHistory.summary(row);
+                    outputVector.back().m_historyStart = summary.m_firstSecond;
+                    outputVector.back().m_activeSeconds = summary.m_activeSeconds;
+                    outputVector.back().m_peakSecondBytes = summary.m_peakBytes;
+                }
+            }
+        }
+    }
+    for (auto &shard : m_shards)
+    {
+        shard->collectPublished(outputVector, withHistory);
+    }
+}
+
+// Decodes the samples under the publish lock of each table, they are written out after it is released
+void ConnectionsTable::collectHistory(std::vector<Connection> &connections, std::vector<HistorySample> &samples,
+                                      std::vector<size_t> &sampleEnds)
+{
+    {
+        std::lock_guard<std::mutex> publishLock(m_publishMutex);
+        for (uint32_t row = 0; row < m_rowTick.size(); row++)
+        {
+            if (m_rowTick[row] == 0)
+            {
+                continue;
+            }
+            m_flowHistory.read(row, m_samples);
+            if (m_samples.empty())
+            {
+                continue;
+            }
+            connections.emplace_back();
+            m_columns.read(row, connections.back());
+            samples.insert(samples.end(), m_samples.begin(), m_samples.end());
+            sampleEnds.push_back(samples.size());
+        }
+    }
+    for (auto &shard : m_shards)
+    {
+        shard->collectHistory(connections, samples, sampleEnds);
+    }
+}
+
+// Number of flows of both address families
+size_t ConnectionsTable::size()
+{
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+    return m_ipv4Flows.m_current.size() + m_ipv6Flows.m_current.size();
+}
+
+// Current time, either system time or the simulated time of replayed packets
+std::chrono::system_clock::time_point ConnectionsTable::now()
+{
+    if (m_simulatedClock)
+    {
+        return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(m_simulatedTime.load()));
+    }
+    return std::chrono::system_clock::now();
+}
+
+// Monotonic time, the simulated clock follows packet timestamps which only move forward
+std::chrono::nanoseconds ConnectionsTable::monotonicNow()
+{
+    if (m_simulatedClock)
     {
-        outputVector.push_back(current.second);
+        return std::chrono::system_clock::duration(m_simulatedTime.load());
     }
+    return std::chrono::steady_clock::now().time_since_epoch();
+}
+
+// Switch between system and simulated clock
+void ConnectionsTable::setSimulatedClock(bool enabled)
+{
+    m_simulatedClock = enabled;
+}
+
+// Move simulated clock to the timestamp of the packet being replayed
+void ConnectionsTable::setSimulatedTime(std::chrono::system_clock::time_point time)
+{
+    m_simulatedTime = time.time_since_epoch().count();
+}
+
+// Creates a new shard for a capture worker
+ConnectionsTable &ConnectionsTable::addShard()
+{
+    m_shards.push_back(std::make_unique<ConnectionsTable>());
+    // Shards add to the rollups of this table
+    m_shards.back()->m_rollups = m_rollups;
+    return *m_shards.back();
 }
 
 // Gets top connections (truncates the vector from getSortedConnections)
@@ -217,28 +1451,88 @@ void ConnectionsTable::setLogFileStream()
         // If stream is opened, make header
         else
         {
-            *m_logFileStream << "timestamp,protocol,src_ip,src_port,dst_ip,dst_port,bytes_sent,bytes_received,packets_sent,packets_received\n";
+            *m_logFileStream << LOG_HEADER;
             m_logFileStream->flush();
         }
+        // The rollup log is appended to, a restart continues it
+        std::error_code error;
+        bool emptyRollupLog = !std::filesystem::exists(rollupLogPath(), error) || std::filesystem::file_size(rollupLogPath(), error) == 0;
+        std::ofstream rollupLog(rollupLogPath(), std::ios::out | std::ios::app);
+        if (!rollupLog.is_open())
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (emptyRollupLog)
+        {
+            rollupLog << "start,resolution,scope,bytes_sent,bytes_received,packets\n";
+        }
     }
 }
-// Extract ip and port from endpoint string
-void ConnectionsTable::parseEndpoint(const std::string &endpoint, std::string &ip, std::string &port)
+// Writes fields of log rows into a row buffer, every field is followed by separator
+class LogFields
+{
+public:
+    explicit LogFields(char *row, size_t length) : m_end(row), m_limit(row + length) {}
+
+    template <typename Number>
+    void number(Number value, char separator = ',')
+    {
+        m_end = std::to_chars(m_end, m_limit, value).ptr;
+        *m_end++ = separator;
+    }
+    void text(std::string_view value)
+    {
+        std::memcpy(m_end, value.data(), value.size());
+        m_end += value.size();
+        *m_end++ = ',';
+    }
+    void empty(char separator = ',')
+    {
+        *m_end++ = separator;
+    }
+    // Protocol and both endpoints of the flow
+    void endpoints(const Connection &connection)
+    {
+        text(Display::protocolToStr(connection.m_ID.getProtocol()));
+        text(connection.m_srcText.view());
+        number(connection.m_ID.getSrcPort());
+        text(connection.m_destText.view());
+        number(connection.m_ID.getDestPort());
+    }
+    char *end() const
+    {
+        return m_end;
+    }
+
+private:
+    char *m_end;
+    char *m_limit;
+};
+
+// Fields are written one after another by to_chars, the addresses were formatted when the flow got its row.
+// The history fields are empty for a flow without history
+size_t ConnectionsTable::formatLogRow(time_t timestamp, const Connection &connection, char (&row)[LOG_ROW_LENGTH])
 {
-    // Find port location
-    size_t colonPos = endpoint.find_last_of(':');
-    // Slice into 2 part based on port location
-    if (colonPos != std::string::npos)
+    LogFields fields(row, LOG_ROW_LENGTH);
+    fields.number(timestamp);
+    fields.endpoints(connection);
+    fields.number(connection.m_bytesSent);
+    fields.number(connection.m_bytesReceived);
+    fields.number(connection.m_packetsSent);
+    fields.number(connection.m_packetsReceived);
+    if (connection.m_activeSeconds != 0)
     {
-        ip = endpoint.substr(0, colonPos);
-        port = endpoint.substr(colonPos + 1);
+        fields.number(connection.m_historyStart);
+        fields.number(connection.m_activeSeconds);
+        fields.number(connection.m_peakSecondBytes, '\n');
     }
-    // No colon, set entire string as ip representation
     else
     {
-        ip = endpoint;
-        port = "0";
+        fields.empty();
+        fields.empty();
+        fields.empty('\n');
     }
+    return static_cast<size_t>(fields.end() - row);
 }
 
 // Logs the whole connections table into log
@@ -257,44 +1551,107 @@ void ConnectionsTable::logConnectionsTable(SortBy sortBy)
         }
 
         // Update header
-        *m_logFileStream << "timestamp,protocol,src_ip,src_port,dst_ip,dst_port,bytes_sent,bytes_received,packets_sent,packets_received\n";
+        *m_logFileStream << LOG_HEADER;
 
+        // Log the published state of all flows, the live table is not locked
         std::vector<Connection> connections;
-        getSortedConnections(sortBy, connections);
+        collectPublished(connections, m_flowHistory.budget() != 0);
+        sortConnections(sortBy, connections);
         // Uncomment the next line to store only top 10 connections into log file
         //  getTopConnections(10, connections);
 
-        auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        auto timestamp = std::chrono::system_clock::to_time_t(now());
 
-        // Fill up log the file with all connections that exist in connectionsTable
+        // Fill up log the file with all connections that exist in connectionsTable, every row is written into
+        // the same buffer
+        char row[LOG_ROW_LENGTH];
         for (const Connection &connection : connections)
         {
-            std::string srcEndpoint = ConnectionID::endpointToString(connection.m_ID.getSrcEndPoint());
-            std::string destEndpoint = ConnectionID::endpointToString(connection.m_ID.getDestEndPoint());
-            std::string protocol = Display::protocolToStr(connection.m_ID.getProtocol());
+            m_logFileStream->write(row, static_cast<std::streamsize>(formatLogRow(timestamp, connection, row)));
+        }
 
-            std::string srcIP, srcPortStr, destIP, destPortStr;
-            parseEndpoint(srcEndpoint, srcIP, srcPortStr);
-            parseEndpoint(destEndpoint, destIP, destPortStr);
+        m_logFileStream->flush();
+
+        // Minutes and hours that closed since the previous call are appended to the rollup log
+        std::vector<RollupRecord> records;
+        {
+            std::lock_guard<std::mutex> rollupLock(m_rollups->m_mutex);
+            m_rollups->closedBuckets(timestamp, records);
+        }
+        if (!records.empty())
+        {
+            std::ofstream rollupLog(rollupLogPath(), std::ios::out | std::ios::app);
+            for (const RollupRecord &record : records)
+            {
+                rollupLog << record.m_start << ","
+                          << (record.m_resolution == ROLLUP_HOUR ? "1h" : "1m") << ","
+                          << (record.m_host ? Rollups::hostToString(record.m_address) : "interface") << ","
+                          << record.m_traffic.m_bytesSent << ","
+                          << record.m_traffic.m_bytesReceived << ","
+                          << record.m_traffic.m_packets << "\n";
+            }
+        }
+    }
+}
 
-            uint16_t srcPort = std::stoi(srcPortStr);
-            uint16_t destPort = std::stoi(destPortStr);
+// Writes the history log on request. Its size grows with flows and seconds, so it is not part of the
+// log rewritten every tick
+bool ConnectionsTable::logHistory()
+{
+    if (m_logFilePath.empty() || m_flowHistory.budget() == 0)
+    {
+        return false;
+    }
+    std::vector<Connection> connections;
+    std::vector<HistorySample> samples;
+    std::vector<size_t> sampleEnds;
+    collectHistory(connections, samples, sampleEnds);
 
-            // Make one line
-            *m_logFileStream << now << ","
-                             << protocol << ","
-                             << srcIP << ","
-                             << srcPort << ","
-                             << destIP << ","
-                             << destPort << ","
-                             << connection.m_bytesSent << ","
-                             << connection.m_bytesReceived << ","
-                             << connection.m_packetsSent << ","
-                             << connection.m_packetsReceived << "\n";
+    std::ofstream historyLog(historyLogPath(), std::ios::out | std::ios::trunc);
+    if (!historyLog.is_open())
+    {
+        return false;
+    }
+    historyLog << HISTORY_LOG_HEADER;
+    // The endpoints of a flow are written once, every sample only replaces the fields after them
+    char row[LOG_ROW_LENGTH];
+    size_t sample = 0;
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        LogFields endpoints(row, LOG_ROW_LENGTH);
+        endpoints.endpoints(connections[i]);
+        for (; sample < sampleEnds[i]; sample++)
+        {
+            LogFields fields = endpoints;
+            fields.number(samples[sample].m_second);
+            fields.number(samples[sample].m_bytes, '\n');
+            historyLog.write(row, static_cast<std::streamsize>(fields.end() - row));
         }
+    }
+    return historyLog.good();
+}
 
-        m_logFileStream->flush();
+// Log path with the suffix before the .csv extension
+static std::string siblingLogPath(const std::string &logFilePath, const char *suffix)
+{
+    std::string path = logFilePath;
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0)
+    {
+        path.resize(path.size() - 4);
     }
+    return path + suffix;
+}
+
+// Log path with .rollup before the .csv extension
+std::string ConnectionsTable::rollupLogPath() const
+{
+    return siblingLogPath(m_logFilePath, ".rollup.csv");
+}
+
+// Log path with .history before the .csv extension
+std::string ConnectionsTable::historyLogPath() const
+{
+    return siblingLogPath(m_logFilePath, ".history.csv");
 }
 
 // Helper function to set log file path
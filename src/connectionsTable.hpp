@@ -19,42 +19,228 @@
 #include <sstream>
 #include <arpa/inet.h>
 #include <mutex>
+#include <atomic>
 #include "connectionID.hpp"
 #include "connection.hpp"
+#include "flowMap.hpp"
+#include "rankHeap.hpp"
+#include "flowColumns.hpp"
+#include "flowHistory.hpp"
+#include "rollup.hpp"
+#include "heavyHitters.hpp"
+#include "flowFilter.hpp"
+#include "timerWheel.hpp"
+#include "slabPool.hpp"
+#include "spscQueue.hpp"
 #include <iostream>
 #include <memory>
 #include <fstream>
+#include <filesystem>
 
 // Enum to specify sorting criteria
 enum SortBy
 {
     BY_BYTES,
-    BY_PACKETS
+    BY_PACKETS,
+    // Current speed (received + sent bytes per second)
+    BY_RATE,
+    // Speed averaged over 10 s, 40 s and the EWMA window (received + sent bytes per second)
+    BY_RATE_10S,
+    BY_RATE_40S,
+    BY_RATE_EWMA,
+    // Current received and sent bytes per second
+    BY_RX_RATE,
+    BY_TX_RATE
+};
+// Number of sorting criteria
+static const int SORT_KEYS = 8;
+
+// Traffic of one flow gathered from a batch of packets
+struct FlowDelta
+{
+    ConnectionID m_ID;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+    uint64_t m_packetsSent = 0;
+    uint64_t m_packetsReceived = 0;
+    // Capture time of the flow's latest packet in the batch, the epoch = time of applyBatch
+    std::chrono::system_clock::time_point m_lastSeen;
+};
+
+// Idle timeouts and size limit of the table
+struct ExpiryConfig
+{
+    // Flows without traffic for this long are removed (seconds)
+    unsigned int m_tcpTimeout = 300;
+    unsigned int m_udpTimeout = 60;
+    unsigned int m_icmpTimeout = 30;
+    // Maximum number of flows, 0 = unlimited. When the table is full the flow nearest to its idle
+    // timeout is evicted to make room for a new one
+    size_t m_maxFlows = 0;
+};
+
+// Expiry timer of one flow. The first seen time tells a flow apart from a later flow with the same key
+template <int Family>
+struct FlowTimer
+{
+    FlowKey<Family> m_key;
+    std::chrono::system_clock::rep m_firstSeen;
+};
+
+// Live state of a flow in the record pool. Capture is the only writer of a table, it adds to the counters
+// without the table lock (relaxed atomic load and store, no locked instruction) and readers load them. The
+// counters come first and the record is aligned to a cache line, so one packet touches a single line
+struct alignas(64) FlowRecord
+{
+    std::atomic<uint64_t> m_bytesSent{0};
+    std::atomic<uint64_t> m_bytesReceived{0};
+    std::atomic<uint64_t> m_packetsSent{0};
+    std::atomic<uint64_t> m_packetsReceived{0};
+    std::atomic<std::chrono::system_clock::rep> m_lastSeen{0};
+    // Set by capture at the first change since the last calculateSpeed, cleared by calculateSpeed
+    std::atomic<bool> m_changed{false};
+    // Identity of the flow, written under the table lock when the flow is created
+    ConnectionID m_ID;
+    IPFamily m_ipFamily = IPFamily::IPv4;
+    std::chrono::system_clock::time_point m_firstSeen;
+
+    // Add traffic, capture thread only
+    void add(uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived,
+             std::chrono::system_clock::time_point currentTime);
+    // Copy of the flow with the current counters
+    void read(Connection &connection) const;
+};
+
+// Flows of one address family, keyed by the compact flow key of that family
+template <int Family>
+struct FlowTables
+{
+    // Connections table right now, record of every flow in ConnectionsTable::m_records
+    FlowMap<FlowKey<Family>, uint32_t, FlowKeyHash<Family>> m_current;
+    // Idle timeout of every live flow
+    TimerWheel<FlowTimer<Family>> m_timers;
+};
+
+// Immutable top of the table published by calculateSpeed. Display and logger read it while the
+// capture threads keep updating the live table
+struct TableSnapshot
+{
+    // Best flows for every sort key (indexed by SortBy), best first
+    std::vector<Connection> m_top[SORT_KEYS];
+    // Number of flows in the table and its shards
+    size_t m_flowCount = 0;
+    // m_lockRate and m_captureStallRate of this call, for readers on other threads
+    double m_lockRate = 0;
+    double m_captureStallRate = 0;
+    // Traffic is counted in the sketch of this table or of a shard, the largest flows of the sketches, largest
+    // first, their error probability and the memory of the sketches. m_top keeps the flows counted before
+    bool m_sketch = false;
+    std::vector<HeavyHitter> m_heavyHitters;
+    double m_sketchConfidence = 0;
+    size_t m_sketchMemory = 0;
+    std::chrono::system_clock::time_point m_time;
 };
 
 // Class to manage all network connections
 class ConnectionsTable
 {
 public:
-    // Connections table 1 sec before now
-    std::unordered_map<ConnectionID, Connection, ConnectionIDHash> m_connectionsTableBefore;
-    // Connections table right now
-    std::unordered_map<ConnectionID, Connection, ConnectionIDHash> m_connectionsTable;
+    // IPv4 flows use the short IPv4 key, the rest the full IPv6 key. m_current is the live table written
+    // by capture, the published rows belong to calculateSpeed (guarded by m_publishMutex). One capture thread writes
+    // a table (workers have shards). It changes the flow maps under m_tableMutex, and so does expireIdle on the
+    // statistics tick, but only while capture is outside an IngestScope (see expireIdle). Inside one, capture
+    // looks up flows and updates counters of existing flows lock-free. Other threads read the maps under
+    // m_tableMutex
+    FlowTables<AF_INET> m_ipv4Flows;
+    FlowTables<AF_INET6> m_ipv6Flows;
     // Mutex for thread safety
     std::mutex m_tableMutex;
+    // Serializes calculateSpeed with readers of the published rows
+    std::mutex m_publishMutex;
 
     void removeConnection(Connection connection);
     Connection *getConnection(Connection connection);
 
     // txOrRx: 1 - update tx (src)
     //         2 - update rx  (dst)
-    void updateConnection(const ConnectionID &id, bool txRx, uint64_t bytes);
+    // timestamp is the capture time of the packet, the epoch = now()
+    void updateConnection(const ConnectionID &id, bool txRx, uint64_t bytes, std::chrono::system_clock::time_point timestamp = {});
+    // Apply batch of flow updates, existing flows without the lock, new ones under a single lock acquisition
+    void applyBatch(const std::vector<FlowDelta> &batch);
+    // Called by an idle capture thread, expires idle flows
+    void maintain();
+    // Called by the statistics tick, expires idle flows of this table and its shards while their capture
+    // threads are not updating them
+    void expireIdle();
+    // Number of times the ingest path locked the table, and its rate per second (this table and its shards)
+    std::atomic<uint64_t> m_lockAcquisitions{0};
+    double m_lockRate = 0;
+    // Time the ingest path waited for the table lock (ns), and milliseconds of waiting per second
+    std::atomic<uint64_t> m_captureStallNs{0};
+    double m_captureStallRate = 0;
+    // Idle timeouts and flow limit. setExpiryConfig splits the limit between the shards
+    ExpiryConfig m_expiry;
+    void setExpiryConfig(const ExpiryConfig &config);
+    // When traffic goes to the heavy hitter sketch instead of exact flows. setSketchConfig splits the threshold
+    // between the shards
+    SketchConfig m_sketch;
+    void setSketchConfig(const SketchConfig &config);
+    // Flows removed after their idle timeout, and flows evicted because the table was full
+    std::atomic<uint64_t> m_expiredFlows{0};
+    std::atomic<uint64_t> m_evictedFlows{0};
+    // Same counters summed over this table and its shards
+    uint64_t countExpiredFlows();
+    uint64_t countEvictedFlows();
+    // Allocator statistics of the flow records of this table and its shards
+    SlabStats slabStats();
+    // Compute speeds of the flows changed since the last call, re-rank them and publish a new snapshot.
+    // Costs O(changed flows * log n + m_snapshotSize), the live table is locked only to copy changed counters.
+    // When most flows changed, speeds are swept over all rows and the rankings rebuilt in O(n)
     void calculateSpeed();
+    // Last published snapshot (empty before the first calculateSpeed)
+    std::shared_ptr<const TableSnapshot> getSnapshot() const;
+    // Rows per sort key in the snapshot
+    size_t m_snapshotSize = 10;
+    // Flows ranked first to first + count - 1 by sortBy in this table and its shards, as published by the last
+    // calculateSpeed, best first, and the number of flows ranked. Only these flows are read: the rankings
+    // address any rank directly, so the cost doesn't grow with first. Only the ranking of sortBy keeps its
+    // order. With a filter the ranks count only the flows it matches, which every table keeps in a ranking of
+    // its own. A new filter or sort key fills it by a scan over all rows that locks the published rows a chunk
+    // at a time, from then on calculateSpeed updates it from the changed rows. Locks the published rows of this
+    // table and its shards, one caller at a time
+    size_t getRange(SortBy sortBy, size_t first, size_t count, std::vector<Connection> &connections,
+                    const FlowFilter *filter = nullptr);
+    // Time constant of the EWMA speed in seconds (this table and its shards), 0 = not computed
+    void setEwmaWindow(double seconds);
+    double ewmaWindow() const;
+    // Bytes of compressed per-second history per flow (this table and its shards), 0 = no history
+    void setHistoryBudget(size_t bytes);
+    size_t historyBudget() const;
+    // Memory held by the histories of this table and its shards
+    size_t historyMemory();
+    // Host slots of the rollups (shared with the shards), 0 = only the interface
+    void setRollupHosts(size_t hosts);
+    size_t rollupHosts();
+    // Traffic of the interface and of up to hosts busiest hosts of the last hour over the last minute, hour,
+    // day and week, kept after the flows expire
+    void rollupSummary(size_t hosts, std::vector<RollupSummary> &rows);
+    size_t rollupMemory();
+    // Sparklines of the snapshot rows: SPARKLINE_WIDTH characters of SPARKLINE_SECONDS each, the last hour
+    static constexpr int SPARKLINE_WIDTH = 20;
+    static constexpr int SPARKLINE_SECONDS = 180;
+    static_assert(SPARKLINE_WIDTH <= static_cast<int>(SparklineText::CAPACITY), "sparkline does not fit its text");
 
+    // Sorted copy of the live table (locks it), the display uses getSnapshot instead
     void getSortedConnections(SortBy sortBy, std::vector<Connection> &outputVector);
+    static void sortConnections(SortBy sortBy, std::vector<Connection> &connections);
+    // Value connections are ranked by, higher first
+    static double rankScore(SortBy sortBy, const Connection &connection);
     void getTopConnections(unsigned int num, std::vector<Connection> &connectionsSorted);
 
-    void parseEndpoint(const std::string &endpoint, std::string &ip, std::string &port);
+    // CSV row of a flow with the summary of its history and the newline, the longest is about 270 characters.
+    // Returns its length
+    static constexpr size_t LOG_ROW_LENGTH = 320;
+    static size_t formatLogRow(time_t timestamp, const Connection &connection, char (&row)[LOG_ROW_LENGTH]);
     void setLogFileStream();
     void logConnectionsTable(SortBy sortBy);
     std::shared_ptr<std::ofstream> m_logFileStream;
@@ -62,4 +248,174 @@ public:
     std::mutex m_logMutex;
 
     void setLogFilePath(const std::string &logFilePath);
+    // Log the closed minute and hour rollup buckets are appended to, log.csv -> log.rollup.csv
+    std::string rollupLogPath() const;
+    // Write every retained second of every flow to the history log (log.csv -> log.history.csv), one row per
+    // second with traffic. False without logging, without history or if the file can't be written
+    bool logHistory();
+    std::string historyLogPath() const;
+
+    // Clock for last seen times of updates without a packet timestamp and for expiry. Replay drives it by
+    // packet timestamps instead of system time
+    std::chrono::system_clock::time_point now();
+    // Monotonic clock for rates (the simulated clock in replay)
+    std::chrono::nanoseconds monotonicNow();
+    void setSimulatedClock(bool enabled);
+    void setSimulatedTime(std::chrono::system_clock::time_point time);
+    std::atomic<bool> m_simulatedClock{false};
+    std::atomic<std::chrono::system_clock::rep> m_simulatedTime{0};
+
+    // Private tables of capture workers. Every worker writes only to its own shard,
+    // calculateSpeed and getSortedConnections merge them with this table
+    std::vector<std::unique_ptr<ConnectionsTable>> m_shards;
+    ConnectionsTable &addShard();
+    // Append connections of this table (not its shards) to outputVector
+    void collectConnections(std::vector<Connection> &outputVector);
+    // Append the published state of all flows of this table and its shards to outputVector, withHistory
+    // also fills the summary of their history
+    void collectPublished(std::vector<Connection> &outputVector, bool withHistory = false);
+    // Append the published flows of this table and its shards that have history to connections and their
+    // samples, oldest first, to samples. The samples of connections[i] end at sampleEnds[i]
+    void collectHistory(std::vector<Connection> &connections, std::vector<HistorySample> &samples,
+                        std::vector<size_t> &sampleEnds);
+    // Number of flows in this table (not its shards)
+    size_t size();
+
+private:
+    // Add traffic to an existing flow without the lock, false if the flow doesn't exist. Capture thread only
+    bool updateExisting(const ConnectionID &id, std::chrono::system_clock::time_point currentTime,
+                        uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    template <int Family>
+    bool updateExisting(FlowTables<Family> &tables, const FlowKey<Family> &key, std::chrono::system_clock::time_point currentTime,
+                        uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    // Expire idle flows once a second. Caller holds m_tableMutex
+    void expireIfDue(std::chrono::system_clock::time_point currentTime);
+    // Add traffic to the connection, create it if it doesn't exist. Caller holds m_tableMutex
+    void addTraffic(const ConnectionID &id, std::chrono::system_clock::time_point currentTime,
+                    uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    template <int Family>
+    void addTraffic(FlowTables<Family> &tables, const FlowKey<Family> &key, const ConnectionID &id,
+                    std::chrono::system_clock::time_point currentTime,
+                    uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    // Remove a flow from the live table and free its record. Caller holds m_tableMutex
+    template <int Family>
+    void eraseFlow(FlowTables<Family> &tables, typename decltype(FlowTables<Family>::m_current)::iterator flow);
+    // Idle timeout of a flow (seconds)
+    int64_t idleTimeout(Protocol protocol) const;
+    // Timer callback, remove the flow if it is idle at time (seconds) or return its real deadline.
+    // Caller holds m_tableMutex
+    template <int Family>
+    int64_t expireFlow(FlowTables<Family> &tables, const FlowTimer<Family> &timer, int64_t time);
+    // Count traffic in the sketch, configured by the first call. Caller holds m_tableMutex
+    void addToSketch(const ConnectionID &id, uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    // Make room for a new flow when the table is full. Caller holds m_tableMutex
+    void evictFlow();
+    // Expire idle flows of both families. Caller holds m_tableMutex
+    void expireFlows(int64_t now);
+    // Copy flows changed since the last calculateSpeed into their rows, list them in m_changedRows.
+    // Caller holds m_tableMutex and m_publishMutex
+    void copyChanged();
+    // Speeds and ranks of the changed rows and of the rows that stopped moving. Caller holds m_publishMutex
+    void rankChanged(double timeDeltaSeconds);
+    // Speeds of all rows in one sweep and rankings rebuilt from scratch. Caller holds m_publishMutex
+    void rankAll(double timeDeltaSeconds);
+    // Value a row is ranked by, orders rows like rankScore orders their connections
+    double rowScore(SortBy sortBy, uint32_t row) const;
+    // False for the key of a window that is not computed, its ranking stays empty
+    bool sortKeyEnabled(int sortKey) const;
+    // Forget the published state of a removed flow. Caller holds m_publishMutex
+    void removeRow(uint32_t row);
+    // Match set of filter ranked by sortBy, checked against the rows not checked yet MATCH_SCAN_ROWS at a time
+    // under m_publishMutex. Locks m_publishMutex
+    void scanMatches(const FlowFilter &filter, SortBy sortBy);
+    // Match ranking after a tick: the changed rows and the rows that stopped moving, or all matching rows
+    // after the rankings were rebuilt. Caller holds m_publishMutex
+    void rankMatches(bool rebuilt);
+    // Check a row against the filter of the match set if not done yet and rank it there by its score.
+    // Caller holds m_publishMutex
+    void refreshMatch(uint32_t row);
+    // Published state of a row with the sparkline of its history up to second. Caller holds m_publishMutex
+    void readRow(uint32_t row, int64_t second, Connection &connection);
+    // Lock the table for the capture path, waiting time is added to m_captureStallNs
+    std::unique_lock<std::mutex> lockForIngest();
+    uint64_t countLockAcquisitions();
+    uint64_t countCaptureStall();
+    uint64_t m_lockAcquisitionsBefore = 0;
+    uint64_t m_captureStallBefore = 0;
+    std::chrono::system_clock::time_point m_lockRateTime;
+    // Published snapshot, swapped atomically so readers never see a partly built one
+    std::atomic<std::shared_ptr<const TableSnapshot>> m_snapshot;
+    // Records of the live flows of both families. Allocated and released by capture under m_tableMutex
+    SlabPool<FlowRecord> m_records;
+    // Records capture changed since the last calculateSpeed, pushed without the lock. An id may be stale
+    // (flow removed, record reused), copyChanged skips records whose changed flag is not set
+    SpscQueue<uint32_t> m_changedRecords;
+    // Records of flows expired or evicted since the last calculateSpeed, their rows are dropped there
+    std::vector<uint32_t> m_removedRecords;
+    // Batch entries of flows that are not in the table yet (capture only)
+    std::vector<size_t> m_newFlows;
+    // Start of the second of the next expiry run, written under m_tableMutex, read by capture without it
+    std::atomic<std::chrono::system_clock::rep> m_expiryDue{0};
+    // Capture is updating flows without the lock, and expireIdle is expiring them under it
+    std::atomic<bool> m_ingesting{false};
+    std::atomic<bool> m_idleExpiry{false};
+    // Sets m_ingesting for the lock-free part of a capture update
+    struct IngestScope
+    {
+        explicit IngestScope(ConnectionsTable &table);
+        ~IngestScope();
+        ConnectionsTable &m_table;
+    };
+    // Heavy hitters of the traffic since the table switched to the sketch. The flows counted before stay in the
+    // table until they expire. Switched on by capture under m_tableMutex, never off
+    HeavyHitters m_heavyHitters;
+    bool m_sketchActive = false;
+    // Totals of the sketch at the previous calculateSpeed, the difference goes to the interface rollup
+    RollupTraffic m_sketchTotals;
+    // Result of getConnection
+    Connection m_found;
+    // Published state of every flow with its speeds. The row of a flow is the id of its record, so no
+    // lookup is needed to find it
+    FlowColumns m_columns;
+    // Traffic of every row per second, recorded for the changed rows of every call
+    FlowHistory m_flowHistory;
+    // Interface and host rollups of this table and its shards, addShard hands them to the shards
+    std::shared_ptr<Rollups> m_rollups = std::make_shared<Rollups>();
+    // Decoded samples of one row (reused between calls)
+    std::vector<HistorySample> m_samples;
+    // Flows with a row
+    size_t m_activeRows = 0;
+    // Rows changed in this call and the traffic each gained, and rows of removed flows taken from the live
+    // table (reused between calls)
+    std::vector<uint32_t> m_changedRows;
+    std::vector<RollupTraffic> m_changedTraffic;
+    std::vector<uint32_t> m_removedRows;
+    // Rows ranked by every sort key
+    RankHeap m_ranking[SORT_KEYS];
+    // Rows matching the filter of the last filtered getRange ranked by its key (m_matchKey -1 = no filter),
+    // whether each row was checked against it and whether it matched. Rows below m_matchScanned were scanned
+    static constexpr size_t MATCH_SCAN_ROWS = 16384;
+    enum MatchState : uint8_t
+    {
+        MATCH_UNCHECKED,
+        MATCH_YES,
+        MATCH_NO
+    };
+    FlowFilter m_matchFilter;
+    int m_matchKey = -1;
+    RankHeap m_matches;
+    std::vector<uint8_t> m_matchState;
+    size_t m_matchScanned = 0;
+    // Rows updated by the previous call, their speed drops to zero if they don't change again
+    std::vector<uint32_t> m_movingRows;
+    // calculateSpeed call that last updated each row, 0 = no flow
+    std::vector<uint64_t> m_rowTick;
+    // Changed rows above 1 / DENSE_SHARE of all flows make calculateSpeed sweep all rows and rebuild the rankings
+    static constexpr size_t DENSE_SHARE = 8;
+    // Rows and scores a rebuild of the rankings starts from (reused between calls)
+    std::vector<uint32_t> m_rankedRows;
+    std::vector<double> m_rowScores;
+    uint64_t m_tick = 0;
+    // Monotonic time of the previous call, rates are computed over the exact time between calls
+    std::chrono::nanoseconds m_previousTick{0};
 };
\ No newline at end of file
@@ -5,11 +5,20 @@
 
 #include "display.hpp"
 
+#include <charconv>
+#include <poll.h>
+#include <unistd.h>
+
+// Screen column of the EWMA speed, after the fixed columns
+static const int EWMA_COLUMN = 119;
+// Width of the EWMA column
+static const int EWMA_WIDTH = 10;
+
 // Constructor
-Display::Display(ConnectionsTable &connectionsTable, SortBy sortBy, int updateInterval) : m_connectionsTable(connectionsTable)
+Display::Display(ConnectionsTable &connectionsTable, SortBy sortBy, int refreshInterval) : m_connectionsTable(connectionsTable)
 {
     m_sortBy = sortBy;
-    m_updateInterval = updateInterval;
+    m_refreshInterval = std::chrono::milliseconds(refreshInterval);
 };
 
 // Desctructor
@@ -33,43 +42,413 @@ void Display::init()
     nodelay(stdscr, TRUE);
     // Enable special keys
     keypad(stdscr, TRUE);
+    // Escape cancels the filter without waiting a second for a key sequence
+    set_escdelay(25);
 }
 
-// Updates display every 1 second
+// Computes the speeds and draws them at once
 void Display::update()
 {
-    int maxC;
-    // Screen size
-    getmaxyx(stdscr, maxC, maxC);
-
-    clear();
-    // Header
-    mvprintw(0, 0, "%-25s %-25s %-8s %-18s %-18s",
-             "Src IP:Port", "Dst IP:Port", "Proto", "Rx", "Tx");
-    mvprintw(1, 0, "%-25s %-25s %-8s %-9s %-8s %-9s %-8s",
-             "", "", "", "b/s", "p/s", "b/s", "p/s");
-    // Separator
-    mvhline(2, 0, '-', maxC);
-    // Update speeds
-    m_connectionsTable.calculateSpeed();
+    tick();
+    draw();
+}
 
-    // Create vector of Connection objects (in order to retreive connections that will be displayed)
-    std::vector<Connection> connections;
-    // Sort connections
-    m_connectionsTable.getSortedConnections(m_sortBy, connections);
-    // Only show top 10 connections
-    m_connectionsTable.getTopConnections(10, connections);
+// Statistics tick: update speeds, publish a new snapshot and log it
+void Display::tick()
+{
+    // A capture thread blocked on an idle link doesn't expire its flows
+    m_connectionsTable.expireIdle();
+    m_connectionsTable.calculateSpeed();
     // Log connections table (if --log was specified)
     m_connectionsTable.logConnectionsTable(m_sortBy);
+}
+
+// Draws the last published snapshot. The frame is composed into the shadow screen, only cells that changed
+// since the previous frame are sent to the terminal
+void Display::draw()
+{
+    m_screen.begin(stdscr);
+    int maxY = m_screen.rows();
+    std::shared_ptr<const TableSnapshot> snapshot = m_connectionsTable.getSnapshot();
+    if (m_showRollups)
+    {
+        printRollups(maxY);
+    }
+    else if (snapshot && snapshot->m_sketch)
+    {
+        printHeavyHitters(*snapshot);
+    }
+    else
+    {
+        // Header, the averaged speeds count both directions
+        std::string header = Screen::format("%-25s %-25s %-8s %-18s %-18s %-9s %-9s",
+                                            "Src IP:Port", "Dst IP:Port", "Proto", "Rx", "Tx", "Avg 10s", "Avg 40s");
+        std::string units = Screen::format("%-25s %-25s %-8s %-9s %-8s %-9s %-8s %-9s %-9s",
+                                           "", "", "", "b/s", "p/s", "b/s", "p/s", "b/s", "b/s");
+        if (m_connectionsTable.ewmaWindow() > 0)
+        {
+            header.resize(EWMA_COLUMN, ' ');
+            header += Screen::format("%-9s", "EWMA");
+            units.resize(EWMA_COLUMN, ' ');
+            units += Screen::format("%-9s", "b/s");
+        }
+        if (m_connectionsTable.historyBudget() > 0)
+        {
+            header.resize(historyColumn(), ' ');
+            header += Screen::format("%-*s", ConnectionsTable::SPARKLINE_WIDTH, "Last hour");
+        }
+        m_screen.line(0, header);
+        m_screen.line(1, units);
+
+        // Flows on screen, the last ones while paused unless a key changed the view
+        size_t rows = flowRows();
+        if (snapshot && (!m_paused || m_viewChanged))
+        {
+            fetchFlows(*snapshot, rows);
+        }
+        m_viewChanged = false;
+
+        // Separator, with the ranks shown when not all flows fit
+        std::string separator(m_screen.columns(), '-');
+        if (m_flowTotal > rows)
+        {
+            std::string position = Screen::format(" %zu-%zu of %zu ", m_scroll + 1, m_scroll + m_flows.size(), m_flowTotal);
+            if (position.size() + 2 <= separator.size())
+            {
+                separator.replace(separator.size() - position.size() - 2, position.size(), position);
+            }
+        }
+        m_screen.line(2, separator);
+        printViewLine(3);
+
+        // Print each connection
+        int row = 2;
+        for (auto current = m_flows.begin(); current != m_flows.end(); current++)
+        {
+            printConnection(row++, *current);
+        }
+    }
+    // Status line
+    printStatus(maxY - 1);
+
+    m_screen.end();
+}
+
+// Print the largest flows of the sketch. Their bytes are estimated: the true bytes are at most the estimate and
+// at least the estimate less the error, with the probability in the title
+void Display::printHeavyHitters(const TableSnapshot &snapshot)
+{
+    m_screen.line(0, Screen::format("%-25s %-25s %-8s %-18s %-18s %-9s %-9s %s %.1f%%",
+                                    "Src IP:Port", "Dst IP:Port", "Proto", "Rx", "Tx", "Bytes", "Error",
+                                    "Heavy hitters, bounds hold with", 100 * snapshot.m_sketchConfidence));
+    m_screen.line(1, Screen::format("%-25s %-25s %-8s %-9s %-8s %-9s %-8s %-9s %-9s",
+                                    "", "", "", "b/s", "p/s", "b/s", "p/s", "at most", "less"));
+    m_screen.line(2, std::string(m_screen.columns(), '-'));
+
+    for (size_t i = 0; i < snapshot.m_heavyHitters.size() && i < 10; i++)
+    {
+        const HeavyHitter &hitter = snapshot.m_heavyHitters[i];
+        const Connection &connection = hitter.m_connection;
+        char src[ConnectionID::ENDPOINT_LENGTH];
+        char dest[ConnectionID::ENDPOINT_LENGTH];
+        int srcLength = static_cast<int>(ConnectionID::writeEndpoint(connection.m_srcText, connection.m_ID.getSrcPort(), src));
+        int destLength = static_cast<int>(ConnectionID::writeEndpoint(connection.m_destText, connection.m_ID.getDestPort(), dest));
+        m_screen.line(3 + i, Screen::format("%-25.*s %-25.*s %-8s %-9s %-8s %-9s %-8s %-9s %-9s",
+                                            srcLength, src,
+                                            destLength, dest,
+                                            protocolToStr(connection.m_ID.m_protocol).c_str(),
+                                            formatTraffic(connection.m_rxSpeedBytes).c_str(),
+                                            formatPacketRate(connection.m_rxSpeedPackets).c_str(),
+                                            formatTraffic(connection.m_txSpeedBytes).c_str(),
+                                            formatPacketRate(connection.m_txSpeedPackets).c_str(),
+                                            formatTraffic(hitter.m_estimate).c_str(),
+                                            formatTraffic(hitter.m_error).c_str()));
+    }
+}
+
+// Print the rollups of the interface and of the busiest hosts of the last hour, received and sent bytes of
+// every span
+void Display::printRollups(int maxY)
+{
+    m_screen.line(0, Screen::format("%-40s %-21s %-21s %-21s %-21s", "Rollup", "Last minute", "Last hour", "Last day", "Last week"));
+    m_screen.line(1, Screen::format("%-40s %-10s %-10s %-10s %-10s %-10s %-10s %-10s %-10s", "", "Rx", "Tx", "Rx", "Tx", "Rx", "Tx", "Rx", "Tx"));
+    m_screen.line(2, std::string(m_screen.columns(), '-'));
+
+    // Rows between the header and the two status lines, the interface takes the first one
+    int rows = maxY - 3 - 2;
+    std::vector<RollupSummary> summary;
+    m_connectionsTable.rollupSummary(rows > 1 ? rows - 1 : 0, summary);
+    for (size_t i = 0; i < summary.size() && static_cast<int>(i) < rows; i++)
+    {
+        const RollupSummary &rollup = summary[i];
+        std::string scope = rollup.m_host ? Rollups::hostToString(rollup.m_address) : "Interface";
+        std::string text = Screen::format("%-40s", scope.c_str());
+        for (int span = 0; span < ROLLUP_SPANS; span++)
+        {
+            text += Screen::format(" %-10s %-10s", formatTraffic(rollup.m_spans[span].m_bytesReceived).c_str(),
+                                   formatTraffic(rollup.m_spans[span].m_bytesSent).c_str());
+        }
+        m_screen.line(3 + i, text);
+    }
+}
+
+// Keys switch the view: 'a' rollups, b p r R T 1 4 e the sort key, '/' the filter, space pause, arrows, pages,
+// Home and End scroll. 'h' writes the history log
+void Display::handleKey(int key)
+{
+    if (m_editingFilter)
+    {
+        handleFilterKey(key);
+        return;
+    }
+    // Sort keys are ranked all the time, switching costs no sort
+    static const std::pair<int, SortBy> sortKeys[] = {{'b', BY_BYTES}, {'p', BY_PACKETS}, {'r', BY_RATE}, {'R', BY_RX_RATE},
+                                                      {'T', BY_TX_RATE}, {'1', BY_RATE_10S}, {'4', BY_RATE_40S}, {'e', BY_RATE_EWMA}};
+    for (const auto &[sortKey, sortBy] : sortKeys)
+    {
+        if (key == sortKey && (sortBy != BY_RATE_EWMA || m_connectionsTable.ewmaWindow() > 0))
+        {
+            m_sortBy = sortBy;
+            m_scroll = 0;
+            m_viewChanged = true;
+            return;
+        }
+    }
+
+    if (key == 'a')
+    {
+        m_showRollups = !m_showRollups;
+    }
+    else if (key == 'h')
+    {
+        m_connectionsTable.logHistory();
+    }
+    else if (key == KEY_RESIZE)
+    {
+        m_screen.invalidate();
+        m_viewChanged = true;
+    }
+    else if (key == '/')
+    {
+        m_editingFilter = true;
+        m_filterInput = m_filterBefore = m_filter.text();
+        m_filterError.clear();
+    }
+    else if (key == ' ')
+    {
+        m_paused = !m_paused;
+        m_viewChanged = true;
+    }
+    // Scrolling, fetchFlows keeps m_scroll above the last page
+    else if (key == KEY_DOWN)
+    {
+        m_scroll++;
+        m_viewChanged = true;
+    }
+    else if (key == KEY_UP)
+    {
+        m_scroll -= std::min<size_t>(m_scroll, 1);
+        m_viewChanged = true;
+    }
+    else if (key == KEY_NPAGE)
+    {
+        m_scroll += flowRows();
+        m_viewChanged = true;
+    }
+    else if (key == KEY_PPAGE)
+    {
+        m_scroll -= std::min(m_scroll, flowRows());
+        m_viewChanged = true;
+    }
+    else if (key == KEY_HOME)
+    {
+        m_scroll = 0;
+        m_viewChanged = true;
+    }
+    else if (key == KEY_END)
+    {
+        m_scroll = SIZE_MAX;
+        m_viewChanged = true;
+    }
+}
+
+// Keys while the filter is typed. Every change that parses is applied at once, an invalid filter is shown
+// with its error and the previous one stays
+void Display::handleFilterKey(int key)
+{
+    if (key == '\n' || key == '\r' || key == KEY_ENTER)
+    {
+        if (m_filterError.empty())
+        {
+            m_editingFilter = false;
+        }
+        return;
+    }
+    if (key == 27)
+    {
+        m_filter.parse(m_filterBefore, m_filterError);
+        m_filterError.clear();
+        m_editingFilter = false;
+    }
+    else if (key == KEY_BACKSPACE || key == 127 || key == 8)
+    {
+        if (m_filterInput.empty())
+        {
+            return;
+        }
+        m_filterInput.pop_back();
+    }
+    else if (key >= 32 && key < 127)
+    {
+        m_filterInput.push_back(static_cast<char>(key));
+    }
+    else
+    {
+        return;
+    }
+    if (m_editingFilter && m_filter.parse(m_filterInput, m_filterError))
+    {
+        m_filterError.clear();
+    }
+    m_scroll = 0;
+    m_viewChanged = true;
+}
+
+// Flows from m_scroll that fit on the screen, m_scroll stays within the flows. The top of the snapshot is
+// already ranked by every sort key, further down or with a filter the rankings are asked for the visible
+// flows only
+void Display::fetchFlows(const TableSnapshot &snapshot, size_t rows)
+{
+    SortBy sortBy = m_sortBy;
+    if (m_filter.empty())
+    {
+        size_t flowCount = snapshot.m_flowCount;
+        m_scroll = std::min(m_scroll, flowCount > rows ? flowCount - rows : 0);
+        if (m_scroll == 0 && snapshot.m_top[sortBy].size() >= std::min(rows, flowCount))
+        {
+            m_flows = snapshot.m_top[sortBy];
+            m_connectionsTable.getTopConnections(rows, m_flows);
+            m_flowTotal = flowCount;
+            return;
+        }
+    }
+    m_flowTotal = m_connectionsTable.getRange(sortBy, m_scroll, rows, m_flows, &m_filter);
+    // Past the last page of the flows that match
+    if (m_scroll > 0 && m_scroll + rows > m_flowTotal)
+    {
+        m_scroll = m_flowTotal > rows ? m_flowTotal - rows : 0;
+        m_flowTotal = m_connectionsTable.getRange(sortBy, m_scroll, rows, m_flows, &m_filter);
+    }
+}
+
+// Sort key, filter and pause above the flows, or the filter being typed
+void Display::printViewLine(int row)
+{
+    if (m_editingFilter)
+    {
+        std::string text = "Filter: " + m_filterInput + "_";
+        if (!m_filterError.empty())
+        {
+            text += "  (" + m_filterError + ")";
+        }
+        m_screen.line(row, text);
+        return;
+    }
+    std::string text = std::string("Sort: ") + sortName(m_sortBy);
+    if (!m_filter.empty())
+    {
+        text += "  Filter: " + m_filter.text();
+    }
+    if (m_paused)
+    {
+        text += "  PAUSED";
+    }
+    text += "   [b p r R T 1 4 e] sort  [/] filter  [space] pause  [a] rollups";
+    if (!m_connectionsTable.m_logFilePath.empty() && m_connectionsTable.historyBudget() > 0)
+    {
+        text += "  [h] history log";
+    }
+    m_screen.line(row, text);
+}
+
+// Name of the sort key on the view line
+const char *Display::sortName(SortBy sortBy)
+{
+    switch (sortBy)
+    {
+    case BY_PACKETS:
+        return "packets";
+    case BY_RATE:
+        return "rate";
+    case BY_RATE_10S:
+        return "rate 10 s";
+    case BY_RATE_40S:
+        return "rate 40 s";
+    case BY_RATE_EWMA:
+        return "EWMA rate";
+    case BY_RX_RATE:
+        return "Rx rate";
+    case BY_TX_RATE:
+        return "Tx rate";
+    default:
+        return "bytes";
+    }
+}
+
+// Lines 0 - 2 hold the header, flows start at line 4, the last two lines are the status
+size_t Display::flowRows()
+{
+    int rows = getmaxy(stdscr) - 6;
+    return rows > 1 ? rows : 1;
+}
 
-    // Print each connection
-    int row = 2;
-    for (auto current = connections.begin(); current != connections.end(); current++)
+// Print capture counters, table lock rate and capture stall on the specific row, table counters on the row above
+void Display::printStatus(int row)
+{
+    // Counters of all capture engines (more with --workers)
+    uint64_t received = 0, dropped = 0;
+    bool haveStats = false;
+    for (PacketCapture *capture : m_captures)
     {
-        printConnection(row++, *current);
+        uint64_t captureReceived = 0, captureDropped = 0;
+        if (capture->getStats(captureReceived, captureDropped))
+        {
+            received += captureReceived;
+            dropped += captureDropped;
+            haveStats = true;
+        }
     }
 
-    refresh();
+    // Rates of the last statistics tick, published with the snapshot
+    std::shared_ptr<const TableSnapshot> snapshot = m_connectionsTable.getSnapshot();
+    double lockRate = snapshot ? snapshot->m_lockRate : 0;
+    double captureStallRate = snapshot ? snapshot->m_captureStallRate : 0;
+    if (haveStats)
+    {
+        m_screen.line(row, Screen::format("Received: %lu  Dropped: %lu (%.2f%%)  Table locks: %.0f/s  Capture stall: %.2f ms/s",
+                                          received, dropped, received ? 100.0 * dropped / received : 0.0,
+                                          lockRate, captureStallRate));
+    }
+    else
+    {
+        m_screen.line(row, Screen::format("Table locks: %.0f/s  Capture stall: %.2f ms/s", lockRate, captureStallRate));
+    }
+
+    // Table line above: flows removed after the idle timeout, flows evicted by the flow limit and
+    // the slabs holding the flow records
+    uint64_t expired = m_connectionsTable.countExpiredFlows();
+    uint64_t evicted = m_connectionsTable.countEvictedFlows();
+    SlabStats slabs = m_connectionsTable.slabStats();
+    std::string table = Screen::format("Flows: %zu  Expired: %lu  Evicted: %lu  Slabs: %zu (%.1f%% unused, %zu released)  History: %zu KiB  Rollups: %zu KiB",
+                                       slabs.m_records, expired, evicted, slabs.m_liveSlabs, 100.0 * slabs.fragmentation(),
+                                       slabs.m_releasedSlabs, m_connectionsTable.historyMemory() / 1024,
+                                       m_connectionsTable.rollupMemory() / 1024);
+    // Memory of the sketches once traffic goes to them
+    if (snapshot && snapshot->m_sketch)
+    {
+        table += Screen::format("  Sketch: %zu KiB", snapshot->m_sketchMemory / 1024);
+    }
+    m_screen.line(row - 1, table);
 }
 
 // Method to convert protocol enum to string
@@ -97,17 +476,39 @@ std::string Display::protocolToStr(Protocol protocol)
 // Print a single connection on the specific row
 void Display::printConnection(int row, Connection &connection)
 {
-    std::string srcIPfull = ConnectionID::endpointToString(connection.m_ID.getSrcEndPoint());
-    std::string destIPfull = ConnectionID::endpointToString(connection.m_ID.getDestEndPoint());
+    // Endpoints from the addresses formatted when the flow got its row
+    char src[ConnectionID::ENDPOINT_LENGTH];
+    char dest[ConnectionID::ENDPOINT_LENGTH];
+    int srcLength = static_cast<int>(ConnectionID::writeEndpoint(connection.m_srcText, connection.m_ID.getSrcPort(), src));
+    int destLength = static_cast<int>(ConnectionID::writeEndpoint(connection.m_destText, connection.m_ID.getDestPort(), dest));
 
-    mvprintw(row + 2, 0, "%-25s %-25s %-8s %-9s %-8s %-9s %-8s",
-             srcIPfull.c_str(),
-             destIPfull.c_str(),
-             protocolToStr(connection.m_ID.m_protocol).c_str(),
-             formatTraffic(connection.m_rxSpeedBytes).c_str(),
-             formatPacketRate(connection.m_rxSpeedPackets).c_str(),
-             formatTraffic(connection.m_txSpeedBytes).c_str(),
-             formatPacketRate(connection.m_txSpeedPackets).c_str());
+    std::string text = Screen::format("%-25.*s %-25.*s %-8s %-9s %-8s %-9s %-8s %-9s %-9s",
+                                      srcLength, src,
+                                      destLength, dest,
+                                      protocolToStr(connection.m_ID.m_protocol).c_str(),
+                                      formatTraffic(connection.m_rxSpeedBytes).c_str(),
+                                      formatPacketRate(connection.m_rxSpeedPackets).c_str(),
+                                      formatTraffic(connection.m_txSpeedBytes).c_str(),
+                                      formatPacketRate(connection.m_txSpeedPackets).c_str(),
+                                      formatTraffic(connection.m_speed10s).c_str(),
+                                      formatTraffic(connection.m_speed40s).c_str());
+    if (m_connectionsTable.ewmaWindow() > 0)
+    {
+        text.resize(EWMA_COLUMN, ' ');
+        text += Screen::format("%-9s", formatTraffic(connection.m_speedEwma).c_str());
+    }
+    if (m_connectionsTable.historyBudget() > 0)
+    {
+        text.resize(historyColumn(), ' ');
+        text += connection.m_sparkline.view();
+    }
+    m_screen.line(row + 2, text);
+}
+
+// Screen column of the sparkline, after the EWMA speed when it is shown
+int Display::historyColumn()
+{
+    return m_connectionsTable.ewmaWindow() > 0 ? EWMA_COLUMN + EWMA_WIDTH : EWMA_COLUMN;
 }
 
 // Format bytes into readable format
@@ -124,9 +525,7 @@ std::string Display::formatTraffic(double bytes)
         unitIndex++;
     }
 
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(1) << size << units[unitIndex];
-    return oss.str();
+    return formatUnit(size, units[unitIndex]);
 }
 
 // Format packets into readable format
@@ -143,22 +542,93 @@ std::string Display::formatPacketRate(double packets)
         unitIndex++;
     }
 
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(1) << rate << units[unitIndex];
-    return oss.str();
+    return formatUnit(rate, units[unitIndex]);
+}
+
+// One decimal and the unit letter written by to_chars into a stack buffer. The text is shorter than the
+// inline buffer of std::string, so no cell allocates
+std::string Display::formatUnit(double value, const char *unit)
+{
+    char buffer[32];
+    auto [end, result] = std::to_chars(buffer, buffer + sizeof(buffer) - 1, value, std::chars_format::fixed, 1);
+    if (result != std::errc())
+    {
+        return std::string(unit);
+    }
+    if (unit[0] != '\0')
+    {
+        *end++ = unit[0];
+    }
+    return std::string(buffer, end);
 }
 
-// Main loop
+// Main loop: a frame every m_refreshInterval on a timerfd, pressed keys are shown without waiting for it
 void Display::run()
 {
     init();
+    TickTimer refresh;
+    std::string error;
+    if (!refresh.start(m_refreshInterval, error))
+    {
+        endwin();
+        std::cerr << "Refresh timer: " << error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    draw();
 
+    pollfd inputs[2] = {{refresh.fd(), POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+    nfds_t inputCount = 2;
     while (true)
     {
-        update();
-
-        std::this_thread::sleep_for(std::chrono::seconds(m_updateInterval));
+        if (poll(inputs, inputCount, -1) < 0)
+        {
+            // Interrupted by a signal
+            continue;
+        }
+        bool redraw = false;
+        if (inputCount > 1 && inputs[1].revents != 0)
+        {
+            int key;
+            int keys = 0;
+            while ((key = getch()) != ERR)
+            {
+                handleKey(key);
+                keys++;
+            }
+            // Readable input without a key was closed, it is not polled any more
+            if (keys == 0)
+            {
+                inputCount = 1;
+            }
+            redraw = true;
+        }
+        if (inputs[0].revents != 0 && refresh.expired() != 0)
+        {
+            redraw = true;
+        }
+        if (redraw)
+        {
+            draw();
+        }
     }
 
     endwin();
-}
\ No newline at end of file
+}
+
+// Statistics loop on its own timerfd. Speeds are averaged over the exact time between ticks, so they don't
+// depend on how often the screen is refreshed, and a slow frame doesn't delay them
+void Display::runStatistics()
+{
+    TickTimer statistics;
+    std::string error;
+    if (!statistics.start(m_statsInterval, error))
+    {
+        endwin();
+        std::cerr << "Statistics timer: " << error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    while (statistics.wait() != 0)
+    {
+        tick();
+    }
+}
@@ -8,6 +8,9 @@
 #include "connectionsTable.hpp"
 #include "connection.hpp"
 #include "connectionID.hpp"
+#include "packet.hpp"
+#include "screen.hpp"
+#include "tickTimer.hpp"
 #include <ncurses.h>
 #include <string>
 #include <vector>
@@ -21,22 +24,65 @@
 class Display
 {
 public:
-    // Constructor
-    Display(ConnectionsTable &connectionsTable, SortBy sortBy, int updateInterval);
+    // Constructor, the screen is refreshed every refreshInterval milliseconds
+    Display(ConnectionsTable &connectionsTable, SortBy sortBy, int refreshInterval);
     // Destructor
     ~Display();
 
+    // Refresh the screen and handle keys, on the display thread
     void run();
+    // Compute the speeds and write the log every m_statsInterval, on the statistics thread
+    void runStatistics();
     ConnectionsTable &m_connectionsTable;
-    SortBy m_sortBy;
-    int m_updateInterval;
+    // Sort key, switched by keys while running and read by the statistics thread for the log
+    std::atomic<SortBy> m_sortBy;
+    // Screen refresh and statistics tick are independent, speeds are computed over the exact time between
+    // statistics ticks however often the screen shows them
+    std::chrono::milliseconds m_refreshInterval;
+    std::chrono::milliseconds m_statsInterval{1000};
+    // Capture engines whose received and dropped counters are shown every tick
+    std::vector<PacketCapture *> m_captures;
+    // Rollups of the interface and the hosts instead of the flows, switched by 'a'
+    bool m_showRollups = false;
+    // Rank of the first flow shown, moved by the arrow, page, Home and End keys
+    size_t m_scroll = 0;
+    // Only flows matching the filter are shown. After '/' keys edit m_filterInput, the filter follows it
+    // while it is valid, Enter keeps it and Escape goes back to m_filterBefore
+    FlowFilter m_filter;
+    bool m_editingFilter = false;
+    std::string m_filterInput;
+    std::string m_filterBefore;
+    std::string m_filterError;
+    // Space freezes the flows shown, a key changing the view fetches them once more
+    bool m_paused = false;
+    bool m_viewChanged = false;
+    // Flows on screen, and the number of flows ranked or matching the filter
+    std::vector<Connection> m_flows;
+    size_t m_flowTotal = 0;
+    // Shadow of the terminal, only what changed between frames is drawn
+    Screen m_screen;
 
     // Helper functions
     void printConnection(int row, Connection &connection);
+    void printHeavyHitters(const TableSnapshot &snapshot);
     void init();
     void kill();
+    // Statistics tick followed by a frame, for callers without the two threads
     void update();
+    void tick();
+    void draw();
+    void printStatus(int row);
+    void printRollups(int maxY);
+    void handleKey(int key);
+    void handleFilterKey(int key);
+    void fetchFlows(const TableSnapshot &snapshot, size_t rows);
+    void printViewLine(int row);
+    static const char *sortName(SortBy sortBy);
+    int historyColumn();
+    // Screen lines for flows between the header and the status lines
+    size_t flowRows();
     static std::string protocolToStr(Protocol protocol);
     std::string formatPacketRate(double packets);
     std::string formatTraffic(double bytes);
+    static std::string formatUnit(double value, const char *unit);
 };
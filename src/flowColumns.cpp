@@ -0,0 +1,264 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "flowColumns.hpp"
+
+#include <bit>
+#include <cmath>
+
+// Exact conversion of a counter delta below 2^52 to double. The delta is placed in the mantissa of 2^52 and
+// 2^52 is subtracted, which vectorizes with plain SSE2 unlike a uint64_t to double cast (4 PB per tick fit)
+static inline double deltaToDouble(uint64_t delta)
+{
+    return std::bit_cast<double>(delta | 0x4330000000000000ull) - 4503599627370496.0;
+}
+
+// Rows a sweep handles at once. A block has a fixed trip count, which lets the compiler vectorize it at -O2
+static constexpr size_t SWEEP_BLOCK = 8;
+
+// Speed of one block of rows, the previous counters move to the current ones
+static inline void blockRates(const uint64_t *__restrict current, uint64_t *__restrict previous, double *__restrict speed,
+                              double seconds)
+{
+    for (size_t i = 0; i < SWEEP_BLOCK; i++)
+    {
+        speed[i] = deltaToDouble(current[i] - previous[i]) / seconds;
+        previous[i] = current[i];
+    }
+}
+
+// Speed of one counter column over rows [begin, end)
+static void columnRates(std::vector<uint64_t> &current, std::vector<uint64_t> &previous, std::vector<double> &speed,
+                        size_t begin, size_t end, double seconds)
+{
+    size_t row = begin;
+    for (; row + SWEEP_BLOCK <= end; row += SWEEP_BLOCK)
+    {
+        blockRates(current.data() + row, previous.data() + row, speed.data() + row, seconds);
+    }
+    for (; row < end; row++)
+    {
+        speed[row] = deltaToDouble(current[row] - previous[row]) / seconds;
+        previous[row] = current[row];
+    }
+}
+
+// Bytes one block of rows gained since the previous counters, weighted and added to a decayed column
+static inline void blockWindow(const uint64_t *__restrict sent, const uint64_t *__restrict previousSent,
+                               const uint64_t *__restrict received, const uint64_t *__restrict previousReceived,
+                               double *__restrict decayed, double weight)
+{
+    for (size_t i = 0; i < SWEEP_BLOCK; i++)
+    {
+        decayed[i] += deltaToDouble((sent[i] - previousSent[i]) + (received[i] - previousReceived[i])) * weight;
+    }
+}
+
+// Gains of rows [begin, end) added to one window, before the previous counters move
+static void columnWindow(const FlowColumns &columns, std::vector<double> &decayed, size_t begin, size_t end, double weight)
+{
+    size_t row = begin;
+    for (; row + SWEEP_BLOCK <= end; row += SWEEP_BLOCK)
+    {
+        blockWindow(columns.m_bytesSent.data() + row, columns.m_previousBytesSent.data() + row,
+                    columns.m_bytesReceived.data() + row, columns.m_previousBytesReceived.data() + row,
+                    decayed.data() + row, weight);
+    }
+    for (; row < end; row++)
+    {
+        decayed[row] += deltaToDouble((columns.m_bytesSent[row] - columns.m_previousBytesSent[row]) +
+                                      (columns.m_bytesReceived[row] - columns.m_previousBytesReceived[row])) * weight;
+    }
+}
+
+// Largest exponent of a window weight before the decayed columns are rescaled. exp(64) times any byte count
+// stays far below the range of double, and a rescale is needed only once per 64 time constants
+static constexpr double RESCALE_EXPONENT = 64;
+
+// Number of rows
+size_t FlowColumns::size() const
+{
+    return m_bytesSent.size();
+}
+
+// Resize every column
+void FlowColumns::resize(size_t rows)
+{
+    m_bytesSent.resize(rows, 0);
+    m_bytesReceived.resize(rows, 0);
+    m_packetsSent.resize(rows, 0);
+    m_packetsReceived.resize(rows, 0);
+    m_previousBytesSent.resize(rows, 0);
+    m_previousBytesReceived.resize(rows, 0);
+    m_previousPacketsSent.resize(rows, 0);
+    m_previousPacketsReceived.resize(rows, 0);
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        m_decayedBytes[window].resize(rows, 0);
+    }
+    m_txSpeedBytes.resize(rows, 0);
+    m_rxSpeedBytes.resize(rows, 0);
+    m_txSpeedPackets.resize(rows, 0);
+    m_rxSpeedPackets.resize(rows, 0);
+    m_ID.resize(rows);
+    m_srcText.resize(rows);
+    m_destText.resize(rows);
+    m_ipFamily.resize(rows, IPFamily::IPv4);
+    m_firstSeen.resize(rows);
+    m_lastSeen.resize(rows);
+}
+
+// One sweep per window and per counter column. Without elapsed time the deltas are still consumed and
+// counted in the windows, speeds are zero
+void FlowColumns::computeRates(size_t begin, size_t end, double seconds)
+{
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        if (m_windowSeconds[window] > 0)
+        {
+            columnWindow(*this, m_decayedBytes[window], begin, end, m_windowWeight[window]);
+        }
+    }
+    if (seconds <= 0)
+    {
+        for (size_t row = begin; row < end; row++)
+        {
+            resetPrevious(static_cast<uint32_t>(row));
+        }
+        return;
+    }
+    columnRates(m_bytesSent, m_previousBytesSent, m_txSpeedBytes, begin, end, seconds);
+    columnRates(m_bytesReceived, m_previousBytesReceived, m_rxSpeedBytes, begin, end, seconds);
+    columnRates(m_packetsSent, m_previousPacketsSent, m_txSpeedPackets, begin, end, seconds);
+    columnRates(m_packetsReceived, m_previousPacketsReceived, m_rxSpeedPackets, begin, end, seconds);
+}
+
+// Weights of the windows at time, the decayed columns are rescaled when a weight would grow too large
+bool FlowColumns::advance(std::chrono::nanoseconds time)
+{
+    if (!m_started)
+    {
+        m_landmark = m_previousTime = time;
+        m_started = true;
+    }
+    double elapsed = std::chrono::duration<double>(time - m_previousTime).count();
+    m_previousTime = time;
+    bool rescaled = false;
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        if (m_windowSeconds[window] > 0 &&
+            std::chrono::duration<double>(time - m_landmark).count() / m_windowSeconds[window] > RESCALE_EXPONENT)
+        {
+            rescale(time);
+            rescaled = true;
+            break;
+        }
+    }
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        m_windowWeight[window] = m_windowScale[window] = 0;
+        if (m_windowSeconds[window] > 0)
+        {
+            double exponent = std::chrono::duration<double>(time - m_landmark).count() / m_windowSeconds[window];
+            // Bytes of a tick arrived evenly over its interval, not all at its end, so steady traffic averages
+            // to its rate whatever the tick length
+            double spread = 1;
+            if (elapsed > 0)
+            {
+                spread = -std::expm1(-elapsed / m_windowSeconds[window]) * m_windowSeconds[window] / elapsed;
+            }
+            m_windowWeight[window] = std::exp(exponent) * spread;
+            m_windowScale[window] = std::exp(-exponent) / m_windowSeconds[window];
+        }
+    }
+    return rescaled;
+}
+
+// Move the landmark, all decayed columns shrink by the weight the landmark gained
+void FlowColumns::rescale(std::chrono::nanoseconds time)
+{
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        if (m_windowSeconds[window] <= 0)
+        {
+            continue;
+        }
+        double factor = std::exp(-std::chrono::duration<double>(time - m_landmark).count() / m_windowSeconds[window]);
+        for (double &decayed : m_decayedBytes[window])
+        {
+            decayed *= factor;
+        }
+    }
+    m_landmark = time;
+}
+
+// Decayed column times the scale of the window
+double FlowColumns::windowSpeed(RateWindow window, uint32_t row) const
+{
+    return m_decayedBytes[window][row] * m_windowScale[window];
+}
+
+// Traffic of a new flow counts into the windows at its first tick, the instant speed starts at zero
+void FlowColumns::startRow(uint32_t row)
+{
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        m_decayedBytes[window][row] += static_cast<double>(m_bytesSent[row] + m_bytesReceived[row]) * m_windowWeight[window];
+    }
+    resetPrevious(row);
+}
+
+// Previous counters of a new flow, speeds start at zero
+void FlowColumns::resetPrevious(uint32_t row)
+{
+    m_previousBytesSent[row] = m_bytesSent[row];
+    m_previousBytesReceived[row] = m_bytesReceived[row];
+    m_previousPacketsSent[row] = m_packetsSent[row];
+    m_previousPacketsReceived[row] = m_packetsReceived[row];
+    m_txSpeedBytes[row] = m_rxSpeedBytes[row] = 0;
+    m_txSpeedPackets[row] = m_rxSpeedPackets[row] = 0;
+}
+
+// Key and formatted addresses of the flow
+void FlowColumns::setID(uint32_t row, const ConnectionID &id)
+{
+    m_ID[row] = id;
+    ConnectionID::formatAddress(id.m_srcAddress, m_srcText[row]);
+    ConnectionID::formatAddress(id.m_destAddress, m_destText[row]);
+}
+
+// Row of a removed flow is zero, so sweeps over it produce zero speeds
+void FlowColumns::clear(uint32_t row)
+{
+    m_bytesSent[row] = m_bytesReceived[row] = 0;
+    m_packetsSent[row] = m_packetsReceived[row] = 0;
+    for (int window = 0; window < RATE_WINDOWS; window++)
+    {
+        m_decayedBytes[window][row] = 0;
+    }
+    resetPrevious(row);
+}
+
+// Copies the row into connection
+void FlowColumns::read(uint32_t row, Connection &connection) const
+{
+    connection.m_ID = m_ID[row];
+    connection.m_srcText = m_srcText[row];
+    connection.m_destText = m_destText[row];
+    connection.m_ipFamily = m_ipFamily[row];
+    connection.m_bytesSent = m_bytesSent[row];
+    connection.m_bytesReceived = m_bytesReceived[row];
+    connection.m_packetsSent = m_packetsSent[row];
+    connection.m_packetsReceived = m_packetsReceived[row];
+    connection.m_txSpeedBytes = m_txSpeedBytes[row];
+    connection.m_rxSpeedBytes = m_rxSpeedBytes[row];
+    connection.m_txSpeedPackets = m_txSpeedPackets[row];
+    connection.m_rxSpeedPackets = m_rxSpeedPackets[row];
+    connection.m_speed10s = windowSpeed(WINDOW_10S, row);
+    connection.m_speed40s = windowSpeed(WINDOW_40S, row);
+    connection.m_speedEwma = windowSpeed(WINDOW_EWMA, row);
+    connection.m_first_seen = m_firstSeen[row];
+    connection.m_last_seen = m_lastSeen[row];
+}
@@ -0,0 +1,96 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "connection.hpp"
+#include "connectionID.hpp"
+
+// Averaging windows of the flow rates besides the instant one
+enum RateWindow
+{
+    WINDOW_10S,
+    WINDOW_40S,
+    // Time constant chosen by the user, off by default
+    WINDOW_EWMA
+};
+// Number of averaging windows
+static const int RATE_WINDOWS = 3;
+
+// Published state of flows in struct-of-arrays columns indexed by row. Every counter, its value at the
+// previous tick and its speed are separate dense columns, so the rate pass is a linear sweep over plain
+// arrays that the compiler turns into SIMD code, and ranking reads only the columns it needs
+class FlowColumns
+{
+public:
+    // Counters at the last calculateSpeed
+    std::vector<uint64_t> m_bytesSent;
+    std::vector<uint64_t> m_bytesReceived;
+    std::vector<uint64_t> m_packetsSent;
+    std::vector<uint64_t> m_packetsReceived;
+    // Counters at the calculateSpeed before, speeds are computed against them
+    std::vector<uint64_t> m_previousBytesSent;
+    std::vector<uint64_t> m_previousBytesReceived;
+    std::vector<uint64_t> m_previousPacketsSent;
+    std::vector<uint64_t> m_previousPacketsReceived;
+    // Speeds per second
+    std::vector<double> m_txSpeedBytes;
+    std::vector<double> m_rxSpeedBytes;
+    std::vector<double> m_txSpeedPackets;
+    std::vector<double> m_rxSpeedPackets;
+    // Bytes (both directions) of every row weighted by exp((gain time - landmark) / window), one column per
+    // window. Speed averaged over a window is the column times m_windowScale. The factor is the same for all
+    // rows, so a row that didn't change keeps its value and its rank, only the changed rows are touched
+    std::vector<double> m_decayedBytes[RATE_WINDOWS];
+    // Time constants of the windows (seconds), 0 = window not computed
+    double m_windowSeconds[RATE_WINDOWS] = {10, 40, 0};
+    // Identity of the flow of the row and its addresses formatted for output
+    std::vector<ConnectionID> m_ID;
+    std::vector<AddressText> m_srcText;
+    std::vector<AddressText> m_destText;
+    std::vector<IPFamily> m_ipFamily;
+    std::vector<std::chrono::system_clock::time_point> m_firstSeen;
+    std::vector<std::chrono::system_clock::time_point> m_lastSeen;
+
+    size_t size() const;
+    // Grow or shrink all columns, new rows are zero
+    void resize(size_t rows);
+    // Speeds of rows [begin, end) from the counters gained since the previous counters, which then take the
+    // current values. A row that did not change gets zero speed. seconds <= 0 gives zero speeds. The gains
+    // are added to the windows at the time of the last advance
+    void computeRates(size_t begin, size_t end, double seconds);
+    // Move the windows to time (monotonic clock) before the rows of a tick are computed. Returns true if the
+    // decayed columns were rescaled to a new landmark, which changes the scores of all rows
+    bool advance(std::chrono::nanoseconds time);
+    // Speed of the row averaged over a window (bytes per second, both directions)
+    double windowSpeed(RateWindow window, uint32_t row) const;
+    // Count the traffic a new flow had before its first tick into the windows and start its previous counters
+    void startRow(uint32_t row);
+    // Start the previous counters of a new flow at its current ones, its first speed is zero
+    void resetPrevious(uint32_t row);
+    // Identity of a new flow, its addresses are formatted here and only copied by every output after
+    void setID(uint32_t row, const ConnectionID &id);
+    // Zero the counters and speeds of a row whose flow is gone
+    void clear(uint32_t row);
+    // Copy of the row as a Connection
+    void read(uint32_t row, Connection &connection) const;
+
+private:
+    // Multiply the decayed columns by exp(-(time - landmark) / window) and move the landmark to time
+    void rescale(std::chrono::nanoseconds time);
+
+    // Time the decayed columns are relative to, set by the first advance
+    std::chrono::nanoseconds m_landmark{0};
+    bool m_started = false;
+    // Time of the previous advance
+    std::chrono::nanoseconds m_previousTime{0};
+    // Weight of bytes gained now and factor from a decayed column to a speed, per window
+    double m_windowWeight[RATE_WINDOWS] = {};
+    double m_windowScale[RATE_WINDOWS] = {};
+};
@@ -0,0 +1,183 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "flowFilter.hpp"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <sstream>
+
+// Every term is tried as a protocol, a number and an address in this order, the rest is text
+bool FlowFilter::parse(const std::string &text, std::string &error)
+{
+    std::vector<Protocol> protocols;
+    std::vector<Network> networks;
+    std::vector<uint16_t> ports;
+    std::vector<std::string> substrings;
+    std::istringstream terms(text);
+    std::string term;
+    while (terms >> term)
+    {
+        std::string lower = term;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                       { return std::tolower(c); });
+        if (lower == "tcp" || lower == "udp" || lower == "icmp" || lower == "icmpv6")
+        {
+            protocols.push_back(lower == "tcp" ? Protocol::TCP : lower == "udp" ? Protocol::UDP
+                                                           : lower == "icmp"  ? Protocol::ICMP
+                                                                              : Protocol::ICMPv6);
+            continue;
+        }
+        if (std::all_of(term.begin(), term.end(), [](unsigned char c)
+                        { return std::isdigit(c); }))
+        {
+            unsigned int port = 0;
+            auto [end, result] = std::from_chars(term.data(), term.data() + term.size(), port);
+            if (result != std::errc() || port > UINT16_MAX)
+            {
+                error = "port out of range: " + term;
+                return false;
+            }
+            ports.push_back(static_cast<uint16_t>(port));
+            continue;
+        }
+
+        // Address with an optional prefix length
+        size_t slash = term.find('/');
+        std::string address = term.substr(0, slash);
+        Network network{};
+        in_addr ipv4;
+        int maxBits;
+        if (inet_pton(AF_INET, address.c_str(), &ipv4) == 1)
+        {
+            network.m_address[10] = network.m_address[11] = 0xff;
+            std::memcpy(&network.m_address[12], &ipv4, sizeof(ipv4));
+            maxBits = 32;
+        }
+        else if (inet_pton(AF_INET6, address.c_str(), network.m_address) == 1)
+        {
+            maxBits = 128;
+        }
+        else if (slash != std::string::npos)
+        {
+            error = "not a network: " + term;
+            return false;
+        }
+        else
+        {
+            substrings.push_back(term);
+            continue;
+        }
+        int bits = maxBits;
+        if (slash != std::string::npos)
+        {
+            const char *first = term.data() + slash + 1;
+            const char *last = term.data() + term.size();
+            auto [end, result] = std::from_chars(first, last, bits);
+            if (result != std::errc() || end != last || first == last || bits < 0 || bits > maxBits)
+            {
+                error = "prefix length out of range: " + term;
+                return false;
+            }
+        }
+        // IPv4 prefixes follow the 96 bits of the mapping
+        network.m_bits = bits + 128 - maxBits;
+        networks.push_back(network);
+    }
+
+    m_text = text;
+    m_protocols.swap(protocols);
+    m_networks.swap(networks);
+    m_ports.swap(ports);
+    m_substrings.swap(substrings);
+    return true;
+}
+
+// No terms
+bool FlowFilter::empty() const
+{
+    return m_protocols.empty() && m_networks.empty() && m_ports.empty() && m_substrings.empty();
+}
+
+// Addresses are formatted only when a text term is left to check
+bool FlowFilter::matches(const ConnectionID &id) const
+{
+    AddressText src;
+    AddressText dest;
+    if (!m_substrings.empty())
+    {
+        ConnectionID::formatAddress(id.m_srcAddress, src);
+        ConnectionID::formatAddress(id.m_destAddress, dest);
+    }
+    return matches(id, src, dest);
+}
+
+// Cheap terms first, text terms search the endpoints written into stack buffers
+bool FlowFilter::matches(const ConnectionID &id, const AddressText &src, const AddressText &dest) const
+{
+    for (Protocol protocol : m_protocols)
+    {
+        if (id.m_protocol != protocol)
+        {
+            return false;
+        }
+    }
+    for (uint16_t port : m_ports)
+    {
+        if (id.getSrcPort() != port && id.getDestPort() != port)
+        {
+            return false;
+        }
+    }
+    for (const Network &network : m_networks)
+    {
+        if (!inNetwork(id.m_srcAddress, network) && !inNetwork(id.m_destAddress, network))
+        {
+            return false;
+        }
+    }
+    if (m_substrings.empty())
+    {
+        return true;
+    }
+    char srcBuffer[ConnectionID::ENDPOINT_LENGTH];
+    char destBuffer[ConnectionID::ENDPOINT_LENGTH];
+    std::string_view srcEndpoint(srcBuffer, ConnectionID::writeEndpoint(src, id.getSrcPort(), srcBuffer));
+    std::string_view destEndpoint(destBuffer, ConnectionID::writeEndpoint(dest, id.getDestPort(), destBuffer));
+    for (const std::string &substring : m_substrings)
+    {
+        if (srcEndpoint.find(substring) == std::string_view::npos && destEndpoint.find(substring) == std::string_view::npos)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Text of the last successful parse
+const std::string &FlowFilter::text() const
+{
+    return m_text;
+}
+
+// Whole bytes of the prefix, then the bits left in the next byte
+bool FlowFilter::inNetwork(const uint8_t (&address)[16], const Network &network)
+{
+    int bytes = network.m_bits / 8;
+    if (std::memcmp(address, network.m_address, bytes) != 0)
+    {
+        return false;
+    }
+    int bits = network.m_bits % 8;
+    if (bits == 0)
+    {
+        return true;
+    }
+    uint8_t mask = static_cast<uint8_t>(0xff << (8 - bits));
+    return (address[bytes] & mask) == (network.m_address[bytes] & mask);
+}
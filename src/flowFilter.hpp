@@ -0,0 +1,47 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "connectionID.hpp"
+
+// FlowFilter selects the flows shown while the display runs. The filter is a list of terms separated by
+// spaces, a flow is shown when it matches all of them:
+//   tcp, udp, icmp, icmpv6   the protocol of the flow
+//   <address>[/<bits>]       source or destination address in the IPv4 or IPv6 network (CIDR)
+//   <number>                 source or destination port
+//   anything else            part of the source or destination endpoint as displayed (address:port)
+// Addresses and ports are compared on the flow key, only text terms need the endpoints as text
+class FlowFilter
+{
+public:
+    // Replace the terms, false with error if a network or port term is not valid. An empty text shows all flows
+    bool parse(const std::string &text, std::string &error);
+    bool empty() const;
+    bool matches(const ConnectionID &id) const;
+    // Same with the addresses of the flow already formatted
+    bool matches(const ConnectionID &id, const AddressText &src, const AddressText &dest) const;
+    // Text the filter was parsed from
+    const std::string &text() const;
+
+private:
+    // Network as an IPv6 prefix, IPv4 networks are IPv4-mapped like the addresses of the flow keys
+    struct Network
+    {
+        uint8_t m_address[16];
+        int m_bits;
+    };
+    // Address of the flow key starts with the prefix of network
+    static bool inNetwork(const uint8_t (&address)[16], const Network &network);
+
+    std::string m_text;
+    std::vector<Protocol> m_protocols;
+    std::vector<Network> m_networks;
+    std::vector<uint16_t> m_ports;
+    std::vector<std::string> m_substrings;
+};
@@ -0,0 +1,78 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+// Fast non-allocating hash of a flow 5-tuple, used by the connection tables on every packet.
+// Built with SSE4.2 (-msse4.2 or -march=native) the words are folded with the CRC32C instruction,
+// otherwise with wyhash style 64x64->128 bit multiplications. Both finish with a multiply mix,
+// so low and high bits of the result are usable as table index and tag.
+namespace FlowHash
+{
+    // wyhash secrets
+    static constexpr uint64_t SECRET0 = 0xa0761d6478bd642full;
+    static constexpr uint64_t SECRET1 = 0xe7037ed1a0b428dbull;
+    static constexpr uint64_t SECRET2 = 0x8ebc6af09c88c6e3ull;
+    static constexpr uint64_t SECRET3 = 0x589965cc75374cc3ull;
+
+    // Multiply and fold the 128 bit product
+    static inline uint64_t mix(uint64_t a, uint64_t b)
+    {
+        __uint128_t product = static_cast<__uint128_t>(a) * b;
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+    }
+
+    // Unaligned 64 bit load
+    static inline uint64_t load64(const uint8_t *data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // Hash of two 16 byte addresses (network order), ports and protocol
+    static inline uint64_t hash(const uint8_t *src, const uint8_t *dest, uint16_t srcPort, uint16_t destPort, uint8_t protocol)
+    {
+        uint64_t tail = (static_cast<uint64_t>(srcPort) << 32) | (static_cast<uint64_t>(destPort) << 16) | protocol;
+#ifdef __SSE4_2__
+        // Two independent CRC lanes give 64 bits of state
+        uint64_t low = _mm_crc32_u64(SECRET0, load64(src));
+        uint64_t high = _mm_crc32_u64(SECRET1, load64(src + 8));
+        low = _mm_crc32_u64(low, load64(dest));
+        high = _mm_crc32_u64(high, load64(dest + 8));
+        low = _mm_crc32_u64(low, tail);
+        return mix((high << 32 | low) ^ SECRET2, tail ^ SECRET3);
+#else
+        uint64_t seed = mix(load64(src) ^ SECRET1, load64(src + 8) ^ SECRET0);
+        seed ^= mix(load64(dest) ^ SECRET2, load64(dest + 8) ^ seed);
+        return mix(SECRET1 ^ 37, mix(tail ^ SECRET3, seed ^ SECRET0));
+#endif
+    }
+
+    // Hash of two 4 byte IPv4 addresses, ports and protocol
+    static inline uint64_t hashIPv4(const uint8_t *src, const uint8_t *dest, uint16_t srcPort, uint16_t destPort, uint8_t protocol)
+    {
+        uint32_t srcAddress;
+        uint32_t destAddress;
+        std::memcpy(&srcAddress, src, sizeof(srcAddress));
+        std::memcpy(&destAddress, dest, sizeof(destAddress));
+        uint64_t addresses = (static_cast<uint64_t>(srcAddress) << 32) | destAddress;
+        uint64_t tail = (static_cast<uint64_t>(srcPort) << 32) | (static_cast<uint64_t>(destPort) << 16) | protocol;
+#ifdef __SSE4_2__
+        uint64_t low = _mm_crc32_u64(SECRET0, addresses);
+        uint64_t high = _mm_crc32_u64(SECRET1, tail);
+        low = _mm_crc32_u64(low, tail);
+        return mix((high << 32 | low) ^ SECRET2, addresses ^ SECRET3);
+#else
+        return mix(SECRET1 ^ 13, mix(addresses ^ SECRET0, tail ^ SECRET3));
+#endif
+    }
+}
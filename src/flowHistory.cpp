@@ -0,0 +1,386 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "flowHistory.hpp"
+
+#include <algorithm>
+#include <bit>
+
+// Levels of the sparkline, from no traffic to the busiest period
+static const char SPARKLINE_LEVELS[] = " .:-=+*#%@";
+
+// Write the count lowest bits of value at position, most significant bit first
+static void writeBits(uint8_t *data, uint32_t &position, uint64_t value, int count)
+{
+    while (count > 0)
+    {
+        int free = 8 - static_cast<int>(position % 8);
+        int take = std::min(free, count);
+        uint8_t bits = static_cast<uint8_t>((value >> (count - take)) & ((1u << take) - 1));
+        uint8_t &byte = data[position / 8];
+        // The first write into a byte clears what an older segment left there
+        if (position % 8 == 0)
+        {
+            byte = 0;
+        }
+        byte |= static_cast<uint8_t>(bits << (free - take));
+        position += take;
+        count -= take;
+    }
+}
+
+// Read count bits at position, most significant bit first
+static uint64_t readBits(const uint8_t *data, uint32_t &position, int count)
+{
+    uint64_t value = 0;
+    while (count > 0)
+    {
+        int available = 8 - static_cast<int>(position % 8);
+        int take = std::min(available, count);
+        uint8_t bits = static_cast<uint8_t>((data[position / 8] >> (available - take)) & ((1u << take) - 1));
+        value = (value << take) | bits;
+        position += take;
+        count -= take;
+    }
+    return value;
+}
+
+// Bits of a delta-of-delta: '0', '10' + 7, '110' + 9, '1110' + 12 bits, or '1111' + the whole 32 bit delta
+static uint32_t deltaBits(int64_t deltaOfDelta)
+{
+    if (deltaOfDelta == 0)
+    {
+        return 1;
+    }
+    if (deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        return 2 + 7;
+    }
+    if (deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        return 3 + 9;
+    }
+    if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        return 4 + 12;
+    }
+    return 4 + 32;
+}
+
+// Bits of an XOR: '0' when equal, '10' + the bits inside the previous window, or '11' + 6 bits of leading
+// zeros, 6 bits of length - 1 and the meaningful bits
+static uint32_t xorBits(uint64_t xorValue, uint8_t leading, uint8_t trailing)
+{
+    if (xorValue == 0)
+    {
+        return 1;
+    }
+    int leadingZeros = std::countl_zero(xorValue);
+    int trailingZeros = std::countr_zero(xorValue);
+    if (leading <= 64 && leadingZeros >= leading && trailingZeros >= trailing)
+    {
+        return 2 + (64 - leading - trailing);
+    }
+    return 2 + 6 + 6 + (64 - leadingZeros - trailingZeros);
+}
+
+// Budget per flow, the history recorded so far is dropped
+void FlowHistory::setBudget(size_t bytes)
+{
+    m_budget = bytes;
+    size_t rows = m_rows.size();
+    m_rows.clear();
+    m_rows.resize(rows);
+    m_allocatedRows = 0;
+}
+
+// Bytes of history per flow
+size_t FlowHistory::budget() const
+{
+    return m_budget;
+}
+
+// Rows grow with the rows of the flow columns
+void FlowHistory::resize(size_t rows)
+{
+    m_rows.resize(rows);
+}
+
+// Sum the bytes of the current second, compress the previous second when a new one starts
+void FlowHistory::record(uint32_t row, int64_t second, uint64_t bytes)
+{
+    if (m_budget == 0 || bytes == 0)
+    {
+        return;
+    }
+    if (!m_based)
+    {
+        m_baseSecond = second;
+        m_based = true;
+    }
+    uint32_t relative = static_cast<uint32_t>(std::clamp<int64_t>(second - m_baseSecond, 0, UINT32_MAX));
+    RowHistory &history = m_rows[row];
+    if (history.m_open && relative <= history.m_openSecond)
+    {
+        history.m_openBytes += bytes;
+        return;
+    }
+    if (history.m_open)
+    {
+        encode(history, history.m_openSecond, history.m_openBytes);
+        history.m_activeSeconds++;
+        history.m_peakBytes = std::max(history.m_peakBytes, history.m_openBytes);
+    }
+    else if (history.m_activeSeconds == 0)
+    {
+        history.m_firstSecond = relative;
+    }
+    history.m_open = true;
+    history.m_openSecond = relative;
+    history.m_openBytes = bytes;
+}
+
+// Compress one sample into the head segment
+void FlowHistory::encode(RowHistory &history, uint32_t second, uint64_t bytes)
+{
+    if (!history.m_buffer)
+    {
+        history.m_buffer = std::make_unique<uint8_t[]>(m_budget);
+        m_allocatedRows++;
+    }
+    int64_t delta = static_cast<int64_t>(second) - history.m_lastSecond;
+    int64_t deltaOfDelta = delta - history.m_lastDelta;
+    uint64_t xorValue = bytes ^ history.m_lastValue;
+    // A second that repeats both the delta and the bytes of the previous one is a single '0'
+    bool repeat = deltaOfDelta == 0 && xorValue == 0;
+    uint32_t cost = repeat ? 1 : 1 + deltaBits(deltaOfDelta) + xorBits(xorValue, history.m_leading, history.m_trailing);
+
+    // Start a new segment over the oldest one, its first sample is stored whole
+    if (history.m_segments == 0 || history.m_bits[history.m_head] + cost > segmentBits())
+    {
+        if (history.m_segments != 0)
+        {
+            history.m_head = (history.m_head + 1) % SEGMENTS;
+        }
+        history.m_segments = std::min(history.m_segments + 1, SEGMENTS);
+        uint8_t *segment = history.m_buffer.get() + history.m_head * (m_budget / SEGMENTS);
+        uint32_t position = 0;
+        writeBits(segment, position, second, 32);
+        writeBits(segment, position, bytes, 64);
+        history.m_bits[history.m_head] = position;
+        history.m_lastSecond = second;
+        // A flow active every second encodes its next second in one bit
+        history.m_lastDelta = 1;
+        history.m_lastValue = bytes;
+        history.m_leading = UINT8_MAX;
+        history.m_trailing = 0;
+        return;
+    }
+
+    uint8_t *segment = history.m_buffer.get() + history.m_head * (m_budget / SEGMENTS);
+    uint32_t &position = history.m_bits[history.m_head];
+    if (repeat)
+    {
+        writeBits(segment, position, 0, 1);
+        history.m_lastSecond = second;
+        return;
+    }
+    writeBits(segment, position, 1, 1);
+    if (deltaOfDelta == 0)
+    {
+        writeBits(segment, position, 0, 1);
+    }
+    else if (deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        writeBits(segment, position, 0b10, 2);
+        writeBits(segment, position, static_cast<uint64_t>(deltaOfDelta + 63), 7);
+    }
+    else if (deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        writeBits(segment, position, 0b110, 3);
+        writeBits(segment, position, static_cast<uint64_t>(deltaOfDelta + 255), 9);
+    }
+    else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        writeBits(segment, position, 0b1110, 4);
+        writeBits(segment, position, static_cast<uint64_t>(deltaOfDelta + 2047), 12);
+    }
+    else
+    {
+        writeBits(segment, position, 0b1111, 4);
+        writeBits(segment, position, static_cast<uint64_t>(delta), 32);
+    }
+
+    if (xorValue == 0)
+    {
+        writeBits(segment, position, 0, 1);
+    }
+    else
+    {
+        uint8_t leadingZeros = static_cast<uint8_t>(std::countl_zero(xorValue));
+        uint8_t trailingZeros = static_cast<uint8_t>(std::countr_zero(xorValue));
+        if (history.m_leading <= 64 && leadingZeros >= history.m_leading && trailingZeros >= history.m_trailing)
+        {
+            writeBits(segment, position, 0b10, 2);
+            writeBits(segment, position, xorValue >> history.m_trailing, 64 - history.m_leading - history.m_trailing);
+        }
+        else
+        {
+            int length = 64 - leadingZeros - trailingZeros;
+            writeBits(segment, position, 0b11, 2);
+            writeBits(segment, position, leadingZeros, 6);
+            writeBits(segment, position, length - 1, 6);
+            writeBits(segment, position, xorValue >> trailingZeros, length);
+            history.m_leading = leadingZeros;
+            history.m_trailing = trailingZeros;
+        }
+    }
+    history.m_lastSecond = second;
+    history.m_lastDelta = delta;
+    history.m_lastValue = bytes;
+}
+
+// Bits of one segment
+size_t FlowHistory::segmentBits() const
+{
+    return (m_budget / SEGMENTS) * 8;
+}
+
+// Row is free again, its buffer is released
+void FlowHistory::clear(uint32_t row)
+{
+    if (row >= m_rows.size())
+    {
+        return;
+    }
+    if (m_rows[row].m_buffer)
+    {
+        m_allocatedRows--;
+    }
+    m_rows[row] = RowHistory();
+}
+
+// Decode the segments from the oldest, then the open second
+void FlowHistory::read(uint32_t row, std::vector<HistorySample> &samples) const
+{
+    samples.clear();
+    if (row >= m_rows.size())
+    {
+        return;
+    }
+    const RowHistory &history = m_rows[row];
+    for (int i = 0; i < history.m_segments; i++)
+    {
+        int segmentIndex = (history.m_head + SEGMENTS - history.m_segments + 1 + i) % SEGMENTS;
+        const uint8_t *segment = history.m_buffer.get() + segmentIndex * (m_budget / SEGMENTS);
+        uint32_t end = history.m_bits[segmentIndex];
+        uint32_t position = 0;
+        int64_t second = static_cast<int64_t>(readBits(segment, position, 32));
+        uint64_t value = readBits(segment, position, 64);
+        int64_t delta = 1;
+        uint8_t leading = 0, trailing = 0;
+        samples.push_back({m_baseSecond + second, value});
+        while (position < end)
+        {
+            // Same delta and bytes as the previous second
+            if (readBits(segment, position, 1) == 0)
+            {
+                second += delta;
+                samples.push_back({m_baseSecond + second, value});
+                continue;
+            }
+            // Second, a '0' repeats the previous delta
+            if (readBits(segment, position, 1) != 0)
+            {
+                if (readBits(segment, position, 1) == 0)
+                {
+                    delta += static_cast<int64_t>(readBits(segment, position, 7)) - 63;
+                }
+                else if (readBits(segment, position, 1) == 0)
+                {
+                    delta += static_cast<int64_t>(readBits(segment, position, 9)) - 255;
+                }
+                else if (readBits(segment, position, 1) == 0)
+                {
+                    delta += static_cast<int64_t>(readBits(segment, position, 12)) - 2047;
+                }
+                else
+                {
+                    delta = static_cast<int64_t>(readBits(segment, position, 32));
+                }
+            }
+            second += delta;
+
+            // Bytes, a '0' repeats the previous value
+            if (readBits(segment, position, 1) != 0)
+            {
+                if (readBits(segment, position, 1) != 0)
+                {
+                    leading = static_cast<uint8_t>(readBits(segment, position, 6));
+                    int length = static_cast<int>(readBits(segment, position, 6)) + 1;
+                    trailing = static_cast<uint8_t>(64 - leading - length);
+                }
+                value ^= readBits(segment, position, 64 - leading - trailing) << trailing;
+            }
+            samples.push_back({m_baseSecond + second, value});
+        }
+    }
+    if (history.m_open)
+    {
+        samples.push_back({m_baseSecond + history.m_openSecond, history.m_openBytes});
+    }
+}
+
+// Compressed seconds and the open one
+HistorySummary FlowHistory::summary(uint32_t row) const
+{
+    HistorySummary summary;
+    if (row >= m_rows.size())
+    {
+        return summary;
+    }
+    const RowHistory &history = m_rows[row];
+    summary.m_activeSeconds = history.m_activeSeconds + (history.m_open ? 1 : 0);
+    if (summary.m_activeSeconds != 0)
+    {
+        summary.m_firstSecond = m_baseSecond + history.m_firstSecond;
+        summary.m_peakBytes = std::max(history.m_peakBytes, history.m_open ? history.m_openBytes : 0);
+    }
+    return summary;
+}
+
+// Every allocated row holds the whole budget
+size_t FlowHistory::memoryUsage() const
+{
+    return m_allocatedRows * m_budget;
+}
+
+// Sum the samples into periods ending at now and scale them to the levels
+void FlowHistory::sparkline(const std::vector<HistorySample> &samples, int64_t now, int width, int secondsPerChar,
+                            SparklineText &line)
+{
+    width = std::min<int>(width, SparklineText::CAPACITY);
+    uint64_t periods[SparklineText::CAPACITY] = {};
+    for (const HistorySample &sample : samples)
+    {
+        int64_t age = (now - sample.m_second) / secondsPerChar;
+        if (sample.m_second <= now && age < width)
+        {
+            periods[width - 1 - age] += sample.m_bytes;
+        }
+    }
+    uint64_t busiest = *std::max_element(periods, periods + width);
+    const int levels = sizeof(SPARKLINE_LEVELS) - 1;
+    for (int i = 0; i < width; i++)
+    {
+        line.m_text[i] = SPARKLINE_LEVELS[0];
+        if (periods[i] != 0)
+        {
+            // Any traffic shows at least the lowest mark
+            line.m_text[i] = SPARKLINE_LEVELS[1 + static_cast<int>(static_cast<double>(periods[i]) * (levels - 2) / busiest)];
+        }
+    }
+    line.m_length = static_cast<uint8_t>(width);
+}
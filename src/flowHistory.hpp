@@ -0,0 +1,119 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bytes a flow moved in one second
+struct HistorySample
+{
+    int64_t m_second;
+    uint64_t m_bytes;
+};
+
+// Sparkline of a flow, one character per period. Fixed size and trivially copyable like AddressText, so a flow
+// carries it without allocating
+struct SparklineText
+{
+    static constexpr size_t CAPACITY = 20;
+
+    char m_text[CAPACITY];
+    // 0 = no history
+    uint8_t m_length = 0;
+
+    std::string_view view() const
+    {
+        return std::string_view(m_text, m_length);
+    }
+};
+
+// Traffic of a flow over all its recorded seconds, kept beside the compressed samples so it is read without
+// decoding them. m_activeSeconds = 0 for a flow without history
+struct HistorySummary
+{
+    int64_t m_firstSecond = 0;
+    uint32_t m_activeSeconds = 0;
+    uint64_t m_peakBytes = 0;
+};
+
+// FlowHistory keeps the traffic of every flow per second in a fixed byte budget per flow. Samples are
+// compressed like in Gorilla: the second as a delta-of-delta and the bytes XORed with the previous sample.
+// A sample that repeats both is a single bit, so an hour of steady traffic takes about 450 bytes. The
+// budget is split into SEGMENTS independent streams, when the newest is full the oldest is dropped, so a
+// flow keeps as much of its recent history as fits. Seconds without a sample had no traffic
+class FlowHistory
+{
+public:
+    static constexpr int SEGMENTS = 4;
+    // Smallest budget, a segment has to hold the uncompressed first sample
+    static constexpr size_t MIN_BUDGET = 64;
+
+    // Bytes of compressed history per flow, 0 = no history. Drops all recorded history
+    void setBudget(size_t bytes);
+    size_t budget() const;
+    // Number of rows, new rows have no history
+    void resize(size_t rows);
+    // Add bytes the flow of row moved at second. Bytes of the same second are summed, a second is compressed
+    // once a later one is recorded. Seconds earlier than the last recorded one count to the last one
+    void record(uint32_t row, int64_t second, uint64_t bytes);
+    // Forget the history of a row whose flow is gone
+    void clear(uint32_t row);
+    // Samples of the row, oldest first
+    void read(uint32_t row, std::vector<HistorySample> &samples) const;
+    // First second, seconds with traffic and bytes of the busiest second of the row, including the seconds
+    // whose samples were dropped to make room
+    HistorySummary summary(uint32_t row) const;
+    // Memory held by the compressed samples of all rows
+    size_t memoryUsage() const;
+    // One character per secondsPerChar seconds up to now, the height of the character is the traffic of its
+    // period relative to the busiest period. width is at most SparklineText::CAPACITY
+    static void sparkline(const std::vector<HistorySample> &samples, int64_t now, int width, int secondsPerChar,
+                          SparklineText &line);
+
+private:
+    struct RowHistory
+    {
+        // SEGMENTS streams of m_budget / SEGMENTS bytes, allocated by the first sample
+        std::unique_ptr<uint8_t[]> m_buffer;
+        // Used bits of every segment
+        uint32_t m_bits[SEGMENTS] = {};
+        // Segment being written and number of segments with samples
+        uint8_t m_head = 0;
+        uint8_t m_segments = 0;
+        // Encoder state of the head segment: previous second (relative to m_baseSecond), its delta and bytes,
+        // and the window of meaningful bits of the previous XOR (m_leading > 64 = no window)
+        uint8_t m_leading = UINT8_MAX;
+        uint8_t m_trailing = 0;
+        uint32_t m_lastSecond = 0;
+        int64_t m_lastDelta = 0;
+        uint64_t m_lastValue = 0;
+        // Summary of the compressed seconds
+        uint32_t m_firstSecond = 0;
+        uint32_t m_activeSeconds = 0;
+        uint64_t m_peakBytes = 0;
+        // Sample of the current second, not compressed yet
+        bool m_open = false;
+        uint32_t m_openSecond = 0;
+        uint64_t m_openBytes = 0;
+    };
+
+    // Append a sample to the head segment, start the next segment when it doesn't fit
+    void encode(RowHistory &history, uint32_t second, uint64_t bytes);
+    size_t segmentBits() const;
+
+    std::vector<RowHistory> m_rows;
+    size_t m_budget = 0;
+    // Seconds are stored relative to the first recorded second
+    int64_t m_baseSecond = 0;
+    bool m_based = false;
+    // Rows with an allocated buffer
+    size_t m_allocatedRows = 0;
+};
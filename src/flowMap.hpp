@@ -0,0 +1,439 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// FlowMap is an open-addressing hash table for flow keys in the style of Swiss tables.
+// Every slot has one control byte: empty, deleted, or the low 7 bits of the key hash. Slots are
+// probed in aligned groups of 16 control bytes, matched with one SSE2 compare per group, so a lookup
+// usually reads one line of control bytes and one slot. Entries live in one flat array instead of
+// separately allocated nodes.
+// Iteration walks the slot array in order. Erasing does not move other entries (it leaves a
+// tombstone), so iterators stay valid while erasing; inserting may rehash and invalidate them.
+template <typename Key, typename Value, typename Hash>
+class FlowMap
+{
+public:
+    using value_type = std::pair<Key, Value>;
+    static constexpr size_t GROUP_WIDTH = 16;
+
+    // Forward iterator over full slots
+    template <bool Const>
+    class Iterator
+    {
+    public:
+        using Map = std::conditional_t<Const, const FlowMap, FlowMap>;
+        using Reference = std::conditional_t<Const, const value_type &, value_type &>;
+        using Pointer = std::conditional_t<Const, const value_type *, value_type *>;
+
+        Iterator(Map *map, size_t index) : m_map(map), m_index(index)
+        {
+            skipFree();
+        }
+        // Conversion to const iterator
+        operator Iterator<true>() const
+        {
+            return Iterator<true>(m_map, m_index);
+        }
+        Reference operator*() const
+        {
+            return m_map->m_slots[m_index];
+        }
+        Pointer operator->() const
+        {
+            return &m_map->m_slots[m_index];
+        }
+        Iterator &operator++()
+        {
+            m_index++;
+            skipFree();
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(const Iterator &right) const
+        {
+            return m_index == right.m_index;
+        }
+        bool operator!=(const Iterator &right) const
+        {
+            return m_index != right.m_index;
+        }
+
+        Map *m_map;
+        size_t m_index;
+
+    private:
+        // Move to the next full slot or to the end
+        void skipFree()
+        {
+            while (m_index < m_map->m_capacity && !isFull(m_map->m_control[m_index]))
+            {
+                m_index++;
+            }
+        }
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    // Constructor
+    FlowMap() = default;
+    // Destructor
+    ~FlowMap()
+    {
+        destroySlots();
+    }
+    FlowMap(const FlowMap &) = delete;
+    FlowMap &operator=(const FlowMap &) = delete;
+    FlowMap(FlowMap &&other) noexcept
+    {
+        swap(other);
+    }
+    FlowMap &operator=(FlowMap &&other) noexcept
+    {
+        if (this != &other)
+        {
+            FlowMap moved(std::move(other));
+            swap(moved);
+        }
+        return *this;
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+    iterator end()
+    {
+        return iterator(this, m_capacity);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(this, m_capacity);
+    }
+    size_t size() const
+    {
+        return m_size;
+    }
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+    // Number of slots, a power of two multiple of GROUP_WIDTH
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+    // Bytes held by control bytes and slots
+    size_t memoryUsage() const
+    {
+        return m_capacity * (sizeof(int8_t) + sizeof(value_type));
+    }
+
+    // Find the entry with key, end() if there is none
+    iterator find(const Key &key)
+    {
+        return iterator(this, findIndex(key, Hash{}(key)));
+    }
+    const_iterator find(const Key &key) const
+    {
+        return const_iterator(this, findIndex(key, Hash{}(key)));
+    }
+
+    // Insert the entry if its key is not present yet. Returns the entry with the key and whether it was inserted
+    std::pair<iterator, bool> insert(const value_type &entry)
+    {
+        size_t hash = Hash{}(entry.first);
+        size_t index = findIndex(entry.first, hash);
+        if (index != m_capacity)
+        {
+            return {iterator(this, index), false};
+        }
+        index = prepareInsert(hash);
+        std::construct_at(&m_slots[index], entry);
+        return {iterator(this, index), true};
+    }
+
+    // Value of key, default constructed and inserted if missing
+    Value &operator[](const Key &key)
+    {
+        size_t hash = Hash{}(key);
+        size_t index = findIndex(key, hash);
+        if (index == m_capacity)
+        {
+            index = prepareInsert(hash);
+            std::construct_at(&m_slots[index], key, Value());
+        }
+        return m_slots[index].second;
+    }
+
+    // Erase the entry at position, returns iterator to the next entry
+    iterator erase(iterator position)
+    {
+        eraseIndex(position.m_index);
+        ++position;
+        return position;
+    }
+
+    // Erase the entry with key, returns number of erased entries
+    size_t erase(const Key &key)
+    {
+        size_t index = findIndex(key, Hash{}(key));
+        if (index == m_capacity)
+        {
+            return 0;
+        }
+        eraseIndex(index);
+        return 1;
+    }
+
+    // Remove all entries, keeps the allocated slots
+    void clear()
+    {
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            if (isFull(m_control[i]))
+            {
+                std::destroy_at(&m_slots[i]);
+            }
+        }
+        std::memset(m_control.data(), CONTROL_EMPTY, m_capacity);
+        m_size = 0;
+        m_growthLeft = maxLoad(m_capacity);
+    }
+
+    // Make room for count entries without rehashing
+    void reserve(size_t count)
+    {
+        size_t capacity = m_capacity > 0 ? m_capacity : GROUP_WIDTH;
+        while (maxLoad(capacity) < count)
+        {
+            capacity *= 2;
+        }
+        if (capacity > m_capacity)
+        {
+            rehash(capacity);
+        }
+    }
+
+    void swap(FlowMap &other) noexcept
+    {
+        std::swap(m_control, other.m_control);
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_size, other.m_size);
+        std::swap(m_growthLeft, other.m_growthLeft);
+    }
+
+private:
+    static constexpr int8_t CONTROL_EMPTY = static_cast<int8_t>(0x80);
+    static constexpr int8_t CONTROL_DELETED = static_cast<int8_t>(0xFE);
+
+    // Full slots hold the 7 bit hash tag, free slots have the top bit set
+    static bool isFull(int8_t control)
+    {
+        return control >= 0;
+    }
+    // Groups are filled to 7/8 at most, so probing always ends at an empty slot
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+    static int8_t tag(size_t hash)
+    {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    // Bit i of the mask is set when control byte i of the group equals value
+    static uint32_t matchGroup(const int8_t *group, int8_t value)
+    {
+#ifdef __SSE2__
+        __m128i controls = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++)
+        {
+            mask |= static_cast<uint32_t>(group[i] == value) << i;
+        }
+        return mask;
+#endif
+    }
+    // Bit i of the mask is set when slot i of the group is empty or deleted
+    static uint32_t matchFree(const int8_t *group)
+    {
+#ifdef __SSE2__
+        __m128i controls = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(controls));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++)
+        {
+            mask |= static_cast<uint32_t>(!isFull(group[i])) << i;
+        }
+        return mask;
+#endif
+    }
+
+    // Index of the slot with key, m_capacity if not present. Groups are probed quadratically
+    size_t findIndex(const Key &key, size_t hash) const
+    {
+        if (m_capacity == 0)
+        {
+            return m_capacity;
+        }
+        size_t groupMask = m_capacity / GROUP_WIDTH - 1;
+        size_t group = (hash >> 7) & groupMask;
+        for (size_t step = 1;; step++)
+        {
+            const int8_t *controls = &m_control[group * GROUP_WIDTH];
+            for (uint32_t match = matchGroup(controls, tag(hash)); match != 0; match &= match - 1)
+            {
+                size_t index = group * GROUP_WIDTH + __builtin_ctz(match);
+                if (m_slots[index].first == key)
+                {
+                    return index;
+                }
+            }
+            // An empty slot ends the probe sequence, the key would have been placed there
+            if (matchGroup(controls, CONTROL_EMPTY) != 0 || step > groupMask)
+            {
+                return m_capacity;
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+
+    // First free slot on the probe sequence of hash, grows the table if it is full. The slot is marked full
+    size_t prepareInsert(size_t hash)
+    {
+        if (m_growthLeft == 0)
+        {
+            // Growth was used up by tombstones: rehash at the same size, otherwise double
+            if (m_capacity > 0 && m_size * 32 <= m_capacity * 25)
+            {
+                rehash(m_capacity);
+            }
+            else
+            {
+                rehash(m_capacity > 0 ? m_capacity * 2 : GROUP_WIDTH);
+            }
+        }
+        size_t index = findFree(hash);
+        if (m_control[index] == CONTROL_EMPTY)
+        {
+            m_growthLeft--;
+        }
+        m_control[index] = tag(hash);
+        m_size++;
+        return index;
+    }
+
+    // First empty or deleted slot on the probe sequence of hash
+    size_t findFree(size_t hash) const
+    {
+        size_t groupMask = m_capacity / GROUP_WIDTH - 1;
+        size_t group = (hash >> 7) & groupMask;
+        for (size_t step = 1;; step++)
+        {
+            uint32_t match = matchFree(&m_control[group * GROUP_WIDTH]);
+            if (match != 0)
+            {
+                return group * GROUP_WIDTH + __builtin_ctz(match);
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+
+    // A slot can become empty again only if its group still has an empty slot: then no probe
+    // sequence has ever passed this group. Otherwise it is marked deleted
+    void eraseIndex(size_t index)
+    {
+        std::destroy_at(&m_slots[index]);
+        const int8_t *controls = &m_control[index / GROUP_WIDTH * GROUP_WIDTH];
+        if (matchGroup(controls, CONTROL_EMPTY) != 0)
+        {
+            m_control[index] = CONTROL_EMPTY;
+            m_growthLeft++;
+        }
+        else
+        {
+            m_control[index] = CONTROL_DELETED;
+        }
+        m_size--;
+    }
+
+    // Move all entries into a table with capacity slots, drops tombstones
+    void rehash(size_t capacity)
+    {
+        std::vector<int8_t> oldControl(capacity, CONTROL_EMPTY);
+        std::swap(oldControl, m_control);
+        value_type *oldSlots = m_slots;
+        size_t oldCapacity = m_capacity;
+
+        m_slots = std::allocator<value_type>().allocate(capacity);
+        m_capacity = capacity;
+        m_growthLeft = maxLoad(capacity) - m_size;
+        for (size_t i = 0; i < oldCapacity; i++)
+        {
+            if (isFull(oldControl[i]))
+            {
+                size_t hash = Hash{}(oldSlots[i].first);
+                size_t index = findFree(hash);
+                m_control[index] = tag(hash);
+                std::construct_at(&m_slots[index], std::move(oldSlots[i]));
+                std::destroy_at(&oldSlots[i]);
+            }
+        }
+        if (oldSlots != nullptr)
+        {
+            std::allocator<value_type>().deallocate(oldSlots, oldCapacity);
+        }
+    }
+
+    // Destroy entries and free the slot array
+    void destroySlots()
+    {
+        if (m_slots == nullptr)
+        {
+            return;
+        }
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            if (isFull(m_control[i]))
+            {
+                std::destroy_at(&m_slots[i]);
+            }
+        }
+        std::allocator<value_type>().deallocate(m_slots, m_capacity);
+        m_slots = nullptr;
+    }
+
+    std::vector<int8_t> m_control;
+    value_type *m_slots = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+    // Empty slots that may still be used before the table has to grow
+    size_t m_growthLeft = 0;
+};
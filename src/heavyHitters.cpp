@@ -0,0 +1,215 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "heavyHitters.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+
+// Counters and candidate slots allocated at once, so memory doesn't change while traffic is counted
+void HeavyHitters::configure(size_t width, size_t depth, size_t candidates)
+{
+    m_width = std::bit_ceil(std::max<size_t>(width, 1));
+    m_depth = std::clamp<size_t>(depth, 1, MAX_DEPTH);
+    m_candidateLimit = std::max<size_t>(candidates, 1);
+    m_counters.assign(m_width * m_depth, 0);
+    m_counters.shrink_to_fit();
+    m_candidates.clear();
+    m_candidates.reserve(m_candidateLimit);
+    // The index stays half empty, so flows replacing each other leave few tombstones
+    m_candidateSlots.clear();
+    m_candidateSlots.reserve(2 * m_candidateLimit);
+    m_eviction.clear();
+    m_bytesSent = m_bytesReceived = m_packets = 0;
+}
+
+// False until configure
+bool HeavyHitters::configured() const
+{
+    return m_width != 0;
+}
+
+// The flow hash picks the first counter, a second hash derived from it the step between rows
+void HeavyHitters::counterIndexes(const ConnectionID &id, size_t (&indexes)[MAX_DEPTH]) const
+{
+    uint64_t hash = ConnectionIDHash{}(id);
+    uint64_t step = FlowHash::mix(hash ^ FlowHash::SECRET2, FlowHash::SECRET3) | 1;
+    for (size_t row = 0; row < m_depth; row++)
+    {
+        indexes[row] = row * m_width + ((hash + row * step) & (m_width - 1));
+    }
+}
+
+// Raises the counters of the flow to its new estimate, then updates its candidate slot or tries to take one
+void HeavyHitters::add(const ConnectionID &id, uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived)
+{
+    m_bytesSent += bytesSent;
+    m_bytesReceived += bytesReceived;
+    m_packets += packetsSent + packetsReceived;
+
+    size_t indexes[MAX_DEPTH];
+    counterIndexes(id, indexes);
+    uint64_t estimate = UINT64_MAX;
+    for (size_t row = 0; row < m_depth; row++)
+    {
+        estimate = std::min(estimate, m_counters[indexes[row]]);
+    }
+    // Conservative update: a counter already above the new estimate holds bytes of other flows
+    estimate += bytesSent + bytesReceived;
+    for (size_t row = 0; row < m_depth; row++)
+    {
+        m_counters[indexes[row]] = std::max(m_counters[indexes[row]], estimate);
+    }
+
+    uint32_t slot;
+    auto found = m_candidateSlots.find(id);
+    if (found != m_candidateSlots.end())
+    {
+        slot = found->second;
+    }
+    else
+    {
+        slot = candidateSlot(id, estimate);
+        if (slot == UINT32_MAX)
+        {
+            return;
+        }
+    }
+    Candidate &candidate = m_candidates[slot];
+    candidate.m_estimate = estimate;
+    candidate.m_bytesSent += bytesSent;
+    candidate.m_bytesReceived += bytesReceived;
+    candidate.m_packetsSent += packetsSent;
+    candidate.m_packetsReceived += packetsReceived;
+}
+
+// A free slot, or the slot with the lowest estimate if the flow's estimate is larger
+uint32_t HeavyHitters::candidateSlot(const ConnectionID &id, uint64_t estimate)
+{
+    uint32_t slot;
+    if (m_candidates.size() < m_candidateLimit)
+    {
+        slot = static_cast<uint32_t>(m_candidates.size());
+        m_candidates.emplace_back();
+    }
+    else
+    {
+        slot = m_eviction.best();
+        while (m_eviction.score(slot) != -static_cast<double>(m_candidates[slot].m_estimate))
+        {
+            m_eviction.update(slot, -static_cast<double>(m_candidates[slot].m_estimate));
+            slot = m_eviction.best();
+        }
+        if (m_candidates[slot].m_estimate >= estimate)
+        {
+            return UINT32_MAX;
+        }
+        m_candidateSlots.erase(m_candidates[slot].m_ID);
+        m_candidates[slot] = Candidate();
+    }
+    m_candidates[slot].m_ID = id;
+    m_candidateSlots.insert({id, slot});
+    m_eviction.update(slot, -static_cast<double>(estimate));
+    return slot;
+}
+
+// Smallest counter of the flow
+uint64_t HeavyHitters::estimate(const ConnectionID &id) const
+{
+    if (!configured())
+    {
+        return 0;
+    }
+    size_t indexes[MAX_DEPTH];
+    counterIndexes(id, indexes);
+    uint64_t estimate = UINT64_MAX;
+    for (size_t row = 0; row < m_depth; row++)
+    {
+        estimate = std::min(estimate, m_counters[indexes[row]]);
+    }
+    return estimate;
+}
+
+// Largest candidates with their exact traffic and error. The lower bound of a flow is its exact traffic or its
+// estimate less the error bound, whichever is larger
+void HeavyHitters::top(size_t count, double seconds, std::vector<HeavyHitter> &hitters)
+{
+    std::vector<uint32_t> slots(m_candidates.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    count = std::min(count, slots.size());
+    std::partial_sort(slots.begin(), slots.begin() + count, slots.end(),
+                      [this](uint32_t first, uint32_t second)
+                      { return m_candidates[first].m_estimate > m_candidates[second].m_estimate; });
+
+    uint64_t bound = errorBound();
+    hitters.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const Candidate &candidate = m_candidates[slots[i]];
+        HeavyHitter &hitter = hitters[i];
+        Connection &connection = hitter.m_connection;
+        connection = Connection();
+        connection.m_ID = candidate.m_ID;
+        ConnectionID::formatAddress(candidate.m_ID.m_srcAddress, connection.m_srcText);
+        ConnectionID::formatAddress(candidate.m_ID.m_destAddress, connection.m_destText);
+        connection.m_ipFamily = candidate.m_ID.isIPv4() ? IPFamily::IPv4 : IPFamily::IPv6;
+        connection.m_bytesSent = candidate.m_bytesSent;
+        connection.m_bytesReceived = candidate.m_bytesReceived;
+        connection.m_packetsSent = candidate.m_packetsSent;
+        connection.m_packetsReceived = candidate.m_packetsReceived;
+        if (seconds > 0)
+        {
+            connection.m_rxSpeedBytes = (candidate.m_bytesReceived - candidate.m_periodBytesReceived) / seconds;
+            connection.m_txSpeedBytes = (candidate.m_bytesSent - candidate.m_periodBytesSent) / seconds;
+            connection.m_rxSpeedPackets = (candidate.m_packetsReceived - candidate.m_periodPacketsReceived) / seconds;
+            connection.m_txSpeedPackets = (candidate.m_packetsSent - candidate.m_periodPacketsSent) / seconds;
+        }
+        hitter.m_estimate = candidate.m_estimate;
+        uint64_t lower = std::max(candidate.m_bytesSent + candidate.m_bytesReceived,
+                                  candidate.m_estimate > bound ? candidate.m_estimate - bound : 0);
+        hitter.m_error = candidate.m_estimate - lower;
+    }
+
+    for (Candidate &candidate : m_candidates)
+    {
+        candidate.m_periodBytesSent = candidate.m_bytesSent;
+        candidate.m_periodBytesReceived = candidate.m_bytesReceived;
+        candidate.m_periodPacketsSent = candidate.m_packetsSent;
+        candidate.m_periodPacketsReceived = candidate.m_packetsReceived;
+    }
+}
+
+// e / width of all bytes counted, rounded up
+uint64_t HeavyHitters::errorBound() const
+{
+    if (!configured())
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::ceil(std::exp(1.0) * (m_bytesSent + m_bytesReceived) / m_width));
+}
+
+// 1 - e^-depth
+double HeavyHitters::confidence() const
+{
+    return configured() ? 1 - std::exp(-static_cast<double>(m_depth)) : 0;
+}
+
+// Traffic of all flows since configure
+void HeavyHitters::totals(uint64_t &bytesSent, uint64_t &bytesReceived, uint64_t &packets) const
+{
+    bytesSent = m_bytesSent;
+    bytesReceived = m_bytesReceived;
+    packets = m_packets;
+}
+
+// Counters, candidates with their index and ranking
+size_t HeavyHitters::memoryUsage() const
+{
+    return m_counters.capacity() * sizeof(uint64_t) + m_candidates.capacity() * sizeof(Candidate) +
+           m_candidateSlots.memoryUsage() + m_candidateLimit * (2 * sizeof(uint32_t) + sizeof(double));
+}
@@ -0,0 +1,104 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "connection.hpp"
+#include "connectionID.hpp"
+#include "flowMap.hpp"
+#include "rankHeap.hpp"
+
+// When the connections table counts new traffic in the sketch instead of exact flows, and the size of the sketch
+struct SketchConfig
+{
+    // Sketch from the start
+    bool m_always = false;
+    // Flows in the table at which traffic goes to the sketch, 0 = never automatically
+    size_t m_threshold = 0;
+    // Counters of every Count-Min row (a power of two), rows, and flows kept as heavy hitter candidates
+    size_t m_width = 1 << 16;
+    size_t m_depth = 4;
+    size_t m_candidates = 256;
+};
+
+// Flow estimated by the sketch to be among the largest
+struct HeavyHitter
+{
+    // Traffic counted exactly since the flow became a candidate, speeds over the last period
+    Connection m_connection;
+    // Bytes of the flow since the sketch started, never less than the true bytes
+    uint64_t m_estimate = 0;
+    // The true bytes are at least m_estimate - m_error
+    uint64_t m_error = 0;
+};
+
+// HeavyHitters counts the bytes of any number of flows in fixed memory. The Count-Min sketch has m_depth rows
+// of m_width counters, a flow adds to one counter of every row (conservative update: only the counters below
+// its new estimate are raised) and its estimate is the smallest of them. The estimate is never below the true
+// bytes, and with probability 1 - e^-depth it is above them by at most e / width of all bytes. Flows with the
+// largest estimates are candidates replaced like in Space-Saving: a flow whose estimate exceeds the lowest
+// candidate takes over its slot, and from then on counts its traffic exactly, which bounds its bytes from below.
+// A packet costs one counter per row and one candidate lookup, taking over a slot O(log candidates)
+class HeavyHitters
+{
+public:
+    static constexpr size_t MAX_DEPTH = 8;
+
+    // Allocates the counters and candidate slots, drops everything counted. The width is rounded up to a
+    // power of two, the depth limited to 1..MAX_DEPTH
+    void configure(size_t width, size_t depth, size_t candidates);
+    bool configured() const;
+    void add(const ConnectionID &id, uint64_t bytesSent, uint64_t packetsSent, uint64_t bytesReceived, uint64_t packetsReceived);
+    // Estimated bytes of the flow
+    uint64_t estimate(const ConnectionID &id) const;
+    // Up to count candidates with the largest estimates, largest first. Speeds are the traffic since the
+    // previous call over seconds, every call starts a new period
+    void top(size_t count, double seconds, std::vector<HeavyHitter> &hitters);
+    // An estimate exceeds the true bytes by at most errorBound() with probability confidence()
+    uint64_t errorBound() const;
+    double confidence() const;
+    // Traffic of all flows counted
+    void totals(uint64_t &bytesSent, uint64_t &bytesReceived, uint64_t &packets) const;
+    // Memory held by the counters and the candidates, fixed by configure
+    size_t memoryUsage() const;
+
+private:
+    // Flow holding a candidate slot
+    struct Candidate
+    {
+        ConnectionID m_ID;
+        uint64_t m_estimate = 0;
+        // Exact traffic since the flow took the slot, and the bytes and packets at the previous top
+        uint64_t m_bytesSent = 0;
+        uint64_t m_bytesReceived = 0;
+        uint64_t m_packetsSent = 0;
+        uint64_t m_packetsReceived = 0;
+        uint64_t m_periodBytesSent = 0;
+        uint64_t m_periodBytesReceived = 0;
+        uint64_t m_periodPacketsSent = 0;
+        uint64_t m_periodPacketsReceived = 0;
+    };
+
+    // Index of the counter of the flow in every row, rows use the double hashing h1 + row * h2 of its hash
+    void counterIndexes(const ConnectionID &id, size_t (&indexes)[MAX_DEPTH]) const;
+    // Slot for a flow with estimate, UINT32_MAX when every candidate has a larger one
+    uint32_t candidateSlot(const ConnectionID &id, uint64_t estimate);
+
+    std::vector<uint64_t> m_counters;
+    size_t m_width = 0;
+    size_t m_depth = 0;
+    size_t m_candidateLimit = 0;
+    std::vector<Candidate> m_candidates;
+    FlowMap<ConnectionID, uint32_t, ConnectionIDHash> m_candidateSlots;
+    // Slots ranked by their negated estimate, the best is the slot to take over. Estimates only grow, scores
+    // are brought up to date when a slot is taken over, an outdated best slot is fixed and the next tried
+    RankHeap m_eviction;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+    uint64_t m_packets = 0;
+};
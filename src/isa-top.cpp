@@ -11,6 +11,9 @@
 #include <thread>
 #include <memory>
 #include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
 
 // Global pointer to connections table
 ConnectionsTable *globalConnectionsTable = nullptr;
@@ -29,12 +32,32 @@ void runCapture(PacketCapture &pc)
     pc.startCapture();
 }
 
+// Keep capture worker on one CPU so its shard stays in that CPU's cache
+void pinThread(std::thread &thread, unsigned int index)
+{
+    unsigned int cpuCount = std::thread::hardware_concurrency();
+    if (cpuCount == 0)
+    {
+        return;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(index % cpuCount, &cpuSet);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+}
+
 // Run display in its own thread
 void runDisplay(Display &display)
 {
     display.run();
 }
 
+// Compute the speeds in their own thread, independent of the screen refresh
+void runStatistics(Display &display)
+{
+    display.runStatistics();
+}
+
 int main(int argc, char *argv[])
 {
     // Get command line arguments
@@ -51,10 +74,38 @@ int main(int argc, char *argv[])
     }
     // Signal handler for Ctrl+C
     std::signal(SIGINT, signalHandler);
-    // Create PacketCapture object based on the specified interface
-    PacketCapture pc(cli.m_interface, ct);
-    // Create display object based on the specified sorting criteria
-    Display display(ct, cli.m_sortBy, 1);
+    // Create PacketCapture objects based on the specified interface. With more workers every one of them
+    // joins the same fanout group and writes to its own shard of the connections table
+    std::vector<std::unique_ptr<PacketCapture>> captures;
+    if (cli.m_captureConfig.m_workers > 1)
+    {
+        cli.m_captureConfig.m_fanoutGroup = getpid() & 0xffff;
+        for (unsigned int i = 0; i < cli.m_captureConfig.m_workers; i++)
+        {
+            captures.push_back(std::make_unique<PacketCapture>(cli.m_interface, ct.addShard()));
+        }
+    }
+    else
+    {
+        captures.push_back(std::make_unique<PacketCapture>(cli.m_interface, ct));
+    }
+    for (auto &capture : captures)
+    {
+        capture->m_config = cli.m_captureConfig;
+    }
+    // Idle timeouts and flow limit, after the shards exist so they get their part of the limit
+    ct.setExpiryConfig(cli.m_expiryConfig);
+    ct.setSketchConfig(cli.m_sketchConfig);
+    ct.setEwmaWindow(cli.m_ewmaWindow);
+    ct.setHistoryBudget(cli.m_historyBudget);
+    ct.setRollupHosts(cli.m_rollupHosts);
+    // Create display object based on the specified sorting criteria, refresh and statistics intervals
+    Display display(ct, cli.m_sortBy, cli.m_refreshMs);
+    display.m_statsInterval = std::chrono::milliseconds(cli.m_statsMs);
+    for (auto &capture : captures)
+    {
+        display.m_captures.push_back(capture.get());
+    }
 
     // If --log was specified, set the log file stream
     if (!cli.m_logFilePath.empty())
@@ -62,13 +113,26 @@ int main(int argc, char *argv[])
         ct.setLogFileStream();
     }
 
-    // Start capture packets thread
-    std::thread captureThread(runCapture, std::ref(pc));
-    // Start display thread
+    // Start capture packets threads
+    std::vector<std::thread> captureThreads;
+    for (unsigned int i = 0; i < captures.size(); i++)
+    {
+        captureThreads.emplace_back(runCapture, std::ref(*captures[i]));
+        if (captures.size() > 1)
+        {
+            pinThread(captureThreads.back(), i);
+        }
+    }
+    // Start statistics and display threads
+    std::thread statisticsThread(runStatistics, std::ref(display));
     std::thread displayThread(runDisplay, std::ref(display));
 
-    // Wait for both threads to finish
-    captureThread.join();
+    // Wait for all threads to finish
+    for (std::thread &captureThread : captureThreads)
+    {
+        captureThread.join();
+    }
+    statisticsThread.join();
     displayThread.join();
 
     return 0;
@@ -15,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <cstring>
+#include <thread>
 #include <netinet/ip_icmp.h>
 #include <netinet/icmp6.h>
 #include "connectionsTable.hpp"
@@ -27,8 +28,14 @@ PacketCapture::PacketCapture(std::string interfaceName, ConnectionsTable &connec
     m_pcapHandle = nullptr;
     m_interfaceName = interfaceName;
     m_isCapturing = false;
+    m_stopRequested = false;
+    m_assumeTransmit = false;
+    m_replayStarted = false;
+    m_nanoTimestamps = false;
     initLocalAddresses();
-    m_dataLinkType = 0;
+    // Ethernet until the capture engine reports otherwise
+    m_dataLinkType = DLT_EN10MB;
+    m_linkLevelHeaderLen = 14;
 }
 // Destructor
 PacketCapture::~PacketCapture()
@@ -105,38 +112,47 @@ bool PacketCapture::isLocalIPv6Address(const in6_addr &addr)
 // processing loop
 void PacketCapture::startCapture()
 {
-    char currentError[PCAP_ERRBUF_SIZE];
-    // Open network interface for capture
-    m_pcapHandle = pcap_open_live(m_interfaceName.c_str(), BUFSIZ, 1, 1000, currentError);
-    if (m_pcapHandle == nullptr)
+    m_batch.reserve(m_config.m_batchSize);
+
+    // Capture file replay and native ring have their own setup and loop
+    if (!m_config.m_readFile.empty())
     {
-        endwin();
-        std::cerr << "Couldn't open interface " << m_interfaceName << ": " << currentError << std::endl;
-        exit(EXIT_FAILURE);
+        startReplay();
+        return;
+    }
+    if (m_config.m_backend == CaptureBackend::RING)
+    {
+        startRingCapture();
+        return;
     }
+
+    // Open network interface for capture. Only headers are needed, so the snaplen is computed for Ethernet
+    // first and the handle is reopened if the interface turns out to have a longer link level header
+    int snaplen = headerSnaplen(DLT_EN10MB);
+    openInterface(snaplen);
     m_dataLinkType = pcap_datalink(m_pcapHandle);
 
     // Get data link type to ensure app will correctly work on loopback interface
-    switch (m_dataLinkType)
+    if (!setLinkLevelHeaderLen(m_dataLinkType))
     {
-    case DLT_EN10MB:
-        m_linkLevelHeaderLen = 14; // Ethernet
-        break;
-    case DLT_NULL:
-        m_linkLevelHeaderLen = 4; // Loopback
-        break;
-    case DLT_LOOP:
-        m_linkLevelHeaderLen = 4; // Loopback
-        break;
-    default:
         endwin();
         std::cerr << "Unsupported datalink type: " << m_dataLinkType << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (headerSnaplen(m_dataLinkType) > snaplen)
+    {
+        pcap_close(m_pcapHandle);
+        openInterface(headerSnaplen(m_dataLinkType));
+    }
+    // Let the kernel drop packets that don't match the filter
+    setFilter();
 
-    m_isCapturing = true;
-    // Main loop, 0 for endless loop
-    int loopStatus = pcap_loop(m_pcapHandle, 0, PacketCapture::packetHandler, reinterpret_cast<unsigned char *>(this));
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        m_isCapturing = true;
+    }
+    // Main loop, runs until error or pcap_breakloop
+    int loopStatus = dispatchLoop(PacketCapture::batchHandler, false);
     // Handle loop status
     if (loopStatus == -1)
     {
@@ -153,35 +169,499 @@ void PacketCapture::startCapture()
         std::cerr << "Packet capture ended normally." << std::endl;
     }
 
-    pcap_close(m_pcapHandle);
-    m_pcapHandle = nullptr;
-    m_isCapturing = false;
+    sampleStats(true);
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        m_isCapturing = false;
+        pcap_close(m_pcapHandle);
+        m_pcapHandle = nullptr;
+    }
 
     std::cerr << "Packet capture stopped." << std::endl;
 }
 
-// Method to stop capture and clean up after
-void PacketCapture::stopCapture()
+// Opens the interface with pcap_create so snaplen, kernel buffer size and delivery mode can be set before activation
+void PacketCapture::openInterface(int snaplen)
 {
-    if (m_isCapturing && m_pcapHandle != nullptr)
+    char currentError[PCAP_ERRBUF_SIZE];
+    m_pcapHandle = pcap_create(m_interfaceName.c_str(), currentError);
+    if (m_pcapHandle == nullptr)
     {
-        pcap_breakloop(m_pcapHandle);
+        endwin();
+        std::cerr << "Couldn't open interface " << m_interfaceName << ": " << currentError << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    pcap_set_snaplen(m_pcapHandle, snaplen);
+    pcap_set_promisc(m_pcapHandle, 1);
+    // Immediate mode delivers every packet as soon as it arrives, otherwise the kernel waits up to the timeout
+    if (m_config.m_immediateMode)
+    {
+        pcap_set_immediate_mode(m_pcapHandle, 1);
+    }
+    else
+    {
+        pcap_set_timeout(m_pcapHandle, m_config.m_timeoutMs);
+    }
+    // 0 keeps the libpcap default
+    if (m_config.m_bufferSizeMB > 0)
+    {
+        pcap_set_buffer_size(m_pcapHandle, static_cast<int>(m_config.m_bufferSizeMB) * 1024 * 1024);
+    }
+    // Timestamp source chosen by the user, an unsupported one is only a warning of pcap_activate
+    if (!m_config.m_tstampType.empty())
+    {
+        int tstampType = pcap_tstamp_type_name_to_val(m_config.m_tstampType.c_str());
+        if (tstampType < 0)
+        {
+            endwin();
+            std::cerr << "Unknown timestamp type " << m_config.m_tstampType << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        pcap_set_tstamp_type(m_pcapHandle, tstampType);
+    }
+    // Nanosecond timestamps where the platform has them, microseconds otherwise
+    pcap_set_tstamp_precision(m_pcapHandle, PCAP_TSTAMP_PRECISION_NANO);
+
+    // Positive status is only a warning (e.g. promiscuous mode not supported)
+    int status = pcap_activate(m_pcapHandle);
+    if (status < 0)
+    {
+        endwin();
+        std::cerr << "Couldn't open interface " << m_interfaceName << ": " << pcap_statustostr(status)
+                  << " (" << pcap_geterr(m_pcapHandle) << ")" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    m_nanoTimestamps = pcap_get_tstamp_precision(m_pcapHandle) == PCAP_TSTAMP_PRECISION_NANO;
+}
+
+// Number of bytes needed to parse link level, IP (with options) and ports of a packet
+int PacketCapture::headerSnaplen(int dataLinkType)
+{
+    int linkLevelHeaderLen = getLinkLevelHeaderLen(dataLinkType);
+    if (linkLevelHeaderLen < 0)
+    {
+        linkLevelHeaderLen = 16;
+    }
+    // 802.1Q tag reinserted by libpcap, largest IPv4 header (IPv6 header is 40) and first 8 bytes of L4 header
+    return linkLevelHeaderLen + 4 + 60 + 8;
+}
+
+// Compiles the filter expression and installs it on the pcap handle. For live capture libpcap
+// attaches the program to its socket, so filtered packets never reach userspace
+void PacketCapture::setFilter()
+{
+    if (m_config.m_filter.empty())
+    {
+        return;
+    }
+    struct bpf_program program;
+    if (pcap_compile(m_pcapHandle, &program, m_config.m_filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0)
+    {
+        endwin();
+        std::cerr << "Couldn't parse filter " << m_config.m_filter << ": " << pcap_geterr(m_pcapHandle) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (pcap_setfilter(m_pcapHandle, &program) != 0)
+    {
+        endwin();
+        std::cerr << "Couldn't install filter " << m_config.m_filter << ": " << pcap_geterr(m_pcapHandle) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    pcap_freecode(&program);
+}
+
+// Drains up to m_batchSize packets per pcap_dispatch call and applies them to the table as one batch.
+// Returns -1 on error, -2 after pcap_breakloop and 0 when a capture file ends
+int PacketCapture::dispatchLoop(pcap_handler handler, bool isFile)
+{
+    while (true)
+    {
+        // A stop that came before the handle was published could not break the loop
+        if (m_stopRequested)
+        {
+            return -2;
+        }
+        int count = pcap_dispatch(m_pcapHandle, m_config.m_batchSize, handler, reinterpret_cast<unsigned char *>(this));
+        flushBatch();
+        if (!isFile)
+        {
+            sampleStats();
+        }
+        if (count < 0)
+        {
+            return count;
+        }
+        // Live capture returns 0 on timeout, file only at its end
+        if (count == 0 && isFile)
+        {
+            return 0;
+        }
+    }
+}
+
+// Length of the link level header for the datalink type, -1 if the type is not supported
+int PacketCapture::getLinkLevelHeaderLen(int dataLinkType)
+{
+    switch (dataLinkType)
+    {
+    case DLT_EN10MB:
+        return 14; // Ethernet
+    case DLT_NULL:
+        return 4; // Loopback
+    case DLT_LOOP:
+        return 4; // Loopback
+    case DLT_LINUX_SLL:
+        return 16; // Linux cooked capture (-i any)
+    case DLT_RAW:
+        return 0; // Bare IP
+    }
+    return -1;
+}
+
+// Sets length of the link level header for the datalink type, returns false if the type is not supported
+bool PacketCapture::setLinkLevelHeaderLen(int dataLinkType)
+{
+    int linkLevelHeaderLen = getLinkLevelHeaderLen(dataLinkType);
+    if (linkLevelHeaderLen < 0)
+    {
+        return false;
+    }
+    m_linkLevelHeaderLen = linkLevelHeaderLen;
+    return true;
+}
+
+// Replays packets from a pcap/pcapng file. Rates are calculated on a clock driven by packet timestamps,
+// packets are either pushed as fast as possible or paced by the gaps between their timestamps
+void PacketCapture::startReplay()
+{
+    char currentError[PCAP_ERRBUF_SIZE];
+    // Open capture file, microsecond files are scaled to nanoseconds by libpcap
+    m_pcapHandle = pcap_open_offline_with_tstamp_precision(m_config.m_readFile.c_str(), PCAP_TSTAMP_PRECISION_NANO, currentError);
+    if (m_pcapHandle == nullptr)
+    {
+        endwin();
+        std::cerr << "Couldn't open capture file " << m_config.m_readFile << ": " << currentError << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    m_dataLinkType = pcap_datalink(m_pcapHandle);
+    m_nanoTimestamps = pcap_get_tstamp_precision(m_pcapHandle) == PCAP_TSTAMP_PRECISION_NANO;
+    setFilter();
+    if (!setLinkLevelHeaderLen(m_dataLinkType))
+    {
+        endwin();
+        std::cerr << "Unsupported datalink type: " << m_dataLinkType << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Without local addresses of a capturing host every packet is accounted to its source
+    if (m_localIPv4Addresses.empty() && m_localIPv6Addresses.empty())
+    {
+        m_assumeTransmit = true;
+    }
+    m_connectionsTable.setSimulatedClock(true);
+    m_replayStarted = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        m_isCapturing = true;
+    }
+    int loopStatus = dispatchLoop(PacketCapture::replayHandler, true);
+    if (loopStatus == -1)
+    {
+        endwin();
+        std::cerr << "Error during capture file replay: " << pcap_geterr(m_pcapHandle) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        m_isCapturing = false;
         pcap_close(m_pcapHandle);
         m_pcapHandle = nullptr;
+    }
+}
+
+// Callback for replay. Advances the simulated clock, waits for the packet's turn when pacing and adds it to the batch
+void PacketCapture::replayHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet)
+{
+    PacketCapture *self = reinterpret_cast<PacketCapture *>(packetCaptureObject);
+    std::chrono::nanoseconds packetTime = self->packetTime(pkthdr).time_since_epoch();
+
+    if (!self->m_replayStarted)
+    {
+        self->m_replayStarted = true;
+        self->m_replayFirstPacket = packetTime;
+        self->m_replayWallStart = std::chrono::steady_clock::now();
+    }
+    // Sleep until the same offset from the start as in the original capture, packets gathered so far
+    // must not wait in the batch for that long
+    if (self->m_config.m_replayPaced && packetTime > self->m_replayFirstPacket)
+    {
+        auto packetDue = self->m_replayWallStart + (packetTime - self->m_replayFirstPacket);
+        if (packetDue > std::chrono::steady_clock::now())
+        {
+            self->flushBatch();
+            std::this_thread::sleep_until(packetDue);
+        }
+    }
+
+    self->m_connectionsTable.setSimulatedTime(self->packetTime(pkthdr));
+    batchHandler(packetCaptureObject, pkthdr, packet);
+}
+
+// Starts packet capturing through the TPACKET_V3 ring. Frames are parsed straight from the ring, every block is one batch
+void PacketCapture::startRingCapture()
+{
+    m_ring = std::make_unique<RingCapture>(m_interfaceName, m_config.m_ringSizeMB, m_config.m_blockTimeoutMs);
+    m_ring->m_fanoutGroup = m_config.m_fanoutGroup;
+    m_ring->m_filter = m_config.m_filter;
+    m_ring->m_snaplen = headerSnaplen(DLT_EN10MB);
+
+    std::string ringError;
+    if (!m_ring->open(ringError))
+    {
+        endwin();
+        std::cerr << "Couldn't open ring on interface " << m_interfaceName << ": " << ringError << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    m_dataLinkType = m_ring->m_dataLinkType;
+    m_linkLevelHeaderLen = 14; // Ethernet
+    // The ring hands over the nanosecond timestamps of TPACKET_V3
+    m_nanoTimestamps = true;
+
+    // A stop that came while the ring was opening saw it unpublished, so it is applied here
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        m_isCapturing = true;
+        if (m_stopRequested)
+        {
+            m_ring->stop();
+        }
+    }
+    m_ring->run(PacketCapture::batchHandler, reinterpret_cast<unsigned char *>(this), PacketCapture::flushHandler);
+
+    sampleStats(true);
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
         m_isCapturing = false;
+        m_ring->close();
     }
+
+    std::cerr << "Packet capture stopped." << std::endl;
+}
+
+// Method to stop capture. The capture loop closes its handle once it returns, under m_handleMutex like this
+// call, so the handle is either stopped while it is open or already closed and left alone. A loop that has
+// not published its handle yet sees m_stopRequested instead
+void PacketCapture::stopCapture()
+{
+    m_stopRequested = true;
+    std::lock_guard<std::mutex> lock(m_handleMutex);
+    if (!m_isCapturing)
+    {
+        return;
+    }
+    if (m_ring != nullptr)
+    {
+        m_ring->stop();
+    }
+    else if (m_pcapHandle != nullptr)
+    {
+        // Breaks both live capture and replay
+        pcap_breakloop(m_pcapHandle);
+    }
+}
+
+// Last counters published by the capture thread, the handle and the ring are never touched here. Replay
+// has nothing to drop and publishes none
+bool PacketCapture::getStats(uint64_t &received, uint64_t &dropped)
+{
+    if (!m_haveStats.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    received = m_statsReceived.load(std::memory_order_relaxed);
+    dropped = m_statsDropped.load(std::memory_order_relaxed);
+    return true;
+}
+
+// Capture thread only, while its handle or ring is open. Counters from libpcap or from the ring socket
+void PacketCapture::sampleStats(bool force)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now < m_nextStats)
+    {
+        return;
+    }
+    m_nextStats = now + STATS_INTERVAL;
+    uint64_t received = 0, dropped = 0;
+    if (m_ring != nullptr)
+    {
+        if (!m_ring->getStats(received, dropped))
+        {
+            return;
+        }
+    }
+    else
+    {
+        struct pcap_stat stats;
+        if (m_pcapHandle == nullptr || pcap_stats(m_pcapHandle, &stats) != 0)
+        {
+            return;
+        }
+        received = stats.ps_recv;
+        dropped = stats.ps_drop + stats.ps_ifdrop;
+    }
+    m_statsReceived.store(received, std::memory_order_relaxed);
+    m_statsDropped.store(dropped, std::memory_order_relaxed);
+    m_haveStats.store(true, std::memory_order_release);
 }
 
 // Callback function for pcap. Reliable for processing single packet, extract data and update ConnectionsTable
 void PacketCapture::packetHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet)
+{
+    PacketCapture *self = reinterpret_cast<PacketCapture *>(packetCaptureObject);
+    ConnectionID connID;
+    bool isTransmit = false;
+    bool isReceive = false;
+
+    if (!self->parsePacket(packet, pkthdr->caplen, connID, isTransmit, isReceive))
+    {
+        return;
+    }
+    // Update ConnectionsTable based on the direction of the packet
+    if (isTransmit)
+    {
+        self->m_connectionsTable.updateConnection(connID, true, pkthdr->len, self->packetTime(pkthdr));
+    }
+    if (isReceive)
+    {
+        self->m_connectionsTable.updateConnection(connID, false, pkthdr->len, self->packetTime(pkthdr));
+    }
+}
+
+// Callback used by the capture loops. Packet is only added to the batch, the table is updated once per batch
+void PacketCapture::batchHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet)
+{
+    PacketCapture *self = reinterpret_cast<PacketCapture *>(packetCaptureObject);
+    ConnectionID connID;
+    bool isTransmit = false;
+    bool isReceive = false;
+
+    if (!self->parsePacket(packet, pkthdr->caplen, connID, isTransmit, isReceive))
+    {
+        return;
+    }
+    self->addToBatch(connID, isTransmit, isReceive, pkthdr->len, self->packetTime(pkthdr));
+    if (self->m_batch.size() >= self->m_config.m_batchSize)
+    {
+        self->flushBatch();
+    }
+}
+
+// Capture timestamp of a packet, in nanoseconds or microseconds depending on the capture engine. A capture
+// file may hold any value, so both parts are clamped to a range the nanosecond clock and the expiry deadlines
+// can't overflow in
+std::chrono::system_clock::time_point PacketCapture::packetTime(const struct pcap_pkthdr *pkthdr) const
+{
+    int64_t seconds = std::clamp<int64_t>(pkthdr->ts.tv_sec, 0, MAX_PACKET_SECONDS);
+    int64_t fraction = std::clamp<int64_t>(pkthdr->ts.tv_usec, 0, m_nanoTimestamps ? 999999999 : 999999);
+    std::chrono::nanoseconds subsecond = m_nanoTimestamps ? std::chrono::nanoseconds(fraction)
+                                                          : std::chrono::microseconds(fraction);
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(seconds) + subsecond));
+}
+
+// Adds packet to the batch, packets of a flow already in the batch are merged into its entry. The entry keeps
+// the timestamp of the flow's latest packet
+void PacketCapture::addToBatch(const ConnectionID &connID, bool isTransmit, bool isReceive, uint32_t length,
+                               std::chrono::system_clock::time_point timestamp)
+{
+    if (!isTransmit && !isReceive)
+    {
+        return;
+    }
+    // Bursts usually belong to few flows, so search from the most recently added entry
+    FlowDelta *delta = nullptr;
+    for (auto current = m_batch.rbegin(); current != m_batch.rend(); current++)
+    {
+        if (current->m_ID == connID)
+        {
+            delta = &(*current);
+            break;
+        }
+    }
+    if (delta == nullptr)
+    {
+        m_batch.emplace_back();
+        delta = &m_batch.back();
+        delta->m_ID = connID;
+    }
+
+    if (isTransmit)
+    {
+        delta->m_bytesSent += length;
+        delta->m_packetsSent += 1;
+    }
+    if (isReceive)
+    {
+        delta->m_bytesReceived += length;
+        delta->m_packetsReceived += 1;
+    }
+    delta->m_lastSeen = std::max(delta->m_lastSeen, timestamp);
+}
+
+// Applies the whole batch to ConnectionsTable, an empty batch (capture timeout) lets the table expire idle flows
+void PacketCapture::flushBatch()
+{
+    if (m_batch.empty())
+    {
+        m_connectionsTable.maintain();
+        return;
+    }
+    m_connectionsTable.applyBatch(m_batch);
+    m_batch.clear();
+}
+
+// Static wrapper so capture engines can flush after every drained block and sample their counters
+void PacketCapture::flushHandler(unsigned char *packetCaptureObject)
+{
+    PacketCapture *self = reinterpret_cast<PacketCapture *>(packetCaptureObject);
+    self->flushBatch();
+    self->sampleStats();
+}
+
+// Builds IPv6 ConnectionID from addresses and ports
+static ConnectionID makeIPv6ConnectionID(const in6_addr &srcIPv6, uint16_t srcPort, const in6_addr &destIPv6, uint16_t destPort, Protocol protocol)
+{
+    // Create sockaddr_in6 for source
+    sockaddr_in6 srcSockAddr6 = {};
+    srcSockAddr6.sin6_family = AF_INET6;
+    srcSockAddr6.sin6_addr = srcIPv6;
+    srcSockAddr6.sin6_port = htons(srcPort);
+    // Create sockaddr_in6 for destination
+    sockaddr_in6 destSockAddr6 = {};
+    destSockAddr6.sin6_family = AF_INET6;
+    destSockAddr6.sin6_addr = destIPv6;
+    destSockAddr6.sin6_port = htons(destPort);
+    return ConnectionID(srcSockAddr6, destSockAddr6, protocol);
+}
+
+// Extracts ConnectionID and direction of the packet. Returns false for packets that are not tracked or are too short
+bool PacketCapture::parsePacket(const unsigned char *packet, uint32_t caplen, ConnectionID &connID, bool &isTransmit, bool &isReceive)
 {
     uint8_t version = 0;
     uint32_t family = 0;
-    PacketCapture *self = reinterpret_cast<PacketCapture *>(packetCaptureObject);
-    const unsigned char *ipPacket = packet + self->m_linkLevelHeaderLen;
+    if (caplen <= m_linkLevelHeaderLen)
+    {
+        return false;
+    }
+    const unsigned char *ipPacket = packet + m_linkLevelHeaderLen;
+    uint32_t ipLength = caplen - m_linkLevelHeaderLen;
 
     // Check family
-    if (self->m_dataLinkType == DLT_NULL || self->m_dataLinkType == DLT_LOOP)
+    if (m_dataLinkType == DLT_NULL || m_dataLinkType == DLT_LOOP)
     {
         // For DLT_NULL and DLT_LOOP, consider first 4 bytes
         std::memcpy(&family, packet, 4);
@@ -203,14 +683,19 @@ void PacketCapture::packetHandler(unsigned char *packetCaptureObject, const stru
     }
     else
     {
-        return;
+        return false;
     }
 
     // Process IPv4 packet
     if (version == 4)
     {
+        if (ipLength < sizeof(struct ip))
+        {
+            return false;
+        }
         // Cast the IP header
         const struct ip *ipHeader = reinterpret_cast<const struct ip *>(ipPacket);
+        uint32_t ipHeaderLen = ipHeader->ip_hl * 4;
         // Extract protocol
         uint8_t protocol = ipHeader->ip_p;
         // Extract IP addresses
@@ -218,183 +703,95 @@ void PacketCapture::packetHandler(unsigned char *packetCaptureObject, const stru
         in_addr destIPv4 = ipHeader->ip_dst;
 
         // Determine if the packet is outgoing or incoming by comparing address to local addresses
-        bool isTransmit = self->isLocalIPv4Address(srcIPv4);
-        bool isReceive = self->isLocalIPv4Address(destIPv4);
+        isTransmit = m_assumeTransmit || isLocalIPv4Address(srcIPv4);
+        isReceive = isLocalIPv4Address(destIPv4);
 
         switch (protocol)
         {
         // TCP packet
         case IPPROTO_TCP:
         {
-            // Cast the TCP header
-            const struct tcphdr *tcpHeader = reinterpret_cast<const struct tcphdr *>(ipPacket + (ipHeader->ip_hl * 4));
-            // Extract ports
-            uint16_t srcPort = ntohs(tcpHeader->th_sport);
-            uint16_t destPort = ntohs(tcpHeader->th_dport);
-            // Create and construct ConnectionID object
-            ConnectionID connID = ConnectionID::storeIPv4InIPv6(srcIPv4, srcPort, destIPv4, destPort, Protocol::TCP);
-            // Update ConnectionsTable based on the direction of the packet
-            if (isTransmit)
+            if (ipLength < ipHeaderLen + 4)
             {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
+                return false;
             }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
+            // Cast the TCP header
+            const struct tcphdr *tcpHeader = reinterpret_cast<const struct tcphdr *>(ipPacket + ipHeaderLen);
+            // Create and construct ConnectionID object
+            connID = ConnectionID::storeIPv4InIPv6(srcIPv4, ntohs(tcpHeader->th_sport), destIPv4, ntohs(tcpHeader->th_dport), Protocol::TCP);
+            return true;
         }
         // UDP packet
         case IPPROTO_UDP:
         {
-            // Cast the UDP header
-            const struct udphdr *udpHeader = reinterpret_cast<const struct udphdr *>(ipPacket + (ipHeader->ip_hl * 4));
-            // Extract ports
-            uint16_t srcPort = ntohs(udpHeader->uh_sport);
-            uint16_t destPort = ntohs(udpHeader->uh_dport);
-            // Create and construct ConnectionID object
-            ConnectionID connID = ConnectionID::storeIPv4InIPv6(srcIPv4, srcPort, destIPv4, destPort, Protocol::UDP);
-            // Update ConnectionsTable based on the direction of the packet
-            if (isTransmit)
+            if (ipLength < ipHeaderLen + 4)
             {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
+                return false;
             }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
+            // Cast the UDP header
+            const struct udphdr *udpHeader = reinterpret_cast<const struct udphdr *>(ipPacket + ipHeaderLen);
+            // Create and construct ConnectionID object
+            connID = ConnectionID::storeIPv4InIPv6(srcIPv4, ntohs(udpHeader->uh_sport), destIPv4, ntohs(udpHeader->uh_dport), Protocol::UDP);
+            return true;
         }
-        // ICMP packet
+        // ICMP packet, ICMP has no ports
         case IPPROTO_ICMP:
         {
-            // ICMP has no ports
-            uint16_t srcPort = 0;
-            uint16_t destPort = 0;
-            // Create and construct ConnectionID object
-            ConnectionID connID = ConnectionID::storeIPv4InIPv6(srcIPv4, srcPort, destIPv4, destPort, Protocol::ICMP);
-            // Update ConnectionsTable based on the direction of the packet
-            if (isTransmit)
-            {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
-            }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
+            connID = ConnectionID::storeIPv4InIPv6(srcIPv4, 0, destIPv4, 0, Protocol::ICMP);
+            return true;
         }
         }
+        return false;
     }
+
     // IPv6 packet
-    else if (version == 6)
+    if (ipLength < sizeof(struct ip6_hdr))
     {
-        // Cast the IPv6 header
-        const struct ip6_hdr *ip6Header = reinterpret_cast<const struct ip6_hdr *>(ipPacket);
-        // Extract protocol
-        uint8_t protocol = ip6Header->ip6_nxt;
-        // Extract IP addresses
-        in6_addr srcIPv6 = ip6Header->ip6_src;
-        in6_addr destIPv6 = ip6Header->ip6_dst;
-        // Determine the direction of a packet
-        bool isTransmit = self->isLocalIPv6Address(srcIPv6);
-        bool isReceive = self->isLocalIPv6Address(destIPv6);
+        return false;
+    }
+    // Cast the IPv6 header
+    const struct ip6_hdr *ip6Header = reinterpret_cast<const struct ip6_hdr *>(ipPacket);
+    // Extract protocol
+    uint8_t protocol = ip6Header->ip6_nxt;
+    // Extract IP addresses
+    in6_addr srcIPv6 = ip6Header->ip6_src;
+    in6_addr destIPv6 = ip6Header->ip6_dst;
+    // Determine the direction of a packet
+    isTransmit = m_assumeTransmit || isLocalIPv6Address(srcIPv6);
+    isReceive = isLocalIPv6Address(destIPv6);
 
-        switch (protocol)
-        {
-        // TCP packet
-        case IPPROTO_TCP:
-        {
-            // Cast the TCP header
-            const struct tcphdr *tcpHeader = reinterpret_cast<const struct tcphdr *>(ipPacket + sizeof(struct ip6_hdr));
-            // Extract ports
-            uint16_t srcPort = ntohs(tcpHeader->th_sport);
-            uint16_t destPort = ntohs(tcpHeader->th_dport);
-
-            // Create sockaddr_in6 for source
-            sockaddr_in6 srcSockAddr6 = {};
-            srcSockAddr6.sin6_family = AF_INET6;
-            srcSockAddr6.sin6_addr = srcIPv6;
-            srcSockAddr6.sin6_port = htons(srcPort);
-
-            // Create sockaddr_in6 for destination
-            sockaddr_in6 destSockAddr6 = {};
-            destSockAddr6.sin6_family = AF_INET6;
-            destSockAddr6.sin6_addr = destIPv6;
-            destSockAddr6.sin6_port = htons(destPort);
-            // Initialize and construct ConnectionID object
-            ConnectionID connID(srcSockAddr6, destSockAddr6, Protocol::TCP);
-            // Update ConnectionsTable depending on the direction of packets
-            if (isTransmit)
-            {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
-            }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
-        }
-        // UDP packet
-        case IPPROTO_UDP:
+    switch (protocol)
+    {
+    // TCP packet
+    case IPPROTO_TCP:
+    {
+        if (ipLength < sizeof(struct ip6_hdr) + 4)
         {
-            // Cast the UDP header
-            const struct udphdr *udpHeader = reinterpret_cast<const struct udphdr *>(ipPacket + sizeof(struct ip6_hdr));
-            // Extract ports
-            uint16_t srcPort = ntohs(udpHeader->uh_sport);
-            uint16_t destPort = ntohs(udpHeader->uh_dport);
-            // Create sockaddr_in6 for source
-            sockaddr_in6 srcSockAddr6 = {};
-            srcSockAddr6.sin6_family = AF_INET6;
-            srcSockAddr6.sin6_addr = srcIPv6;
-            srcSockAddr6.sin6_port = htons(srcPort);
-            // Create sockaddr_in6 for destination
-            sockaddr_in6 destSockAddr6 = {};
-            destSockAddr6.sin6_family = AF_INET6;
-            destSockAddr6.sin6_addr = destIPv6;
-            destSockAddr6.sin6_port = htons(destPort);
-            // Initialize and construct ConnectionID object
-            ConnectionID connID(srcSockAddr6, destSockAddr6, Protocol::UDP);
-            // Update ConnectionsTable depending on the direction of packets
-            if (isTransmit)
-            {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
-            }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
+            return false;
         }
-        // ICMPv6 packet
-        case IPPROTO_ICMPV6:
+        // Cast the TCP header
+        const struct tcphdr *tcpHeader = reinterpret_cast<const struct tcphdr *>(ipPacket + sizeof(struct ip6_hdr));
+        connID = makeIPv6ConnectionID(srcIPv6, ntohs(tcpHeader->th_sport), destIPv6, ntohs(tcpHeader->th_dport), Protocol::TCP);
+        return true;
+    }
+    // UDP packet
+    case IPPROTO_UDP:
+    {
+        if (ipLength < sizeof(struct ip6_hdr) + 4)
         {
-            // ICMPv6 has no ports
-            uint16_t srcPort = 0;
-            uint16_t destPort = 0;
-            // Create sockaddr_in6 for source
-            sockaddr_in6 srcSockAddr6 = {};
-            srcSockAddr6.sin6_family = AF_INET6;
-            srcSockAddr6.sin6_addr = srcIPv6;
-            srcSockAddr6.sin6_port = htons(srcPort);
-            // Create sockaddr_in6 for destination
-            sockaddr_in6 destSockAddr6 = {};
-            destSockAddr6.sin6_family = AF_INET6;
-            destSockAddr6.sin6_addr = destIPv6;
-            destSockAddr6.sin6_port = htons(destPort);
-            // Initialize and construct ConnectionID object
-            ConnectionID connID(srcSockAddr6, destSockAddr6, Protocol::ICMPv6);
-            // Update ConnectionsTable depending on the direction of packets
-            if (isTransmit)
-            {
-                self->m_connectionsTable.updateConnection(connID, true, pkthdr->len);
-            }
-            if (isReceive)
-            {
-                self->m_connectionsTable.updateConnection(connID, false, pkthdr->len);
-            }
-            break;
-        }
+            return false;
         }
+        // Cast the UDP header
+        const struct udphdr *udpHeader = reinterpret_cast<const struct udphdr *>(ipPacket + sizeof(struct ip6_hdr));
+        connID = makeIPv6ConnectionID(srcIPv6, ntohs(udpHeader->uh_sport), destIPv6, ntohs(udpHeader->uh_dport), Protocol::UDP);
+        return true;
     }
-}
\ No newline at end of file
+    // ICMPv6 packet, ICMPv6 has no ports
+    case IPPROTO_ICMPV6:
+    {
+        connID = makeIPv6ConnectionID(srcIPv6, 0, destIPv6, 0, Protocol::ICMPv6);
+        return true;
+    }
+    }
+    return false;
+}
@@ -7,8 +7,14 @@
 
 #include <pcap.h>
 #include <string>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 #include "connection.hpp"
 #include "connectionsTable.hpp"
+#include "captureConfig.hpp"
+#include "ringCapture.hpp"
 
 // PacketCapture class handles capturing and processing network packets
 class PacketCapture
@@ -21,15 +27,66 @@ public:
     // Start and stop capture
     void startCapture();
     void stopCapture();
+    // Received and dropped packet counters of the active capture engine, as last sampled by the capture thread.
+    // Safe to call from any thread, false before the first sample and during replay
+    bool getStats(uint64_t &received, uint64_t &dropped);
     // Static callback
     static void packetHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet);
+    static void replayHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet);
+    static void batchHandler(unsigned char *packetCaptureObject, const struct pcap_pkthdr *pkthdr, const unsigned char *packet);
+    static void flushHandler(unsigned char *packetCaptureObject);
+    // Extract ConnectionID and direction, false if packet is not tracked
+    bool parsePacket(const unsigned char *packet, uint32_t caplen, ConnectionID &connID, bool &isTransmit, bool &isReceive);
 
     std::string m_interfaceName;
     uint m_linkLevelHeaderLen;
     int m_dataLinkType;
     pcap_t *m_pcapHandle;
     ConnectionsTable &m_connectionsTable;
+    // Held by stopCapture while it stops the handle or ring, and by the capture thread while it publishes them
+    // and while it closes them, so a handle is never stopped after it was closed
+    std::mutex m_handleMutex;
+    // Handle or ring is open and stopCapture may stop it (guarded by m_handleMutex)
     bool m_isCapturing;
+    // Set by stopCapture, a capture loop that starts after it returns at once
+    std::atomic<bool> m_stopRequested;
+    // Capture engine settings
+    CaptureConfig m_config;
+    // TPACKET_V3 ring, only used with CaptureBackend::RING
+    std::unique_ptr<RingCapture> m_ring;
+    void startRingCapture();
+    // Capture file replay (-r)
+    void startReplay();
+    bool setLinkLevelHeaderLen(int dataLinkType);
+    static int getLinkLevelHeaderLen(int dataLinkType);
+    // Snaplen that covers only the headers packetHandler reads
+    static int headerSnaplen(int dataLinkType);
+    void openInterface(int snaplen);
+    int dispatchLoop(pcap_handler handler, bool isFile);
+    void setFilter();
+    // Counters of the engine read by the capture thread between dispatches, at most every STATS_INTERVAL (and
+    // once more before the handle is closed), and published for getStats
+    static constexpr std::chrono::milliseconds STATS_INTERVAL{100};
+    void sampleStats(bool force = false);
+    std::chrono::steady_clock::time_point m_nextStats;
+    std::atomic<uint64_t> m_statsReceived{0};
+    std::atomic<uint64_t> m_statsDropped{0};
+    std::atomic<bool> m_haveStats{false};
+    // Flows of packets drained but not yet applied to the table, merged by ConnectionID
+    std::vector<FlowDelta> m_batch;
+    void addToBatch(const ConnectionID &connID, bool isTransmit, bool isReceive, uint32_t length,
+                    std::chrono::system_clock::time_point timestamp);
+    // Latest second a packet timestamp is clamped to (2106, the end of the 32-bit pcap timestamp)
+    static constexpr int64_t MAX_PACKET_SECONDS = int64_t(1) << 32;
+    // Capture time of the packet. ts.tv_usec holds nanoseconds when m_nanoTimestamps is set
+    std::chrono::system_clock::time_point packetTime(const struct pcap_pkthdr *pkthdr) const;
+    bool m_nanoTimestamps;
+    void flushBatch();
+    // Count every packet as sent by its source (replay without local addresses)
+    bool m_assumeTransmit;
+    bool m_replayStarted;
+    std::chrono::nanoseconds m_replayFirstPacket;
+    std::chrono::steady_clock::time_point m_replayWallStart;
     void initLocalAddresses();
     bool isLocalIPv4Address(const in_addr &address);
     bool isLocalIPv6Address(const in6_addr &address);
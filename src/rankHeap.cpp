@@ -0,0 +1,485 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "rankHeap.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+// Insert id or change its score, the item moves up or down to its new place
+void RankHeap::update(uint32_t id, double score)
+{
+    if (id >= m_position.size())
+    {
+        m_position.resize(id + 1, NOT_RANKED);
+        m_score.resize(id + 1, 0);
+    }
+
+    // New item starts at the bottom
+    if (m_position[id] == NOT_RANKED)
+    {
+        markChanged(id);
+        m_score[id] = score;
+        m_position[id] = static_cast<uint32_t>(m_heap.size());
+        m_heap.push_back(id);
+        siftUp(m_heap.size() - 1);
+        return;
+    }
+
+    double previous = m_score[id];
+    if (score != previous)
+    {
+        markChanged(id);
+    }
+    m_score[id] = score;
+    if (score > previous)
+    {
+        siftUp(m_position[id]);
+    }
+    else if (score < previous)
+    {
+        siftDown(m_position[id]);
+    }
+}
+
+// Bottom-up heap construction, every inner node is sifted down once. When the sorted order is kept, items
+// whose score changed, new items and items left out are listed for its repair
+void RankHeap::build(const std::vector<uint32_t> &ids, const std::vector<double> &scores)
+{
+    bool keepOrder = m_keepOrder && !m_orderStale;
+    if (keepOrder)
+    {
+        for (uint32_t id : ids)
+        {
+            if (!contains(id) || m_score[id] != scores[id])
+            {
+                markChanged(id);
+            }
+        }
+    }
+    std::fill(m_position.begin(), m_position.end(), NOT_RANKED);
+    std::vector<uint32_t> previous;
+    if (keepOrder)
+    {
+        previous.swap(m_heap);
+    }
+    m_heap = ids;
+    for (size_t position = 0; position < m_heap.size(); position++)
+    {
+        uint32_t id = m_heap[position];
+        if (id >= m_position.size())
+        {
+            m_position.resize(id + 1, NOT_RANKED);
+            m_score.resize(id + 1, 0);
+        }
+        m_position[id] = static_cast<uint32_t>(position);
+        m_score[id] = scores[id];
+    }
+    for (size_t position = m_heap.size() / 2; position > 0; position--)
+    {
+        siftDown(position - 1);
+    }
+    for (uint32_t id : previous)
+    {
+        if (!contains(id))
+        {
+            markChanged(id);
+        }
+    }
+}
+
+// Remove id, the last item takes its place
+void RankHeap::erase(uint32_t id)
+{
+    if (!contains(id))
+    {
+        return;
+    }
+    markChanged(id);
+    size_t position = m_position[id];
+    size_t last = m_heap.size() - 1;
+    swapPositions(position, last);
+    m_heap.pop_back();
+    m_position[id] = NOT_RANKED;
+    if (position < m_heap.size())
+    {
+        siftUp(position);
+        siftDown(position);
+    }
+}
+
+// Best-first walk: children of a heap node are never better than the node, so the next best
+// item is always among the children of the items already taken
+void RankHeap::top(size_t k, std::vector<uint32_t> &ids) const
+{
+    ids.clear();
+    if (m_heap.empty() || k == 0)
+    {
+        return;
+    }
+    auto worse = [this](size_t first, size_t second)
+    { return better(second, first); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(worse)> frontier(worse);
+    frontier.push(0);
+    while (!frontier.empty() && ids.size() < k)
+    {
+        size_t position = frontier.top();
+        frontier.pop();
+        ids.push_back(m_heap[position]);
+        for (size_t child = 2 * position + 1; child <= 2 * position + 2 && child < m_heap.size(); child++)
+        {
+            frontier.push(child);
+        }
+    }
+}
+
+// Slice of the sorted order, from the block of first on
+void RankHeap::range(size_t first, size_t count, std::vector<uint32_t> &ids)
+{
+    repairOrder();
+    ids.clear();
+    if (first >= m_orderSize)
+    {
+        return;
+    }
+    size_t block = std::upper_bound(m_blockStart.begin(), m_blockStart.end(), first) - m_blockStart.begin() - 1;
+    size_t offset = first - m_blockStart[block];
+    for (; block < m_blocks.size() && ids.size() < count; block++, offset = 0)
+    {
+        for (size_t i = offset; i < m_blocks[block].size() && ids.size() < count; i++)
+        {
+            ids.push_back(m_blocks[block][i].m_id);
+        }
+    }
+}
+
+// The order is sorted at its first use, changes are listed from now on
+void RankHeap::keepOrder()
+{
+    if (!m_keepOrder)
+    {
+        m_keepOrder = true;
+        m_orderStale = true;
+    }
+}
+
+// Updates stop listing changes, the memory of the order goes back
+void RankHeap::dropOrder()
+{
+    m_keepOrder = false;
+    m_orderStale = false;
+    m_orderSize = 0;
+    std::vector<std::vector<Ranked>>().swap(m_blocks);
+    std::vector<size_t>().swap(m_blockStart);
+    std::vector<double>().swap(m_orderedScore);
+    std::vector<bool>().swap(m_ordered);
+    std::vector<uint32_t>().swap(m_changed);
+    std::vector<bool>().swap(m_changedMark);
+    std::vector<Ranked>().swap(m_sortedChanged);
+    std::vector<Ranked>().swap(m_merged);
+}
+
+// Item of the sorted order, rank must be below size()
+uint32_t RankHeap::at(size_t rank)
+{
+    repairOrder();
+    size_t block = std::upper_bound(m_blockStart.begin(), m_blockStart.end(), rank) - m_blockStart.begin() - 1;
+    return m_blocks[block][rank - m_blockStart[block]].m_id;
+}
+
+// Binary search of the blocks, then of the block
+size_t RankHeap::countBetter(double score, uint32_t id)
+{
+    repairOrder();
+    Ranked item{score, id};
+    size_t block = findBlock(item);
+    if (block == m_blocks.size())
+    {
+        return m_orderSize;
+    }
+    const std::vector<Ranked> &items = m_blocks[block];
+    return m_blockStart[block] + (std::lower_bound(items.begin(), items.end(), item) - items.begin());
+}
+
+// Root of the heap
+uint32_t RankHeap::best() const
+{
+    return m_heap[0];
+}
+
+bool RankHeap::contains(uint32_t id) const
+{
+    return id < m_position.size() && m_position[id] != NOT_RANKED;
+}
+
+double RankHeap::score(uint32_t id) const
+{
+    return m_score[id];
+}
+
+size_t RankHeap::size() const
+{
+    return m_heap.size();
+}
+
+void RankHeap::clear()
+{
+    m_heap.clear();
+    m_position.clear();
+    m_score.clear();
+    m_blocks.clear();
+    m_blockStart.clear();
+    m_orderSize = 0;
+    m_orderedScore.clear();
+    m_ordered.clear();
+    m_changed.clear();
+    m_changedMark.clear();
+    m_orderStale = false;
+}
+
+// Compare the items at two heap positions
+bool RankHeap::better(size_t first, size_t second) const
+{
+    return before(m_heap[first], m_heap[second]);
+}
+
+// Higher score first, lower id breaks ties so the order is stable between ticks
+bool RankHeap::before(uint32_t firstId, uint32_t secondId) const
+{
+    if (m_score[firstId] != m_score[secondId])
+    {
+        return m_score[firstId] > m_score[secondId];
+    }
+    return firstId < secondId;
+}
+
+// Nothing to do until range is used or while the order is sorted from scratch anyway. Every item is listed
+// once, so the list never grows beyond the number of ids
+void RankHeap::markChanged(uint32_t id)
+{
+    if (!m_keepOrder || m_orderStale)
+    {
+        return;
+    }
+    if (id >= m_changedMark.size())
+    {
+        m_changedMark.resize(std::max<size_t>(id + 1, m_position.size()), false);
+    }
+    if (!m_changedMark[id])
+    {
+        m_changedMark[id] = true;
+        m_changed.push_back(id);
+    }
+}
+
+// Few changed items move one by one, each from the place of the score it had in the order to the place of
+// its current score. Many are taken out of the order in one pass, sorted and merged back
+void RankHeap::repairOrder()
+{
+    keepOrder();
+    if (m_orderStale)
+    {
+        for (uint32_t id : m_changed)
+        {
+            m_changedMark[id] = false;
+        }
+        m_changed.clear();
+        m_merged.resize(m_heap.size());
+        for (size_t position = 0; position < m_heap.size(); position++)
+        {
+            m_merged[position] = {m_score[m_heap[position]], m_heap[position]};
+        }
+        std::sort(m_merged.begin(), m_merged.end());
+        fillOrder(m_merged);
+        m_orderedScore.resize(m_position.size());
+        m_ordered.assign(m_position.size(), false);
+        for (const Ranked &item : m_merged)
+        {
+            m_orderedScore[item.m_id] = item.m_score;
+            m_ordered[item.m_id] = true;
+        }
+        m_orderStale = false;
+        return;
+    }
+    if (m_changed.empty())
+    {
+        return;
+    }
+    if (m_changed.size() > m_orderSize / REBUILD_SHARE)
+    {
+        m_sortedChanged.clear();
+        for (uint32_t id : m_changed)
+        {
+            if (contains(id))
+            {
+                m_sortedChanged.push_back({m_score[id], id});
+            }
+        }
+        std::sort(m_sortedChanged.begin(), m_sortedChanged.end());
+        m_merged.clear();
+        m_merged.reserve(m_heap.size());
+        auto changed = m_sortedChanged.begin();
+        for (const std::vector<Ranked> &block : m_blocks)
+        {
+            for (const Ranked &item : block)
+            {
+                if (m_changedMark[item.m_id])
+                {
+                    continue;
+                }
+                for (; changed != m_sortedChanged.end() && *changed < item; changed++)
+                {
+                    m_merged.push_back(*changed);
+                }
+                m_merged.push_back(item);
+            }
+        }
+        m_merged.insert(m_merged.end(), changed, m_sortedChanged.end());
+        m_orderedScore.resize(m_position.size());
+        m_ordered.resize(m_position.size(), false);
+        for (uint32_t id : m_changed)
+        {
+            m_changedMark[id] = false;
+            m_ordered[id] = contains(id);
+            m_orderedScore[id] = m_score[id];
+        }
+        m_changed.clear();
+        fillOrder(m_merged);
+        return;
+    }
+    for (uint32_t id : m_changed)
+    {
+        m_changedMark[id] = false;
+        if (id < m_ordered.size() && m_ordered[id])
+        {
+            removeOrdered({m_orderedScore[id], id});
+        }
+        if (contains(id))
+        {
+            insertOrdered({m_score[id], id});
+        }
+    }
+    m_changed.clear();
+    m_blockStart.resize(m_blocks.size());
+    size_t start = 0;
+    for (size_t block = 0; block < m_blocks.size(); block++)
+    {
+        m_blockStart[block] = start;
+        start += m_blocks[block].size();
+    }
+}
+
+// Blocks of ORDER_BLOCK items, the last one may be shorter. The ordered scores of the ids are set by the caller
+void RankHeap::fillOrder(const std::vector<Ranked> &sorted)
+{
+    m_blocks.resize((sorted.size() + ORDER_BLOCK - 1) / ORDER_BLOCK);
+    m_blockStart.resize(m_blocks.size());
+    for (size_t block = 0; block < m_blocks.size(); block++)
+    {
+        auto begin = sorted.begin() + block * ORDER_BLOCK;
+        m_blocks[block].assign(begin, begin + std::min(ORDER_BLOCK, sorted.size() - block * ORDER_BLOCK));
+        m_blockStart[block] = block * ORDER_BLOCK;
+    }
+    m_orderSize = sorted.size();
+}
+
+// First block whose last item is not before item
+size_t RankHeap::findBlock(const Ranked &item) const
+{
+    return std::partition_point(m_blocks.begin(), m_blocks.end(), [&item](const std::vector<Ranked> &block)
+                                { return block.back() < item; }) -
+           m_blocks.begin();
+}
+
+// Take an item out of its block, an emptied block goes away
+void RankHeap::removeOrdered(const Ranked &item)
+{
+    size_t block = findBlock(item);
+    std::vector<Ranked> &items = m_blocks[block];
+    items.erase(std::lower_bound(items.begin(), items.end(), item));
+    if (items.empty())
+    {
+        m_blocks.erase(m_blocks.begin() + block);
+    }
+    m_ordered[item.m_id] = false;
+    m_orderSize--;
+}
+
+// Put an item into the block of its rank, a block of 2 * ORDER_BLOCK items is split in halves
+void RankHeap::insertOrdered(const Ranked &item)
+{
+    size_t block = findBlock(item);
+    if (block == m_blocks.size())
+    {
+        if (m_blocks.empty() || m_blocks.back().size() >= 2 * ORDER_BLOCK)
+        {
+            m_blocks.emplace_back();
+        }
+        block = m_blocks.size() - 1;
+    }
+    std::vector<Ranked> &items = m_blocks[block];
+    items.insert(std::lower_bound(items.begin(), items.end(), item), item);
+    if (items.size() >= 2 * ORDER_BLOCK)
+    {
+        std::vector<Ranked> upper(items.begin() + ORDER_BLOCK, items.end());
+        items.resize(ORDER_BLOCK);
+        m_blocks.insert(m_blocks.begin() + block + 1, std::move(upper));
+    }
+    if (item.m_id >= m_ordered.size())
+    {
+        m_ordered.resize(item.m_id + 1, false);
+        m_orderedScore.resize(item.m_id + 1, 0);
+    }
+    m_orderedScore[item.m_id] = item.m_score;
+    m_ordered[item.m_id] = true;
+    m_orderSize++;
+}
+
+// Swap two heap nodes and keep positions in sync
+void RankHeap::swapPositions(size_t first, size_t second)
+{
+    std::swap(m_heap[first], m_heap[second]);
+    m_position[m_heap[first]] = static_cast<uint32_t>(first);
+    m_position[m_heap[second]] = static_cast<uint32_t>(second);
+}
+
+void RankHeap::siftUp(size_t position)
+{
+    while (position > 0)
+    {
+        size_t parent = (position - 1) / 2;
+        if (!better(position, parent))
+        {
+            break;
+        }
+        swapPositions(position, parent);
+        position = parent;
+    }
+}
+
+void RankHeap::siftDown(size_t position)
+{
+    for (;;)
+    {
+        size_t best = position;
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+        if (left < m_heap.size() && better(left, best))
+        {
+            best = left;
+        }
+        if (right < m_heap.size() && better(right, best))
+        {
+            best = right;
+        }
+        if (best == position)
+        {
+            return;
+        }
+        swapPositions(position, best);
+        position = best;
+    }
+}
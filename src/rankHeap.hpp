@@ -0,0 +1,99 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RankHeap ranks items (flow rows) by a score. It is an addressable binary max-heap: the position of every
+// item in the heap is known, so changing the score of one item costs O(log n), and the best k items are
+// read by a best-first walk of the heap in O(k log k) without sorting everything. Once range is used, the
+// heap also keeps its items in sorted order, so any rank is addressed directly (see range). The order is held
+// in blocks of ORDER_BLOCK to 2 * ORDER_BLOCK items, so a changed item moves only the items of its blocks
+class RankHeap
+{
+public:
+    // Insert id or change its score
+    void update(uint32_t id, double score);
+    // Replace the content by ids with their scores (indexed by id) in O(n), cheaper than updating most
+    // of the items one by one
+    void build(const std::vector<uint32_t> &ids, const std::vector<double> &scores);
+    // Remove id, nothing happens if it is not ranked
+    void erase(uint32_t id);
+    // Ids of the best k items, best first
+    void top(size_t k, std::vector<uint32_t> &ids) const;
+    // Ids of the items ranked first to first + count - 1, best first. The first call sorts the items, from
+    // then on items updated or erased are listed, and the next call moves each of them from its old place in
+    // the order to its new one: O(changed * (ORDER_BLOCK + log n) + n / ORDER_BLOCK) once after changes,
+    // O(count + log n) without. When more than 1 / REBUILD_SHARE of the items changed, they are merged back
+    // in one pass over the order instead
+    void range(size_t first, size_t count, std::vector<uint32_t> &ids);
+    // Start keeping the sorted order without reading it yet, cheap while the heap is small
+    void keepOrder();
+    // Stop keeping the sorted order and release it, the next range sorts the items again
+    void dropOrder();
+    // Id at rank, and the number of items ranked before an item with score and id (no such item has to
+    // exist), in the order of range
+    uint32_t at(size_t rank);
+    size_t countBetter(double score, uint32_t id);
+    // Id of the best item, the heap must not be empty
+    uint32_t best() const;
+    bool contains(uint32_t id) const;
+    double score(uint32_t id) const;
+    size_t size() const;
+    void clear();
+
+private:
+    static constexpr uint32_t NOT_RANKED = UINT32_MAX;
+    // Item of the sorted order with its score, so repairs and searches read the order sequentially
+    struct Ranked
+    {
+        double m_score;
+        uint32_t m_id;
+        bool operator<(const Ranked &other) const
+        {
+            return m_score != other.m_score ? m_score > other.m_score : m_id < other.m_id;
+        }
+    };
+    bool better(size_t first, size_t second) const;
+    bool before(uint32_t firstId, uint32_t secondId) const;
+    // List an item for the next repair of the order
+    void markChanged(uint32_t id);
+    // Sorted order up to date, sorted from scratch after build or the first call
+    void repairOrder();
+    // Replace the order by sorted items, cut into blocks of ORDER_BLOCK
+    void fillOrder(const std::vector<Ranked> &sorted);
+    // Block that holds item or where it belongs, m_blocks.size() if it goes after the last block
+    size_t findBlock(const Ranked &item) const;
+    void removeOrdered(const Ranked &item);
+    void insertOrdered(const Ranked &item);
+    void swapPositions(size_t first, size_t second);
+    void siftUp(size_t position);
+    void siftDown(size_t position);
+
+    // Heap of ids, best at position 0
+    std::vector<uint32_t> m_heap;
+    // Position in m_heap and score of every id
+    std::vector<uint32_t> m_position;
+    std::vector<double> m_score;
+    // Items by rank once range was called, in blocks, with the number of items before every block and the
+    // score each id has in the order. Items changed since the last repair (marked by id) and the buffers of a
+    // repair that merges them. m_orderStale sorts everything at the next repair (the first one)
+    static constexpr size_t ORDER_BLOCK = 256;
+    static constexpr size_t REBUILD_SHARE = 16;
+    bool m_keepOrder = false;
+    bool m_orderStale = false;
+    std::vector<std::vector<Ranked>> m_blocks;
+    std::vector<size_t> m_blockStart;
+    size_t m_orderSize = 0;
+    std::vector<double> m_orderedScore;
+    std::vector<bool> m_ordered;
+    std::vector<uint32_t> m_changed;
+    std::vector<bool> m_changedMark;
+    std::vector<Ranked> m_sortedChanged;
+    std::vector<Ranked> m_merged;
+};
@@ -0,0 +1,313 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "ringCapture.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Size of one ring block, the ring holds m_ringSizeMB of them
+static const unsigned int RING_BLOCK_SIZE = 1 << 20;
+// Frame size hint for the kernel (TPACKET_V3 packs frames of variable length into blocks)
+static const unsigned int RING_FRAME_SIZE = 2048;
+// How often the capture loop checks whether it was asked to stop (ms)
+static const int RING_POLL_TIMEOUT_MS = 100;
+
+// Constructor
+RingCapture::RingCapture(std::string interfaceName, unsigned int ringSizeMB, unsigned int blockTimeoutMs)
+{
+    m_interfaceName = interfaceName;
+    m_ringSizeMB = ringSizeMB > 0 ? ringSizeMB : 1;
+    m_blockTimeoutMs = blockTimeoutMs;
+    m_dataLinkType = DLT_EN10MB;
+    m_socket = -1;
+    m_fanoutGroup = -1;
+    m_snaplen = 0;
+    m_ring = nullptr;
+    m_ringLength = 0;
+    m_running = false;
+    m_received = 0;
+    m_dropped = 0;
+    std::memset(&m_request, 0, sizeof(m_request));
+}
+
+// Destructor
+RingCapture::~RingCapture()
+{
+    close();
+}
+
+// Set up AF_PACKET socket with TPACKET_V3 rx ring mapped into our address space
+bool RingCapture::open(std::string &error)
+{
+    // Raw socket receiving all protocols, link level header included
+    m_socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (m_socket < 0)
+    {
+        error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+
+    // Find interface index and hardware type
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, m_interfaceName.c_str(), IFNAMSIZ - 1);
+    if (ioctl(m_socket, SIOCGIFINDEX, &ifr) < 0)
+    {
+        error = std::string("SIOCGIFINDEX: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+    int ifIndex = ifr.ifr_ifindex;
+    if (ioctl(m_socket, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        error = std::string("SIOCGIFHWADDR: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+    // Loopback frames carry a zeroed Ethernet header on Linux
+    if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER && ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK)
+    {
+        error = "unsupported hardware type " + std::to_string(ifr.ifr_hwaddr.sa_family);
+        close();
+        return false;
+    }
+    m_dataLinkType = DLT_EN10MB;
+
+    // Filter first, so the ring never sees unwanted packets
+    if ((!m_filter.empty() || m_snaplen > 0) && !attachFilter(error))
+    {
+        close();
+        return false;
+    }
+
+    // Switch socket to TPACKET_V3
+    int version = TPACKET_V3;
+    if (setsockopt(m_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+    {
+        error = std::string("PACKET_VERSION: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    // Describe the ring: m_ringSizeMB blocks, retired by the kernel when full or after m_blockTimeoutMs
+    m_request.tp_block_size = RING_BLOCK_SIZE;
+    m_request.tp_block_nr = m_ringSizeMB;
+    m_request.tp_frame_size = RING_FRAME_SIZE;
+    m_request.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) * m_ringSizeMB;
+    m_request.tp_retire_blk_tov = m_blockTimeoutMs;
+    m_request.tp_sizeof_priv = 0;
+    m_request.tp_feature_req_word = 0;
+    if (setsockopt(m_socket, SOL_PACKET, PACKET_RX_RING, &m_request, sizeof(m_request)) < 0)
+    {
+        error = std::string("PACKET_RX_RING: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    // Map the ring
+    m_ringLength = static_cast<size_t>(m_request.tp_block_size) * m_request.tp_block_nr;
+    void *ring = mmap(nullptr, m_ringLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, m_socket, 0);
+    if (ring == MAP_FAILED)
+    {
+        // Locking may be refused by RLIMIT_MEMLOCK, retry without it
+        ring = mmap(nullptr, m_ringLength, PROT_READ | PROT_WRITE, MAP_SHARED, m_socket, 0);
+    }
+    if (ring == MAP_FAILED)
+    {
+        error = std::string("mmap: ") + std::strerror(errno);
+        m_ringLength = 0;
+        close();
+        return false;
+    }
+    m_ring = static_cast<uint8_t *>(ring);
+    for (unsigned int i = 0; i < m_request.tp_block_nr; i++)
+    {
+        m_blocks.push_back(m_ring + static_cast<size_t>(i) * m_request.tp_block_size);
+    }
+
+    // Bind to the interface
+    struct sockaddr_ll address;
+    std::memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = ifIndex;
+    if (bind(m_socket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        error = std::string("bind: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    // Share the traffic with the other workers, the kernel flow hash keeps a flow on one socket
+    if (m_fanoutGroup >= 0)
+    {
+        int fanout = (m_fanoutGroup & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(m_socket, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+        {
+            error = std::string("PACKET_FANOUT: ") + std::strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    // Promiscuous mode, same as pcap_open_live(..., 1, ...)
+    struct packet_mreq membership;
+    std::memset(&membership, 0, sizeof(membership));
+    membership.mr_ifindex = ifIndex;
+    membership.mr_type = PACKET_MR_PROMISC;
+    setsockopt(m_socket, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership));
+
+    // Armed here and not in run(), so a stop() that comes before run() starts is not lost
+    m_running = true;
+    return true;
+}
+
+// Compile the filter expression with libpcap and attach the program to the socket. The program returns
+// m_snaplen for accepted packets, so the kernel also truncates frames before copying them to the ring
+bool RingCapture::attachFilter(std::string &error)
+{
+    // Frames in the ring are Ethernet frames, compile for that datalink
+    pcap_t *dead = pcap_open_dead(m_dataLinkType, m_snaplen > 0 ? m_snaplen : 65535);
+    if (dead == nullptr)
+    {
+        error = "pcap_open_dead failed";
+        return false;
+    }
+    struct bpf_program program;
+    // Empty expression accepts everything
+    if (pcap_compile(dead, &program, m_filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0)
+    {
+        error = std::string("filter: ") + pcap_geterr(dead);
+        pcap_close(dead);
+        return false;
+    }
+    pcap_close(dead);
+
+    // struct bpf_insn and struct sock_filter have the same layout
+    struct sock_fprog socketProgram;
+    socketProgram.len = program.bf_len;
+    socketProgram.filter = reinterpret_cast<struct sock_filter *>(program.bf_insns);
+    int status = setsockopt(m_socket, SOL_SOCKET, SO_ATTACH_FILTER, &socketProgram, sizeof(socketProgram));
+    pcap_freecode(&program);
+    if (status < 0)
+    {
+        error = std::string("SO_ATTACH_FILTER: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Main loop, waits for retired blocks and walks them in ring order
+void RingCapture::run(pcap_handler handler, unsigned char *user, void (*blockDone)(unsigned char *))
+{
+    struct pollfd pfd;
+    pfd.fd = m_socket;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    unsigned int current = 0;
+    while (m_running)
+    {
+        tpacket_block_desc *block = reinterpret_cast<tpacket_block_desc *>(m_blocks[current]);
+        // Block still owned by the kernel, wait for it
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+        {
+            // Nothing came before the timeout, the idle flush lets the table expire idle flows
+            if (poll(&pfd, 1, RING_POLL_TIMEOUT_MS) == 0 && blockDone != nullptr)
+            {
+                blockDone(user);
+            }
+            continue;
+        }
+
+        walkBlock(block, handler, user);
+        if (blockDone != nullptr)
+        {
+            blockDone(user);
+        }
+
+        // Give the block back to the kernel
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        current = (current + 1) % m_blocks.size();
+    }
+}
+
+// Frames in a block are linked by tp_next_offset, each one starts at tp_mac relative to its header
+unsigned int RingCapture::walkBlock(const tpacket_block_desc *block, pcap_handler handler, unsigned char *user)
+{
+    unsigned int packetCount = block->hdr.bh1.num_pkts;
+    const uint8_t *frame = reinterpret_cast<const uint8_t *>(block) + block->hdr.bh1.offset_to_first_pkt;
+
+    for (unsigned int i = 0; i < packetCount; i++)
+    {
+        const tpacket3_hdr *header = reinterpret_cast<const tpacket3_hdr *>(frame);
+
+        // Nanosecond timestamp kept as libpcap does with PCAP_TSTAMP_PRECISION_NANO, ts.tv_usec holds nanoseconds
+        struct pcap_pkthdr pkthdr;
+        pkthdr.ts.tv_sec = header->tp_sec;
+        pkthdr.ts.tv_usec = header->tp_nsec;
+        pkthdr.caplen = header->tp_snaplen;
+        pkthdr.len = header->tp_len;
+        handler(user, &pkthdr, frame + header->tp_mac);
+
+        frame += header->tp_next_offset;
+    }
+    return packetCount;
+}
+
+// Ask run() to return, it notices within RING_POLL_TIMEOUT_MS
+void RingCapture::stop()
+{
+    m_running = false;
+}
+
+// Unmap the ring and close the socket
+void RingCapture::close()
+{
+    if (m_ring != nullptr)
+    {
+        munmap(m_ring, m_ringLength);
+        m_ring = nullptr;
+        m_ringLength = 0;
+    }
+    m_blocks.clear();
+    if (m_socket >= 0)
+    {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
+
+// PACKET_STATISTICS resets on every read, so keep running totals. Only the thread running the ring reads them
+bool RingCapture::getStats(uint64_t &received, uint64_t &dropped)
+{
+    if (m_socket < 0)
+    {
+        return false;
+    }
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+    if (getsockopt(m_socket, SOL_PACKET, PACKET_STATISTICS, &stats, &length) < 0)
+    {
+        return false;
+    }
+    // tp_packets already includes tp_drops
+    m_received += stats.tp_packets;
+    m_dropped += stats.tp_drops;
+    received = m_received;
+    dropped = m_dropped;
+    return true;
+}
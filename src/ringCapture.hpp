@@ -0,0 +1,60 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <pcap.h>
+#include <linux/if_packet.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// RingCapture reads packets from an AF_PACKET socket through a TPACKET_V3 memory-mapped block ring.
+// Frames are handed to the callback directly from the ring, without copying them to userspace buffers
+class RingCapture
+{
+public:
+    // Constructor
+    RingCapture(std::string interfaceName, unsigned int ringSizeMB, unsigned int blockTimeoutMs);
+    // Destructor
+    ~RingCapture();
+
+    // Create the socket, set up and map the ring and bind it to the interface
+    bool open(std::string &error);
+    // Walk ring blocks and pass every frame to handler until stop() is called (also before run() starts),
+    // blockDone is called after every block
+    void run(pcap_handler handler, unsigned char *user, void (*blockDone)(unsigned char *) = nullptr);
+    void stop();
+    void close();
+    // Kernel counters (cumulative since open), read by the thread that runs the ring
+    bool getStats(uint64_t &received, uint64_t &dropped);
+    // Pass every frame in a retired block to handler, returns number of frames
+    static unsigned int walkBlock(const tpacket_block_desc *block, pcap_handler handler, unsigned char *user);
+
+    std::string m_interfaceName;
+    unsigned int m_ringSizeMB;
+    unsigned int m_blockTimeoutMs;
+    // Datalink type of the frames in the ring (DLT_EN10MB for Ethernet and loopback)
+    int m_dataLinkType;
+    int m_socket;
+    // pcap filter expression attached to the socket as classic BPF, empty for none
+    std::string m_filter;
+    // Bytes of every frame stored in the ring, 0 for whole frames
+    int m_snaplen;
+    // PACKET_FANOUT group to join in hash mode (both directions of a flow land on the same socket), -1 for none
+    int m_fanoutGroup;
+
+private:
+    bool attachFilter(std::string &error);
+    tpacket_req3 m_request;
+    uint8_t *m_ring;
+    size_t m_ringLength;
+    // Start of every block in the mapped ring
+    std::vector<uint8_t *> m_blocks;
+    std::atomic<bool> m_running;
+    uint64_t m_received;
+    uint64_t m_dropped;
+};
@@ -0,0 +1,378 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "rollup.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+
+// Ring and number of its buckets every span is summed from
+static const RollupResolution SPAN_RESOLUTION[ROLLUP_SPANS] = {ROLLUP_SECOND, ROLLUP_MINUTE, ROLLUP_HOUR, ROLLUP_HOUR};
+static const int64_t SPAN_PERIODS[ROLLUP_SPANS] = {60, 60, 24, 168};
+
+// Period of a second, rounded down also before the epoch
+static int64_t periodOf(int64_t second, RollupResolution resolution)
+{
+    int64_t seconds = ROLLUP_SECONDS[resolution];
+    return second >= 0 ? second / seconds : -((-second + seconds - 1) / seconds);
+}
+
+// Periods of all resolutions at once
+void rollupPeriods(int64_t second, int64_t (&periods)[ROLLUP_RESOLUTIONS])
+{
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++)
+    {
+        periods[resolution] = periodOf(second, static_cast<RollupResolution>(resolution));
+    }
+}
+
+// Number of buckets, the recorded traffic is dropped
+void RollupRing::resize(size_t buckets)
+{
+    m_buckets.assign(buckets, RollupBucket());
+    m_headPeriod = INT64_MIN;
+    m_headIndex = 0;
+}
+
+// The newest period is found without the modulo, a later one becomes the newest
+RollupBucket &RollupRing::slot(int64_t period)
+{
+    if (period == m_headPeriod)
+    {
+        return m_buckets[m_headIndex];
+    }
+    size_t index = static_cast<uint64_t>(period) % m_buckets.size();
+    if (period > m_headPeriod)
+    {
+        m_headPeriod = period;
+        m_headIndex = index;
+    }
+    return m_buckets[index];
+}
+
+// Number of buckets
+size_t RollupRing::size() const
+{
+    return m_buckets.size();
+}
+
+// A bucket holding an older period starts over
+void RollupRing::add(int64_t period, const RollupTraffic &traffic)
+{
+    if (m_buckets.empty())
+    {
+        return;
+    }
+    RollupBucket &bucket = slot(period);
+    if (bucket.m_period != period)
+    {
+        if (bucket.m_period > period)
+        {
+            return;
+        }
+        bucket.m_period = period;
+        bucket.m_traffic = RollupTraffic();
+    }
+    bucket.m_traffic.add(traffic);
+}
+
+// Sum the buckets still holding their period, at most the whole ring
+RollupTraffic RollupRing::sum(int64_t first, int64_t last) const
+{
+    RollupTraffic traffic;
+    first = std::max(first, last - static_cast<int64_t>(m_buckets.size()) + 1);
+    for (int64_t period = first; period <= last; period++)
+    {
+        if (const RollupBucket *bucket = find(period))
+        {
+            traffic.add(bucket->m_traffic);
+        }
+    }
+    return traffic;
+}
+
+// Bucket of the period if it was not reused yet
+const RollupBucket *RollupRing::find(int64_t period) const
+{
+    if (m_buckets.empty())
+    {
+        return nullptr;
+    }
+    const RollupBucket &bucket = m_buckets[static_cast<uint64_t>(period) % m_buckets.size()];
+    return bucket.m_period == period ? &bucket : nullptr;
+}
+
+// The bucket holds the period with no traffic
+void RollupRing::clear(int64_t period)
+{
+    if (m_buckets.empty())
+    {
+        return;
+    }
+    RollupBucket &bucket = slot(period);
+    bucket.m_period = period;
+    bucket.m_traffic = RollupTraffic();
+}
+
+// Size every ring, the recorded traffic is dropped
+void Rollup::resize(const size_t (&buckets)[ROLLUP_RESOLUTIONS])
+{
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++)
+    {
+        m_rings[resolution].resize(buckets[resolution]);
+    }
+    m_since = INT64_MIN;
+}
+
+// The second counts to its bucket of every resolution
+void Rollup::add(int64_t second, const RollupTraffic &traffic)
+{
+    int64_t periods[ROLLUP_RESOLUTIONS];
+    rollupPeriods(second, periods);
+    add(periods, traffic);
+}
+
+// Periods are computed once for all flows of a second
+void Rollup::add(const int64_t (&periods)[ROLLUP_RESOLUTIONS], const RollupTraffic &traffic)
+{
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++)
+    {
+        m_rings[resolution].add(periods[resolution], traffic);
+    }
+}
+
+// Only the current bucket of every ring can hold traffic of the previous host, later ones replace the
+// older periods they find
+void Rollup::restart(int64_t second)
+{
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++)
+    {
+        m_rings[resolution].clear(periodOf(second, static_cast<RollupResolution>(resolution)));
+    }
+    m_since = second;
+}
+
+// Sum of the buckets of the span, the current bucket included
+RollupTraffic Rollup::sum(RollupSpan span, int64_t now) const
+{
+    RollupResolution resolution = SPAN_RESOLUTION[span];
+    int64_t last = periodOf(now, resolution);
+    return m_rings[resolution].sum(std::max(last - SPAN_PERIODS[span] + 1, firstPeriod(resolution)), last);
+}
+
+// Period of the second the slot was taken
+int64_t Rollup::firstPeriod(RollupResolution resolution) const
+{
+    return m_since == INT64_MIN ? INT64_MIN : periodOf(m_since, resolution);
+}
+
+// Ring of one resolution
+const RollupRing &Rollup::ring(RollupResolution resolution) const
+{
+    return m_rings[resolution];
+}
+
+// The interface rings are allocated up front, host rings by the first traffic of the host
+Rollups::Rollups()
+{
+    m_interface.resize(INTERFACE_BUCKETS);
+}
+
+// Drop all hosts, slots are allocated again as hosts appear
+void Rollups::setHostLimit(size_t hosts)
+{
+    m_hostLimit = hosts;
+    m_hosts.clear();
+    m_hosts.shrink_to_fit();
+    m_hostKeys.clear();
+    m_hostKeys.shrink_to_fit();
+    m_counts.clear();
+    m_counts.shrink_to_fit();
+    m_hostSlots = FlowMap<HostKey, uint32_t, HostKeyHash>();
+    m_eviction.clear();
+}
+
+// Number of host slots
+size_t Rollups::hostLimit() const
+{
+    return m_hostLimit;
+}
+
+// Traffic of the interface as it was captured
+void Rollups::addInterface(int64_t second, const RollupTraffic &traffic)
+{
+    m_interface.add(second, traffic);
+}
+
+// The source host sent the bytes of the flow and the destination host received them
+void Rollups::addHosts(int64_t second, const ConnectionID &id, const RollupTraffic &traffic)
+{
+    if (m_hostLimit == 0)
+    {
+        return;
+    }
+    if (second != m_second)
+    {
+        rollupPeriods(second, m_periods);
+        m_second = second;
+    }
+    HostKey host;
+    std::memcpy(host.m_address, id.m_srcAddress, sizeof(host.m_address));
+    uint32_t slot = hostSlot(host, second);
+    m_hosts[slot].add(m_periods, {traffic.bytes(), 0, traffic.m_packets});
+    m_counts[slot] += traffic.bytes();
+
+    std::memcpy(host.m_address, id.m_destAddress, sizeof(host.m_address));
+    slot = hostSlot(host, second);
+    m_hosts[slot].add(m_periods, {0, traffic.bytes(), traffic.m_packets});
+    m_counts[slot] += traffic.bytes();
+}
+
+// Existing slot, a new one while there are free slots, or the slot with the lowest count
+uint32_t Rollups::hostSlot(const HostKey &host, int64_t second)
+{
+    auto found = m_hostSlots.find(host);
+    if (found != m_hostSlots.end())
+    {
+        return found->second;
+    }
+    uint32_t slot;
+    if (m_hosts.size() < m_hostLimit)
+    {
+        // All slots at once, the vector never grows past the limit. The index stays half empty, so hosts
+        // replacing each other leave few tombstones
+        m_hosts.reserve(m_hostLimit);
+        m_hostKeys.reserve(m_hostLimit);
+        m_counts.reserve(m_hostLimit);
+        m_hostSlots.reserve(2 * m_hostLimit);
+        slot = static_cast<uint32_t>(m_hosts.size());
+        m_hosts.emplace_back();
+        m_hosts[slot].resize(HOST_BUCKETS);
+        m_hostKeys.push_back(host);
+        m_counts.push_back(0);
+        m_eviction.update(slot, 0);
+    }
+    else
+    {
+        // Lowest count, the count of the slot stays with the new host
+        slot = m_eviction.best();
+        while (m_eviction.score(slot) != -static_cast<double>(m_counts[slot]))
+        {
+            m_eviction.update(slot, -static_cast<double>(m_counts[slot]));
+            slot = m_eviction.best();
+        }
+        m_hostSlots.erase(m_hostKeys[slot]);
+        m_hostKeys[slot] = host;
+        m_hosts[slot].restart(second);
+    }
+    m_hostSlots.insert({host, slot});
+    return slot;
+}
+
+// Spans of the interface and of the busiest hosts of the last hour
+void Rollups::summary(int64_t now, size_t hosts, std::vector<RollupSummary> &rows) const
+{
+    rows.clear();
+    RollupSummary interface;
+    for (int span = 0; span < ROLLUP_SPANS; span++)
+    {
+        interface.m_spans[span] = m_interface.sum(static_cast<RollupSpan>(span), now);
+    }
+    rows.push_back(interface);
+
+    std::vector<std::pair<uint64_t, uint32_t>> busiest;
+    busiest.reserve(m_hosts.size());
+    for (uint32_t slot = 0; slot < m_hosts.size(); slot++)
+    {
+        uint64_t bytes = m_hosts[slot].sum(LAST_HOUR, now).bytes();
+        if (bytes != 0)
+        {
+            busiest.push_back({bytes, slot});
+        }
+    }
+    size_t count = std::min(hosts, busiest.size());
+    std::partial_sort(busiest.begin(), busiest.begin() + count, busiest.end(),
+                      [](const auto &first, const auto &second)
+                      { return first.first > second.first; });
+    for (size_t i = 0; i < count; i++)
+    {
+        RollupSummary row;
+        row.m_host = true;
+        row.m_address = m_hostKeys[busiest[i].second];
+        for (int span = 0; span < ROLLUP_SPANS; span++)
+        {
+            row.m_spans[span] = m_hosts[busiest[i].second].sum(static_cast<RollupSpan>(span), now);
+        }
+        rows.push_back(row);
+    }
+}
+
+// Periods after the last written one up to the one before now, those still in the rings. Every interface
+// period is written so the log has no gaps, hosts only with traffic
+void Rollups::closedBuckets(int64_t now, std::vector<RollupRecord> &records)
+{
+    records.clear();
+    for (RollupResolution resolution : {ROLLUP_MINUTE, ROLLUP_HOUR})
+    {
+        int64_t closed = periodOf(now, resolution) - 1;
+        int64_t &written = m_closedPeriod[resolution];
+        if (written == INT64_MIN)
+        {
+            written = closed;
+            continue;
+        }
+        int64_t first = std::max(written + 1, closed - static_cast<int64_t>(m_interface.ring(resolution).size()) + 1);
+        for (int64_t period = first; period <= closed; period++)
+        {
+            const RollupBucket *bucket = m_interface.ring(resolution).find(period);
+            records.push_back({period * ROLLUP_SECONDS[resolution], resolution, false, HostKey{},
+                               bucket ? bucket->m_traffic : RollupTraffic()});
+            if (resolution != ROLLUP_HOUR)
+            {
+                continue;
+            }
+            for (uint32_t slot = 0; slot < m_hosts.size(); slot++)
+            {
+                const RollupBucket *hostBucket = m_hosts[slot].ring(resolution).find(period);
+                // Buckets before the host got the slot belong to an evicted host
+                if (hostBucket && hostBucket->m_traffic.bytes() != 0 && period >= m_hosts[slot].firstPeriod(resolution))
+                {
+                    records.push_back({period * ROLLUP_SECONDS[resolution], resolution, true, m_hostKeys[slot],
+                                       hostBucket->m_traffic});
+                }
+            }
+        }
+        written = std::max(written, closed);
+    }
+}
+
+// Buckets of the interface and of the allocated host slots, and the host index
+size_t Rollups::memoryUsage() const
+{
+    size_t buckets = 0;
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++)
+    {
+        buckets += INTERFACE_BUCKETS[resolution] + m_hosts.size() * HOST_BUCKETS[resolution];
+    }
+    return buckets * sizeof(RollupBucket) + m_hostKeys.capacity() * (sizeof(HostKey) + sizeof(uint64_t)) +
+           m_hostSlots.memoryUsage();
+}
+
+// IPv4-mapped addresses are written as IPv4
+std::string Rollups::hostToString(const HostKey &host)
+{
+    char ipStr[INET6_ADDRSTRLEN];
+    in6_addr address;
+    std::memcpy(&address, host.m_address, sizeof(address));
+    if (IN6_IS_ADDR_V4MAPPED(&address))
+    {
+        inet_ntop(AF_INET, &host.m_address[12], ipStr, sizeof(ipStr));
+    }
+    else
+    {
+        inet_ntop(AF_INET6, &address, ipStr, sizeof(ipStr));
+    }
+    return ipStr;
+}
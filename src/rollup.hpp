@@ -0,0 +1,219 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "connectionID.hpp"
+#include "flowHash.hpp"
+#include "flowMap.hpp"
+#include "rankHeap.hpp"
+
+// Resolutions of the rollup rings
+enum RollupResolution
+{
+    ROLLUP_SECOND,
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR
+};
+// Number of resolutions
+static const int ROLLUP_RESOLUTIONS = 3;
+// Seconds of one bucket of every resolution
+static constexpr int64_t ROLLUP_SECONDS[ROLLUP_RESOLUTIONS] = {1, 60, 3600};
+
+// Periods ending now the rollups are queried for, each summed from the finest ring that covers it
+enum RollupSpan
+{
+    LAST_MINUTE,
+    LAST_HOUR,
+    LAST_DAY,
+    LAST_WEEK
+};
+// Number of spans
+static const int ROLLUP_SPANS = 4;
+
+// Period of second in every resolution
+void rollupPeriods(int64_t second, int64_t (&periods)[ROLLUP_RESOLUTIONS]);
+
+// Traffic added to a rollup. Sent and received are seen from the interface, or from the host for a host
+struct RollupTraffic
+{
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+    uint64_t m_packets = 0;
+
+    uint64_t bytes() const
+    {
+        return m_bytesSent + m_bytesReceived;
+    }
+    void add(const RollupTraffic &traffic)
+    {
+        m_bytesSent += traffic.m_bytesSent;
+        m_bytesReceived += traffic.m_bytesReceived;
+        m_packets += traffic.m_packets;
+    }
+};
+
+// Bucket of one period of a ring, m_period = start second / bucket seconds
+struct RollupBucket
+{
+    int64_t m_period = INT64_MIN;
+    RollupTraffic m_traffic;
+};
+
+// Fixed number of buckets of one resolution. A bucket is reused by the period that many buckets later,
+// so the ring always holds the newest periods and never grows
+class RollupRing
+{
+public:
+    void resize(size_t buckets);
+    size_t size() const;
+    // Add traffic to the bucket of period, traffic of a period older than the ring is dropped
+    void add(int64_t period, const RollupTraffic &traffic);
+    // Traffic of the periods first..last that are still in the ring
+    RollupTraffic sum(int64_t first, int64_t last) const;
+    // Bucket of period, nullptr if it is not in the ring
+    const RollupBucket *find(int64_t period) const;
+    // Empty the bucket of period
+    void clear(int64_t period);
+
+private:
+    // Bucket of period, also holding an older or newer period
+    RollupBucket &slot(int64_t period);
+
+    std::vector<RollupBucket> m_buckets;
+    // Newest period and its bucket, most adds go to it without dividing
+    int64_t m_headPeriod = INT64_MIN;
+    size_t m_headIndex = 0;
+};
+
+// One ring of every resolution for one scope (the interface or a host). Every second of traffic is added to
+// its second, minute and hour bucket at once, so the coarser rings are downsampled incrementally and nothing
+// is re-aggregated when a finer bucket is reused
+class Rollup
+{
+public:
+    // Buckets of the second, minute and hour ring
+    void resize(const size_t (&buckets)[ROLLUP_RESOLUTIONS]);
+    void add(int64_t second, const RollupTraffic &traffic);
+    // Add traffic to the buckets of periods of a second split by rollupPeriods
+    void add(const int64_t (&periods)[ROLLUP_RESOLUTIONS], const RollupTraffic &traffic);
+    // Start over at second for a new host of the slot in O(1): the current buckets are emptied, older ones
+    // are hidden by m_since until they are reused
+    void restart(int64_t second);
+    // Traffic of the span ending at second now
+    RollupTraffic sum(RollupSpan span, int64_t now) const;
+    const RollupRing &ring(RollupResolution resolution) const;
+    // First period of the resolution that belongs to this scope
+    int64_t firstPeriod(RollupResolution resolution) const;
+
+private:
+    RollupRing m_rings[ROLLUP_RESOLUTIONS];
+    // Second the host got the slot, INT64_MIN = all buckets are valid
+    int64_t m_since = INT64_MIN;
+};
+
+// Address of a host, IPv4 is IPv4-mapped like in ConnectionID
+struct HostKey
+{
+    uint8_t m_address[16];
+
+    bool operator==(const HostKey &right) const
+    {
+        return std::memcmp(m_address, right.m_address, sizeof(m_address)) == 0;
+    }
+};
+
+// Hash of a host address
+struct HostKeyHash
+{
+    std::size_t operator()(const HostKey &key) const
+    {
+        return FlowHash::mix(FlowHash::load64(key.m_address) ^ FlowHash::SECRET0,
+                             FlowHash::load64(key.m_address + 8) ^ FlowHash::SECRET1);
+    }
+};
+
+// Traffic of the interface or of one host over every span
+struct RollupSummary
+{
+    // False for the interface
+    bool m_host = false;
+    HostKey m_address{};
+    RollupTraffic m_spans[ROLLUP_SPANS];
+};
+
+// Closed bucket of a ring, written to the rollup log
+struct RollupRecord
+{
+    int64_t m_start;
+    RollupResolution m_resolution;
+    bool m_host;
+    HostKey m_address;
+    RollupTraffic m_traffic;
+};
+
+// Rollups keep the traffic of the interface and of the busiest hosts at 1 s, 1 min and 1 h resolution in
+// constant memory, independent of the flows in the table, so traffic of expired flows is not forgotten.
+// A flow counts to the interface, its bytes as sent by its source host and received by its destination
+// host. The hosts have a fixed number of slots replaced like in Space-Saving: a new host takes the slot with
+// the lowest count and continues from that count, so a host with more than 1 / slots of all host traffic
+// always keeps its slot and the slots of quiet hosts are taken over as traffic of other hosts adds up. A
+// host slot is allocated by its first traffic, so memory stays flat however long the process runs
+class Rollups
+{
+public:
+    // Interface: an hour of seconds, a day of minutes and 30 days of hours
+    static constexpr size_t INTERFACE_BUCKETS[ROLLUP_RESOLUTIONS] = {3600, 1440, 720};
+    // Host: a minute of seconds, an hour of minutes and a week of hours
+    static constexpr size_t HOST_BUCKETS[ROLLUP_RESOLUTIONS] = {60, 60, 168};
+
+    Rollups();
+    // Writers and readers of the rollups hold it, the methods below don't lock
+    std::mutex m_mutex;
+
+    // Number of host slots, 0 = only the interface. Drops the hosts recorded so far
+    void setHostLimit(size_t hosts);
+    size_t hostLimit() const;
+    // Add traffic at second to the interface
+    void addInterface(int64_t second, const RollupTraffic &traffic);
+    // Add traffic of one flow at second to its two hosts
+    void addHosts(int64_t second, const ConnectionID &id, const RollupTraffic &traffic);
+    // Interface first, then up to hosts hosts with the most traffic in the last hour
+    void summary(int64_t now, size_t hosts, std::vector<RollupSummary> &rows) const;
+    // Minute and hour buckets of the interface and hour buckets of the hosts that closed since the previous
+    // call, oldest first. The first call only marks where the log starts
+    void closedBuckets(int64_t now, std::vector<RollupRecord> &records);
+    // Memory held by the rings and the host index
+    size_t memoryUsage() const;
+    // Address without port
+    static std::string hostToString(const HostKey &host);
+
+private:
+    // Slot of the host, the slot with the lowest count is taken over when all slots are used
+    uint32_t hostSlot(const HostKey &host, int64_t second);
+
+    Rollup m_interface;
+    std::vector<Rollup> m_hosts;
+    // Address of the host in every slot
+    std::vector<HostKey> m_hostKeys;
+    FlowMap<HostKey, uint32_t, HostKeyHash> m_hostSlots;
+    // Space-Saving count of every slot
+    std::vector<uint64_t> m_counts;
+    // Slots ranked by their negated count, the best is the slot to take over. Scores are brought up to date
+    // only when a slot is taken over, counts only grow, so an outdated best slot is fixed and the next tried
+    RankHeap m_eviction;
+    // Periods of the second of the last add, every flow of a tick has the same
+    int64_t m_second = INT64_MIN;
+    int64_t m_periods[ROLLUP_RESOLUTIONS] = {};
+    size_t m_hostLimit = 256;
+    // Last period of every resolution written by closedBuckets, INT64_MIN = nothing yet
+    int64_t m_closedPeriod[ROLLUP_RESOLUTIONS] = {INT64_MIN, INT64_MIN, INT64_MIN};
+};
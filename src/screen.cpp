@@ -0,0 +1,123 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "screen.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+// New frame, the shadow is dropped when the window changed size or was invalidated
+void Screen::begin(WINDOW *window)
+{
+    int rows, columns;
+    getmaxyx(window, rows, columns);
+    if (window != m_window || rows != m_rows || columns != m_columns || m_invalid)
+    {
+        m_window = window;
+        m_rows = rows;
+        m_columns = columns;
+        m_shadow.assign(rows, std::string());
+        m_invalid = false;
+        werase(window);
+    }
+    m_drawn.assign(rows, false);
+    m_cellsWritten = 0;
+}
+
+// Cells beyond the end of the shorter text are blanks, the changed span is written with its blanks
+void Screen::line(int row, const std::string &text)
+{
+    if (row < 0 || row >= m_rows)
+    {
+        return;
+    }
+    m_drawn[row] = true;
+    std::string &shadow = m_shadow[row];
+    size_t length = std::min(text.size(), static_cast<size_t>(m_columns));
+    if (shadow.size() == length && shadow.compare(0, length, text, 0, length) == 0)
+    {
+        return;
+    }
+    auto cell = [](const std::string &line, size_t column)
+    {
+        return column < line.size() ? line[column] : ' ';
+    };
+    size_t width = std::max(length, shadow.size());
+    size_t first = 0;
+    while (first < width && cell(shadow, first) == (first < length ? text[first] : ' '))
+    {
+        first++;
+    }
+    size_t last = width;
+    while (last > first && cell(shadow, last - 1) == (last - 1 < length ? text[last - 1] : ' '))
+    {
+        last--;
+    }
+    if (first < last)
+    {
+        std::string span = text.substr(first, std::min(last, length) - std::min(first, length));
+        span.resize(last - first, ' ');
+        mvwaddnstr(m_window, row, static_cast<int>(first), span.c_str(), static_cast<int>(span.size()));
+        m_cellsWritten += span.size();
+    }
+    shadow.assign(text, 0, length);
+}
+
+// Lines drawn by the previous frame but not by this one are erased
+void Screen::end()
+{
+    for (int row = 0; row < m_rows; row++)
+    {
+        if (!m_drawn[row] && !m_shadow[row].empty())
+        {
+            wmove(m_window, row, 0);
+            wclrtoeol(m_window);
+            m_cellsWritten += m_shadow[row].size();
+            m_shadow[row].clear();
+        }
+    }
+    wnoutrefresh(m_window);
+    doupdate();
+}
+
+// After the terminal was resized or overwritten
+void Screen::invalidate()
+{
+    m_invalid = true;
+}
+
+// Lines of the window
+int Screen::rows() const
+{
+    return m_rows;
+}
+
+// Columns of the window
+int Screen::columns() const
+{
+    return m_columns;
+}
+
+// Cells written by the last frame
+size_t Screen::cellsWritten() const
+{
+    return m_cellsWritten;
+}
+
+// Formats like printf
+std::string Screen::format(const char *format, ...)
+{
+    char buffer[1024];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = std::vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length < 0)
+    {
+        return std::string();
+    }
+    return std::string(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+}
@@ -0,0 +1,45 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <ncurses.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Screen keeps a shadow copy of the lines it drew in a window. A frame is composed line by line between begin
+// and end, every line is compared with its shadow and only the span from the first to the last changed cell is
+// written, a line that didn't change is not touched at all. The window is never cleared (clear() makes the
+// next refresh repaint the whole terminal), lines missing from the frame are erased. When few values change
+// between ticks, only those cells are sent to the terminal
+class Screen
+{
+public:
+    // Start a frame in window. After a change of its size everything is drawn again
+    void begin(WINDOW *window);
+    // Text of a line of the frame, cut at the width of the window
+    void line(int row, const std::string &text);
+    // Erase the lines the frame didn't draw and send the changes to the terminal
+    void end();
+    // Draw everything again in the next frame
+    void invalidate();
+    int rows() const;
+    int columns() const;
+    // Cells written to the window by the last frame
+    size_t cellsWritten() const;
+    // printf into a string
+    static std::string format(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+private:
+    WINDOW *m_window = nullptr;
+    int m_rows = 0;
+    int m_columns = 0;
+    // What every line of the window shows, and whether the current frame drew it
+    std::vector<std::string> m_shadow;
+    std::vector<bool> m_drawn;
+    bool m_invalid = true;
+    size_t m_cellsWritten = 0;
+};
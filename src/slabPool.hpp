@@ -0,0 +1,168 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Allocator statistics of a SlabPool
+struct SlabStats
+{
+    // Slabs currently allocated, and slabs returned to the heap since the start
+    size_t m_liveSlabs = 0;
+    size_t m_releasedSlabs = 0;
+    // Records in use and records the live slabs can hold
+    size_t m_records = 0;
+    size_t m_capacity = 0;
+    // Share of the live slabs that is unused (0 - 1)
+    double fragmentation() const
+    {
+        return m_capacity == 0 ? 0.0 : 1.0 - static_cast<double>(m_records) / m_capacity;
+    }
+};
+
+// Pool of fixed size records allocated in slabs of SLAB_RECORDS. Records are addressed by a 32 bit id and
+// never move, so the hash table holds only the id and growing it does not copy the records. New records
+// come from the lowest slab with a free record, the higher slabs drain as flows leave and a slab whose
+// last record is released goes back to the heap at once
+template <typename T>
+class SlabPool
+{
+public:
+    static constexpr uint32_t SLAB_SHIFT = 12;
+    static constexpr uint32_t SLAB_RECORDS = 1u << SLAB_SHIFT;
+
+    // Id of a free record. The record keeps the value it was released with, the caller overwrites it
+    uint32_t allocate()
+    {
+        uint32_t slabIndex = firstSlabWithSpace();
+        if (slabIndex == m_slabs.size())
+        {
+            m_slabs.emplace_back();
+            m_hasSpace.resize((m_slabs.size() + 63) / 64, 0);
+        }
+        Slab &slab = m_slabs[slabIndex];
+        // Slab was never allocated or was released
+        if (!slab.m_records)
+        {
+            slab.m_records = std::make_unique<T[]>(SLAB_RECORDS);
+            slab.m_free.resize(SLAB_RECORDS);
+            for (uint32_t i = 0; i < SLAB_RECORDS; i++)
+            {
+                slab.m_free[i] = static_cast<uint16_t>(SLAB_RECORDS - 1 - i);
+            }
+            setHasSpace(slabIndex, true);
+            m_liveSlabs++;
+        }
+        uint32_t record = slab.m_free.back();
+        slab.m_free.pop_back();
+        if (slab.m_free.empty())
+        {
+            setHasSpace(slabIndex, false);
+        }
+        m_records++;
+        return (slabIndex << SLAB_SHIFT) | record;
+    }
+
+    // Return record to its slab, the slab is freed when it becomes empty
+    void release(uint32_t id)
+    {
+        uint32_t slabIndex = id >> SLAB_SHIFT;
+        Slab &slab = m_slabs[slabIndex];
+        slab.m_free.push_back(static_cast<uint16_t>(id & (SLAB_RECORDS - 1)));
+        setHasSpace(slabIndex, true);
+        m_records--;
+        if (slab.m_free.size() == SLAB_RECORDS)
+        {
+            slab.m_records.reset();
+            slab.m_free.clear();
+            slab.m_free.shrink_to_fit();
+            m_liveSlabs--;
+            m_releasedSlabs++;
+        }
+    }
+
+    // Record lies in a live slab, records of released slabs must not be accessed
+    bool isAllocated(uint32_t id) const
+    {
+        uint32_t slabIndex = id >> SLAB_SHIFT;
+        return slabIndex < m_slabs.size() && m_slabs[slabIndex].m_records != nullptr;
+    }
+
+    T &operator[](uint32_t id)
+    {
+        return m_slabs[id >> SLAB_SHIFT].m_records[id & (SLAB_RECORDS - 1)];
+    }
+
+    const T &operator[](uint32_t id) const
+    {
+        return m_slabs[id >> SLAB_SHIFT].m_records[id & (SLAB_RECORDS - 1)];
+    }
+
+    size_t size() const
+    {
+        return m_records;
+    }
+
+    SlabStats stats() const
+    {
+        SlabStats stats;
+        stats.m_liveSlabs = m_liveSlabs;
+        stats.m_releasedSlabs = m_releasedSlabs;
+        stats.m_records = m_records;
+        stats.m_capacity = m_liveSlabs * SLAB_RECORDS;
+        return stats;
+    }
+
+    // Heap bytes held by the pool
+    size_t memoryUsage() const
+    {
+        return m_slabs.capacity() * sizeof(Slab) + m_liveSlabs * SLAB_RECORDS * (sizeof(T) + sizeof(uint16_t));
+    }
+
+private:
+    struct Slab
+    {
+        std::unique_ptr<T[]> m_records;
+        // Free record indexes of the slab
+        std::vector<uint16_t> m_free;
+    };
+
+    // Lowest slab with a free record or one that is not allocated, m_slabs.size() if all are full
+    uint32_t firstSlabWithSpace() const
+    {
+        for (size_t word = 0; word < m_hasSpace.size(); word++)
+        {
+            if (m_hasSpace[word] != 0)
+            {
+                return static_cast<uint32_t>(word * 64 + __builtin_ctzll(m_hasSpace[word]));
+            }
+        }
+        return static_cast<uint32_t>(m_slabs.size());
+    }
+
+    void setHasSpace(uint32_t slabIndex, bool hasSpace)
+    {
+        uint64_t bit = 1ull << (slabIndex % 64);
+        if (hasSpace)
+        {
+            m_hasSpace[slabIndex / 64] |= bit;
+        }
+        else
+        {
+            m_hasSpace[slabIndex / 64] &= ~bit;
+        }
+    }
+
+    std::vector<Slab> m_slabs;
+    // Bit per slab that has a free record or is released
+    std::vector<uint64_t> m_hasSpace;
+    size_t m_liveSlabs = 0;
+    size_t m_releasedSlabs = 0;
+    size_t m_records = 0;
+};
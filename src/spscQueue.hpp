@@ -0,0 +1,95 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Unbounded single producer, single consumer queue of small trivially copyable items. Items are written
+// into chunks of CHUNK_ITEMS, the producer publishes the count of written items of its chunk with a
+// release store and the consumer reads up to it. Neither side ever waits for the other, the consumer
+// frees a chunk after it has read all of its items
+template <typename T>
+class SpscQueue
+{
+public:
+    static constexpr uint32_t CHUNK_ITEMS = 4096;
+
+    SpscQueue()
+    {
+        m_head = m_tail = new Chunk();
+    }
+
+    ~SpscQueue()
+    {
+        while (m_head != nullptr)
+        {
+            Chunk *next = m_head->m_next.load(std::memory_order_relaxed);
+            delete m_head;
+            m_head = next;
+        }
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Producer side
+    void push(const T &item)
+    {
+        m_tail->m_items[m_tailIndex] = item;
+        m_tail->m_count.store(++m_tailIndex, std::memory_order_release);
+        if (m_tailIndex == CHUNK_ITEMS)
+        {
+            Chunk *chunk = new Chunk();
+            m_tail->m_next.store(chunk, std::memory_order_release);
+            m_tail = chunk;
+            m_tailIndex = 0;
+        }
+    }
+
+    // Consumer side, calls consume(item) for every item pushed so far
+    template <typename Consume>
+    void drain(Consume &&consume)
+    {
+        while (true)
+        {
+            uint32_t count = m_head->m_count.load(std::memory_order_acquire);
+            while (m_headIndex < count)
+            {
+                consume(m_head->m_items[m_headIndex++]);
+            }
+            if (m_headIndex < CHUNK_ITEMS)
+            {
+                return;
+            }
+            // Chunk read to the end, the producer has moved on once it links the next one
+            Chunk *next = m_head->m_next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return;
+            }
+            delete m_head;
+            m_head = next;
+            m_headIndex = 0;
+        }
+    }
+
+private:
+    struct Chunk
+    {
+        T m_items[CHUNK_ITEMS];
+        std::atomic<uint32_t> m_count{0};
+        std::atomic<Chunk *> m_next{nullptr};
+    };
+
+    // Consumer position
+    alignas(64) Chunk *m_head;
+    uint32_t m_headIndex = 0;
+    // Producer position, on its own cache line
+    alignas(64) Chunk *m_tail;
+    uint32_t m_tailIndex = 0;
+};
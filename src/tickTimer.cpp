@@ -0,0 +1,88 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#include "tickTimer.hpp"
+
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Destructor
+TickTimer::~TickTimer()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+// Non-blocking timerfd, wait() polls it
+bool TickTimer::start(std::chrono::milliseconds interval, std::string &error)
+{
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_fd < 0)
+    {
+        error = std::string("timerfd_create: ") + std::strerror(errno);
+        return false;
+    }
+    m_interval = interval;
+    itimerspec spec{};
+    spec.it_interval.tv_sec = interval.count() / 1000;
+    spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(m_fd, 0, &spec, nullptr) < 0)
+    {
+        error = std::string("timerfd_settime: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Sleeps in poll until the timer fires
+uint64_t TickTimer::wait()
+{
+    if (m_fd < 0)
+    {
+        return 0;
+    }
+    pollfd timer{m_fd, POLLIN, 0};
+    while (true)
+    {
+        uint64_t ticks = expired();
+        if (ticks != 0)
+        {
+            return ticks;
+        }
+        if (poll(&timer, 1, -1) < 0 && errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+// Reading the timerfd returns the expirations since the last read and resets them
+uint64_t TickTimer::expired()
+{
+    uint64_t ticks = 0;
+    if (read(m_fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+    {
+        return 0;
+    }
+    return ticks;
+}
+
+// Descriptor for poll
+int TickTimer::fd() const
+{
+    return m_fd;
+}
+
+// Time between ticks
+std::chrono::milliseconds TickTimer::interval() const
+{
+    return m_interval;
+}
@@ -0,0 +1,34 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// TickTimer is a periodic timer on a timerfd (CLOCK_MONOTONIC). Ticks follow the clock and not the work done
+// between them, so a slow tick doesn't delay the ones after it, and ticks missed meanwhile are counted instead
+// of queued. The descriptor can be polled together with other input
+class TickTimer
+{
+public:
+    // Destructor
+    ~TickTimer();
+
+    // Create the timer, the first tick is one interval from now
+    bool start(std::chrono::milliseconds interval, std::string &error);
+    // Block until the next tick, returns the ticks since the previous call (more than 1 after a late call),
+    // 0 if the timer failed
+    uint64_t wait();
+    // Ticks since the previous call without blocking, 0 if none
+    uint64_t expired();
+    int fd() const;
+    std::chrono::milliseconds interval() const;
+
+private:
+    int m_fd = -1;
+    std::chrono::milliseconds m_interval{0};
+};
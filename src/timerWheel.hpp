@@ -0,0 +1,151 @@
+/*
+ * Author: Vladimir Azarov
+ * Login:  xazaro00
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hashed timer wheel with one second slots. Every entry sits in the slot of its deadline, advancing the
+// wheel visits only the slots whose second has passed, so an expiry sweep costs the number of due entries
+// instead of a scan of all flows. The wheel does not know the real deadline of an entry, the callback
+// decides: it either removes the entry or returns a later deadline, and the entry is rescheduled. Flows
+// therefore are not touched on every packet, only once per idle timeout
+template <typename Entry>
+class TimerWheel
+{
+public:
+    // One lap of the wheel (seconds), deadlines further away are rescheduled when their slot comes up
+    static constexpr int64_t SLOTS = 512;
+    // Callback results: the entry is stale (its flow no longer exists), or the callback removed its flow
+    static constexpr int64_t DROP = -1;
+    static constexpr int64_t EXPIRE = -2;
+
+    TimerWheel() : m_slots(SLOTS) {}
+
+    // Add entry due at deadline (seconds), now is the current time
+    void schedule(const Entry &entry, int64_t deadline, int64_t now)
+    {
+        if (!m_started)
+        {
+            m_now = now;
+            m_started = true;
+        }
+        // Overdue entries fire on the next advance
+        if (deadline <= m_now)
+        {
+            deadline = m_now + 1;
+        }
+        m_slots[slot(deadline)].push_back(entry);
+        m_size++;
+    }
+
+    // Fire the slots of all seconds up to now. fire(entry, time) returns DROP, EXPIRE if the entry is due at
+    // time, or its real deadline if it is later. Returns the number of expired entries
+    template <typename Fire>
+    size_t advance(int64_t now, Fire &&fire)
+    {
+        if (!m_started)
+        {
+            m_now = now;
+            m_started = true;
+            return 0;
+        }
+        size_t expired = 0;
+        // After a long pause every slot is visited once, entries that are not due yet get rescheduled
+        int64_t from = now - m_now > SLOTS ? now - SLOTS + 1 : m_now + 1;
+        m_now = now;
+        for (int64_t slotTime = from; slotTime <= now; slotTime++)
+        {
+            expired += fireSlot(slotTime, now, fire);
+        }
+        return expired;
+    }
+
+    // Remove one entry whose deadline is the nearest, used to make room when the table is full. The first lap
+    // expires only entries that are due by their slot, the second lap takes any live entry.
+    // Returns false if the wheel has no live entry
+    template <typename Fire>
+    bool evictOne(Fire &&fire)
+    {
+        for (int64_t lap = 0; lap < 2 && m_size > 0; lap++)
+        {
+            for (int64_t slotTime = m_now + 1; slotTime <= m_now + SLOTS; slotTime++)
+            {
+                std::vector<Entry> &entries = m_slots[slot(slotTime)];
+                while (!entries.empty())
+                {
+                    Entry entry = entries.back();
+                    entries.pop_back();
+                    m_size--;
+                    int64_t result = fire(entry, lap == 0 ? slotTime : INT64_MAX);
+                    if (result == EXPIRE)
+                    {
+                        return true;
+                    }
+                    if (result != DROP)
+                    {
+                        schedule(entry, result, m_now);
+                    }
+                    // Rescheduled into this slot again, it is not due yet
+                    if (result != DROP && slot(result) == slot(slotTime))
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    // Slot of a second. The unsigned modulo keeps seconds before the epoch inside the wheel, SLOTS divides 2^64
+    // so the slots still follow each other across zero
+    static size_t slot(int64_t second)
+    {
+        return static_cast<size_t>(static_cast<uint64_t>(second) % SLOTS);
+    }
+
+    // Fire all entries of one slot at time now, the rescheduled ones are appended after the swap
+    template <typename Fire>
+    size_t fireSlot(int64_t slotIndex, int64_t now, Fire &fire)
+    {
+        size_t expired = 0;
+        std::vector<Entry> due;
+        due.swap(m_slots[slot(slotIndex)]);
+        m_size -= due.size();
+        for (const Entry &entry : due)
+        {
+            int64_t result = fire(entry, now);
+            if (result == EXPIRE)
+            {
+                expired++;
+            }
+            else if (result != DROP)
+            {
+                schedule(entry, result, m_now);
+            }
+        }
+        // Keep the capacity of the slot for the next lap
+        if (m_slots[slot(slotIndex)].empty())
+        {
+            due.clear();
+            m_slots[slot(slotIndex)].swap(due);
+        }
+        return expired;
+    }
+
+    std::vector<std::vector<Entry>> m_slots;
+    // Last second the wheel was advanced to
+    int64_t m_now = 0;
+    bool m_started = false;
+    size_t m_size = 0;
+};
@@ -32,7 +32,7 @@ static std::vector<char*> createArgv(const std::vector<std::string>& args) {
 
 // Helper to create a mock pcap header with a specific length
 pcap_pkthdr createMockPcapHeader(uint32_t len) {
-    pcap_pkthdr header;
+    pcap_pkthdr header{};
     header.ts.tv_sec = 0;
     header.ts.tv_usec = 0;
     header.caplen = len;
@@ -95,7 +95,7 @@ TEST(FullSystemIntegrationTest, SimulatedMainFlow) {
         tcpHeader->th_sport = htons(12345 + i);
         tcpHeader->th_dport = htons(80);
 
-        pcap_pkthdr pkthdr;
+        pcap_pkthdr pkthdr{};
         pkthdr.caplen = sizeof(packet);
         pkthdr.len = sizeof(packet);
 
@@ -122,7 +122,7 @@ TEST(PacketCaptureDisplayIntegrationTest, PacketCaptureAndDisplay) {
     inet_pton(AF_INET, "192.168.1.10", &localAddr);
     packetCapture.m_localIPv4Addresses.push_back(localAddr);
 
-    Display display(connectionsTable, SortBy::BY_BYTES, 1);
+    Display display(connectionsTable, SortBy::BY_BYTES, 1000);
 
     display.init();
     display.update();
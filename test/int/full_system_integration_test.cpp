@@ -52,7 +52,7 @@ TEST(FullSystemIntegrationTest, SimulatedMainFlow) {
         tcpHeader->th_sport = htons(12345 + i);
         tcpHeader->th_dport = htons(80);
 
-        pcap_pkthdr pkthdr;
+        pcap_pkthdr pkthdr{};
         pkthdr.caplen = sizeof(packet);
         pkthdr.len = sizeof(packet);
 
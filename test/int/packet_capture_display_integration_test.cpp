@@ -33,7 +33,7 @@ TEST(PacketCaptureDisplayIntegrationTest, PacketCaptureAndDisplay) {
     tcpHeader->th_sport = htons(12345);
     tcpHeader->th_dport = htons(80);
 
-    pcap_pkthdr pkthdr;
+    pcap_pkthdr pkthdr{};
     pkthdr.caplen = sizeof(packet);
     pkthdr.len = sizeof(packet);
 
@@ -9,7 +9,7 @@
 #include <pcap.h>
 
 pcap_pkthdr createMockPcapHeader(uint32_t len) {
-    pcap_pkthdr header;
+    pcap_pkthdr header{};
     header.ts.tv_sec = 0;
     header.ts.tv_usec = 0;
     header.caplen = len;
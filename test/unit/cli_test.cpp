@@ -120,3 +120,154 @@ TEST(CommandLineInterfaceTest, ExtraArguments) {
         cli.validateRetrieveArgs();
     }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
 }
+
+TEST(CommandLineInterfaceTest, ReplayFileWithoutInterface) {
+    std::vector<std::string> args = {"program", "-r", "capture.pcap", "--paced"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_captureConfig.m_readFile, "capture.pcap");
+    EXPECT_TRUE(cli.m_captureConfig.m_replayPaced);
+}
+
+TEST(CommandLineInterfaceTest, FilterExpression) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "-f", "not port 22 and not vlan 42"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_captureConfig.m_filter, "not port 22 and not vlan 42");
+}
+
+TEST(CommandLineInterfaceTest, TimestampType) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--tstamp-type", "adapter"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_captureConfig.m_tstampType, "adapter");
+}
+
+TEST(CommandLineInterfaceTest, AveragedRateSort) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "-s", "r40", "--ewma", "5"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_sortBy, SortBy::BY_RATE_40S);
+    EXPECT_EQ(cli.m_ewmaWindow, 5);
+}
+
+TEST(CommandLineInterfaceTest, DirectionRateSort) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "-s", "tx"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_sortBy, SortBy::BY_TX_RATE);
+}
+
+TEST(CommandLineInterfaceTest, EwmaSortWithoutWindow) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "-s", "e"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    EXPECT_EXIT({
+        CommandLineInterface cli(argc, argv.data());
+        cli.validateRetrieveArgs();
+    }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
+
+TEST(CommandLineInterfaceTest, SketchOptions) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--sketch-above", "2000000"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_FALSE(cli.m_sketchConfig.m_always);
+    EXPECT_EQ(cli.m_sketchConfig.m_threshold, 2000000);
+}
+
+TEST(CommandLineInterfaceTest, RefreshAndStatsInterval) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--refresh", "250", "--stats-interval", "10000"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_refreshMs, 250);
+    EXPECT_EQ(cli.m_statsMs, 10000);
+}
+
+TEST(CommandLineInterfaceTest, ZeroRefresh) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--refresh", "0"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    EXPECT_EXIT({
+        CommandLineInterface cli(argc, argv.data());
+        cli.validateRetrieveArgs();
+    }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
+
+TEST(CommandLineInterfaceTest, ExpiryOptions) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--tcp-timeout", "600", "--udp-timeout", "20",
+                                     "--icmp-timeout", "5", "--max-flows", "100000"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    CommandLineInterface cli(argc, argv.data());
+    cli.validateRetrieveArgs();
+
+    EXPECT_EQ(cli.m_expiryConfig.m_tcpTimeout, 600);
+    EXPECT_EQ(cli.m_expiryConfig.m_udpTimeout, 20);
+    EXPECT_EQ(cli.m_expiryConfig.m_icmpTimeout, 5);
+    EXPECT_EQ(cli.m_expiryConfig.m_maxFlows, 100000);
+}
+
+TEST(CommandLineInterfaceTest, ZeroTimeout) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--udp-timeout", "0"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    EXPECT_EXIT({
+        CommandLineInterface cli(argc, argv.data());
+        cli.validateRetrieveArgs();
+    }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
+
+TEST(CommandLineInterfaceTest, ReplayWithWorkers) {
+    std::vector<std::string> args = {"program", "-r", "capture.pcap", "--workers", "4"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    EXPECT_EXIT({
+        CommandLineInterface cli(argc, argv.data());
+        cli.validateRetrieveArgs();
+    }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
+
+TEST(CommandLineInterfaceTest, ZeroPcapTimeout) {
+    std::vector<std::string> args = {"program", "-i", "eth0", "--timeout", "0"};
+    std::vector<char*> argv = createArgv(args);
+    int argc = args.size();
+
+    EXPECT_EXIT({
+        CommandLineInterface cli(argc, argv.data());
+        cli.validateRetrieveArgs();
+    }, ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
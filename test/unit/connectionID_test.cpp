@@ -3,6 +3,9 @@
 #include <arpa/inet.h>
 #include <cstring>
 #include <string>
+#include <bitset>
+#include <unordered_set>
+#include <vector>
 
 sockaddr_in6 createIPv4MappedIPv6SockAddr(const std::string& ipv4Address, uint16_t port) {
     sockaddr_in6 addr;
@@ -132,6 +135,112 @@ TEST(ConnectionIDTest, HashFunction) {
     EXPECT_NE(hash1, hash3);
 }
 
+TEST(ConnectionIDTest, HashIgnoresFieldsOutsideEquality) {
+    sockaddr_in6 src = createIPv6SockAddr("2001:db8::1", 12345);
+    sockaddr_in6 dest = createIPv6SockAddr("2001:db8::2", 54321);
+    ConnectionID connID1(src, dest, Protocol::TCP);
+    src.sin6_flowinfo = 7;
+    src.sin6_scope_id = 3;
+    ConnectionID connID2(src, dest, Protocol::TCP);
+
+    ConnectionIDHash hashFunc;
+    ASSERT_TRUE(connID1 == connID2);
+    EXPECT_EQ(hashFunc(connID1), hashFunc(connID2));
+    EXPECT_NE(hashFunc(connID1), hashFunc(ConnectionID(src, dest, Protocol::UDP)));
+    EXPECT_NE(hashFunc(connID1), hashFunc(ConnectionID(dest, src, Protocol::TCP)));
+}
+
+// Sequential flows (one client, consecutive ports and hosts) are the typical worst case for a weak hash
+TEST(ConnectionIDTest, HashDistribution) {
+    const int hosts = 64;
+    const int ports = 1024;
+    const size_t buckets = 1024;
+    std::vector<size_t> lowBuckets(buckets, 0);
+    std::vector<size_t> highBuckets(buckets, 0);
+    std::unordered_set<size_t> hashes;
+
+    ConnectionIDHash hashFunc;
+    for (int host = 0; host < hosts; host++) {
+        for (int port = 0; port < ports; port++) {
+            in_addr src{};
+            in_addr dest{};
+            src.s_addr = htonl(0x0a000001);
+            dest.s_addr = htonl(0xc0a80000 + host);
+            ConnectionID connID = ConnectionID::storeIPv4InIPv6(src, 40000 + port, dest, 443, Protocol::TCP);
+            size_t hash = hashFunc(connID);
+            hashes.insert(hash);
+            lowBuckets[hash % buckets]++;
+            highBuckets[hash >> (64 - 10)]++;
+        }
+    }
+
+    const double total = static_cast<double>(hosts) * ports;
+    EXPECT_EQ(hashes.size(), static_cast<size_t>(total));
+
+    // Chi-square with 1023 degrees of freedom, mean 1023 and standard deviation about 45
+    const double expected = total / buckets;
+    double chiLow = 0;
+    double chiHigh = 0;
+    for (size_t i = 0; i < buckets; i++) {
+        chiLow += (lowBuckets[i] - expected) * (lowBuckets[i] - expected) / expected;
+        chiHigh += (highBuckets[i] - expected) * (highBuckets[i] - expected) / expected;
+    }
+    EXPECT_LT(chiLow, 1023 + 6 * 45);
+    EXPECT_LT(chiHigh, 1023 + 6 * 45);
+}
+
+// Flipping any single input bit changes about half of the output bits
+TEST(ConnectionIDTest, HashAvalanche) {
+    sockaddr_in6 src = createIPv4MappedIPv6SockAddr("10.0.0.1", 40000);
+    sockaddr_in6 dest = createIPv4MappedIPv6SockAddr("192.168.0.1", 443);
+    ConnectionIDHash hashFunc;
+    size_t base = hashFunc(ConnectionID(src, dest, Protocol::TCP));
+
+    double flippedBits = 0;
+    int flips = 0;
+    for (int endpoint = 0; endpoint < 2; endpoint++) {
+        for (int bit = 0; bit < 128 + 16; bit++) {
+            sockaddr_in6 flippedSrc = src;
+            sockaddr_in6 flippedDest = dest;
+            sockaddr_in6 &target = endpoint == 0 ? flippedSrc : flippedDest;
+            if (bit < 128) {
+                target.sin6_addr.s6_addr[bit / 8] ^= 1 << (bit % 8);
+            } else {
+                target.sin6_port ^= 1 << (bit - 128);
+            }
+            size_t hash = hashFunc(ConnectionID(flippedSrc, flippedDest, Protocol::TCP));
+            size_t changed = std::bitset<64>(base ^ hash).count();
+            EXPECT_GE(changed, 10u);
+            flippedBits += changed;
+            flips++;
+        }
+    }
+    double average = flippedBits / flips;
+    EXPECT_GT(average, 28.0);
+    EXPECT_LT(average, 36.0);
+}
+
+TEST(ConnectionIDTest, CompactIPv4Key) {
+    in_addr srcIPv4Addr, destIPv4Addr;
+    inet_pton(AF_INET, "192.168.1.1", &srcIPv4Addr);
+    inet_pton(AF_INET, "192.168.1.2", &destIPv4Addr);
+    ConnectionID connID = ConnectionID::storeIPv4InIPv6(srcIPv4Addr, 12345, destIPv4Addr, 80, Protocol::UDP);
+    ASSERT_TRUE(connID.isIPv4());
+
+    FlowKey<AF_INET> key = connID.toIPv4Key();
+    EXPECT_EQ(std::memcmp(key.m_srcAddress, &srcIPv4Addr, 4), 0);
+    EXPECT_EQ(std::memcmp(key.m_destAddress, &destIPv4Addr, 4), 0);
+    EXPECT_EQ(ntohs(key.m_srcPort), 12345);
+    EXPECT_EQ(ntohs(key.m_destPort), 80);
+    EXPECT_EQ(key.m_protocol, Protocol::UDP);
+    EXPECT_TRUE(key == connID.toIPv4Key());
+
+    ConnectionID ipv6ID(createIPv6SockAddr("2001:db8::1", 1), createIPv6SockAddr("2001:db8::2", 2), Protocol::TCP);
+    EXPECT_FALSE(ipv6ID.isIPv4());
+    EXPECT_EQ(sizeof(ConnectionID), 38u);
+    EXPECT_EQ(sizeof(FlowKey<AF_INET>), 14u);
+}
+
 TEST(ConnectionIDTest, GetPorts) {
     sockaddr_in6 src = createIPv6SockAddr("2001:db8::1", 12345);
     sockaddr_in6 dest = createIPv6SockAddr("2001:db8::2", 54321);
@@ -151,6 +260,23 @@ TEST(ConnectionIDTest, EndpointToString) {
     EXPECT_EQ(endpointStrIPv4Mapped, "192.168.1.1:54321");
 }
 
+TEST(ConnectionIDTest, FormatAddressAndWriteEndpoint) {
+    ConnectionID connID(createIPv6SockAddr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", 65535),
+                        createIPv4MappedIPv6SockAddr("255.255.255.255", 0), Protocol::UDP);
+    AddressText src;
+    AddressText dest;
+    ConnectionID::formatAddress(connID.m_srcAddress, src);
+    ConnectionID::formatAddress(connID.m_destAddress, dest);
+    EXPECT_EQ(src.view(), "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+    EXPECT_EQ(dest.view(), "255.255.255.255");
+
+    char buffer[ConnectionID::ENDPOINT_LENGTH];
+    size_t length = ConnectionID::writeEndpoint(src, connID.getSrcPort(), buffer);
+    EXPECT_EQ(std::string(buffer, length), "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff:65535");
+    length = ConnectionID::writeEndpoint(dest, connID.getDestPort(), buffer);
+    EXPECT_EQ(std::string(buffer, length), "255.255.255.255:0");
+}
+
 TEST(ConnectionIDTest, CompareEndpoints) {
     sockaddr_in6 ep1 = createIPv6SockAddr("2001:db8::1", 12345);
     sockaddr_in6 ep2 = createIPv6SockAddr("2001:db8::1", 12345);
@@ -4,6 +4,8 @@
 #include <gtest/gtest.h>
 #include <netinet/in.h>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <thread>
 #include <vector>
 
@@ -194,3 +196,844 @@ TEST(ConnectionsTableTest, GetSortedConnections_EmptyTable)
 
     EXPECT_EQ(sortedConnections.size(), 0);
 }
+
+TEST(ConnectionsTableTest, Shards_AreMergedIntoSortedConnections)
+{
+    ConnectionsTable table;
+    ConnectionsTable &shard1 = table.addShard();
+    ConnectionsTable &shard2 = table.addShard();
+
+    ConnectionID id1(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    ConnectionID id2(createSockAddr6(3), createSockAddr6(4), Protocol::UDP);
+    ConnectionID id3(createSockAddr6(5), createSockAddr6(6), Protocol::TCP);
+
+    shard1.updateConnection(id1, true, 100);
+    shard2.updateConnection(id2, false, 700);
+    shard2.updateConnection(id3, true, 300);
+
+    table.calculateSpeed();
+
+    std::vector<Connection> sortedConnections;
+    table.getSortedConnections(SortBy::BY_BYTES, sortedConnections);
+
+    ASSERT_EQ(sortedConnections.size(), 3);
+    EXPECT_EQ(sortedConnections[0].m_ID, id2);
+    EXPECT_EQ(sortedConnections[1].m_ID, id3);
+    EXPECT_EQ(sortedConnections[2].m_ID, id1);
+}
+
+TEST(ConnectionsTableTest, CalculateSpeed_UsesSimulatedClock)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::UDP);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+
+    table.setSimulatedTime(start);
+    table.updateConnection(id, true, 100);
+    table.calculateSpeed();
+
+    table.setSimulatedTime(start + std::chrono::seconds(2));
+    table.updateConnection(id, true, 1000);
+    table.updateConnection(id, true, 1000);
+    table.calculateSpeed();
+
+    Connection tempConnection;
+    tempConnection.m_ID = id;
+
+    Connection *connection = table.getConnection(tempConnection);
+    ASSERT_NE(connection, nullptr);
+    EXPECT_DOUBLE_EQ(connection->m_txSpeedBytes, 1000);
+    EXPECT_DOUBLE_EQ(connection->m_txSpeedPackets, 1);
+}
+
+TEST(ConnectionsTableTest, CalculateSpeed_SubSecondTicksAndPacketTimestamps)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::UDP);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+
+    table.setSimulatedTime(start);
+    table.updateConnection(id, true, 100, start);
+    table.calculateSpeed();
+
+    // Half a second is not truncated to zero or to a whole second
+    auto packetTime = start + std::chrono::nanoseconds(250000123);
+    table.setSimulatedTime(start + std::chrono::milliseconds(500));
+    table.updateConnection(id, true, 1000, packetTime);
+    table.calculateSpeed();
+
+    Connection tempConnection;
+    tempConnection.m_ID = id;
+
+    Connection *connection = table.getConnection(tempConnection);
+    ASSERT_NE(connection, nullptr);
+    EXPECT_DOUBLE_EQ(connection->m_txSpeedBytes, 2000);
+    EXPECT_DOUBLE_EQ(connection->m_txSpeedPackets, 2);
+    // Last seen is the time on the packet, not the clock at the update
+    EXPECT_EQ(connection->m_last_seen, packetTime);
+}
+
+TEST(ConnectionsTableTest, AveragedSpeedsRankPastBursts)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setEwmaWindow(1);
+
+    ConnectionID burst(createSockAddr6(1), createSockAddr6(2), Protocol::UDP);
+    ConnectionID steady(createSockAddr6(3), createSockAddr6(4), Protocol::UDP);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+
+    table.setSimulatedTime(start);
+    table.updateConnection(burst, true, 100);
+    table.updateConnection(steady, true, 100);
+    table.calculateSpeed();
+
+    // One burst in the first second, then only the steady flow sends
+    for (int second = 1; second <= 10; second++)
+    {
+        table.setSimulatedTime(start + std::chrono::seconds(second));
+        if (second == 1)
+        {
+            table.updateConnection(burst, true, 100000);
+        }
+        table.updateConnection(steady, true, 1000);
+        table.calculateSpeed();
+    }
+
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    ASSERT_NE(snapshot, nullptr);
+    ASSERT_EQ(snapshot->m_top[BY_RATE].size(), 2);
+    ASSERT_EQ(snapshot->m_top[BY_RATE_40S].size(), 2);
+    EXPECT_EQ(snapshot->m_top[BY_RATE][0].m_ID, steady);
+    EXPECT_EQ(snapshot->m_top[BY_RATE_10S][0].m_ID, burst);
+    EXPECT_EQ(snapshot->m_top[BY_RATE_40S][0].m_ID, burst);
+    // The short EWMA window has already forgotten the burst
+    EXPECT_EQ(snapshot->m_top[BY_RATE_EWMA][0].m_ID, steady);
+
+    // First bytes count at the first tick, the burst is spread over the second before its tick
+    double spread = 40 * (1 - std::exp(-1 / 40.0));
+    double expected = (100 + 100000 * std::exp(1 / 40.0) * spread) * std::exp(-10 / 40.0) / 40;
+    EXPECT_NEAR(snapshot->m_top[BY_RATE_40S][0].m_speed40s, expected, 1e-6);
+}
+
+TEST(ConnectionsTableTest, HistoryFeedsSparklineAndLog)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setHistoryBudget(256);
+
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+
+    // Two ticks in the same second are one sample, an idle second has none
+    int seconds[] = {0, 0, 1, 3};
+    for (int second : seconds)
+    {
+        table.setSimulatedTime(start + std::chrono::seconds(second));
+        table.updateConnection(id, true, 100);
+        table.calculateSpeed();
+    }
+
+    std::vector<Connection> connections;
+    table.collectPublished(connections, true);
+    ASSERT_EQ(connections.size(), 1);
+    EXPECT_EQ(connections[0].m_historyStart, 1000);
+    EXPECT_EQ(connections[0].m_activeSeconds, 3);
+    EXPECT_EQ(connections[0].m_peakSecondBytes, 200);
+
+    // The log keeps the summary, the samples go to the history log on request
+    table.setLogFilePath(testing::TempDir() + "history_test.csv");
+    table.setLogFileStream();
+    table.logConnectionsTable(BY_BYTES);
+    std::ifstream log(testing::TempDir() + "history_test.csv");
+    std::string line;
+    std::getline(log, line);
+    std::getline(log, line);
+    EXPECT_EQ(line.substr(line.size() - 11), ",1000,3,200");
+    ASSERT_TRUE(table.logHistory());
+    std::ifstream historyLog(table.historyLogPath());
+    std::getline(historyLog, line);
+    EXPECT_EQ(line, "protocol,src_ip,src_port,dst_ip,dst_port,second,bytes");
+    for (const char *sample : {",1000,200", ",1001,100", ",1003,100"})
+    {
+        std::getline(historyLog, line);
+        EXPECT_EQ(line, std::string("TCP,::1,0,::2,0") + sample);
+    }
+    EXPECT_FALSE(std::getline(historyLog, line));
+    std::remove(table.historyLogPath().c_str());
+    std::remove(table.rollupLogPath().c_str());
+    std::remove((testing::TempDir() + "history_test.csv").c_str());
+
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    ASSERT_EQ(snapshot->m_top[BY_BYTES].size(), 1);
+    std::string_view sparkline = snapshot->m_top[BY_BYTES][0].m_sparkline.view();
+    ASSERT_EQ(sparkline.size(), ConnectionsTable::SPARKLINE_WIDTH);
+    EXPECT_NE(sparkline.back(), ' ');
+    EXPECT_EQ(sparkline.front(), ' ');
+}
+
+TEST(ConnectionsTableTest, RollupsOutliveFlowsAndAreLogged)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setLogFilePath(testing::TempDir() + "rollups_test.csv");
+    EXPECT_EQ(table.rollupLogPath(), testing::TempDir() + "rollups_test.rollup.csv");
+    std::remove(table.rollupLogPath().c_str());
+    table.setLogFileStream();
+
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(6000));
+    table.setSimulatedTime(start);
+    table.updateConnection(id, true, 100);
+    table.updateConnection(id, false, 50);
+    table.calculateSpeed();
+    table.logConnectionsTable(BY_BYTES);
+
+    // The flow is gone, its traffic stays in the rollups
+    Connection connection;
+    connection.m_ID = id;
+    table.removeConnection(connection);
+    table.setSimulatedTime(start + std::chrono::seconds(61));
+    table.calculateSpeed();
+    table.logConnectionsTable(BY_BYTES);
+
+    std::vector<RollupSummary> rows;
+    table.rollupSummary(10, rows);
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0].m_spans[LAST_MINUTE].bytes(), 0);
+    EXPECT_EQ(rows[0].m_spans[LAST_HOUR].m_bytesSent, 100);
+    EXPECT_EQ(rows[0].m_spans[LAST_HOUR].m_bytesReceived, 50);
+    EXPECT_EQ(rows[0].m_spans[LAST_HOUR].m_packets, 2);
+    EXPECT_EQ(rows[1].m_spans[LAST_HOUR].bytes(), 150);
+
+    // The closed minute is appended to the rollup log
+    std::ifstream rollupLog(table.rollupLogPath());
+    std::string header, line;
+    std::getline(rollupLog, header);
+    EXPECT_EQ(header, "start,resolution,scope,bytes_sent,bytes_received,packets");
+    std::getline(rollupLog, line);
+    EXPECT_EQ(line, "6000,1m,interface,100,50,2");
+    EXPECT_FALSE(std::getline(rollupLog, line));
+    std::remove(table.rollupLogPath().c_str());
+    std::remove((testing::TempDir() + "rollups_test.csv").c_str());
+}
+
+TEST(ConnectionsTableTest, LogRowsOfIPv4AndIPv6Flows)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setLogFilePath(testing::TempDir() + "log_rows_test.csv");
+    table.setLogFileStream();
+
+    sockaddr_in6 src = createSockAddr6();
+    sockaddr_in6 dest = createSockAddr6();
+    inet_pton(AF_INET6, "2001:db8::10", &src.sin6_addr);
+    inet_pton(AF_INET6, "fe80::1:2", &dest.sin6_addr);
+    src.sin6_port = htons(40000);
+    dest.sin6_port = htons(443);
+    ConnectionID ipv6(src, dest, Protocol::TCP);
+    in_addr srcIPv4{};
+    in_addr destIPv4{};
+    inet_pton(AF_INET, "10.0.0.1", &srcIPv4);
+    inet_pton(AF_INET, "255.255.255.255", &destIPv4);
+    ConnectionID ipv4 = ConnectionID::storeIPv4InIPv6(srcIPv4, 65535, destIPv4, 0, Protocol::UDP);
+
+    table.setSimulatedTime(std::chrono::system_clock::time_point(std::chrono::seconds(1700000000)));
+    table.updateConnection(ipv6, true, 1500);
+    table.updateConnection(ipv6, false, 60);
+    table.updateConnection(ipv4, true, 100);
+    table.calculateSpeed();
+    table.logConnectionsTable(BY_BYTES);
+
+    std::ifstream log(testing::TempDir() + "log_rows_test.csv");
+    std::string line;
+    std::getline(log, line);
+    EXPECT_EQ(line, "timestamp,protocol,src_ip,src_port,dst_ip,dst_port,bytes_sent,bytes_received,packets_sent,packets_received,"
+                    "history_start,active_seconds,peak_second_bytes");
+    std::getline(log, line);
+    EXPECT_EQ(line, "1700000000,TCP,2001:db8::10,40000,fe80::1:2,443,1500,60,1,1,,,");
+    std::getline(log, line);
+    EXPECT_EQ(line, "1700000000,UDP,10.0.0.1,65535,255.255.255.255,0,100,0,1,0,,,");
+    EXPECT_FALSE(std::getline(log, line));
+    std::remove((testing::TempDir() + "log_rows_test.csv").c_str());
+}
+
+TEST(ConnectionsTableTest, SketchTakesOverAboveThreshold)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setSimulatedTime(std::chrono::system_clock::time_point(std::chrono::seconds(6000)));
+    SketchConfig config;
+    config.m_threshold = 2;
+    table.setSketchConfig(config);
+
+    ConnectionID first(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    ConnectionID second(createSockAddr6(1), createSockAddr6(3), Protocol::TCP);
+    ConnectionID third(createSockAddr6(1), createSockAddr6(4), Protocol::UDP);
+    table.updateConnection(first, true, 100);
+    table.updateConnection(second, false, 200);
+    // The table is at the threshold, the new flow and then every packet go to the sketch
+    table.updateConnection(third, true, 5000);
+    table.updateConnection(first, false, 300);
+    table.calculateSpeed();
+
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    EXPECT_TRUE(snapshot->m_sketch);
+    EXPECT_EQ(snapshot->m_flowCount, 2);
+    EXPECT_GT(snapshot->m_sketchMemory, 0);
+    ASSERT_EQ(snapshot->m_heavyHitters.size(), 2);
+    EXPECT_EQ(snapshot->m_heavyHitters[0].m_connection.m_ID, third);
+    EXPECT_EQ(snapshot->m_heavyHitters[0].m_estimate, 5000);
+    EXPECT_EQ(snapshot->m_heavyHitters[0].m_error, 0);
+    EXPECT_EQ(snapshot->m_heavyHitters[1].m_connection.m_ID, first);
+    EXPECT_EQ(snapshot->m_heavyHitters[1].m_connection.m_bytesReceived, 300);
+    // The exact flow kept the traffic from before the switch
+    ASSERT_EQ(snapshot->m_top[BY_BYTES].size(), 2);
+    EXPECT_EQ(snapshot->m_top[BY_BYTES][1].m_bytesSent, 100);
+
+    // The interface rollup counts the traffic of both
+    std::vector<RollupSummary> rows;
+    table.rollupSummary(0, rows);
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_EQ(rows[0].m_spans[LAST_MINUTE].m_bytesSent, 5100);
+    EXPECT_EQ(rows[0].m_spans[LAST_MINUTE].m_bytesReceived, 500);
+    EXPECT_EQ(rows[0].m_spans[LAST_MINUTE].m_packets, 4);
+}
+
+TEST(ConnectionsTableTest, IPv4AndIPv6FlowsUseTheirOwnKeys)
+{
+    ConnectionsTable table;
+    in_addr src4{};
+    in_addr dest4{};
+    src4.s_addr = htonl(0x0a000001);
+    dest4.s_addr = htonl(0x0a000002);
+    ConnectionID ipv4Id = ConnectionID::storeIPv4InIPv6(src4, 1000, dest4, 80, Protocol::TCP);
+    ConnectionID ipv6Id(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+
+    table.updateConnection(ipv4Id, true, 100);
+    table.updateConnection(ipv4Id, false, 50);
+    table.updateConnection(ipv6Id, true, 300);
+
+    EXPECT_EQ(table.m_ipv4Flows.m_current.size(), 1);
+    EXPECT_EQ(table.m_ipv6Flows.m_current.size(), 1);
+    EXPECT_EQ(table.size(), 2);
+
+    Connection tempConnection;
+    tempConnection.m_ID = ipv4Id;
+    Connection *connection = table.getConnection(tempConnection);
+    ASSERT_NE(connection, nullptr);
+    EXPECT_EQ(connection->m_ipFamily, IPFamily::IPv4);
+    EXPECT_EQ(connection->m_ID, ipv4Id);
+    EXPECT_EQ(connection->m_bytesSent, 100);
+    EXPECT_EQ(connection->m_bytesReceived, 50);
+
+    tempConnection.m_ID = ipv6Id;
+    connection = table.getConnection(tempConnection);
+    ASSERT_NE(connection, nullptr);
+    EXPECT_EQ(connection->m_ipFamily, IPFamily::IPv6);
+
+    table.removeConnection(tempConnection);
+    EXPECT_EQ(table.size(), 1);
+}
+
+TEST(ConnectionsTableTest, Snapshot_IsImmutableAfterPublication)
+{
+    ConnectionsTable table;
+    EXPECT_EQ(table.getSnapshot(), nullptr);
+
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    table.updateConnection(id, true, 100);
+    table.calculateSpeed();
+
+    std::shared_ptr<const TableSnapshot> first = table.getSnapshot();
+    ASSERT_NE(first, nullptr);
+    ASSERT_EQ(first->m_top[SortBy::BY_BYTES].size(), 1);
+    EXPECT_EQ(first->m_top[SortBy::BY_BYTES][0].m_bytesSent, 100);
+
+    // Capture keeps writing to the live table, the published snapshot does not change
+    table.updateConnection(id, true, 50);
+    ConnectionID id2(createSockAddr6(3), createSockAddr6(4), Protocol::UDP);
+    table.updateConnection(id2, false, 10);
+    EXPECT_EQ(first->m_top[SortBy::BY_BYTES].size(), 1);
+    EXPECT_EQ(first->m_top[SortBy::BY_BYTES][0].m_bytesSent, 100);
+
+    table.calculateSpeed();
+    std::shared_ptr<const TableSnapshot> second = table.getSnapshot();
+    EXPECT_NE(first, second);
+    EXPECT_EQ(second->m_top[SortBy::BY_BYTES].size(), 2);
+    EXPECT_EQ(second->m_flowCount, 2);
+
+    // Nobody held the lock while capture updated the table
+    EXPECT_EQ(table.m_captureStallNs.load(), 0);
+}
+
+TEST(ConnectionsTableTest, Snapshot_TopMatchesFullSort)
+{
+    ConnectionsTable table;
+    table.m_snapshotSize = 5;
+    std::vector<ConnectionID> ids;
+    for (int i = 0; i < 50; i++)
+    {
+        ids.emplace_back(createSockAddr6(1000 + i), createSockAddr6(2000 + i), Protocol::TCP);
+        table.updateConnection(ids.back(), true, 100 + (i * 37) % 50 * 10);
+        table.updateConnection(ids.back(), false, 1);
+    }
+    table.calculateSpeed();
+
+    // Only a few flows change, the rest keep their rank
+    table.updateConnection(ids[3], false, 100000);
+    table.updateConnection(ids[40], true, 5);
+    table.updateConnection(ids[41], true, 5);
+    table.updateConnection(ids[41], true, 5);
+    table.calculateSpeed();
+
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->m_flowCount, 50);
+    for (SortBy sortBy : {SortBy::BY_BYTES, SortBy::BY_PACKETS})
+    {
+        std::vector<Connection> sorted;
+        table.getSortedConnections(sortBy, sorted);
+        const std::vector<Connection> &top = snapshot->m_top[sortBy];
+        ASSERT_EQ(top.size(), 5);
+        for (size_t i = 0; i < top.size(); i++)
+        {
+            EXPECT_EQ(ConnectionsTable::rankScore(sortBy, top[i]), ConnectionsTable::rankScore(sortBy, sorted[i]));
+        }
+    }
+    EXPECT_EQ(snapshot->m_top[SortBy::BY_BYTES][0].m_ID, ids[3]);
+
+    // Removed flows leave the ranking
+    Connection removed;
+    removed.m_ID = ids[3];
+    table.removeConnection(removed);
+    table.calculateSpeed();
+    snapshot = table.getSnapshot();
+    EXPECT_EQ(snapshot->m_flowCount, 49);
+    EXPECT_FALSE(snapshot->m_top[SortBy::BY_BYTES][0].m_ID == ids[3]);
+}
+
+TEST(ConnectionsTableTest, GetRange_ScrollsOverAllFlowsOfAllShards)
+{
+    ConnectionsTable table;
+    table.m_snapshotSize = 3;
+    ConnectionsTable &shard1 = table.addShard();
+    ConnectionsTable &shard2 = table.addShard();
+    ConnectionsTable *tables[] = {&table, &shard1, &shard2};
+    for (int i = 0; i < 300; i++)
+    {
+        ConnectionID id(createSockAddr6(1000 + i), createSockAddr6(5000 + i), Protocol::TCP);
+        // Few distinct sizes, so flows of different shards tie
+        tables[i % 3]->updateConnection(id, true, 100 + (i * 7) % 40 * 10);
+    }
+    table.calculateSpeed();
+    ConnectionID changed(createSockAddr6(1000 + 10), createSockAddr6(5000 + 10), Protocol::TCP);
+    shard1.updateConnection(changed, false, 250);
+    table.calculateSpeed();
+
+    std::vector<Connection> sorted;
+    table.getSortedConnections(SortBy::BY_BYTES, sorted);
+    ASSERT_EQ(sorted.size(), 300);
+    for (size_t first : {0, 1, 3, 57, 150, 290, 299})
+    {
+        std::vector<Connection> window;
+        table.getRange(SortBy::BY_BYTES, first, 20, window);
+        ASSERT_EQ(window.size(), std::min<size_t>(20, 300 - first));
+        for (size_t i = 0; i < window.size(); i++)
+        {
+            EXPECT_EQ(ConnectionsTable::rankScore(SortBy::BY_BYTES, window[i]),
+                      ConnectionsTable::rankScore(SortBy::BY_BYTES, sorted[first + i]));
+        }
+    }
+
+    // Consecutive windows cover every flow once
+    std::vector<ConnectionID> seen;
+    for (size_t first = 0; first < 300; first += 40)
+    {
+        std::vector<Connection> window;
+        table.getRange(SortBy::BY_BYTES, first, 40, window);
+        for (const Connection &connection : window)
+        {
+            seen.push_back(connection.m_ID);
+        }
+    }
+    ASSERT_EQ(seen.size(), 300);
+    for (size_t i = 0; i < seen.size(); i++)
+    {
+        for (size_t j = i + 1; j < seen.size(); j++)
+        {
+            ASSERT_FALSE(seen[i] == seen[j]);
+        }
+    }
+    std::vector<Connection> window;
+    table.getRange(SortBy::BY_BYTES, 300, 10, window);
+    EXPECT_TRUE(window.empty());
+}
+
+TEST(ConnectionsTableTest, GetRange_FiltersAndRanksByDirection)
+{
+    ConnectionsTable table;
+    table.m_snapshotSize = 3;
+    ConnectionsTable &shard1 = table.addShard();
+    ConnectionsTable &shard2 = table.addShard();
+    ConnectionsTable *tables[] = {&table, &shard1, &shard2};
+    // Rates of the second tick, every flow sends or receives
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1000));
+    for (int tick = 0; tick < 2; tick++)
+    {
+        for (ConnectionsTable *current : tables)
+        {
+            current->setSimulatedClock(true);
+            current->setSimulatedTime(start + std::chrono::seconds(tick));
+        }
+        for (int i = 0; i < 300; i++)
+        {
+            ConnectionID id(createSockAddr6(1000 + i), createSockAddr6(5000 + i), i % 4 == 0 ? Protocol::UDP : Protocol::TCP);
+            tables[i % 3]->updateConnection(id, i % 2 == 0, 100 + (i * 7) % 40 * 10);
+        }
+        table.calculateSpeed();
+    }
+
+    // Rx and Tx rates rank every flow by its own direction
+    for (SortBy sortBy : {SortBy::BY_RX_RATE, SortBy::BY_TX_RATE})
+    {
+        std::vector<Connection> sorted;
+        table.collectPublished(sorted);
+        ConnectionsTable::sortConnections(sortBy, sorted);
+        std::vector<Connection> window;
+        EXPECT_EQ(table.getRange(sortBy, 0, 150, window), 300);
+        ASSERT_EQ(window.size(), 150);
+        for (size_t i = 0; i < window.size(); i++)
+        {
+            EXPECT_EQ(ConnectionsTable::rankScore(sortBy, window[i]), ConnectionsTable::rankScore(sortBy, sorted[i]));
+            EXPECT_GT(ConnectionsTable::rankScore(sortBy, window[i]), 0);
+        }
+    }
+
+    // Only the UDP flows, counted and windowed in rank order
+    FlowFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.parse("udp", error));
+    std::vector<Connection> sorted;
+    table.getSortedConnections(SortBy::BY_BYTES, sorted);
+    std::vector<Connection> matching;
+    for (const Connection &connection : sorted)
+    {
+        if (connection.m_ID.m_protocol == Protocol::UDP)
+        {
+            matching.push_back(connection);
+        }
+    }
+    ASSERT_EQ(matching.size(), 75);
+    for (size_t first : {0, 1, 40, 70, 75})
+    {
+        std::vector<Connection> window;
+        EXPECT_EQ(table.getRange(SortBy::BY_BYTES, first, 10, window, &filter), 75);
+        ASSERT_EQ(window.size(), std::min<size_t>(10, 75 - first));
+        for (size_t i = 0; i < window.size(); i++)
+        {
+            EXPECT_EQ(window[i].m_ID.m_protocol, Protocol::UDP);
+            EXPECT_EQ(ConnectionsTable::rankScore(SortBy::BY_BYTES, window[i]),
+                      ConnectionsTable::rankScore(SortBy::BY_BYTES, matching[first + i]));
+        }
+    }
+}
+
+TEST(ConnectionsTableTest, GetRange_FilterFollowsTicks)
+{
+    ConnectionsTable table;
+    ConnectionsTable &shard = table.addShard();
+    ConnectionsTable *tables[] = {&table, &shard};
+    auto flow = [](int i)
+    { return ConnectionID(createSockAddr6(1000 + i), createSockAddr6(5000 + i), i % 4 == 0 ? Protocol::UDP : Protocol::TCP); };
+    for (int i = 0; i < 200; i++)
+    {
+        tables[i % 2]->updateConnection(flow(i), true, 100 + (i * 7) % 40 * 10);
+    }
+    table.calculateSpeed();
+
+    // Every page of the filter against the sorted table
+    auto expectFiltered = [&table](SortBy sortBy, const FlowFilter &filter)
+    {
+        std::vector<Connection> sorted;
+        table.getSortedConnections(sortBy, sorted);
+        std::vector<Connection> matching;
+        for (const Connection &connection : sorted)
+        {
+            if (filter.matches(connection.m_ID))
+            {
+                matching.push_back(connection);
+            }
+        }
+        for (size_t first = 0; first <= matching.size(); first += 15)
+        {
+            std::vector<Connection> window;
+            ASSERT_EQ(table.getRange(sortBy, first, 15, window, &filter), matching.size());
+            ASSERT_EQ(window.size(), std::min<size_t>(15, matching.size() - first));
+            for (size_t i = 0; i < window.size(); i++)
+            {
+                EXPECT_TRUE(filter.matches(window[i].m_ID));
+                EXPECT_EQ(ConnectionsTable::rankScore(sortBy, window[i]), ConnectionsTable::rankScore(sortBy, matching[first + i]));
+            }
+        }
+    };
+    FlowFilter udp;
+    FlowFilter tcp;
+    std::string error;
+    ASSERT_TRUE(udp.parse("udp", error));
+    ASSERT_TRUE(tcp.parse("tcp", error));
+    expectFiltered(SortBy::BY_BYTES, udp);
+
+    // Few changes update the match set flow by flow: a flow rises to the top, a new one comes, one goes
+    tables[0]->updateConnection(flow(4), false, 100000);
+    tables[1]->updateConnection(flow(201), true, 50);
+    tables[0]->updateConnection(flow(204), true, 60000);
+    Connection removed;
+    removed.m_ID = flow(8);
+    table.removeConnection(removed);
+    table.calculateSpeed();
+    expectFiltered(SortBy::BY_BYTES, udp);
+
+    // Most flows changed, the match set is rebuilt with the rankings
+    for (int i = 0; i < 240; i += 2)
+    {
+        tables[i % 2]->updateConnection(flow(i), false, 1000 + i);
+    }
+    table.calculateSpeed();
+    expectFiltered(SortBy::BY_BYTES, udp);
+    expectFiltered(SortBy::BY_PACKETS, udp);
+    expectFiltered(SortBy::BY_PACKETS, tcp);
+
+    // Without the filter all flows are ranked again
+    std::vector<Connection> window;
+    EXPECT_EQ(table.getRange(SortBy::BY_BYTES, 0, 10, window), 221);
+    expectFiltered(SortBy::BY_BYTES, udp);
+}
+
+TEST(ConnectionsTableTest, Expiry_IdleFlowsExpireByProtocol)
+{
+    ConnectionsTable table;
+    ExpiryConfig config;
+    config.m_tcpTimeout = 300;
+    config.m_udpTimeout = 30;
+    table.setExpiryConfig(config);
+    table.setSimulatedClock(true);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    table.setSimulatedTime(start);
+
+    ConnectionID tcp(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    ConnectionID udp(createSockAddr6(3), createSockAddr6(4), Protocol::UDP);
+    ConnectionID activeUdp(createSockAddr6(5), createSockAddr6(6), Protocol::UDP);
+    table.updateConnection(tcp, true, 100);
+    table.updateConnection(udp, true, 100);
+    table.updateConnection(activeUdp, true, 100);
+    table.calculateSpeed();
+
+    // activeUdp keeps sending, the idle UDP flow times out
+    for (int second = 1; second <= 40; second++)
+    {
+        table.setSimulatedTime(start + std::chrono::seconds(second));
+        table.updateConnection(activeUdp, true, 100);
+        table.calculateSpeed();
+    }
+    EXPECT_EQ(table.size(), 2);
+    EXPECT_EQ(table.countExpiredFlows(), 1);
+    EXPECT_EQ(table.getSnapshot()->m_flowCount, 2);
+
+    Connection probe;
+    probe.m_ID = udp;
+    EXPECT_EQ(table.getConnection(probe), nullptr);
+
+    // A new flow with the key of the expired one starts from zero
+    table.updateConnection(udp, true, 7);
+    table.calculateSpeed();
+    Connection *again = table.getConnection(probe);
+    ASSERT_NE(again, nullptr);
+    EXPECT_EQ(again->m_bytesSent, 7);
+
+    // Long after, everything is idle. An idle capture thread calls maintain
+    table.setSimulatedTime(start + std::chrono::seconds(1000));
+    table.maintain();
+    table.calculateSpeed();
+    EXPECT_EQ(table.size(), 0);
+    EXPECT_EQ(table.countExpiredFlows(), 4);
+    EXPECT_EQ(table.getSnapshot()->m_flowCount, 0);
+}
+
+TEST(ConnectionsTableTest, Expiry_StatisticsTickExpiresShardsOfIdleCapture)
+{
+    ConnectionsTable table;
+    ConnectionsTable &shard = table.addShard();
+    ExpiryConfig config;
+    config.m_udpTimeout = 30;
+    table.setExpiryConfig(config);
+    shard.setSimulatedClock(true);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    shard.setSimulatedTime(start);
+
+    ConnectionID udp(createSockAddr6(1), createSockAddr6(2), Protocol::UDP);
+    shard.updateConnection(udp, true, 100);
+    table.calculateSpeed();
+    EXPECT_EQ(shard.size(), 1);
+
+    // The capture thread of the shard is blocked in a read, the statistics tick expires its flows
+    shard.setSimulatedTime(start + std::chrono::seconds(31));
+    table.expireIdle();
+    table.calculateSpeed();
+    EXPECT_EQ(shard.size(), 0);
+    EXPECT_EQ(table.countExpiredFlows(), 1);
+    EXPECT_EQ(table.getSnapshot()->m_flowCount, 0);
+}
+
+TEST(ConnectionsTableTest, Expiry_MaxFlowsEvictsIdleFlowFirst)
+{
+    ConnectionsTable table;
+    ExpiryConfig config;
+    config.m_maxFlows = 3;
+    table.setExpiryConfig(config);
+    table.setSimulatedClock(true);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    table.setSimulatedTime(start);
+
+    std::vector<ConnectionID> ids;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        ids.emplace_back(createSockAddr6(10 + i), createSockAddr6(20 + i), Protocol::TCP);
+        table.updateConnection(ids.back(), true, 100);
+    }
+    // First and last flow stay active, the middle one is the oldest by its last packet
+    table.setSimulatedTime(start + std::chrono::seconds(10));
+    table.calculateSpeed();
+    table.updateConnection(ids[0], true, 100);
+    table.updateConnection(ids[2], true, 100);
+
+    ConnectionID newcomer(createSockAddr6(30), createSockAddr6(31), Protocol::TCP);
+    table.updateConnection(newcomer, true, 100);
+    EXPECT_EQ(table.size(), 3);
+    EXPECT_EQ(table.countEvictedFlows(), 1);
+
+    Connection probe;
+    probe.m_ID = ids[1];
+    EXPECT_EQ(table.getConnection(probe), nullptr);
+    probe.m_ID = newcomer;
+    EXPECT_NE(table.getConnection(probe), nullptr);
+
+    table.calculateSpeed();
+    EXPECT_EQ(table.getSnapshot()->m_flowCount, 3);
+}
+
+TEST(ConnectionsTableTest, LockFree_ExistingFlowsDoNotLockTheTable)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    table.setSimulatedTime(std::chrono::system_clock::time_point(std::chrono::seconds(1700000000)));
+    ConnectionID id(createSockAddr6(1), createSockAddr6(2), Protocol::TCP);
+    table.updateConnection(id, true, 100);
+    uint64_t locks = table.m_lockAcquisitions.load();
+
+    // Changed flows are handed over to calculateSpeed without the lock as well
+    table.calculateSpeed();
+    for (int i = 0; i < 100; i++)
+    {
+        table.updateConnection(id, i % 2 == 0, 10);
+    }
+    EXPECT_EQ(table.m_lockAcquisitions.load(), locks);
+
+    table.calculateSpeed();
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    ASSERT_EQ(snapshot->m_top[SortBy::BY_BYTES].size(), 1);
+    EXPECT_EQ(snapshot->m_top[SortBy::BY_BYTES][0].m_bytesSent, 600);
+    EXPECT_EQ(snapshot->m_top[SortBy::BY_BYTES][0].m_bytesReceived, 500);
+    EXPECT_EQ(snapshot->m_top[SortBy::BY_PACKETS][0].m_packetsSent + snapshot->m_top[SortBy::BY_PACKETS][0].m_packetsReceived, 101);
+}
+
+TEST(ConnectionsTableTest, LockFree_ConcurrentCaptureAndDisplay)
+{
+    ConnectionsTable table;
+    std::vector<ConnectionID> ids;
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        ids.emplace_back(createSockAddr6(100 + i), createSockAddr6(200 + i), Protocol::UDP);
+    }
+    const int rounds = 20000;
+
+    // One capture thread, the display publishes snapshots meanwhile
+    std::thread capture([&]()
+                        {
+        std::vector<FlowDelta> batch(ids.size());
+        for (int round = 0; round < rounds; round++)
+        {
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                batch[i].m_ID = ids[i];
+                batch[i].m_bytesSent = 10;
+                batch[i].m_packetsSent = 1;
+            }
+            table.applyBatch(batch);
+        } });
+    for (int tick = 0; tick < 50; tick++)
+    {
+        table.calculateSpeed();
+    }
+    capture.join();
+
+    table.maintain();
+    table.calculateSpeed();
+    std::vector<Connection> published;
+    table.collectPublished(published);
+    ASSERT_EQ(published.size(), ids.size());
+    for (const Connection &connection : published)
+    {
+        EXPECT_EQ(connection.m_bytesSent, 10u * rounds);
+        EXPECT_EQ(connection.m_packetsSent, static_cast<unsigned long>(rounds));
+    }
+}
+
+TEST(ConnectionsTableTest, Columns_ReusedRecordStartsNewRow)
+{
+    ConnectionsTable table;
+    table.setSimulatedClock(true);
+    auto start = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    table.setSimulatedTime(start);
+    ExpiryConfig config;
+    config.m_udpTimeout = 5;
+    table.setExpiryConfig(config);
+
+    ConnectionID oldFlow(createSockAddr6(1), createSockAddr6(2), Protocol::UDP);
+    table.updateConnection(oldFlow, true, 1000);
+    table.calculateSpeed();
+
+    // The old flow expires and a new flow takes its record before the next calculateSpeed
+    table.setSimulatedTime(start + std::chrono::seconds(10));
+    table.maintain();
+    ConnectionID newFlow(createSockAddr6(3), createSockAddr6(4), Protocol::UDP);
+    table.updateConnection(newFlow, false, 40);
+    table.calculateSpeed();
+
+    std::shared_ptr<const TableSnapshot> snapshot = table.getSnapshot();
+    EXPECT_EQ(snapshot->m_flowCount, 1);
+    ASSERT_EQ(snapshot->m_top[SortBy::BY_BYTES].size(), 1);
+    const Connection &top = snapshot->m_top[SortBy::BY_BYTES][0];
+    EXPECT_EQ(top.m_ID, newFlow);
+    EXPECT_EQ(top.m_bytesSent, 0);
+    EXPECT_EQ(top.m_bytesReceived, 40);
+    EXPECT_EQ(top.m_rxSpeedBytes, 0);
+}
+
+TEST(ConnectionsTableTest, Expiry_TimestampsBeforeEpoch)
+{
+    ConnectionsTable table;
+    // Timers of seconds before the epoch land in the wheel like any other
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        ConnectionID udp(createSockAddr6(i), createSockAddr6(100000), Protocol::UDP);
+        table.updateConnection(udp, true, 100, std::chrono::system_clock::time_point(std::chrono::seconds(-1000 - 7 * static_cast<int64_t>(i))));
+    }
+    EXPECT_EQ(table.size(), 1000);
+    table.maintain();
+    EXPECT_EQ(table.size(), 0);
+}
@@ -0,0 +1,78 @@
+#include "../../src/flowColumns.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cmath>
+
+TEST(FlowColumnsTest, SweepComputesSpeedsAndMovesPrevious) {
+    FlowColumns columns;
+    columns.resize(21);
+    EXPECT_EQ(columns.size(), 21);
+    // Full blocks and a remainder, every row gained a different amount
+    for (uint32_t row = 0; row < 21; row++) {
+        columns.m_bytesSent[row] = 1000 * row;
+        columns.m_bytesReceived[row] = 10 * row;
+        columns.m_packetsSent[row] = row;
+        columns.m_packetsReceived[row] = 2 * row;
+    }
+    columns.computeRates(0, columns.size(), 2);
+    for (uint32_t row = 0; row < 21; row++) {
+        EXPECT_EQ(columns.m_txSpeedBytes[row], 500.0 * row);
+        EXPECT_EQ(columns.m_rxSpeedBytes[row], 5.0 * row);
+        EXPECT_EQ(columns.m_txSpeedPackets[row], 0.5 * row);
+        EXPECT_EQ(columns.m_rxSpeedPackets[row], 1.0 * row);
+        EXPECT_EQ(columns.m_previousBytesSent[row], columns.m_bytesSent[row]);
+    }
+
+    // Rows without a change drop to zero speed
+    columns.m_bytesSent[3] += 300;
+    columns.computeRates(0, columns.size(), 1);
+    EXPECT_EQ(columns.m_txSpeedBytes[3], 300);
+    EXPECT_EQ(columns.m_txSpeedBytes[4], 0);
+    EXPECT_EQ(columns.m_rxSpeedPackets[20], 0);
+}
+
+TEST(FlowColumnsTest, LargeCountersAndNoElapsedTime) {
+    FlowColumns columns;
+    columns.resize(1);
+    // Deltas are exact below 2^52 whatever the size of the counters
+    columns.m_previousBytesSent[0] = (1ull << 62);
+    columns.m_bytesSent[0] = (1ull << 62) + (1ull << 51) + 7;
+    columns.computeRates(0, 1, 1);
+    EXPECT_EQ(columns.m_txSpeedBytes[0], static_cast<double>((1ull << 51) + 7));
+
+    // Without elapsed time the gain is consumed and speeds are zero
+    columns.m_bytesSent[0] += 100;
+    columns.computeRates(0, 1, 0);
+    EXPECT_EQ(columns.m_txSpeedBytes[0], 0);
+    EXPECT_EQ(columns.m_previousBytesSent[0], columns.m_bytesSent[0]);
+
+    columns.clear(0);
+    EXPECT_EQ(columns.m_bytesSent[0], 0);
+    EXPECT_EQ(columns.m_previousBytesSent[0], 0);
+}
+
+TEST(FlowColumnsTest, WindowsAverageAndSurviveRescale) {
+    FlowColumns columns;
+    columns.m_windowSeconds[WINDOW_EWMA] = 1;
+    columns.resize(2);
+    // Row 0 gains 1000 B every second, row 1 starts with a burst and stays idle
+    columns.m_bytesSent[1] = 5000;
+    columns.advance(std::chrono::seconds(0));
+    columns.startRow(0);
+    columns.startRow(1);
+    for (int second = 1; second <= 200; second++) {
+        columns.m_bytesSent[0] += 1000;
+        bool rescaled = columns.advance(std::chrono::seconds(second));
+        // The EWMA window (exponent > 64 after 64 s) forces rescales
+        if (second == 65) {
+            EXPECT_TRUE(rescaled);
+        }
+        columns.computeRates(0, 2, 1);
+    }
+    // Steady traffic averages to its rate, the 40 s average is still warming up
+    EXPECT_NEAR(columns.windowSpeed(WINDOW_10S, 0), 1000, 1e-3);
+    EXPECT_NEAR(columns.windowSpeed(WINDOW_EWMA, 0), 1000, 1e-3);
+    EXPECT_NEAR(columns.windowSpeed(WINDOW_40S, 0), 1000 * (1 - std::exp(-200 / 40.0)), 1e-3);
+    EXPECT_NEAR(columns.windowSpeed(WINDOW_40S, 1), 5000 * std::exp(-200 / 40.0) / 40, 1e-9);
+    EXPECT_NEAR(columns.windowSpeed(WINDOW_10S, 1), 5000 * std::exp(-200 / 10.0) / 10, 1e-12);
+}
@@ -0,0 +1,85 @@
+#include "../../src/flowFilter.hpp"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <string>
+
+static ConnectionID ipv4Flow(const char *src, uint16_t srcPort, const char *dest, uint16_t destPort, Protocol protocol) {
+    in_addr srcAddress{};
+    in_addr destAddress{};
+    inet_pton(AF_INET, src, &srcAddress);
+    inet_pton(AF_INET, dest, &destAddress);
+    return ConnectionID::storeIPv4InIPv6(srcAddress, srcPort, destAddress, destPort, protocol);
+}
+
+static ConnectionID ipv6Flow(const char *src, uint16_t srcPort, const char *dest, uint16_t destPort, Protocol protocol) {
+    sockaddr_in6 srcAddress{};
+    sockaddr_in6 destAddress{};
+    srcAddress.sin6_family = destAddress.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, src, &srcAddress.sin6_addr);
+    inet_pton(AF_INET6, dest, &destAddress.sin6_addr);
+    srcAddress.sin6_port = htons(srcPort);
+    destAddress.sin6_port = htons(destPort);
+    return ConnectionID(srcAddress, destAddress, protocol);
+}
+
+TEST(FlowFilterTest, EmptyFilterMatchesEverything) {
+    FlowFilter filter;
+    std::string error;
+    EXPECT_TRUE(filter.empty());
+    ASSERT_TRUE(filter.parse("   ", error));
+    EXPECT_TRUE(filter.empty());
+    EXPECT_TRUE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.1", 80, Protocol::TCP)));
+}
+
+TEST(FlowFilterTest, ProtocolAndPortOfEitherEndpoint) {
+    FlowFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.parse("UDP 53", error));
+    EXPECT_TRUE(filter.matches(ipv4Flow("10.0.0.1", 40000, "8.8.8.8", 53, Protocol::UDP)));
+    EXPECT_TRUE(filter.matches(ipv4Flow("8.8.8.8", 53, "10.0.0.1", 40000, Protocol::UDP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 40000, "8.8.8.8", 53, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 40000, "8.8.8.8", 5353, Protocol::UDP)));
+    EXPECT_EQ(filter.text(), "UDP 53");
+}
+
+TEST(FlowFilterTest, IPv4AndIPv6Networks) {
+    FlowFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.parse("192.168.0.0/23", error));
+    EXPECT_TRUE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.200", 80, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.2.1", 80, Protocol::TCP)));
+    // An IPv4 network doesn't match IPv6 addresses with the same low bits
+    EXPECT_FALSE(filter.matches(ipv6Flow("::c0a8:101", 1234, "2001:db8::1", 80, Protocol::TCP)));
+
+    ASSERT_TRUE(filter.parse("2001:db8::/32", error));
+    EXPECT_TRUE(filter.matches(ipv6Flow("2001:db8:1::5", 1234, "fe80::1", 80, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv6Flow("2001:db9::5", 1234, "fe80::1", 80, Protocol::TCP)));
+
+    // A single address without a prefix length
+    ASSERT_TRUE(filter.parse("10.0.0.1", error));
+    EXPECT_TRUE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.1", 80, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.10", 1234, "192.168.1.1", 80, Protocol::TCP)));
+}
+
+TEST(FlowFilterTest, TextMatchesTheDisplayedEndpoint) {
+    FlowFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.parse("168.1 :443", error));
+    EXPECT_TRUE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.1", 443, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.1", 80, Protocol::TCP)));
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.2.1", 443, Protocol::TCP)));
+}
+
+TEST(FlowFilterTest, InvalidTermsKeepThePreviousFilter) {
+    FlowFilter filter;
+    std::string error;
+    ASSERT_TRUE(filter.parse("tcp", error));
+    EXPECT_FALSE(filter.parse("70000", error));
+    EXPECT_FALSE(error.empty());
+    EXPECT_FALSE(filter.parse("10.0.0.0/33", error));
+    EXPECT_FALSE(filter.parse("10.0.0/8", error));
+    EXPECT_FALSE(filter.parse("2001:db8::/", error));
+    EXPECT_EQ(filter.text(), "tcp");
+    EXPECT_FALSE(filter.matches(ipv4Flow("10.0.0.1", 1234, "192.168.1.1", 53, Protocol::UDP)));
+}
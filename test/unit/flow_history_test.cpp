@@ -0,0 +1,106 @@
+#include "../../src/flowHistory.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+TEST(FlowHistoryTest, SamplesRoundTrip) {
+    FlowHistory history;
+    history.setBudget(1024);
+    history.resize(2);
+
+    // Steady seconds, gaps of every size, large and repeated values
+    std::vector<HistorySample> expected;
+    int64_t second = 1700000000;
+    uint64_t values[] = {1500, 1500, 1500, 3000, 0x123456789abcull, 7, 7, 1ull << 63, 64000, 64000};
+    int64_t gaps[] = {1, 1, 1, 2, 50, 300, 1, 3000, 100000, 1};
+    for (int i = 0; i < 10; i++) {
+        second += gaps[i];
+        history.record(0, second, values[i] / 2);
+        // Bytes of the same second are summed
+        history.record(0, second, values[i] - values[i] / 2);
+        expected.push_back({second, values[i]});
+    }
+
+    std::vector<HistorySample> samples;
+    history.read(0, samples);
+    ASSERT_EQ(samples.size(), expected.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        EXPECT_EQ(samples[i].m_second, expected[i].m_second);
+        EXPECT_EQ(samples[i].m_bytes, expected[i].m_bytes);
+    }
+
+    // Other rows and cleared rows have no history
+    history.read(1, samples);
+    EXPECT_TRUE(samples.empty());
+    history.clear(0);
+    history.read(0, samples);
+    EXPECT_TRUE(samples.empty());
+    EXPECT_EQ(history.memoryUsage(), 0);
+}
+
+TEST(FlowHistoryTest, BudgetKeepsTheNewestSeconds) {
+    FlowHistory history;
+    history.setBudget(1024);
+    history.resize(1);
+
+    // An hour of a steady flow costs a bit per second and fits whole
+    for (int64_t second = 1; second <= 3600; second++) {
+        history.record(0, second, 1000);
+    }
+    std::vector<HistorySample> samples;
+    history.read(0, samples);
+    ASSERT_EQ(samples.size(), 3600);
+    EXPECT_EQ(samples.front().m_second, 1);
+    EXPECT_EQ(history.memoryUsage(), 1024);
+
+    // A varying flow doesn't fit, the oldest segments are dropped and the newest seconds stay contiguous
+    for (int64_t second = 3601; second <= 7200; second++) {
+        history.record(0, second, 1000 + (second * 7919) % 4096);
+    }
+    history.read(0, samples);
+    EXPECT_LT(samples.size(), 3600);
+    EXPECT_GT(samples.size(), 100);
+    EXPECT_EQ(samples.back().m_second, 7200);
+    EXPECT_EQ(samples.back().m_bytes, 1000 + (7200 * 7919) % 4096);
+    for (size_t i = 1; i < samples.size(); i++) {
+        EXPECT_EQ(samples[i].m_second, samples[i - 1].m_second + 1);
+    }
+    EXPECT_EQ(history.memoryUsage(), 1024);
+}
+
+TEST(FlowHistoryTest, Sparkline) {
+    std::vector<HistorySample> samples = {{100, 10}, {105, 800}, {110, 800}, {118, 100}};
+    // Four periods of five seconds ending at second 119
+    SparklineText line;
+    FlowHistory::sparkline(samples, 119, 4, 5, line);
+    EXPECT_EQ(line.view(), ".@@:");
+    FlowHistory::sparkline({}, 119, 4, 5, line);
+    EXPECT_EQ(line.view(), "    ");
+}
+
+TEST(FlowHistoryTest, SummaryOutlivesDroppedSamples) {
+    FlowHistory history;
+    history.setBudget(FlowHistory::MIN_BUDGET);
+    history.resize(1);
+    EXPECT_EQ(history.summary(0).m_activeSeconds, 0);
+
+    // Changing values fill the small budget, the oldest segments are dropped
+    uint64_t peak = 0;
+    for (int64_t second = 0; second < 1000; second++) {
+        uint64_t bytes = 1000 + (second * 7919) % 5000;
+        history.record(0, 5000 + second * 3, bytes);
+        peak = std::max(peak, bytes);
+    }
+    std::vector<HistorySample> samples;
+    history.read(0, samples);
+    ASSERT_LT(samples.size(), 1000);
+    EXPECT_GT(samples.front().m_second, 5000);
+
+    HistorySummary summary = history.summary(0);
+    EXPECT_EQ(summary.m_firstSecond, 5000);
+    EXPECT_EQ(summary.m_activeSeconds, 1000);
+    EXPECT_EQ(summary.m_peakBytes, peak);
+    history.clear(0);
+    EXPECT_EQ(history.summary(0).m_activeSeconds, 0);
+}
@@ -0,0 +1,133 @@
+#include "../../src/flowMap.hpp"
+#include "../../src/connectionID.hpp"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using IPv4FlowMap = FlowMap<FlowKey<AF_INET>, uint64_t, FlowKeyHash<AF_INET>>;
+
+static FlowKey<AF_INET> makeKey(uint32_t host, uint16_t port)
+{
+    FlowKey<AF_INET> key{};
+    uint32_t src = htonl(0x0a000001);
+    uint32_t dest = htonl(host);
+    std::memcpy(key.m_srcAddress, &src, sizeof(src));
+    std::memcpy(key.m_destAddress, &dest, sizeof(dest));
+    key.m_srcPort = htons(port);
+    key.m_destPort = htons(443);
+    key.m_protocol = Protocol::TCP;
+    key.m_family = AF_INET;
+    return key;
+}
+
+TEST(FlowMapTest, InsertFindErase) {
+    IPv4FlowMap map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.find(makeKey(1, 1)), map.end());
+
+    EXPECT_TRUE(map.insert({makeKey(1, 1), 10}).second);
+    EXPECT_FALSE(map.insert({makeKey(1, 1), 20}).second);
+    map[makeKey(2, 2)] += 5;
+
+    ASSERT_NE(map.find(makeKey(1, 1)), map.end());
+    EXPECT_EQ(map.find(makeKey(1, 1))->second, 10u);
+    EXPECT_EQ(map[makeKey(2, 2)], 5u);
+    EXPECT_EQ(map.size(), 2u);
+
+    EXPECT_EQ(map.erase(makeKey(1, 1)), 1u);
+    EXPECT_EQ(map.erase(makeKey(1, 1)), 0u);
+    EXPECT_EQ(map.find(makeKey(1, 1)), map.end());
+    EXPECT_EQ(map.size(), 1u);
+}
+
+TEST(FlowMapTest, GrowsAndKeepsEntries) {
+    IPv4FlowMap map;
+    const uint32_t count = 100000;
+    for (uint32_t i = 0; i < count; i++) {
+        map.insert({makeKey(i, static_cast<uint16_t>(i)), i});
+    }
+    EXPECT_EQ(map.size(), count);
+    EXPECT_LE(map.size(), map.capacity() - map.capacity() / 8);
+    for (uint32_t i = 0; i < count; i++) {
+        auto found = map.find(makeKey(i, static_cast<uint16_t>(i)));
+        ASSERT_NE(found, map.end());
+        EXPECT_EQ(found->second, i);
+    }
+
+    // Iteration visits every entry once
+    uint64_t sum = 0;
+    size_t visited = 0;
+    for (const auto &entry : map) {
+        sum += entry.second;
+        visited++;
+    }
+    EXPECT_EQ(visited, count);
+    EXPECT_EQ(sum, static_cast<uint64_t>(count) * (count - 1) / 2);
+}
+
+TEST(FlowMapTest, EraseWhileIterating) {
+    IPv4FlowMap map;
+    for (uint32_t i = 0; i < 1000; i++) {
+        map.insert({makeKey(i, 1), i});
+    }
+    size_t capacity = map.capacity();
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->second % 2 == 0) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    EXPECT_EQ(map.size(), 500u);
+    EXPECT_EQ(map.capacity(), capacity);
+    for (uint32_t i = 0; i < 1000; i++) {
+        EXPECT_EQ(map.find(makeKey(i, 1)) != map.end(), i % 2 == 1);
+    }
+}
+
+// Steady churn of inserts and erases must not grow the table, tombstones are reused or rehashed away
+TEST(FlowMapTest, ChurnDoesNotGrow) {
+    IPv4FlowMap map;
+    for (uint32_t i = 0; i < 1000; i++) {
+        map.insert({makeKey(i, 1), i});
+    }
+    size_t capacity = map.capacity();
+    for (uint32_t i = 1000; i < 200000; i++) {
+        map.erase(makeKey(i - 1000, 1));
+        map.insert({makeKey(i, 1), i});
+    }
+    EXPECT_EQ(map.size(), 1000u);
+    EXPECT_EQ(map.capacity(), capacity);
+}
+
+TEST(FlowMapTest, MatchesUnorderedMap) {
+    IPv4FlowMap map;
+    std::unordered_map<FlowKey<AF_INET>, uint64_t, FlowKeyHash<AF_INET>> reference;
+    std::mt19937 random(42);
+    for (int i = 0; i < 200000; i++) {
+        FlowKey<AF_INET> key = makeKey(random() % 5000, static_cast<uint16_t>(random() % 4));
+        switch (random() % 3) {
+        case 0:
+            map[key] += i;
+            reference[key] += i;
+            break;
+        case 1:
+            EXPECT_EQ(map.erase(key), reference.erase(key));
+            break;
+        default:
+            auto found = map.find(key);
+            auto expected = reference.find(key);
+            ASSERT_EQ(found == map.end(), expected == reference.end());
+            if (expected != reference.end()) {
+                EXPECT_EQ(found->second, expected->second);
+            }
+        }
+    }
+    EXPECT_EQ(map.size(), reference.size());
+    for (const auto &entry : map) {
+        ASSERT_EQ(reference.count(entry.first), 1u);
+        EXPECT_EQ(reference[entry.first], entry.second);
+    }
+}
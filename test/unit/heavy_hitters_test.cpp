@@ -0,0 +1,73 @@
+#include "../../src/heavyHitters.hpp"
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <cstdint>
+#include <vector>
+
+static ConnectionID flow(uint32_t index) {
+    in_addr src{};
+    in_addr dest{};
+    src.s_addr = htonl(0x0a000000 | index);
+    dest.s_addr = htonl(0xc0a80001);
+    return ConnectionID::storeIPv4InIPv6(src, static_cast<uint16_t>(1024 + index % 50000), dest, 53, Protocol::UDP);
+}
+
+TEST(HeavyHittersTest, LargestFlowsAreFoundWithinTheirBounds) {
+    HeavyHitters sketch;
+    sketch.configure(1024, 4, 16);
+    size_t memory = sketch.memoryUsage();
+
+    // Five large flows hidden in 50000 small ones
+    for (uint32_t i = 0; i < 50000; i++) {
+        sketch.add(flow(100 + i), 100, 1, 0, 0);
+        if (i % 100 == 0) {
+            for (uint32_t large = 0; large < 5; large++) {
+                sketch.add(flow(large), 1000 * (large + 1), 1, 1000, 1);
+            }
+        }
+    }
+    EXPECT_EQ(sketch.memoryUsage(), memory);
+    // e / 1024 of 15 MB
+    EXPECT_EQ(sketch.errorBound(), 39819);
+
+    std::vector<HeavyHitter> hitters;
+    sketch.top(5, 0, hitters);
+    ASSERT_EQ(hitters.size(), 5);
+    for (uint32_t i = 0; i < 5; i++) {
+        uint32_t large = 4 - i;
+        uint64_t bytes = 500 * (1000 * (large + 1) + 1000);
+        EXPECT_EQ(hitters[i].m_connection.m_ID, flow(large));
+        EXPECT_GE(hitters[i].m_estimate, bytes);
+        EXPECT_LE(hitters[i].m_estimate - hitters[i].m_error, bytes);
+        EXPECT_LE(hitters[i].m_error, sketch.errorBound());
+        EXPECT_EQ(sketch.estimate(flow(large)), hitters[i].m_estimate);
+    }
+    // A small flow is never underestimated
+    EXPECT_GE(sketch.estimate(flow(100)), 100);
+}
+
+TEST(HeavyHittersTest, LargerFlowTakesOverTheLowestCandidate) {
+    HeavyHitters sketch;
+    sketch.configure(4096, 4, 2);
+    sketch.add(flow(1), 1000, 1, 0, 0);
+    sketch.add(flow(2), 10, 1, 0, 0);
+    sketch.add(flow(3), 0, 0, 500, 2);
+    // Too small to take a slot
+    sketch.add(flow(2), 10, 1, 0, 0);
+
+    std::vector<HeavyHitter> hitters;
+    sketch.top(10, 2, hitters);
+    ASSERT_EQ(hitters.size(), 2);
+    EXPECT_EQ(hitters[0].m_connection.m_ID, flow(1));
+    EXPECT_EQ(hitters[1].m_connection.m_ID, flow(3));
+    EXPECT_EQ(hitters[1].m_estimate, 500);
+    EXPECT_EQ(hitters[1].m_error, 0);
+    EXPECT_EQ(hitters[1].m_connection.m_packetsReceived, 2);
+    EXPECT_DOUBLE_EQ(hitters[1].m_connection.m_rxSpeedBytes, 250);
+
+    // Speeds count the traffic since the previous call
+    sketch.add(flow(1), 100, 1, 0, 0);
+    sketch.top(10, 1, hitters);
+    EXPECT_DOUBLE_EQ(hitters[0].m_connection.m_txSpeedBytes, 100);
+    EXPECT_DOUBLE_EQ(hitters[1].m_connection.m_rxSpeedBytes, 0);
+}
@@ -14,7 +14,7 @@
 #include <netinet/icmp6.h>    
 
 pcap_pkthdr createMockPcapHeader(uint32_t len) {
-    pcap_pkthdr header;
+    pcap_pkthdr header{};
     header.ts.tv_sec = 0;
     header.ts.tv_usec = 0;
     header.caplen = len;
@@ -192,3 +192,146 @@ TEST(PacketCaptureTest, PacketHandlerICMP) {
     EXPECT_EQ(conn.m_bytesSent, pkthdr.len);
     EXPECT_EQ(conn.m_bytesReceived, 0);
 }
+
+// Write classic pcap file with one Ethernet/IPv4/UDP packet per source port, one second apart
+static void writeCaptureFile(const std::string &path, const std::vector<uint16_t> &srcPorts) {
+    FILE *file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    uint32_t globalHeader[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, DLT_EN10MB};
+    fwrite(globalHeader, sizeof(globalHeader), 1, file);
+
+    for (size_t i = 0; i < srcPorts.size(); i++) {
+        unsigned char packet[14 + sizeof(struct ip) + sizeof(struct udphdr)];
+        memset(packet, 0, sizeof(packet));
+        struct ip *ipHeader = reinterpret_cast<struct ip *>(packet + 14);
+        ipHeader->ip_v = 4;
+        ipHeader->ip_hl = 5;
+        ipHeader->ip_p = IPPROTO_UDP;
+        inet_pton(AF_INET, "10.1.1.1", &(ipHeader->ip_src));
+        inet_pton(AF_INET, "10.1.1.2", &(ipHeader->ip_dst));
+        struct udphdr *udpHeader = reinterpret_cast<struct udphdr *>(packet + 14 + 20);
+        udpHeader->uh_sport = htons(srcPorts[i]);
+        udpHeader->uh_dport = htons(53);
+
+        uint32_t recordHeader[4] = {static_cast<uint32_t>(1700000000 + i), 0, sizeof(packet), sizeof(packet)};
+        fwrite(recordHeader, sizeof(recordHeader), 1, file);
+        fwrite(packet, sizeof(packet), 1, file);
+    }
+    fclose(file);
+}
+
+TEST(PacketCaptureTest, ReplayFileFeedsTableWithSimulatedClock) {
+    std::string path = ::testing::TempDir() + "isa_top_replay.pcap";
+    writeCaptureFile(path, {5000, 5000, 5001});
+
+    ConnectionsTable connectionsTable;
+    PacketCapture packetCapture("", connectionsTable);
+    packetCapture.m_config.m_readFile = path;
+
+    packetCapture.startCapture();
+
+    std::vector<Connection> connections;
+    connectionsTable.getSortedConnections(SortBy::BY_PACKETS, connections);
+
+    ASSERT_EQ(connections.size(), 2);
+    EXPECT_EQ(connections[0].m_packetsSent, 2);
+    EXPECT_EQ(connections[0].m_ID.getSrcPort(), 5000);
+    // Clock follows the last replayed packet, not the system time
+    EXPECT_EQ(std::chrono::system_clock::to_time_t(connectionsTable.now()), 1700000002);
+    remove(path.c_str());
+}
+
+// A stop that comes before the loop has published its handle ends the loop before the first packet
+TEST(PacketCaptureTest, StopBeforeReplayStartsReadsNothing) {
+    std::string path = ::testing::TempDir() + "isa_top_stopped.pcap";
+    writeCaptureFile(path, {5000, 5001});
+
+    ConnectionsTable connectionsTable;
+    PacketCapture packetCapture("", connectionsTable);
+    packetCapture.m_config.m_readFile = path;
+
+    packetCapture.stopCapture();
+    packetCapture.startCapture();
+
+    std::vector<Connection> connections;
+    connectionsTable.getSortedConnections(SortBy::BY_PACKETS, connections);
+    EXPECT_TRUE(connections.empty());
+    EXPECT_EQ(packetCapture.m_pcapHandle, nullptr);
+    remove(path.c_str());
+}
+
+// getStats only reads what the capture thread published, nothing before a handle was sampled
+TEST(PacketCaptureTest, StatsWaitForTheCaptureThread) {
+    ConnectionsTable connectionsTable;
+    PacketCapture packetCapture("eth0", connectionsTable);
+    uint64_t received = 0, dropped = 0;
+    EXPECT_FALSE(packetCapture.getStats(received, dropped));
+    packetCapture.sampleStats(true);
+    EXPECT_FALSE(packetCapture.getStats(received, dropped));
+}
+
+TEST(PacketCaptureTest, BatchHandlerMergesFlowsUnderOneLock) {
+    ConnectionsTable connectionsTable;
+    PacketCapture packetCapture("eth0", connectionsTable);
+    packetCapture.m_config.m_batchSize = 8;
+
+    in_addr localAddr;
+    inet_pton(AF_INET, "192.168.1.10", &localAddr);
+    packetCapture.m_localIPv4Addresses.push_back(localAddr);
+
+    unsigned char packet[54];
+    memset(packet, 0, sizeof(packet));
+    struct ip *ipHeader = reinterpret_cast<struct ip *>(packet + 14);
+    ipHeader->ip_v = 4;
+    ipHeader->ip_hl = 5;
+    ipHeader->ip_p = IPPROTO_TCP;
+    inet_pton(AF_INET, "192.168.1.10", &(ipHeader->ip_src));
+    inet_pton(AF_INET, "8.8.8.8", &(ipHeader->ip_dst));
+    struct tcphdr *tcpHeader = reinterpret_cast<struct tcphdr *>(packet + 14 + 20);
+    tcpHeader->th_dport = htons(80);
+
+    pcap_pkthdr pkthdr = createMockPcapHeader(sizeof(packet));
+    for (int i = 0; i < 6; ++i) {
+        tcpHeader->th_sport = htons(i < 5 ? 40000 : 40001);
+        PacketCapture::batchHandler(reinterpret_cast<unsigned char *>(&packetCapture), &pkthdr, packet);
+    }
+
+    // Nothing is applied before the batch is flushed
+    std::vector<Connection> connections;
+    connectionsTable.getSortedConnections(SortBy::BY_PACKETS, connections);
+    EXPECT_EQ(connections.size(), 0);
+    EXPECT_EQ(packetCapture.m_batch.size(), 2);
+
+    packetCapture.flushBatch();
+    connectionsTable.getSortedConnections(SortBy::BY_PACKETS, connections);
+
+    ASSERT_EQ(connections.size(), 2);
+    EXPECT_EQ(connections[0].m_packetsSent, 5);
+    EXPECT_EQ(connections[0].m_bytesSent, 5 * sizeof(packet));
+    EXPECT_EQ(connections[1].m_packetsSent, 1);
+    EXPECT_EQ(connectionsTable.m_lockAcquisitions, 1);
+}
+
+TEST(PacketCaptureTest, HeaderSnaplenCoversHeadersOnly) {
+    // Ethernet + VLAN tag + IPv4 with options + ports
+    EXPECT_EQ(PacketCapture::headerSnaplen(DLT_EN10MB), 14 + 4 + 60 + 8);
+    EXPECT_EQ(PacketCapture::headerSnaplen(DLT_LINUX_SLL), 16 + 4 + 60 + 8);
+    EXPECT_LT(PacketCapture::headerSnaplen(DLT_EN10MB), 128);
+}
+
+TEST(PacketCaptureTest, PacketTimeClampsOutOfRangeTimestamps) {
+    ConnectionsTable table;
+    PacketCapture capture("lo", table);
+    capture.m_nanoTimestamps = true;
+    pcap_pkthdr header = createMockPcapHeader(60);
+
+    // Before the epoch
+    header.ts.tv_sec = -5;
+    header.ts.tv_usec = -1;
+    EXPECT_EQ(capture.packetTime(&header).time_since_epoch().count(), 0);
+    // Past the nanosecond clock
+    header.ts.tv_sec = INT64_MAX / 2;
+    header.ts.tv_usec = 2000000000;
+    EXPECT_EQ(capture.packetTime(&header),
+              std::chrono::system_clock::time_point(std::chrono::seconds(PacketCapture::MAX_PACKET_SECONDS) + std::chrono::nanoseconds(999999999)));
+}
@@ -0,0 +1,237 @@
+#include "../../src/rankHeap.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Ids of the best k scores by a full sort, ties broken by lower id
+static std::vector<uint32_t> sortedTop(const std::vector<double> &scores, const std::vector<bool> &ranked, size_t k)
+{
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < scores.size(); id++) {
+        if (ranked[id]) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [&](uint32_t first, uint32_t second) {
+        return scores[first] != scores[second] ? scores[first] > scores[second] : first < second;
+    });
+    ids.resize(std::min(k, ids.size()));
+    return ids;
+}
+
+TEST(RankHeapTest, TopOfEmptyHeap) {
+    RankHeap heap;
+    std::vector<uint32_t> ids{1, 2};
+    heap.top(10, ids);
+    EXPECT_TRUE(ids.empty());
+    EXPECT_FALSE(heap.contains(0));
+    EXPECT_EQ(heap.size(), 0);
+}
+
+TEST(RankHeapTest, UpdateReordersItems) {
+    RankHeap heap;
+    heap.update(0, 10);
+    heap.update(1, 30);
+    heap.update(2, 20);
+
+    std::vector<uint32_t> ids;
+    heap.top(3, ids);
+    EXPECT_EQ(ids, (std::vector<uint32_t>{1, 2, 0}));
+
+    heap.update(0, 40);
+    heap.update(1, 5);
+    heap.top(2, ids);
+    EXPECT_EQ(ids, (std::vector<uint32_t>{0, 2}));
+    EXPECT_EQ(heap.score(1), 5);
+
+    heap.erase(0);
+    heap.erase(7);
+    EXPECT_FALSE(heap.contains(0));
+    heap.top(5, ids);
+    EXPECT_EQ(ids, (std::vector<uint32_t>{2, 1}));
+}
+
+TEST(RankHeapTest, RandomUpdatesMatchFullSort) {
+    const uint32_t count = 2000;
+    RankHeap heap;
+    std::vector<double> scores(count, 0);
+    std::vector<bool> ranked(count, false);
+    std::mt19937 random(7);
+
+    for (int step = 0; step < 50000; step++) {
+        uint32_t id = random() % count;
+        if (random() % 8 == 0) {
+            heap.erase(id);
+            ranked[id] = false;
+        }
+        else {
+            // Few distinct scores so ties are common
+            scores[id] = static_cast<double>(random() % 500);
+            heap.update(id, scores[id]);
+            ranked[id] = true;
+        }
+        if (step % 1000 == 0) {
+            std::vector<uint32_t> ids;
+            heap.top(25, ids);
+            ASSERT_EQ(ids, sortedTop(scores, ranked, 25));
+        }
+    }
+    EXPECT_EQ(heap.size(), static_cast<size_t>(std::count(ranked.begin(), ranked.end(), true)));
+
+    heap.clear();
+    EXPECT_EQ(heap.size(), 0);
+    EXPECT_FALSE(heap.contains(0));
+}
+
+TEST(RankHeapTest, BuildMatchesFullSort) {
+    const uint32_t count = 3000;
+    RankHeap heap;
+    std::vector<double> scores(count, 0);
+    std::vector<bool> ranked(count, false);
+    std::mt19937 random(11);
+    heap.update(count + 5, 1000);
+
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < count; id++) {
+        scores[id] = static_cast<double>(random() % 300);
+        if (random() % 3 != 0) {
+            ids.push_back(id);
+            ranked[id] = true;
+        }
+    }
+    heap.build(ids, scores);
+    EXPECT_FALSE(heap.contains(count + 5));
+    EXPECT_EQ(heap.size(), ids.size());
+
+    // Built heap keeps working with single updates
+    for (int step = 0; step < 2000; step++) {
+        uint32_t id = random() % count;
+        scores[id] = static_cast<double>(random() % 300);
+        heap.update(id, scores[id]);
+        ranked[id] = true;
+    }
+    heap.top(40, ids);
+    EXPECT_EQ(ids, sortedTop(scores, ranked, 40));
+}
+
+// The sorted order is repaired from the items changed between calls and sorted again after a build
+TEST(RankHeapTest, RangeMatchesFullSort) {
+    const uint32_t count = 2000;
+    RankHeap heap;
+    std::vector<double> scores(count, 0);
+    std::vector<bool> ranked(count, false);
+    std::mt19937 random(13);
+
+    std::vector<uint32_t> ids;
+    heap.range(0, 10, ids);
+    EXPECT_TRUE(ids.empty());
+    for (int step = 0; step < 30000; step++) {
+        uint32_t id = random() % count;
+        if (random() % 8 == 0) {
+            heap.erase(id);
+            ranked[id] = false;
+        }
+        else {
+            scores[id] = static_cast<double>(random() % 500);
+            heap.update(id, scores[id]);
+            ranked[id] = true;
+        }
+        if (step == 15000) {
+            std::vector<uint32_t> all;
+            for (uint32_t item = 0; item < count; item++) {
+                if (ranked[item]) {
+                    all.push_back(item);
+                }
+            }
+            heap.build(all, scores);
+        }
+        if (step % 997 == 0) {
+            std::vector<uint32_t> sorted = sortedTop(scores, ranked, count);
+            size_t first = random() % (sorted.size() + 1);
+            heap.range(first, 30, ids);
+            std::vector<uint32_t> expected(sorted.begin() + first, sorted.begin() + std::min(first + 30, sorted.size()));
+            ASSERT_EQ(ids, expected);
+            if (first < sorted.size()) {
+                EXPECT_EQ(heap.at(first), sorted[first]);
+                EXPECT_EQ(heap.countBetter(scores[sorted[first]], sorted[first]), first);
+            }
+        }
+    }
+}
+
+TEST(RankHeapTest, CountBetterOfTies) {
+    RankHeap heap;
+    heap.update(4, 10);
+    heap.update(2, 20);
+    heap.update(7, 20);
+    heap.update(1, 5);
+
+    EXPECT_EQ(heap.countBetter(20, 0), 0);
+    EXPECT_EQ(heap.countBetter(20, 5), 1);
+    EXPECT_EQ(heap.countBetter(20, UINT32_MAX), 2);
+    EXPECT_EQ(heap.countBetter(15, 0), 2);
+    EXPECT_EQ(heap.countBetter(0, 0), 4);
+}
+
+// Few changes between reads move items one by one between the blocks of the order, which split and empty out
+// as items pile up at the top or leave it
+TEST(RankHeapTest, SmallRepairsMatchFullSort) {
+    const uint32_t count = 5000;
+    RankHeap heap;
+    std::vector<double> scores(count, 0);
+    std::vector<bool> ranked(count, false);
+    std::mt19937 random(17);
+    for (uint32_t id = 0; id < count; id++) {
+        scores[id] = static_cast<double>(random() % 1000);
+        heap.update(id, scores[id]);
+        ranked[id] = true;
+    }
+
+    std::vector<uint32_t> ids;
+    heap.range(0, 1, ids);
+    for (int step = 0; step < 3000; step++) {
+        for (int change = 0; change < 5; change++) {
+            uint32_t id = random() % count;
+            if (random() % 4 == 0) {
+                heap.erase(id);
+                ranked[id] = false;
+            }
+            else {
+                // Half the updates go to the top, so the first blocks grow
+                scores[id] = random() % 2 == 0 ? 2000 + step : static_cast<double>(random() % 1000);
+                heap.update(id, scores[id]);
+                ranked[id] = true;
+            }
+        }
+        if (step % 50 == 0) {
+            std::vector<uint32_t> sorted = sortedTop(scores, ranked, count);
+            for (size_t first : {size_t(0), sorted.size() / 2, sorted.size() - 5}) {
+                heap.range(first, 40, ids);
+                std::vector<uint32_t> expected(sorted.begin() + first,
+                                               sorted.begin() + std::min(first + 40, sorted.size()));
+                ASSERT_EQ(ids, expected);
+                EXPECT_EQ(heap.at(first), sorted[first]);
+                EXPECT_EQ(heap.countBetter(scores[sorted[first]], sorted[first]), first);
+            }
+        }
+        else {
+            heap.range(0, 1, ids);
+        }
+    }
+}
+
+TEST(RankHeapTest, DroppedOrderIsSortedAgain) {
+    RankHeap heap;
+    heap.update(1, 10);
+    heap.update(2, 30);
+    std::vector<uint32_t> ids;
+    heap.range(0, 5, ids);
+    heap.dropOrder();
+    heap.update(3, 20);
+    heap.update(2, 5);
+
+    heap.range(0, 5, ids);
+    EXPECT_EQ(ids, (std::vector<uint32_t>{3, 1, 2}));
+    EXPECT_EQ(heap.countBetter(15, 0), 1);
+}
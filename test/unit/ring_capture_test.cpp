@@ -0,0 +1,96 @@
+#include "../../src/ringCapture.hpp"
+#include "../../src/packet.hpp"
+#include "../../src/connectionsTable.hpp"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <cstring>
+#include <vector>
+
+// Frame as the kernel lays it out in a TPACKET_V3 block: header, padding, link level frame
+static const unsigned int FRAME_STRIDE = 256;
+static const unsigned int FRAME_MAC_OFFSET = 64;
+static const unsigned int PACKET_LENGTH = 14 + sizeof(struct ip) + sizeof(struct tcphdr);
+
+struct CountedFrames {
+    unsigned int count = 0;
+    std::vector<uint32_t> lengths;
+    std::vector<long> nsecs;
+};
+
+static void countingHandler(unsigned char *user, const struct pcap_pkthdr *pkthdr, const unsigned char *) {
+    CountedFrames *frames = reinterpret_cast<CountedFrames *>(user);
+    frames->count++;
+    frames->lengths.push_back(pkthdr->len);
+    frames->nsecs.push_back(pkthdr->ts.tv_usec);
+}
+
+// Build a retired block with one IPv4 TCP frame per source port
+static void buildBlock(std::vector<uint8_t> &block, const std::vector<uint16_t> &srcPorts) {
+    block.assign(4096, 0);
+    tpacket_block_desc *desc = reinterpret_cast<tpacket_block_desc *>(block.data());
+    desc->hdr.bh1.block_status = TP_STATUS_USER;
+    desc->hdr.bh1.num_pkts = srcPorts.size();
+    desc->hdr.bh1.offset_to_first_pkt = 64;
+
+    for (size_t i = 0; i < srcPorts.size(); i++) {
+        uint8_t *frame = block.data() + 64 + i * FRAME_STRIDE;
+        tpacket3_hdr *header = reinterpret_cast<tpacket3_hdr *>(frame);
+        header->tp_next_offset = (i + 1 < srcPorts.size()) ? FRAME_STRIDE : 0;
+        header->tp_sec = 10;
+        header->tp_nsec = 5000 * (i + 1);
+        header->tp_snaplen = PACKET_LENGTH;
+        header->tp_len = PACKET_LENGTH + i;
+        header->tp_mac = FRAME_MAC_OFFSET;
+
+        struct ip *ipHeader = reinterpret_cast<struct ip *>(frame + FRAME_MAC_OFFSET + 14);
+        ipHeader->ip_v = 4;
+        ipHeader->ip_hl = 5;
+        ipHeader->ip_p = IPPROTO_TCP;
+        inet_pton(AF_INET, "192.168.1.10", &(ipHeader->ip_src));
+        inet_pton(AF_INET, "8.8.8.8", &(ipHeader->ip_dst));
+
+        struct tcphdr *tcpHeader = reinterpret_cast<struct tcphdr *>(frame + FRAME_MAC_OFFSET + 14 + 20);
+        tcpHeader->th_sport = htons(srcPorts[i]);
+        tcpHeader->th_dport = htons(443);
+    }
+}
+
+TEST(RingCaptureTest, WalkBlockVisitsEveryFrame) {
+    std::vector<uint8_t> block;
+    buildBlock(block, {1000, 1001, 1002});
+
+    CountedFrames frames;
+    unsigned int walked = RingCapture::walkBlock(reinterpret_cast<tpacket_block_desc *>(block.data()),
+                                                 countingHandler, reinterpret_cast<unsigned char *>(&frames));
+
+    EXPECT_EQ(walked, 3);
+    ASSERT_EQ(frames.count, 3);
+    EXPECT_EQ(frames.lengths[0], PACKET_LENGTH);
+    EXPECT_EQ(frames.lengths[2], PACKET_LENGTH + 2);
+    // Timestamps keep the nanoseconds of the ring
+    EXPECT_EQ(frames.nsecs[1], 10000);
+}
+
+TEST(RingCaptureTest, WalkBlockFeedsPacketHandler) {
+    ConnectionsTable connectionsTable;
+    PacketCapture packetCapture("eth0", connectionsTable);
+
+    in_addr localAddr;
+    inet_pton(AF_INET, "192.168.1.10", &localAddr);
+    packetCapture.m_localIPv4Addresses.push_back(localAddr);
+
+    std::vector<uint8_t> block;
+    buildBlock(block, {2000, 2000, 2001});
+
+    RingCapture::walkBlock(reinterpret_cast<tpacket_block_desc *>(block.data()),
+                           PacketCapture::packetHandler, reinterpret_cast<unsigned char *>(&packetCapture));
+
+    std::vector<Connection> connections;
+    connectionsTable.getSortedConnections(SortBy::BY_PACKETS, connections);
+
+    ASSERT_EQ(connections.size(), 2);
+    EXPECT_EQ(connections[0].m_packetsSent, 2);
+    EXPECT_EQ(connections[0].m_ID.getSrcPort(), 2000);
+}
@@ -0,0 +1,118 @@
+#include "../../src/rollup.hpp"
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static ConnectionID hostFlow(uint32_t src, uint32_t dest) {
+    sockaddr_in6 srcAddr, destAddr;
+    std::memset(&srcAddr, 0, sizeof(srcAddr));
+    std::memset(&destAddr, 0, sizeof(destAddr));
+    srcAddr.sin6_family = destAddr.sin6_family = AF_INET6;
+    srcAddr.sin6_addr.s6_addr32[3] = htonl(src);
+    destAddr.sin6_addr.s6_addr32[3] = htonl(dest);
+    return ConnectionID(srcAddr, destAddr, Protocol::TCP);
+}
+
+// Traffic of a flow to the interface and its hosts
+static void addFlow(Rollups &rollups, int64_t second, const ConnectionID &id, const RollupTraffic &traffic) {
+    rollups.addInterface(second, traffic);
+    rollups.addHosts(second, id, traffic);
+}
+
+TEST(RollupTest, RingKeepsTheNewestPeriods) {
+    RollupRing ring;
+    ring.resize(4);
+    for (int64_t period = 0; period < 6; period++) {
+        ring.add(period, {10, 1, 1});
+    }
+    EXPECT_EQ(ring.find(1), nullptr);
+    ASSERT_NE(ring.find(2), nullptr);
+    EXPECT_EQ(ring.find(5)->m_traffic.m_bytesSent, 10);
+
+    // Older than the ring, dropped
+    ring.add(1, {1000, 0, 1});
+    EXPECT_EQ(ring.find(1), nullptr);
+    RollupTraffic sum = ring.sum(0, 5);
+    EXPECT_EQ(sum.m_bytesSent, 40);
+    EXPECT_EQ(sum.bytes(), 44);
+    EXPECT_EQ(sum.m_packets, 4);
+}
+
+TEST(RollupTest, SecondsAreDownsampledIntoEverySpan) {
+    Rollup rollup;
+    rollup.resize(Rollups::INTERFACE_BUCKETS);
+    // Two hours of 1000 bytes a second
+    for (int64_t second = 0; second < 7200; second++) {
+        rollup.add(second, {600, 400, 2});
+    }
+    EXPECT_EQ(rollup.sum(LAST_MINUTE, 7199).bytes(), 60 * 1000);
+    EXPECT_EQ(rollup.sum(LAST_HOUR, 7199).bytes(), 3600 * 1000);
+    EXPECT_EQ(rollup.sum(LAST_DAY, 7199).bytes(), 7200 * 1000);
+    EXPECT_EQ(rollup.sum(LAST_WEEK, 7199).m_packets, 7200 * 2);
+    // A day later only the day-old hours are left in the week
+    EXPECT_EQ(rollup.sum(LAST_DAY, 7199 + 86400).bytes(), 0);
+    EXPECT_EQ(rollup.sum(LAST_WEEK, 7199 + 86400).bytes(), 7200 * 1000);
+}
+
+TEST(RollupTest, HostSlotsStayBounded) {
+    Rollups rollups;
+    rollups.setHostLimit(4);
+    addFlow(rollups, 100, hostFlow(1, 2), {1000000, 0, 1000});
+    addFlow(rollups, 100, hostFlow(1, 5), {100000, 0, 100});
+
+    // Many small hosts take over the free slot one after another, the busy hosts keep theirs
+    size_t memory = 0;
+    for (uint32_t host = 10; host < 2000; host += 2) {
+        addFlow(rollups, 101, hostFlow(host, host + 1), {10, 0, 1});
+        if (host == 10) {
+            memory = rollups.memoryUsage();
+        }
+    }
+    EXPECT_EQ(rollups.memoryUsage(), memory);
+
+    std::vector<RollupSummary> rows;
+    rollups.summary(101, 10, rows);
+    ASSERT_EQ(rows.size(), 5);
+    EXPECT_FALSE(rows[0].m_host);
+    EXPECT_EQ(rows[0].m_spans[LAST_MINUTE].bytes(), 1100000 + 995 * 10);
+    EXPECT_TRUE(rows[1].m_host);
+    EXPECT_EQ(Rollups::hostToString(rows[1].m_address), "::1");
+    EXPECT_EQ(rows[1].m_spans[LAST_HOUR].m_bytesSent, 1100000);
+    EXPECT_EQ(Rollups::hostToString(rows[2].m_address), "::2");
+    EXPECT_EQ(rows[2].m_spans[LAST_HOUR].m_bytesReceived, 1000000);
+    EXPECT_EQ(Rollups::hostToString(rows[3].m_address), "::5");
+    EXPECT_EQ(rows[4].m_spans[LAST_HOUR].bytes(), 10);
+}
+
+TEST(RollupTest, ClosedBucketsAreWrittenOnce) {
+    Rollups rollups;
+    std::vector<RollupRecord> records;
+    // The first call marks where the log starts
+    rollups.closedBuckets(3600, records);
+    EXPECT_TRUE(records.empty());
+
+    addFlow(rollups, 3600, hostFlow(1, 2), {100, 50, 2});
+    addFlow(rollups, 3725, hostFlow(1, 2), {10, 0, 1});
+    rollups.closedBuckets(3725, records);
+    // Minutes 60 and 61 closed, the empty one too
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].m_start, 3600);
+    EXPECT_EQ(records[0].m_resolution, ROLLUP_MINUTE);
+    EXPECT_EQ(records[0].m_traffic.m_bytesReceived, 50);
+    EXPECT_EQ(records[1].m_start, 3660);
+    EXPECT_EQ(records[1].m_traffic.bytes(), 0);
+    rollups.closedBuckets(3730, records);
+    EXPECT_TRUE(records.empty());
+
+    // The hour closes for the interface and both hosts
+    rollups.closedBuckets(7200, records);
+    ASSERT_EQ(records.size(), 60 - 2 + 3);
+    EXPECT_EQ(records[57].m_start, 7140);
+    EXPECT_EQ(records[58].m_resolution, ROLLUP_HOUR);
+    EXPECT_FALSE(records[58].m_host);
+    EXPECT_EQ(records[58].m_traffic.bytes(), 160);
+    EXPECT_TRUE(records[59].m_host);
+    EXPECT_EQ(records[59].m_traffic.m_bytesSent + records[60].m_traffic.m_bytesSent, 160);
+}
@@ -0,0 +1,80 @@
+#include "../../src/screen.hpp"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+
+// Window of a terminal that writes nowhere
+class ScreenTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_output = std::fopen("/dev/null", "w");
+        m_input = std::fopen("/dev/null", "r");
+        m_terminal = newterm("xterm", m_output, m_input);
+        ASSERT_NE(m_terminal, nullptr);
+        m_window = newwin(5, 20, 0, 0);
+    }
+    void TearDown() override {
+        delwin(m_window);
+        endwin();
+        delscreen(m_terminal);
+        std::fclose(m_output);
+        std::fclose(m_input);
+    }
+    // Text of a row of the window
+    std::string row(int y) {
+        char text[21] = {};
+        mvwinnstr(m_window, y, 0, text, 20);
+        std::string line(text);
+        return line.substr(0, line.find_last_not_of(' ') + 1);
+    }
+
+    FILE *m_output = nullptr;
+    FILE *m_input = nullptr;
+    SCREEN *m_terminal = nullptr;
+    WINDOW *m_window = nullptr;
+};
+
+TEST_F(ScreenTest, OnlyChangedCellsAreWritten) {
+    Screen screen;
+    screen.begin(m_window);
+    screen.line(0, "Flows: 10");
+    screen.line(1, "10.0.0.1  1.5K");
+    screen.end();
+    EXPECT_EQ(screen.cellsWritten(), 9 + 14);
+
+    // Same frame, nothing to write
+    screen.begin(m_window);
+    screen.line(0, "Flows: 10");
+    screen.line(1, "10.0.0.1  1.5K");
+    screen.end();
+    EXPECT_EQ(screen.cellsWritten(), 0);
+
+    // One digit changed, a shorter line blanks its old tail, the line longer than the window is cut
+    screen.begin(m_window);
+    screen.line(0, "Flows: 11");
+    screen.line(1, "10.0.0.1  9K");
+    screen.line(2, std::string(30, '-'));
+    screen.end();
+    EXPECT_EQ(screen.cellsWritten(), 1 + 4 + 20);
+    EXPECT_EQ(row(0), "Flows: 11");
+    EXPECT_EQ(row(1), "10.0.0.1  9K");
+    EXPECT_EQ(row(2), std::string(20, '-'));
+
+    // Lines the frame doesn't draw are erased
+    screen.begin(m_window);
+    screen.line(0, "Flows: 11");
+    screen.end();
+    EXPECT_EQ(row(1), "");
+    EXPECT_EQ(row(2), "");
+
+    // Everything again after invalidate
+    screen.invalidate();
+    screen.begin(m_window);
+    screen.line(0, "Flows: 11");
+    screen.end();
+    EXPECT_EQ(screen.cellsWritten(), 9);
+}
+
+TEST(ScreenFormatTest, FormatsLikePrintf) {
+    EXPECT_EQ(Screen::format("%-5s|%3d", "ab", 7), "ab   |  7");
+}
@@ -0,0 +1,64 @@
+#include "../../src/slabPool.hpp"
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+
+using Pool = SlabPool<uint64_t>;
+
+TEST(SlabPoolTest, RecordsKeepTheirAddress) {
+    Pool pool;
+    uint32_t first = pool.allocate();
+    pool[first] = 42;
+    uint64_t *address = &pool[first];
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 3 * Pool::SLAB_RECORDS; i++) {
+        ids.push_back(pool.allocate());
+        pool[ids.back()] = i;
+    }
+    EXPECT_EQ(&pool[first], address);
+    EXPECT_EQ(pool[first], 42);
+    EXPECT_EQ(pool.size(), 3 * Pool::SLAB_RECORDS + 1);
+    EXPECT_EQ(std::set<uint32_t>(ids.begin(), ids.end()).size(), ids.size());
+    EXPECT_EQ(pool.stats().m_liveSlabs, 4);
+}
+
+TEST(SlabPoolTest, EmptySlabIsReleased) {
+    Pool pool;
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 2 * Pool::SLAB_RECORDS; i++) {
+        ids.push_back(pool.allocate());
+    }
+    EXPECT_EQ(pool.stats().m_liveSlabs, 2);
+    EXPECT_DOUBLE_EQ(pool.stats().fragmentation(), 0.0);
+
+    // Drain the second slab and half of the first one
+    for (uint32_t i = Pool::SLAB_RECORDS / 2; i < ids.size(); i++) {
+        pool.release(ids[i]);
+    }
+    SlabStats stats = pool.stats();
+    EXPECT_EQ(stats.m_liveSlabs, 1);
+    EXPECT_EQ(stats.m_releasedSlabs, 1);
+    EXPECT_EQ(stats.m_records, Pool::SLAB_RECORDS / 2);
+    EXPECT_DOUBLE_EQ(stats.fragmentation(), 0.5);
+
+    // Free records of the first slab are reused before a new slab is allocated
+    for (uint32_t i = 0; i < Pool::SLAB_RECORDS / 2; i++) {
+        EXPECT_LT(pool.allocate(), Pool::SLAB_RECORDS);
+    }
+    EXPECT_EQ(pool.stats().m_liveSlabs, 1);
+    EXPECT_GE(pool.allocate(), Pool::SLAB_RECORDS);
+    EXPECT_EQ(pool.stats().m_liveSlabs, 2);
+}
+
+TEST(SlabPoolTest, LowestSlabIsFilledFirst) {
+    Pool pool;
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 3 * Pool::SLAB_RECORDS; i++) {
+        ids.push_back(pool.allocate());
+    }
+    // One free record in the last and in the first slab
+    pool.release(ids.back());
+    pool.release(ids.front());
+    EXPECT_EQ(pool.allocate(), ids.front());
+    EXPECT_EQ(pool.allocate(), ids.back());
+}
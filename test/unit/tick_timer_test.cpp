@@ -0,0 +1,35 @@
+#include "../../src/tickTimer.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+TEST(TickTimerTest, WaitsForTheNextTick) {
+    TickTimer timer;
+    std::string error;
+    ASSERT_TRUE(timer.start(std::chrono::milliseconds(20), error)) << error;
+    EXPECT_EQ(timer.interval(), std::chrono::milliseconds(20));
+    EXPECT_EQ(timer.expired(), 0u);
+
+    auto before = std::chrono::steady_clock::now();
+    EXPECT_GE(timer.wait(), 1u);
+    EXPECT_GE(std::chrono::steady_clock::now() - before, std::chrono::milliseconds(15));
+}
+
+// Ticks missed by a slow caller are counted, not queued: the next wait returns them all at once
+TEST(TickTimerTest, CountsMissedTicks) {
+    TickTimer timer;
+    std::string error;
+    ASSERT_TRUE(timer.start(std::chrono::milliseconds(10), error)) << error;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(55));
+    uint64_t ticks = timer.wait();
+    EXPECT_GE(ticks, 4u);
+    EXPECT_LE(ticks, 50u);
+    EXPECT_EQ(timer.expired(), 0u);
+}
+
+TEST(TickTimerTest, NotStarted) {
+    TickTimer timer;
+    EXPECT_EQ(timer.fd(), -1);
+    EXPECT_EQ(timer.wait(), 0u);
+}
@@ -0,0 +1,68 @@
+#include "../../src/timerWheel.hpp"
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+
+using Wheel = TimerWheel<int>;
+
+TEST(TimerWheelTest, EntriesFireAtTheirDeadline) {
+    Wheel wheel;
+    wheel.schedule(1, 105, 100);
+    wheel.schedule(2, 103, 100);
+    EXPECT_EQ(wheel.size(), 2);
+
+    std::vector<int> fired;
+    auto fire = [&](int entry, int64_t) {
+        fired.push_back(entry);
+        return Wheel::EXPIRE;
+    };
+    EXPECT_EQ(wheel.advance(102, fire), 0);
+    EXPECT_EQ(wheel.advance(104, fire), 1);
+    EXPECT_EQ(fired, std::vector<int>{2});
+    EXPECT_EQ(wheel.advance(200, fire), 1);
+    EXPECT_EQ(fired, (std::vector<int>{2, 1}));
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheelTest, LateDeadlinesAreRescheduled) {
+    Wheel wheel;
+    // Real deadlines move as the flows see traffic, and may be more than one lap away
+    std::map<int, int64_t> deadline{{1, 110}, {2, 110 + 3 * Wheel::SLOTS}};
+    wheel.schedule(1, 10, 0);
+    wheel.schedule(2, 10, 0);
+    auto fire = [&](int entry, int64_t time) {
+        return deadline[entry] > time ? deadline[entry] : Wheel::EXPIRE;
+    };
+    for (int64_t now = 1; now < 110; now++) {
+        EXPECT_EQ(wheel.advance(now, fire), 0);
+    }
+    EXPECT_EQ(wheel.advance(110, fire), 1);
+    EXPECT_EQ(wheel.size(), 1);
+    // A long pause visits every slot once
+    EXPECT_EQ(wheel.advance(100000, fire), 1);
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheelTest, EvictTakesNearestDeadline) {
+    Wheel wheel;
+    std::map<int, int64_t> deadline{{1, 50}, {2, 20}, {3, 30}};
+    for (auto &[entry, due] : deadline) {
+        wheel.schedule(entry, 5, 0);
+    }
+    std::vector<int> evicted;
+    auto fire = [&](int entry, int64_t time) {
+        if (deadline[entry] > time) {
+            return deadline[entry];
+        }
+        evicted.push_back(entry);
+        return Wheel::EXPIRE;
+    };
+    EXPECT_TRUE(wheel.evictOne(fire));
+    EXPECT_TRUE(wheel.evictOne(fire));
+    EXPECT_EQ(evicted, (std::vector<int>{2, 3}));
+
+    // Stale entries are skipped
+    auto stale = [](int, int64_t) { return Wheel::DROP; };
+    EXPECT_FALSE(wheel.evictOne(stale));
+    EXPECT_EQ(wheel.size(), 0);
+}